@@ -5,10 +5,25 @@ g++ -std=c++17 -Wall -Wextra -Wno-unused-parameter -O3 -march=native -flto -DNDE
     compiler/src/lexer/lexer.cpp ^
     compiler/src/parser/parser.cpp ^
     compiler/src/ast/ast_visitor.cpp ^
+    compiler/src/ast/symbol.cpp ^
     compiler/src/semantic/semantic_analyzer.cpp ^
+    compiler/src/optimizer/optimizer.cpp ^
+    compiler/src/optimizer/inliner.cpp ^
+    compiler/src/optimizer/units.cpp ^
+    compiler/src/optimizer/ctfe.cpp ^
+    compiler/src/optimizer/effects.cpp ^
+    compiler/src/optimizer/redundancy.cpp ^
     compiler/src/codegen/code_generator.cpp ^
     compiler/src/codegen/js_transpiler.cpp ^
     compiler/src/interpreter/interpreter.cpp ^
+    compiler/src/interpreter/resolver.cpp ^
+    compiler/src/interpreter/type_specializer.cpp ^
+    compiler/src/bytecode/bytecode_compiler.cpp ^
+    compiler/src/bytecode/bytecode_peephole.cpp ^
+    compiler/src/bytecode/bytecode_cache.cpp ^
+    compiler/src/bytecode/vm.cpp ^
+    compiler/src/bytecode/jit.cpp ^
+    compiler/src/bytecode/vm_profiler.cpp ^
     compiler/src/http/http_client.cpp ^
     compiler/src/http/http_server.cpp ^
     compiler/src/main.cpp ^
@@ -25,6 +40,7 @@ g++ -std=c++17 -Wall -Wextra -Wno-unused-parameter -O3 -march=native -flto -DNDE
     compiler/src/lexer/lexer.cpp ^
     compiler/src/parser/parser.cpp ^
     compiler/src/ast/ast_visitor.cpp ^
+    compiler/src/ast/symbol.cpp ^
     compiler/src/semantic/semantic_analyzer.cpp ^
     lsp-server/src/main.cpp ^
     -o synthflow-lsp.exe
@@ -34,6 +50,7 @@ g++ -std=c++17 -Wall -Wextra -Wno-unused-parameter -O3 -march=native -flto -DNDE
     compiler/src/lexer/lexer.cpp ^
     compiler/src/parser/parser.cpp ^
     compiler/src/ast/ast_visitor.cpp ^
+    compiler/src/ast/symbol.cpp ^
     compiler/src/semantic/semantic_analyzer.cpp ^
     mcp-server/src/main.cpp ^
     -o synthflow-mcp.exe
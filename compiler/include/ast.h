@@ -6,6 +6,7 @@
 #include <memory>
 #include <cstdint>
 #include <utility>  // For std::move
+#include "symbol.h"
 
 // Forward declarations for all AST node classes
 class ASTVisitor;
@@ -99,9 +100,88 @@ public:
     virtual void visit(StructDeclaration* node) = 0;  // struct Agent { ... }
 };
 
+// Node-kind tag stored on every AST node, so passes and backends can dispatch
+// with a switch instead of a dynamic_cast chain
+enum class NodeKind : uint8_t {
+    // Expressions
+    IntegerLiteral,
+    StringLiteral,
+    BooleanLiteral,
+    NullLiteral,
+    FloatLiteral,
+    Identifier,
+    BinaryExpression,
+    UnaryExpression,
+    AssignmentExpression,
+    CallExpression,
+    ArrayLiteral,
+    ArrayIndexExpression,
+    ArrayAssignmentExpression,
+    LambdaExpression,
+    MatchExpression,
+    CompoundAssignment,
+    UpdateExpression,
+    InterpolatedString,
+    MapLiteral,
+    MemberExpression,
+    MethodCallExpression,
+    SelfExpression,
+    
+    // Statements
+    VariableDeclaration,
+    ExpressionStatement,
+    BlockStatement,
+    IfStatement,
+    WhileStatement,
+    ForStatement,
+    BreakStatement,
+    ContinueStatement,
+    FunctionDeclaration,
+    ReturnStatement,
+    TryStatement,
+    ImportStatement,
+    StructDeclaration
+};
+
+// Pre-decoded operators; the spelling stays in `op` for printing and codegen
+enum class BinaryOp : uint8_t {
+    Add, Sub, Mul, Div, Mod,
+    Eq, Ne, Lt, Gt, Le, Ge,
+    And, Or,
+    Unknown
+};
+
+enum class UnaryOp : uint8_t { Neg, Not, Unknown };
+
+inline BinaryOp binaryOpFromString(const std::string& op) {
+    if (op == "+" || op == "+=") return BinaryOp::Add;
+    if (op == "-" || op == "-=") return BinaryOp::Sub;
+    if (op == "*" || op == "*=") return BinaryOp::Mul;
+    if (op == "/" || op == "/=") return BinaryOp::Div;
+    if (op == "%") return BinaryOp::Mod;
+    if (op == "==") return BinaryOp::Eq;
+    if (op == "!=") return BinaryOp::Ne;
+    if (op == "<") return BinaryOp::Lt;
+    if (op == ">") return BinaryOp::Gt;
+    if (op == "<=") return BinaryOp::Le;
+    if (op == ">=") return BinaryOp::Ge;
+    if (op == "&&" || op == "and") return BinaryOp::And;
+    if (op == "||" || op == "or") return BinaryOp::Or;
+    return BinaryOp::Unknown;
+}
+
+inline UnaryOp unaryOpFromString(const std::string& op) {
+    if (op == "-") return UnaryOp::Neg;
+    if (op == "!" || op == "not") return UnaryOp::Not;
+    return UnaryOp::Unknown;
+}
+
 // Base class for all AST nodes
 class ASTNode {
 public:
+    const NodeKind kind;
+    
+    explicit ASTNode(NodeKind k) : kind(k) {}
     virtual ~ASTNode() = default;
     virtual void accept(ASTVisitor& visitor) = 0;
 };
@@ -109,12 +189,16 @@ public:
 // Base class for expressions
 class Expression : public ASTNode {
 public:
+    explicit Expression(NodeKind k) : ASTNode(k) {}
     virtual ~Expression() = default;
 };
 
 // Base class for statements
 class Statement : public ASTNode {
 public:
+    uint32_t line = 0;  // Source line of the first token, 0 if not parsed from source
+
+    explicit Statement(NodeKind k) : ASTNode(k) {}
     virtual ~Statement() = default;
 };
 
@@ -123,8 +207,8 @@ class IntegerLiteral : public Expression {
 public:
     int64_t value;
     
-    IntegerLiteral() : value(0) {}
-    explicit IntegerLiteral(int64_t val) : value(val) {}
+    IntegerLiteral() : Expression(NodeKind::IntegerLiteral), value(0) {}
+    explicit IntegerLiteral(int64_t val) : Expression(NodeKind::IntegerLiteral), value(val) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -134,8 +218,8 @@ class StringLiteral : public Expression {
 public:
     std::string value;
     
-    StringLiteral() : value("") {}
-    explicit StringLiteral(const std::string& val) : value(val) {}
+    StringLiteral() : Expression(NodeKind::StringLiteral), value("") {}
+    explicit StringLiteral(const std::string& val) : Expression(NodeKind::StringLiteral), value(val) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -145,8 +229,8 @@ class BooleanLiteral : public Expression {
 public:
     bool value;
     
-    BooleanLiteral() : value(false) {}
-    explicit BooleanLiteral(bool val) : value(val) {}
+    BooleanLiteral() : Expression(NodeKind::BooleanLiteral), value(false) {}
+    explicit BooleanLiteral(bool val) : Expression(NodeKind::BooleanLiteral), value(val) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -154,7 +238,7 @@ public:
 // Null literal node (for null safety)
 class NullLiteral : public Expression {
 public:
-    NullLiteral() = default;
+    NullLiteral() : Expression(NodeKind::NullLiteral) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -164,8 +248,8 @@ class FloatLiteral : public Expression {
 public:
     double value;
     
-    FloatLiteral() : value(0.0) {}
-    explicit FloatLiteral(double val) : value(val) {}
+    FloatLiteral() : Expression(NodeKind::FloatLiteral), value(0.0) {}
+    explicit FloatLiteral(double val) : Expression(NodeKind::FloatLiteral), value(val) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -174,9 +258,12 @@ public:
 class Identifier : public Expression {
 public:
     std::string name;
+    Symbol symbol;   // Interned name (global lookups)
+    int depth = -1;  // Resolved frame distance (-1 = global, looked up by name)
+    int slot = -1;   // Resolved slot within that frame
     
-    Identifier() : name("") {}
-    explicit Identifier(const std::string& n) : name(n) {}
+    Identifier() : Expression(NodeKind::Identifier), name("") {}
+    explicit Identifier(const std::string& n) : Expression(NodeKind::Identifier), name(n), symbol(n) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -184,12 +271,19 @@ public:
 // Binary expression node
 class BinaryExpression : public Expression {
 public:
+    // Operand types inferred ahead of the run (TypeSpecializer) or seen on
+    // first evaluation; picks the interpreter's fast path and the VM's opcode
+    enum class OperandTypes : uint8_t { Unknown, IntInt, FloatFloat, Generic };
+    
     std::unique_ptr<Expression> left;
     std::string op;
+    BinaryOp binaryOp;
     std::unique_ptr<Expression> right;
+    OperandTypes operandTypes = OperandTypes::Unknown;
     
     BinaryExpression(std::unique_ptr<Expression> l, const std::string& o, std::unique_ptr<Expression> r)
-        : left(std::move(l)), op(o), right(std::move(r)) {}
+        : Expression(NodeKind::BinaryExpression), left(std::move(l)), op(o),
+          binaryOp(binaryOpFromString(o)), right(std::move(r)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -198,10 +292,11 @@ public:
 class UnaryExpression : public Expression {
 public:
     std::string op;
+    UnaryOp unaryOp;
     std::unique_ptr<Expression> operand;
     
     UnaryExpression(const std::string& o, std::unique_ptr<Expression> expr)
-        : op(o), operand(std::move(expr)) {}
+        : Expression(NodeKind::UnaryExpression), op(o), unaryOp(unaryOpFromString(o)), operand(std::move(expr)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -210,17 +305,19 @@ public:
 class VariableDeclaration : public Statement {
 public:
     std::string name;
+    Symbol symbol;                  // Interned name (global bindings)
     std::unique_ptr<Expression> initializer;
     bool isConst = false;           // const keyword (immutable)
     std::string typeName = "";      // Optional type annotation (int, float, string, bool, array)
     bool isNullable = false;        // Whether type is nullable (?)
+    int slot = -1;                  // Resolved slot in the declaring frame (-1 = global)
     
     VariableDeclaration(const std::string& n, std::unique_ptr<Expression> init)
-        : name(n), initializer(std::move(init)) {}
+        : Statement(NodeKind::VariableDeclaration), name(n), symbol(n), initializer(std::move(init)) {}
     
     VariableDeclaration(const std::string& n, std::unique_ptr<Expression> init, 
                         bool constant, const std::string& type = "", bool nullable = false)
-        : name(n), initializer(std::move(init)), isConst(constant), 
+        : Statement(NodeKind::VariableDeclaration), name(n), symbol(n), initializer(std::move(init)), isConst(constant), 
           typeName(type), isNullable(nullable) {}
     
     void accept(ASTVisitor& visitor) override;
@@ -231,9 +328,11 @@ class AssignmentExpression : public Expression {
 public:
     std::unique_ptr<Expression> left;
     std::unique_ptr<Expression> right;
+    int depth = -1;  // Resolved target frame distance (-1 = global)
+    int slot = -1;   // Resolved target slot
     
     AssignmentExpression(std::unique_ptr<Expression> l, std::unique_ptr<Expression> r)
-        : left(std::move(l)), right(std::move(r)) {}
+        : Expression(NodeKind::AssignmentExpression), left(std::move(l)), right(std::move(r)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -244,7 +343,7 @@ public:
     std::unique_ptr<Expression> expression;
     
     explicit ExpressionStatement(std::unique_ptr<Expression> expr)
-        : expression(std::move(expr)) {}
+        : Statement(NodeKind::ExpressionStatement), expression(std::move(expr)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -253,8 +352,10 @@ public:
 class BlockStatement : public Statement {
 public:
     std::vector<std::unique_ptr<Statement>> statements;
+    int frameSize = 0;  // Slots declared directly in this block (0 = no frame needed)
+    bool frameCaptured = false;  // A nested function closes over this frame
     
-    BlockStatement() = default;
+    BlockStatement() : Statement(NodeKind::BlockStatement) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -269,7 +370,7 @@ public:
     IfStatement(std::unique_ptr<Expression> cond,
                 std::unique_ptr<BlockStatement> thenB,
                 std::unique_ptr<BlockStatement> elseB = nullptr)
-        : condition(std::move(cond)), thenBranch(std::move(thenB)), elseBranch(std::move(elseB)) {}
+        : Statement(NodeKind::IfStatement), condition(std::move(cond)), thenBranch(std::move(thenB)), elseBranch(std::move(elseB)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -281,7 +382,7 @@ public:
     std::unique_ptr<BlockStatement> body;
     
     WhileStatement(std::unique_ptr<Expression> cond, std::unique_ptr<BlockStatement> b)
-        : condition(std::move(cond)), body(std::move(b)) {}
+        : Statement(NodeKind::WhileStatement), condition(std::move(cond)), body(std::move(b)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -293,12 +394,14 @@ public:
     std::unique_ptr<Expression> condition;
     std::unique_ptr<Expression> increment;
     std::unique_ptr<BlockStatement> body;
+    int frameSize = 0;  // Slots declared by the initializer (0 = no frame needed)
+    bool frameCaptured = false;  // A nested function closes over this frame
     
     ForStatement(std::unique_ptr<Statement> init,
                  std::unique_ptr<Expression> cond,
                  std::unique_ptr<Expression> incr,
                  std::unique_ptr<BlockStatement> b)
-        : initializer(std::move(init)), condition(std::move(cond)),
+        : Statement(NodeKind::ForStatement), initializer(std::move(init)), condition(std::move(cond)),
           increment(std::move(incr)), body(std::move(b)) {}
     
     void accept(ASTVisitor& visitor) override;
@@ -307,7 +410,7 @@ public:
 // Break statement
 class BreakStatement : public Statement {
 public:
-    BreakStatement() = default;
+    BreakStatement() : Statement(NodeKind::BreakStatement) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -315,7 +418,7 @@ public:
 // Continue statement
 class ContinueStatement : public Statement {
 public:
-    ContinueStatement() = default;
+    ContinueStatement() : Statement(NodeKind::ContinueStatement) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -325,12 +428,16 @@ class FunctionDeclaration : public Statement {
 public:
     std::string name;
     std::vector<std::string> parameters;
+    std::vector<std::string> parameterTypes;  // Annotation per parameter ("" = none, "int?" = nullable)
+    std::string returnType;                   // Annotated result type ("" = none)
     std::unique_ptr<BlockStatement> body;
+    int frameSize = 0;  // Parameters plus locals declared directly in the body
+    bool frameCaptured = false;  // A nested function closes over this frame
     
     FunctionDeclaration(const std::string& n,
                         const std::vector<std::string>& params,
                         std::unique_ptr<BlockStatement> b)
-        : name(n), parameters(params), body(std::move(b)) {}
+        : Statement(NodeKind::FunctionDeclaration), name(n), parameters(params), body(std::move(b)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -341,20 +448,32 @@ public:
     std::unique_ptr<Expression> value;
     
     explicit ReturnStatement(std::unique_ptr<Expression> val = nullptr)
-        : value(std::move(val)) {}
+        : Statement(NodeKind::ReturnStatement), value(std::move(val)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
 
 // Function call expression
+struct UserFunction;  // Defined by the interpreter
+
+// Call-site cache: the target a CallExpression resolved to, valid while the
+// interpreter's function binding epoch is unchanged
+struct CallSiteCache {
+    uint64_t epoch = 0;                      // Epoch the target was resolved in (0 = empty)
+    const UserFunction* function = nullptr;  // Resolved user function, or
+    const void* native = nullptr;            // the builtin's Value::FunctionType
+};
+
 class CallExpression : public Expression {
 public:
     std::string callee;
+    Symbol calleeSymbol;  // Interned callee name
     std::vector<std::unique_ptr<Expression>> arguments;
+    CallSiteCache cache;  // Filled in by the interpreter
     
     CallExpression(const std::string& c,
                    std::vector<std::unique_ptr<Expression>> args)
-        : callee(c), arguments(std::move(args)) {}
+        : Expression(NodeKind::CallExpression), callee(c), calleeSymbol(c), arguments(std::move(args)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -364,7 +483,7 @@ class ArrayLiteral : public Expression {
 public:
     std::vector<std::unique_ptr<Expression>> elements;
     
-    ArrayLiteral() = default;
+    ArrayLiteral() : Expression(NodeKind::ArrayLiteral) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -374,10 +493,11 @@ class ArrayIndexExpression : public Expression {
 public:
     std::unique_ptr<Expression> array;
     std::unique_ptr<Expression> index;
+    bool arrayIntIndex = false;  // Inferred array and int index: the VM emits INDEX_ARRAY_INT
     
     ArrayIndexExpression(std::unique_ptr<Expression> arr,
                          std::unique_ptr<Expression> idx)
-        : array(std::move(arr)), index(std::move(idx)) {}
+        : Expression(NodeKind::ArrayIndexExpression), array(std::move(arr)), index(std::move(idx)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -392,7 +512,7 @@ public:
     ArrayAssignmentExpression(std::unique_ptr<Expression> arr,
                               std::unique_ptr<Expression> idx,
                               std::unique_ptr<Expression> val)
-        : array(std::move(arr)), index(std::move(idx)), value(std::move(val)) {}
+        : Expression(NodeKind::ArrayAssignmentExpression), array(std::move(arr)), index(std::move(idx)), value(std::move(val)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -407,7 +527,7 @@ public:
     TryStatement(std::unique_ptr<BlockStatement> tryB,
                  const std::string& errVar,
                  std::unique_ptr<BlockStatement> catchB)
-        : tryBlock(std::move(tryB)), errorVariable(errVar), catchBlock(std::move(catchB)) {}
+        : Statement(NodeKind::TryStatement), tryBlock(std::move(tryB)), errorVariable(errVar), catchBlock(std::move(catchB)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -418,12 +538,14 @@ public:
     std::vector<std::string> parameters;
     std::unique_ptr<Expression> body;  // Single expression body
     std::unique_ptr<BlockStatement> blockBody;  // Optional block body
+    int frameSize = 0;  // Parameters plus locals declared directly in the body
+    bool frameCaptured = false;  // A nested function closes over this frame
     
     LambdaExpression(std::vector<std::string> params, std::unique_ptr<Expression> expr)
-        : parameters(std::move(params)), body(std::move(expr)), blockBody(nullptr) {}
+        : Expression(NodeKind::LambdaExpression), parameters(std::move(params)), body(std::move(expr)), blockBody(nullptr) {}
     
     LambdaExpression(std::vector<std::string> params, std::unique_ptr<BlockStatement> block)
-        : parameters(std::move(params)), body(nullptr), blockBody(std::move(block)) {}
+        : Expression(NodeKind::LambdaExpression), parameters(std::move(params)), body(nullptr), blockBody(std::move(block)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -441,7 +563,7 @@ public:
     std::vector<MatchCase> cases;
     
     MatchExpression(std::unique_ptr<Expression> subj, std::vector<MatchCase> c)
-        : subject(std::move(subj)), cases(std::move(c)) {}
+        : Expression(NodeKind::MatchExpression), subject(std::move(subj)), cases(std::move(c)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -451,10 +573,14 @@ class CompoundAssignment : public Expression {
 public:
     std::unique_ptr<Expression> target;
     std::string op;  // "+=", "-=", "*=", "/="
+    BinaryOp binaryOp;  // The arithmetic part of op
     std::unique_ptr<Expression> value;
+    int depth = -1;  // Resolved target frame distance (-1 = global)
+    int slot = -1;   // Resolved target slot
     
     CompoundAssignment(std::unique_ptr<Expression> tgt, const std::string& o, std::unique_ptr<Expression> val)
-        : target(std::move(tgt)), op(o), value(std::move(val)) {}
+        : Expression(NodeKind::CompoundAssignment), target(std::move(tgt)), op(o),
+          binaryOp(binaryOpFromString(o)), value(std::move(val)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -464,10 +590,14 @@ class UpdateExpression : public Expression {
 public:
     std::unique_ptr<Expression> operand;
     std::string op;  // "++" or "--"
+    bool increment;  // true for "++"
     bool prefix;     // true for ++x, false for x++
+    int depth = -1;  // Resolved target frame distance (-1 = global)
+    int slot = -1;   // Resolved target slot
     
     UpdateExpression(std::unique_ptr<Expression> expr, const std::string& o, bool pre)
-        : operand(std::move(expr)), op(o), prefix(pre) {}
+        : Expression(NodeKind::UpdateExpression), operand(std::move(expr)), op(o),
+          increment(o == "++"), prefix(pre) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -487,7 +617,7 @@ class InterpolatedString : public Expression {
 public:
     std::vector<StringPart> parts;
     
-    explicit InterpolatedString(std::vector<StringPart> p) : parts(std::move(p)) {}
+    explicit InterpolatedString(std::vector<StringPart> p) : Expression(NodeKind::InterpolatedString), parts(std::move(p)) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -501,25 +631,54 @@ class MapLiteral : public Expression {
 public:
     // Each entry is a key-value pair
     std::vector<std::pair<std::unique_ptr<Expression>, std::unique_ptr<Expression>>> entries;
+    std::vector<Symbol> keySymbols;  // Interned key per entry (empty symbol = computed key)
     
-    MapLiteral() = default;
+    MapLiteral() : Expression(NodeKind::MapLiteral) {}
     
     void addEntry(std::unique_ptr<Expression> key, std::unique_ptr<Expression> value) {
+        if (auto* str = dynamic_cast<StringLiteral*>(key.get())) {
+            keySymbols.emplace_back(str->value);
+        } else {
+            keySymbols.emplace_back();
+        }
         entries.emplace_back(std::move(key), std::move(value));
     }
     
     void accept(ASTVisitor& visitor) override;
 };
 
+// Polymorphic inline cache for a member access or method call site.
+// The AST only provides the storage: the interpreter fills the entries with
+// the receiver's value type and what it resolved to for that type, and checks
+// them before falling back to a full lookup.
+struct NativeMethod;  // Defined by the interpreter
+class Shape;         // Defined by the interpreter
+struct InlineCache {
+    static constexpr size_t kMaxEntries = 4;
+    
+    struct Entry {
+        uint8_t receiver = 0;                  // Value::Type of the receiver
+        uint32_t position = 0;                 // Map entry position or struct slot (member access)
+        const Shape* shape = nullptr;          // Struct receiver's shape (member access)
+        const NativeMethod* method = nullptr;  // Resolved handler (method calls)
+    };
+    
+    Entry entries[kMaxEntries];
+    uint8_t size = 0;
+    bool megamorphic = false;  // Saw more receivers than fit; always take the slow path
+};
+
 // Member access expression: obj.field, obj.method()
 class MemberExpression : public Expression {
 public:
     std::unique_ptr<Expression> object;  // The object being accessed
     std::string member;                   // The field or method name
+    Symbol memberSymbol;                  // Interned member name
     bool isComputed;                      // true for obj["field"], false for obj.field
+    InlineCache cache;                    // Filled in by the interpreter
 
     MemberExpression(std::unique_ptr<Expression> obj, const std::string& mem, bool computed = false)
-        : object(std::move(obj)), member(mem), isComputed(computed) {}
+        : Expression(NodeKind::MemberExpression), object(std::move(obj)), member(mem), memberSymbol(mem), isComputed(computed) {}
 
     void accept(ASTVisitor& visitor) override;
 };
@@ -529,11 +688,13 @@ class MethodCallExpression : public Expression {
 public:
     std::unique_ptr<Expression> object;   // The object being called on
     std::string method;                    // The method name
+    Symbol methodSymbol;                   // Interned method name
     std::vector<std::unique_ptr<Expression>> arguments;  // Method arguments
+    InlineCache cache;                     // Filled in by the interpreter
 
     MethodCallExpression(std::unique_ptr<Expression> obj, const std::string& meth,
                          std::vector<std::unique_ptr<Expression>> args)
-        : object(std::move(obj)), method(meth), arguments(std::move(args)) {}
+        : Expression(NodeKind::MethodCallExpression), object(std::move(obj)), method(meth), methodSymbol(meth), arguments(std::move(args)) {}
 
     void accept(ASTVisitor& visitor) override;
 };
@@ -541,7 +702,7 @@ public:
 // Self expression: self keyword in struct methods
 class SelfExpression : public Expression {
 public:
-    SelfExpression() = default;
+    SelfExpression() : Expression(NodeKind::SelfExpression) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -554,15 +715,16 @@ public:
     std::string alias;                   // e.g., "net" (optional, for 'as' clause)
     std::vector<std::string> imports;    // Specific symbols to import (for named imports)
     bool isDefault;                      // Is this a default import (import whole module)
+    int slot = -1;                       // Resolved slot for the alias (-1 = global)
     
     ImportStatement(const std::string& name) 
-        : moduleName(name), isDefault(true) {}
+        : Statement(NodeKind::ImportStatement), moduleName(name), isDefault(true) {}
     
     ImportStatement(const std::string& name, const std::string& path)
-        : moduleName(name), modulePath(path), isDefault(true) {}
+        : Statement(NodeKind::ImportStatement), moduleName(name), modulePath(path), isDefault(true) {}
     
     ImportStatement(const std::string& name, const std::string& path, const std::string& as)
-        : moduleName(name), modulePath(path), alias(as), isDefault(true) {}
+        : Statement(NodeKind::ImportStatement), moduleName(name), modulePath(path), alias(as), isDefault(true) {}
     
     void accept(ASTVisitor& visitor) override;
 };
@@ -570,12 +732,13 @@ public:
 // Struct field in declaration
 struct StructField {
     std::string name;
+    Symbol symbol;  // Interned field name
     std::string typeName;
     bool isPublic;
     std::unique_ptr<Expression> defaultValue;  // Optional default
     
     StructField(const std::string& n, const std::string& t, bool pub = true)
-        : name(n), typeName(t), isPublic(pub), defaultValue(nullptr) {}
+        : name(n), symbol(n), typeName(t), isPublic(pub), defaultValue(nullptr) {}
 };
 
 // Struct declaration: struct Agent { name: string, fn process(self) -> string { ... } }
@@ -586,7 +749,7 @@ public:
     std::vector<std::unique_ptr<FunctionDeclaration>> methods;  // Methods
     std::string parentStruct;                              // For 'extends' (optional)
     
-    StructDeclaration(const std::string& n) : name(n) {}
+    StructDeclaration(const std::string& n) : Statement(NodeKind::StructDeclaration), name(n) {}
     
     void addField(const std::string& fieldName, const std::string& typeName, bool isPublic = true) {
         fields.emplace_back(fieldName, typeName, isPublic);
@@ -1,78 +1,189 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <variant>
 #include <memory>
 
 // Bytecode instruction set for SynthFlow VM
+//
+// A register machine. Each call gets a flat frame of registers: first the
+// locals, where the compiler gives every block, loop and catch scope of a
+// function its own range, then the temporaries expressions are evaluated in.
+// A resolved local is therefore a register operand, and `a = b + c` on locals
+// is the single instruction ADD a, b, c. Names the Resolver left unbound
+// (globals, module scope) are looked up in the chunk's environment.
+//
+// Operand notation: R(x) is register x, K(x) is constants[x], and RK(x) is
+// K(x & ~kConstantOperand) if the kConstantOperand bit is set, R(x) otherwise.
+// Bx is the 32-bit operand formed by b (low half) and c (high half).
 enum class OpCode : uint8_t {
-    // Stack operations
-    PUSH_INT,       // Push integer constant
-    PUSH_FLOAT,     // Push float constant
-    PUSH_STRING,    // Push string constant
-    PUSH_BOOL,      // Push boolean constant
-    PUSH_NULL,      // Push null value
-    POP,            // Pop top of stack
-    DUP,            // Duplicate top of stack
-    
+    // Loads and moves
+    LOAD_CONST,     // R(a) = K(Bx)
+    LOAD_BOOL,      // R(a) = b != 0
+    LOAD_NULL,      // R(a) = null
+    MOVE,           // R(a) = R(b)
+    CLEAR_LOCALS,   // Reset R(a) .. R(a + b - 1) to null
+
     // Variable operations
-    LOAD_VAR,       // Load variable by index
-    STORE_VAR,      // Store variable by index
-    LOAD_GLOBAL,    // Load global variable
-    STORE_GLOBAL,   // Store global variable
-    
-    // Arithmetic operations
+    LOAD_UPVALUE,   // R(a) = slot b of the frame c functions out
+    STORE_UPVALUE,  // Slot b of the frame c functions out = R(a)
+    LOAD_GLOBAL,    // R(a) = the binding of names[Bx]
+    STORE_GLOBAL,   // Assign R(a) to the existing binding of names[Bx]
+    DEFINE_GLOBAL,  // Bind names[Bx] to R(a) in the chunk's environment
+    LOAD_SELF,      // R(a) = self
+
+    // Arithmetic operations: R(a) = RK(b) op RK(c)
     ADD,
     SUB,
     MUL,
     DIV,
     MOD,
-    NEG,            // Unary negation
-    
-    // Comparison operations
+    NEG,            // R(a) = -RK(b)
+    INC,            // R(a) = R(a) + 1
+    DEC,            // R(a) = R(a) - 1
+
+    // Compound assignment: R(a) = RK(b) op= RK(c), with integer division
+    COMPOUND_ADD,
+    COMPOUND_SUB,
+    COMPOUND_MUL,
+    COMPOUND_DIV,
+
+    // Comparison operations: R(a) = RK(b) op RK(c)
     EQ,
     NE,
     LT,
     GT,
     LE,
     GE,
-    
-    // Logical operations
-    AND,
-    OR,
-    NOT,
-    
+    MATCH,          // R(a) = whether subject RK(b) matches pattern RK(c)
+
+    // Conditional tests: skip the next instruction (the jump taken when the
+    // condition is false) if RK(b) op RK(c)
+    TEST_EQ,
+    TEST_NE,
+    TEST_LT,
+    TEST_GT,
+    TEST_LE,
+    TEST_GE,
+
+    // Logical operations (both operands were evaluated)
+    AND,            // R(a) = RK(b) && RK(c)
+    OR,             // R(a) = RK(b) || RK(c)
+    NOT,            // R(a) = !RK(b)
+
     // Control flow
-    JUMP,           // Unconditional jump
-    JUMP_IF_FALSE,  // Jump if top of stack is false
-    JUMP_IF_TRUE,   // Jump if top of stack is true
-    
+    JUMP,           // Jump to Bx
+    JUMP_IF_FALSE,  // Jump to Bx if R(a) is falsy
+    JUMP_IF_TRUE,   // Jump to Bx if R(a) is truthy
+
     // Function operations
-    CALL,           // Call function
-    RETURN,         // Return from function
-    
-    // Array operations
-    MAKE_ARRAY,     // Create array from N stack elements
-    INDEX,          // Array index access
-    INDEX_SET,      // Array index assignment
-    
-    // Built-in operations
-    PRINT,          // Print to stdout
-    
-    // Special
-    HALT            // Stop execution
+    CALL,           // R(a) = names[b](R(a) .. R(a + c - 1))
+    RETURN,         // Return RK(a) from the current function
+    DECLARE_FUNCTION, // Bind functions[Bx], closing over the current frame
+
+    // Array and map operations
+    MAKE_ARRAY,     // R(a) = [R(b) .. R(b + c - 1)]
+    MAKE_MAP,       // R(a) = map from mapLayouts[c], entries from R(b) on
+    INDEX,          // R(a) = R(b)[RK(c)]
+    INDEX_SET,      // R(a)[RK(b)] = RK(c)
+    GET_MEMBER,     // R(a) = R(b).name with memberSites[c]
+    CALL_METHOD,    // R(a) = R(a).name(R(a + 1) .. R(a + c)) with memberSites[b]
+
+    // Strings
+    BUILD_STRING,   // R(a) = concatenated interpolation parts R(b) .. R(b + c - 1)
+
+    // Exceptions
+    RAISE,          // Throw K(Bx) as a runtime error
+
+    // Declarations
+    DEFINE_STRUCT,  // Bind the constructor for structs[Bx]
+    IMPORT,         // R(a) = export map of imports[Bx], run now
+
+    // Superinstructions, formed by the peephole pass from the pairs that
+    // dominate measured opcode-pair counts (see bytecode_peephole.h)
+    BRANCH_EQ,      // Jump to a if RK(b) == RK(c)
+    BRANCH_NE,
+    BRANCH_LT,
+    BRANCH_GT,
+    BRANCH_LE,
+    BRANCH_GE,
+    INC_BRANCH_LT,  // R(a) = R(a) + 1, then jump to c if R(a) < RK(b)
+
+    // Quickened forms: rewritten in place by the VM, or emitted by the
+    // compiler for operand types the TypeSpecializer inferred
+    ADD_INT,
+    SUB_INT,
+    MUL_INT,
+    MOD_INT,
+    ADD_FLOAT,
+    SUB_FLOAT,
+    MUL_FLOAT,
+    DIV_FLOAT,
+    ADD_STR,
+    EQ_INT,
+    NE_INT,
+    LT_INT,
+    GT_INT,
+    LE_INT,
+    GE_INT,
+    TEST_EQ_INT,
+    TEST_NE_INT,
+    TEST_LT_INT,
+    TEST_GT_INT,
+    TEST_LE_INT,
+    TEST_GE_INT,
+    BRANCH_EQ_INT,
+    BRANCH_NE_INT,
+    BRANCH_LT_INT,
+    BRANCH_GT_INT,
+    BRANCH_LE_INT,
+    BRANCH_GE_INT,
+    INDEX_ARRAY_INT, // INDEX with an array and an int index
+    GET_FIELD        // GET_MEMBER on a struct of the shape the member site cached: a slot load
 };
 
+// The last opcode the compiler emits; GET_FIELD needs the member cache the
+// VM fills as it runs
+constexpr OpCode kLastCompiledOpCode = OpCode::INDEX_ARRAY_INT;
+
+// Every opcode, quickened forms included
+constexpr size_t kOpCodeCount = static_cast<size_t>(OpCode::GET_FIELD) + 1;
+
+// Mnemonic of `op`, e.g. "LOAD_CONST" (defined in vm.cpp, from the VM's opcode list)
+const char* opcodeName(OpCode op);
+
+// Operand flag selecting a constant instead of a register (RK operands)
+constexpr uint16_t kConstantOperand = 0x8000;
+
+// Registers and RK constants are addressed with the low 15 bits
+constexpr uint32_t kMaxOperand = 0x7FFF;
+
 // Single bytecode instruction
 struct Instruction {
     OpCode opcode;
-    uint32_t operand = 0;  // Optional operand (index, jump offset, etc.)
-    
-    Instruction(OpCode op) : opcode(op), operand(0) {}
-    Instruction(OpCode op, uint32_t arg) : opcode(op), operand(arg) {}
+    uint8_t deopts = 0;    // Times a quickened form of this instruction failed its guard
+    uint16_t a = 0;
+    uint16_t b = 0;
+    uint16_t c = 0;
+
+    Instruction(OpCode op, uint16_t first = 0, uint16_t second = 0, uint16_t third = 0)
+        : opcode(op), a(first), b(second), c(third) {}
+
+    uint32_t bx() const { return b | (static_cast<uint32_t>(c) << 16); }
+    void setBx(uint32_t value) {
+        b = static_cast<uint16_t>(value);
+        c = static_cast<uint16_t>(value >> 16);
+    }
 };
 
+static_assert(sizeof(Instruction) == 8, "Instructions are packed into 8 bytes");
+
 // Constant pool value types
 using ConstantValue = std::variant<
     int64_t,        // Integer
@@ -81,40 +192,111 @@ using ConstantValue = std::variant<
     bool            // Boolean
 >;
 
+// Identity of a constant for pool deduplication: floats compare by their
+// bits, so 0.0 and -0.0 keep separate entries
+struct ConstantIdentity {
+    static uint64_t floatBits(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+    size_t operator()(const ConstantValue& value) const {
+        if (auto* f = std::get_if<double>(&value)) {
+            return std::hash<uint64_t>()(floatBits(*f)) ^ value.index();
+        }
+        return std::hash<ConstantValue>()(value);
+    }
+    bool operator()(const ConstantValue& a, const ConstantValue& b) const {
+        if (a.index() != b.index()) return false;
+        if (auto* f = std::get_if<double>(&a)) return floatBits(*f) == floatBits(std::get<double>(b));
+        return a == b;
+    }
+};
+
 // Compiled function
+struct NativeCode;
+
+// Instructions from `pc` up to the next run's pc were compiled from `line`
+struct LineRun {
+    uint32_t pc;
+    uint32_t line;
+};
+
+// A try block: an error raised by an instruction in [start, end) resumes at
+// `target` with its message in R(messageRegister). Innermost blocks come first.
+struct ExceptionHandler {
+    uint32_t start;
+    uint32_t end;
+    uint32_t target;
+    uint16_t messageRegister;
+};
+
 struct CompiledFunction {
     std::string name;
     std::vector<std::string> parameters;
     std::vector<Instruction> code;
-    int localCount = 0;
+    std::vector<LineRun> lines;  // Ordered by pc; 0 where the line is unknown
+    std::vector<ExceptionHandler> handlers;
+    int registerCount = 0;       // Locals followed by temporaries
+    bool frameCaptured = false;  // A nested function closes over the frame: keep it on the heap
+    bool usesUpvalues = false;   // Reads or writes locals of an enclosing function
+
+    // Source line of the instruction at `pc`, or 0
+    uint32_t lineAt(size_t pc) const {
+        auto it = std::upper_bound(lines.begin(), lines.end(), pc,
+                                   [](size_t value, const LineRun& run) { return value < run.pc; });
+        return it == lines.begin() ? 0 : std::prev(it)->line;
+    }
+
+    // VM run-time state, never serialized
+    uint32_t hotness = 0;           // Calls and loop back edges since the last JIT attempt
+    uint8_t jitCompiles = 0;        // Times the JIT compiled this function
+    NativeCode* native = nullptr;   // Current machine code, owned by the VM's Jit
+};
+
+// Struct declaration: the constructor takes the fields in order
+struct StructInfo {
+    std::string name;
+    std::vector<std::string> fields;
+};
+
+// Import statement, resolved and compiled when it runs
+struct ImportInfo {
+    std::string moduleName;
+    std::string modulePath;
+};
+
+// Map literal: a names[] index per entry, or -1 where the key is computed
+// (the key is then in the register before its value)
+struct MapLayout {
+    std::vector<int32_t> keys;
 };
 
 // Bytecode chunk - compiled program
 class BytecodeChunk {
 public:
-    std::vector<Instruction> code;
     std::vector<ConstantValue> constants;
-    std::vector<CompiledFunction> functions;
-    
-    // Add constant to pool, return index
+    std::vector<std::string> names;             // Variable, function and member names
+    std::vector<CompiledFunction> functions;    // functions[0] is the top-level code
+    std::vector<uint32_t> memberSites;          // names[] index per member access / method call
+    std::vector<MapLayout> mapLayouts;
+    std::vector<StructInfo> structs;
+    std::vector<ImportInfo> imports;
+
+    // Add constant to pool, return index; an equal constant already in the
+    // pool is reused
     uint32_t addConstant(const ConstantValue& value) {
+        auto it = constantIndices.find(value);
+        if (it != constantIndices.end()) {
+            return it->second;
+        }
         constants.push_back(value);
-        return static_cast<uint32_t>(constants.size() - 1);
-    }
-    
-    // Add instruction
-    size_t emit(OpCode op) {
-        code.push_back(Instruction(op));
-        return code.size() - 1;
-    }
-    
-    size_t emit(OpCode op, uint32_t operand) {
-        code.push_back(Instruction(op, operand));
-        return code.size() - 1;
-    }
-    
-    // Patch jump instruction
-    void patchJump(size_t offset, uint32_t target) {
-        code[offset].operand = target;
+        auto index = static_cast<uint32_t>(constants.size() - 1);
+        constantIndices.emplace(value, index);
+        return index;
     }
+
+private:
+    // Pool index per constant added through addConstant
+    std::unordered_map<ConstantValue, uint32_t, ConstantIdentity, ConstantIdentity> constantIndices;
 };
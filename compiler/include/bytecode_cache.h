@@ -0,0 +1,56 @@
+#pragma once
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Serialized bytecode (.sfc files)
+//
+// A compiled chunk is stored as a header followed by a payload holding its
+// tables in declaration order (constants, names, functions, member sites,
+// map layouts, structs, imports). Integers are written in host byte order;
+// instructions are copied as their packed 8-byte form.
+//
+// The header records the format version, the compiler tag (the SynthFlow
+// version and the options that change the generated code), a hash of the
+// source and a checksum of the payload. A file that does not match all of
+// them is rejected, so a stale or damaged cache entry is recompiled rather
+// than run.
+
+constexpr uint32_t kBytecodeFormatVersion = 4;
+
+// FNV-1a, 64-bit
+uint64_t hashBytes(const char* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+std::string serializeChunk(const BytecodeChunk& chunk, uint64_t sourceHash, const std::string& compilerTag);
+
+// Throws std::runtime_error if `data` is not a chunk serialized for this
+// source hash and compiler tag
+BytecodeChunk deserializeChunk(const char* data, size_t size, uint64_t sourceHash, const std::string& compilerTag);
+
+// Cache of compiled chunks keyed by source content and compiler tag
+//
+// Entries are files named after the key in a single directory. Writes go
+// to a temporary file that is renamed into place, so concurrent runs never
+// see a partial entry. A missing, unreadable or invalid entry is a miss.
+class BytecodeCache {
+public:
+    BytecodeCache(std::string directory, std::string compilerTag);
+
+    // $SYNTHFLOW_CACHE_DIR, else $XDG_CACHE_HOME/synthflow, else ~/.cache/synthflow
+    static std::string defaultDirectory();
+
+    // The chunk compiled from `source`, read through a memory mapping
+    std::optional<BytecodeChunk> load(const std::string& source) const;
+    // Best effort: failures to write leave the cache unchanged
+    void store(const std::string& source, const BytecodeChunk& chunk) const;
+
+    std::string entryPath(const std::string& source) const;
+
+private:
+    std::string directory;
+    std::string compilerTag;
+
+    uint64_t sourceHash(const std::string& source) const;
+};
@@ -3,26 +3,112 @@
 #include "bytecode.h"
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 // Compiles AST to bytecode
+//
+// Runs after the Resolver and maps its (depth, slot) pairs onto flat frames:
+// the compiler keeps a stack of the same scopes the Resolver created, each
+// with the offset of its slots in its function's frame. A reference that
+// crosses a function boundary becomes an upvalue access through the closure.
+//
+// Expressions are evaluated into registers. Temporaries are allocated above
+// the locals of the scopes entered so far and released at the end of each
+// statement; no scope begins inside an expression, so they never overlap a
+// live local. Locals and constants are used as operands in place.
 class BytecodeCompiler : public ASTVisitor {
 private:
+    // A resolver scope and where its slots start in its function's frame
+    struct Scope {
+        size_t function;  // Index into `functions`
+        int base;
+    };
+
+    struct Loop {
+        size_t start;                      // Continue target (while loops)
+        std::vector<size_t> breakJumps;
+        std::vector<size_t> continueJumps; // Patched to the increment (for loops)
+    };
+
+    // A function being compiled
+    struct FunctionState {
+        uint32_t index;  // Into chunk.functions
+        int nextSlot = 0;
+        int temps = 0;   // Temporaries in use, from register nextSlot
+        std::vector<Loop> loops;
+
+        explicit FunctionState(uint32_t i) : index(i) {}
+    };
+
+    // Where an expression visitor leaves its value: a given register, or
+    // one of these
+    static constexpr int kAnyRegister = -1;
+    static constexpr int kAnyOperand = -2;  // A register or an RK constant
+    static constexpr int kDiscard = -3;     // Unused (expression statements)
+
+    static constexpr size_t kNoJump = static_cast<size_t>(-1);
+
     BytecodeChunk chunk;
-    std::unordered_map<std::string, uint32_t> localVariables;
-    std::unordered_map<std::string, uint32_t> globalVariables;
-    uint32_t nextLocalIndex = 0;
-    bool inFunction = false;
-    
-    // Variable resolution
-    uint32_t resolveVariable(const std::string& name);
-    uint32_t declareVariable(const std::string& name);
-    
+    std::vector<FunctionState> functions;
+    std::vector<Scope> scopes;
+    std::unordered_map<std::string, uint32_t> nameIndices;
+    int target = kAnyRegister;  // Requested destination of the expression being compiled
+    uint16_t result = 0;        // Operand holding the value of the last expression compiled
+    uint32_t line = 0;          // Source line of the statement being compiled
+
+    CompiledFunction& currentFunction() { return chunk.functions[functions.back().index]; }
+    size_t emit(OpCode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+    size_t emitBx(OpCode op, uint16_t a, uint32_t bx);
+    size_t here() { return currentFunction().code.size(); }
+    void patchJump(size_t offset) { currentFunction().code[offset].setBx(static_cast<uint32_t>(here())); }
+
+    uint32_t nameIndex(const std::string& name);
+    uint32_t constantIndex(const ConstantValue& value) { return chunk.addConstant(value); }
+    uint16_t narrow(size_t value, const char* what);  // 16-bit operand, or a compile error
+
+    // Registers
+    uint16_t checkRegister(int reg);
+    uint16_t allocTemp() { return allocTemps(1); }
+    uint16_t allocTemps(int count);  // First of `count` consecutive temporaries
+    void releaseTemps(int mark) { functions.back().temps = mark; }
+    bool isTemp(uint16_t operand) const;
+    uint16_t destination();          // The requested register, or a new temporary
+    void setResult(uint16_t operand);  // Deliver `operand` where it was requested
+    void setConstantResult(const ConstantValue& value);
+    void moveTo(uint16_t reg, uint16_t operand);
+
+    // Expressions
+    uint16_t compileExpression(Expression* expr, int where);
+    uint16_t compileOperand(Expression* expr) { return compileExpression(expr, kAnyOperand); }
+    uint16_t compileRegister(Expression* expr) { return compileExpression(expr, kAnyRegister); }
+    void compileInto(Expression* expr, uint16_t reg);
+    // Evaluate an operand whose value must survive the evaluation of later
+    // operands: a local is copied unless those are free of side effects
+    uint16_t compileOperandBefore(Expression* expr, bool laterIsPure, bool needRegister = false);
+    static bool isPure(Expression* expr);
+    size_t compileCondition(Expression* condition);  // The jump taken when it is false, or kNoJump
+
+    // Scopes
+    void beginScope(int frameSize, bool captured);
+    void endScope() { scopes.pop_back(); }
+
+    // Resolved variables: depth/slot as attached by the Resolver
+    int localRegister(int depth, int slot);  // -1 unless a local of the current function
+    void emitLoad(uint16_t reg, int depth, int slot, const std::string& name);
+    void emitStore(uint16_t reg, int depth, int slot, const std::string& name);
+    void emitDefine(uint16_t reg, int slot, const std::string& name);  // Declaration in the innermost scope
+    void emitRaise(const std::string& message);
+    void emitReturnNull();
+
+    void compileStatement(Statement* statement);
+    void compileStatements(const std::vector<std::unique_ptr<Statement>>& statements);
+
 public:
     BytecodeCompiler() = default;
-    
-    // Compile statements to bytecode
+
+    // Compile statements to bytecode (the statements must have been resolved)
     BytecodeChunk compile(const std::vector<std::unique_ptr<Statement>>& statements);
-    
+
     // Expression visitors
     void visit(IntegerLiteral* node) override;
     void visit(FloatLiteral* node) override;
@@ -42,7 +128,13 @@ public:
     void visit(CompoundAssignment* node) override;
     void visit(UpdateExpression* node) override;
     void visit(InterpolatedString* node) override;
-    
+
+    // SADK Expression visitors (Agent Development Kit)
+    void visit(MapLiteral* node) override;
+    void visit(MemberExpression* node) override;
+    void visit(MethodCallExpression* node) override;
+    void visit(SelfExpression* node) override;
+
     // Statement visitors
     void visit(VariableDeclaration* node) override;
     void visit(ExpressionStatement* node) override;
@@ -55,4 +147,8 @@ public:
     void visit(FunctionDeclaration* node) override;
     void visit(ReturnStatement* node) override;
     void visit(TryStatement* node) override;
+
+    // SADK Statement visitors (Agent Development Kit)
+    void visit(ImportStatement* node) override;
+    void visit(StructDeclaration* node) override;
 };
@@ -0,0 +1,23 @@
+#pragma once
+#include "bytecode.h"
+
+// Peephole optimizer for compiled bytecode
+//
+// The BytecodeCompiler runs it over every function it emits. It rewrites the
+// code in place and renumbers jump targets and the line table:
+// - Jumps to jumps go straight to the final target, a jump to a RETURN
+//   becomes that RETURN, and a jump to the next instruction is dropped.
+// - A loop's back edge to its condition (JUMP to TEST_LT; JUMP exit) becomes
+//   a compare-and-branch into the body (BRANCH_LT), and `INC i` ahead of a
+//   `BRANCH_LT i, n` back edge becomes INC_BRANCH_LT. These three pairs were
+//   the most frequent on the example benchmarks and the stdlib tests.
+// - Unreachable instructions are removed.
+// - Loads and moves into registers that are never read before being
+//   overwritten are removed. This needs every read of a register to be
+//   visible in the function's own code, so it skips functions whose frame
+//   a closure captures and functions with a try statement.
+//
+// Typed forms the compiler emits are treated as their generic forms.
+
+void optimizePeephole(CompiledFunction& function, const BytecodeChunk& chunk);
+void optimizePeephole(BytecodeChunk& chunk);
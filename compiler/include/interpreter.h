@@ -2,109 +2,281 @@
 #define INTERPRETER_H
 
 #include "ast.h"
+#include "object_map.h"
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <memory>
 #include <variant>
 #include <functional>
 #include <stdexcept>
+#include <cstdint>
+#include <string_view>
 
 // Forward declarations
 class Interpreter;
 class Environment;
 
-// Runtime exception for control flow
-// Forward declare Value to use in ReturnException
-class Value;
-
-class ReturnException : public std::exception {
+// Field layout shared by struct instances (a hidden class)
+//
+// An instance stores its fields in a slot array laid out by its shape, so
+// instances with the same shape keep each field at the same slot and a member
+// access site can cache (shape, slot) instead of looking the name up. Shapes
+// form a transition tree: adding a field to a shape always leads to the same
+// child, so instances built by adding the same fields in the same order share
+// one shape. Shapes are never freed.
+class Shape {
 public:
-    bool hasValue;
-    // Use optional pointer since Value is forward declared in this scope
-    // We'll store the actual value as a variant in the interpreter
-    std::variant<std::monostate, int64_t, double, std::string, bool> primitiveValue;
-    std::shared_ptr<void> complexValue;  // Can be ArrayType or MapType
-    bool isArray;
-    bool isMap;
-    
-    ReturnException() : hasValue(false), isArray(false), isMap(false) {}
-    ReturnException(int64_t v) : hasValue(true), primitiveValue(v), isArray(false), isMap(false) {}
-    ReturnException(double v) : hasValue(true), primitiveValue(v), isArray(false), isMap(false) {}
-    ReturnException(const std::string& v) : hasValue(true), primitiveValue(v), isArray(false), isMap(false) {}
-    ReturnException(bool v) : hasValue(true), primitiveValue(v), isArray(false), isMap(false) {}
-    
-    // For arrays and maps, we set flags and store as void pointer
-    void setArray(std::shared_ptr<void> arr) {
-        hasValue = true;
-        isArray = true;
-        isMap = false;
-        complexValue = arr;
-    }
+    // The empty shape instances of `typeName` start from, one per name
+    static const Shape* root(const std::string& typeName);
     
-    void setMap(std::shared_ptr<void> m) {
-        hasValue = true;
-        isArray = false;
-        isMap = true;
-        complexValue = m;
-    }
+    const std::string& typeName() const { return name; }
+    size_t size() const { return fields.size(); }
+    Symbol fieldAt(size_t slot) const { return fields[slot]; }
+    
+    // Slot of `field`, or -1. Scans the fields: only cache misses get here.
+    int slotOf(Symbol field) const;
+    
+    // This shape with `field` added as the last slot
+    const Shape* withField(Symbol field) const;
+    // This shape without `field`: the remaining fields added to the root in order
+    const Shape* withoutField(Symbol field) const;
+    
+private:
+    Shape(std::string name, const Shape* rootShape) : name(std::move(name)), rootShape(rootShape) {}
+    
+    std::string name;
+    std::vector<Symbol> fields;
+    const Shape* rootShape;
+    mutable std::vector<std::unique_ptr<Shape>> transitions;  // Children, one per added field
 };
 
-class BreakException : public std::exception {};
-class ContinueException : public std::exception {};
-
 // Runtime value type
+//
+// A 16-byte tagged union: ints, floats, bools and null are stored inline;
+// strings, arrays, maps, functions and struct instances live in a single
+// refcounted heap cell.
+// Copying a Value never copies string contents or container storage.
+//
+// Strings are immutable. Concatenating long strings builds a rope and taking a
+// long substring makes a view into its source; either is flattened in place
+// the first time asString() needs a contiguous std::string. asStringView() and
+// stringLength() do not flatten slices, and stringLength() never flattens.
 class Value {
 public:
     using ArrayType = std::vector<Value>;
     using FunctionType = std::function<Value(std::vector<Value>&, Interpreter&)>;
-    using MapType = std::map<std::string, Value>;  // SADK: map/object type
-    
-    std::variant<
-        std::monostate,  // null/undefined
-        int64_t,         // integer
-        double,          // float
-        std::string,     // string
-        bool,            // boolean
-        std::shared_ptr<ArrayType>,     // array
-        std::shared_ptr<FunctionType>,  // function
-        std::shared_ptr<MapType>        // SADK: map/object
-    > data;
+    using MapType = ObjectMap<Value>;  // SADK: map/object type, insertion-ordered
+    
+    enum class Type : uint8_t { Null, Int, Float, Bool, String, Array, Function, Map, Struct };
+    
+private:
+    // Heap cell shared by all copies of a value (the interpreter is single-threaded)
+    struct HeapObject {
+        uint32_t refCount = 1;
+    };
+    
+public:
+    // Struct instance: slot i holds the field shape->fieldAt(i)
+    struct StructObject : HeapObject {
+        const Shape* shape;
+        std::vector<Value> slots;
+        
+        StructObject(const Shape* shape, std::vector<Value> slots) : shape(shape), slots(std::move(slots)) {}
+        
+        // Drop a field, moving the instance to the shape without it
+        void remove(size_t slot);
+        void clear();
+    };
+    
+private:
+    struct StringObject : HeapObject {
+        enum class Kind : uint8_t { Flat, Rope, Slice };
+        
+        Kind kind = Kind::Flat;
+        size_t length;
+        std::string value;              // Flat contents
+        StringObject* left = nullptr;   // Rope: first half; Slice: the flat string viewed
+        StringObject* right = nullptr;  // Rope: second half
+        size_t offset = 0;              // Slice: start within left->value
+        
+        explicit StringObject(std::string v) : length(v.size()), value(std::move(v)) {}
+    };
+    // Array, map and function contents, stored in the cell itself
+    template <typename T>
+    struct Cell : HeapObject {
+        T value;
+        
+        template <typename... Args>
+        explicit Cell(Args&&... args) : value(std::forward<Args>(args)...) {}
+    };
+    
+public:
+    // Counted reference to the contents of an array, map or function value.
+    // It shares the cell's refcount with the Values that hold it.
+    template <typename T>
+    class Ref {
+    public:
+        Ref() = default;
+        Ref(std::nullptr_t) {}
+        Ref(const Ref& other) : cell(other.cell) { if (cell) ++cell->refCount; }
+        Ref(Ref&& other) noexcept : cell(other.cell) { other.cell = nullptr; }
+        Ref& operator=(Ref other) noexcept {
+            std::swap(cell, other.cell);
+            return *this;
+        }
+        ~Ref() {
+            if (cell && --cell->refCount == 0) delete cell;
+        }
+        
+        T* get() const { return cell ? &cell->value : nullptr; }
+        T& operator*() const { return cell->value; }
+        T* operator->() const { return &cell->value; }
+        explicit operator bool() const { return cell != nullptr; }
+        bool operator==(const Ref& other) const { return cell == other.cell; }
+        bool operator!=(const Ref& other) const { return cell != other.cell; }
+        
+    private:
+        friend class Value;
+        explicit Ref(Cell<T>* cell) : cell(cell) {}
+        Cell<T>* cell = nullptr;
+    };
     
+    // A new array, map or function: make<ArrayType>(), make<FunctionType>(lambda)
+    template <typename T, typename... Args>
+    static Ref<T> make(Args&&... args) {
+        return Ref<T>(new Cell<T>(std::forward<Args>(args)...));
+    }
+    
+private:
+    Type type;
+    union {
+        int64_t intValue;
+        double floatValue;
+        bool boolValue;
+        HeapObject* heap;
+    };
+    
+    bool isHeap() const { return type >= Type::String; }
+    void retain() { if (isHeap()) ++heap->refCount; }
+    void release();
+    
+    // Takes ownership of a string cell
+    explicit Value(StringObject* s) : type(Type::String), heap(s) {}
+    StringObject* stringCell() const {
+        if (type != Type::String) throw std::bad_variant_access();
+        return static_cast<StringObject*>(heap);
+    }
+    static const std::string& flatten(StringObject* s);
+    static void destroyString(StringObject* s);
+    
+    template <typename T>
+    Ref<T> ref(Type expected) const {
+        if (type != expected) throw std::bad_variant_access();
+        ++heap->refCount;
+        return Ref<T>(static_cast<Cell<T>*>(heap));
+    }
+    // Takes over the reference `r` holds
+    template <typename T>
+    static HeapObject* adopt(Ref<T>& r) {
+        HeapObject* cell = r.cell;
+        r.cell = nullptr;
+        return cell;
+    }
+    
+public:
     // Constructors
-    Value() : data(std::monostate{}) {}
-    Value(int64_t v) : data(v) {}
-    Value(int v) : data(static_cast<int64_t>(v)) {}
-    Value(double v) : data(v) {}
-    Value(const std::string& v) : data(v) {}
-    Value(const char* v) : data(std::string(v)) {}
-    Value(bool v) : data(v) {}
-    Value(std::shared_ptr<ArrayType> v) : data(v) {}
-    Value(std::shared_ptr<FunctionType> v) : data(v) {}
-    Value(std::shared_ptr<MapType> v) : data(v) {}  // SADK: map constructor
+    Value() : type(Type::Null), intValue(0) {}
+    Value(int64_t v) : type(Type::Int), intValue(v) {}
+    Value(int v) : type(Type::Int), intValue(static_cast<int64_t>(v)) {}
+    Value(double v) : type(Type::Float), floatValue(v) {}
+    Value(const std::string& v) : type(Type::String), heap(new StringObject(v)) {}
+    Value(std::string&& v) : type(Type::String), heap(new StringObject(std::move(v))) {}
+    Value(const char* v) : type(Type::String), heap(new StringObject(v)) {}
+    Value(bool v) : type(Type::Bool), intValue(0) { boolValue = v; }
+    Value(Ref<ArrayType> v) : type(Type::Array), heap(adopt(v)) {}
+    Value(Ref<FunctionType> v) : type(Type::Function), heap(adopt(v)) {}
+    Value(Ref<MapType> v) : type(Type::Map), heap(adopt(v)) {}  // SADK: map constructor
+    Value(const Shape* shape, std::vector<Value> slots) : type(Type::Struct), heap(new StructObject(shape, std::move(slots))) {}
+    
+    Value(const Value& other) : type(other.type), intValue(other.intValue) { retain(); }
+    Value(Value&& other) noexcept : type(other.type), intValue(other.intValue) {
+        other.type = Type::Null;
+    }
+    Value& operator=(const Value& other) {
+        if (this != &other) {
+            Value copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            type = other.type;
+            intValue = other.intValue;
+            other.type = Type::Null;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+    
+    void swap(Value& other) noexcept {
+        std::swap(type, other.type);
+        std::swap(intValue, other.intValue);
+    }
+    
+    Type getType() const { return type; }
     
     // Type checks
-    bool isNull() const { return std::holds_alternative<std::monostate>(data); }
-    bool isInt() const { return std::holds_alternative<int64_t>(data); }
-    bool isFloat() const { return std::holds_alternative<double>(data); }
-    bool isString() const { return std::holds_alternative<std::string>(data); }
-    bool isBool() const { return std::holds_alternative<bool>(data); }
-    bool isArray() const { return std::holds_alternative<std::shared_ptr<ArrayType>>(data); }
-    bool isFunction() const { return std::holds_alternative<std::shared_ptr<FunctionType>>(data); }
-    bool isMap() const { return std::holds_alternative<std::shared_ptr<MapType>>(data); }  // SADK
+    bool isNull() const { return type == Type::Null; }
+    bool isInt() const { return type == Type::Int; }
+    bool isFloat() const { return type == Type::Float; }
+    bool isString() const { return type == Type::String; }
+    bool isBool() const { return type == Type::Bool; }
+    bool isArray() const { return type == Type::Array; }
+    bool isFunction() const { return type == Type::Function; }
+    bool isMap() const { return type == Type::Map; }  // SADK
+    bool isStruct() const { return type == Type::Struct; }
     bool isNumber() const { return isInt() || isFloat(); }
     
-    // Getters
-    int64_t asInt() const { return std::get<int64_t>(data); }
+    // Getters (a type mismatch throws std::bad_variant_access, as before)
+    int64_t asInt() const {
+        if (type != Type::Int) throw std::bad_variant_access();
+        return intValue;
+    }
     double asFloat() const { 
-        if (isInt()) return static_cast<double>(asInt());
-        return std::get<double>(data); 
+        if (isInt()) return static_cast<double>(intValue);
+        if (type != Type::Float) throw std::bad_variant_access();
+        return floatValue; 
+    }
+    const std::string& asString() const {
+        StringObject* s = stringCell();
+        return s->kind == StringObject::Kind::Flat ? s->value : flatten(s);
+    }
+    std::string_view asStringView() const;
+    size_t stringLength() const { return stringCell()->length; }
+    bool asBool() const {
+        if (type != Type::Bool) throw std::bad_variant_access();
+        return boolValue;
     }
-    const std::string& asString() const { return std::get<std::string>(data); }
-    bool asBool() const { return std::get<bool>(data); }
-    std::shared_ptr<ArrayType> asArray() const { return std::get<std::shared_ptr<ArrayType>>(data); }
-    std::shared_ptr<FunctionType> asFunction() const { return std::get<std::shared_ptr<FunctionType>>(data); }
-    std::shared_ptr<MapType> asMap() const { return std::get<std::shared_ptr<MapType>>(data); }  // SADK
+    Ref<ArrayType> asArray() const { return ref<ArrayType>(Type::Array); }
+    Ref<FunctionType> asFunction() const { return ref<FunctionType>(Type::Function); }
+    Ref<MapType> asMap() const { return ref<MapType>(Type::Map); }  // SADK
+    StructObject& asStruct() const {
+        if (type != Type::Struct) throw std::bad_variant_access();
+        return *static_cast<StructObject*>(heap);
+    }
+    
+    // String building: results shorter than these are copied into a flat string
+    static constexpr size_t kRopeMinLength = 64;
+    static constexpr size_t kSliceMinLength = 32;
+    
+    // Concatenate two string values
+    static Value concat(const Value& a, const Value& b);
+    // Characters [pos, pos + count) of a string value, clamped to its length
+    static Value substring(const Value& s, size_t pos, size_t count);
     
     // Convert to string for printing
     std::string toString() const;
@@ -113,28 +285,163 @@ public:
     bool isTruthy() const;
 };
 
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte tagged union");
+
+// Completion record for statement execution
+//
+// Statements report how they finished through Interpreter::completion rather
+// than by throwing: return/break/continue set it, and blocks, loops and calls
+// check it after each statement. Expressions still report through lastValue.
+struct Completion {
+    enum class Type { Normal, Return, Break, Continue };
+    
+    Type type = Type::Normal;
+    Value value;  // Returned value (Type::Return only)
+    
+    bool isAbrupt() const { return type != Type::Normal; }
+};
+
 // Environment for variable scoping
+//
+// Locals live in a flat slot array indexed by the (depth, slot) pairs that the
+// Resolver attaches to the AST. Named bindings are only used by the global and
+// module environments, where builtins, imports and REPL input are defined.
+// Frames that a closure may capture own their slots; the others borrow them
+// from the interpreter's FrameArena.
 class Environment {
 private:
-    std::map<std::string, Value> variables;
+    std::vector<Value> ownedSlots;
+    Value* slots = nullptr;
+    std::unordered_map<Symbol, Value> variables;
     std::shared_ptr<Environment> parent;
     
 public:
     Environment() : parent(nullptr) {}
     Environment(std::shared_ptr<Environment> p) : parent(p) {}
+    Environment(std::shared_ptr<Environment> p, size_t slotCount)
+        : ownedSlots(slotCount), slots(ownedSlots.data()), parent(p) {}
+    Environment(std::shared_ptr<Environment> p, Value* arenaSlots)
+        : slots(arenaSlots), parent(p) {}
+    
+    // Bumped whenever a named binding to a function value is added, replaced or
+    // overwritten, and whenever a user function is declared. Call sites cache
+    // their resolved target against it.
+    static uint64_t functionEpoch;
+    
+    // Named bindings (globals, module scope)
+    void define(Symbol name, const Value& value);
+    const Value* find(Symbol name) const;  // This environment only, or nullptr
+    Value* find(Symbol name);              // Stays valid: bindings are never removed
+    Value get(Symbol name) const;
+    void set(Symbol name, const Value& value);
+    bool exists(Symbol name) const;
+    const std::unordered_map<Symbol, Value>& getVariables() const { return variables; }
+    
+    // Resolved locals
+    Value& slotAt(int depth, int slot) {
+        Environment* env = this;
+        for (int i = 0; i < depth; ++i) {
+            env = env->parent.get();
+        }
+        return env->slots[slot];
+    }
+    void defineSlot(int slot, const Value& value) { slots[slot] = value; }
+};
+
+// Stack-discipline allocator for the slots of frames no closure captures
+//
+// Blocks, loops and calls whose frame is not captured (see Resolver) take
+// their slots from here and give them back, in LIFO order, on scope exit.
+// Chunks are kept for reuse, so a steady-state loop or call allocates nothing.
+class FrameArena {
+public:
+    struct Mark {
+        size_t chunk = 0;
+        size_t used = 0;
+    };
     
-    void define(const std::string& name, const Value& value);
-    Value get(const std::string& name) const;
-    void set(const std::string& name, const Value& value);
-    bool exists(const std::string& name) const;
-    const std::map<std::string, Value>& getVariables() const { return variables; }
+    Mark mark() const { return {current, used}; }
+    Value* allocate(size_t count);
+    
+    // Clear the values handed out since `m` and make them available again
+    void release(Mark m, Value* slots, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            slots[i] = Value();
+        }
+        current = m.chunk;
+        used = m.used;
+    }
+    
+private:
+    static constexpr size_t kChunkValues = 4096;
+    
+    struct Chunk {
+        std::unique_ptr<Value[]> values;
+        size_t size;
+    };
+    
+    std::vector<Chunk> chunks;
+    size_t current = 0;  // Chunk being allocated from
+    size_t used = 0;     // Values handed out from it
+};
+
+// Hit/miss counters for the member and method inline caches
+struct InlineCacheStats {
+    uint64_t memberHits = 0;
+    uint64_t memberMisses = 0;
+    uint64_t methodHits = 0;
+    uint64_t methodMisses = 0;
+};
+
+// Native methods for built-in receiver types
+//
+// Each call site caches the NativeMethod it resolved for a receiver type, so
+// only the first call (per type) searches the table.
+struct NativeMethod {
+    Value::Type receiver;
+    Symbol name;
+    Value (*invoke)(const Value& self, std::vector<Value>& args);
 };
 
+// Runtime operations shared by the tree-walker and the bytecode VM, so both
+// engines produce the same values and the same error messages
+Value concatValues(const Value& left, const Value& right);
+Value binaryOperation(BinaryOp op, const Value& left, const Value& right);  // Generic (untyped) path
+Value unaryOperation(UnaryOp op, const Value& operand);
+Value compoundOperation(BinaryOp op, const Value& current, const Value& value);  // `x op= value`
+Value updateOperation(const Value& current, bool increment);                     // `++x`, `x--`
+bool matchesPattern(const Value& subject, const Value& pattern);
+Value loadMember(const Value& object, Symbol member, InlineCache& cache, InlineCacheStats& stats);
+Value invokeMethod(const Value& object, Symbol method, std::vector<Value>& args,
+                   InlineCache& cache, InlineCacheStats& stats);
+
+// Module loading: the source of `import name` (or `import name from path`),
+// and the map of a finished module's bindings, in name order
+std::string readModuleSource(const std::string& moduleName, const std::string& modulePath);
+Value exportModule(const Environment& moduleEnv);
+
+// A module's statements, parsed from its source and passed through the module
+// transform, if one is set (the driver sets one that runs the optimizer on
+// every module the program imports)
+using ModuleTransform = std::function<void(std::vector<std::unique_ptr<Statement>>& statements,
+                                           const std::string& moduleName, const std::string& modulePath)>;
+void setModuleTransform(ModuleTransform transform);
+bool hasModuleTransform();
+std::vector<std::unique_ptr<Statement>> parseModule(const std::string& source, const std::string& moduleName,
+                                                    const std::string& modulePath);
+
+// Resolve a parsed module and, unless the driver turned it off (--passes
+// without `specialize`), run the TypeSpecializer over it
+void setModuleSpecialization(bool enabled);
+void resolveModule(const std::vector<std::unique_ptr<Statement>>& statements);
+
 // User-defined function wrapper
 struct UserFunction {
     std::vector<std::string> parameters;
     BlockStatement* body;
     std::shared_ptr<Environment> closure;
+    int frameSize = 0;  // Slots for parameters and body locals (from the Resolver)
+    bool frameCaptured = false;  // A nested function closes over the call frame
 };
 
 // Interpreter class
@@ -143,9 +450,15 @@ private:
     std::shared_ptr<Environment> globalEnv;
     std::shared_ptr<Environment> currentEnv;
     Value lastValue;
+    Completion completion;  // How the last statement finished
+    InlineCacheStats cacheStats;
+    FrameArena frameArena;  // Slots for frames that no closure captures
     
     // Store user functions
-    std::map<std::string, UserFunction> userFunctions;
+    std::unordered_map<Symbol, UserFunction> userFunctions;
+    
+    // Imported module ASTs; user functions point into them
+    std::vector<std::vector<std::unique_ptr<Statement>>> loadedModules;
     
 public:
     Interpreter();
@@ -157,7 +470,13 @@ public:
     Value getLastValue() const { return lastValue; }
     
     // Call a function
-    Value callFunction(const std::string& name, std::vector<Value>& args);
+    Value callFunction(Symbol name, std::vector<Value>& args);
+    
+    // Inline cache counters (reported by --ic-stats)
+    const InlineCacheStats& getInlineCacheStats() const { return cacheStats; }
+
+    // Bind a struct's constructor builtin in the global scope
+    void defineStruct(const std::string& name, const std::vector<Symbol>& fields);
     
     // Environment access
     std::shared_ptr<Environment> getGlobalEnv() { return globalEnv; }
@@ -211,11 +530,14 @@ private:
     // Helper to evaluate an expression
     Value evaluate(Expression* expr);
     
+    // Run a user function's body in a fresh frame
+    Value callUserFunction(const UserFunction& func, std::vector<Value>& args);
+    
     // Register built-in functions
     void registerBuiltins();
     
     // Track const variables
-    std::map<std::string, bool> constVariables;
+    std::unordered_map<Symbol, bool> constVariables;
 };
 
 #endif // INTERPRETER_H
@@ -0,0 +1,77 @@
+#pragma once
+#include "vm.h"
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <vector>
+
+// Baseline JIT compiler for the bytecode VM (Linux x86-64)
+//
+// Once a function is hot (calls plus loop back edges reach the VM's
+// threshold), each of its instructions is translated to a fixed machine code
+// template, using the types the interpreter recorded by quickening it:
+// - Moves, loads, int and float arithmetic, int comparisons, tests and
+//   branches, INC/DEC and jumps run inline on the registers. Each checks the
+//   operand type tags it was specialized for and leaves native code if one
+//   does not match.
+// - Indexing, member access and calls to builtins call into the runtime.
+// - Anything else (calls to declared functions, returns, generic
+//   instructions, exceptions, globals) leaves native code.
+//
+// Leaving native code returns the index of the instruction to resume at, and
+// the interpreter carries on from there: nothing is changed before a check
+// fails, so the interpreter runs the instruction as if native code had never
+// started it. The interpreter reenters native code at the next call or back
+// edge. Code that keeps failing its checks is dropped and the function
+// recompiled later with the interpreter's new type feedback; after a few
+// recompilations the function stays interpreted.
+//
+// Code is written to a read-write mapping that is made read-execute before it
+// first runs; no page is ever writable and executable at once.
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(SYNTHFLOW_NO_JIT)
+#define SYNTHFLOW_JIT_X64 1
+#endif
+
+// Machine code for one function (defined in jit.cpp)
+struct NativeCode;
+
+class Jit {
+public:
+    // False on platforms without a code generator, and if Value is not laid
+    // out as the generated code expects
+    static bool supported();
+
+    explicit Jit(JitStats& stats);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Compile `function` and set function.native; false if it was not compiled
+    bool compile(VM& vm, CompiledFunction& function, VM::LoadedChunk& chunk);
+
+    // Run `code` on `registers` from instruction `pc` until it leaves native
+    // code; returns the instruction the interpreter resumes at, or the one
+    // that raised an error in a runtime call
+    uint32_t run(NativeCode& code, Value* registers, uint32_t pc);
+
+    // The last run ended on an error, which rethrow() raises
+    bool raised() const { return pending != nullptr; }
+    [[noreturn]] void rethrow();
+
+    // Runtime state of a call or member access site (defined in jit.cpp)
+    struct CallSite;
+    struct MemberSite;
+
+private:
+    static constexpr uint32_t kMaxGuardExits = 16;  // Failed checks before the code is dropped
+    static constexpr uint8_t kMaxCompiles = 4;      // Per function
+
+    JitStats& stats;
+    std::vector<std::unique_ptr<NativeCode>> code;  // Kept until the VM goes away
+    std::exception_ptr pending;                     // Raised in a runtime call
+
+    static int callBuiltin(CallSite* site, Value* args) noexcept;
+    static int getMember(MemberSite* site, Value* dst, const Value* object) noexcept;
+};
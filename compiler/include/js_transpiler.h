@@ -15,6 +15,7 @@ private:
     void indent();
     void emit(const std::string& code);
     void emitLine(const std::string& code);
+    void emitStatement(Statement* stmt);
     
 public:
     JSTranspiler() = default;
@@ -0,0 +1,269 @@
+#pragma once
+#include "symbol.h"
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Key of an ObjectMap entry: a symbol, or the string itself for a key that
+// arrives at run time (request data, computed map keys) and is not interned.
+// Such keys stay out of the process-wide SymbolTable, so a long-running
+// program that keys maps by the data it receives does not grow the table.
+// A string key only views its text: the map owns a copy of each one it stores.
+//
+// One word, so entries stay as small as symbol-keyed ones: the symbol ID
+// shifted left and tagged with a 1, or the address of the text.
+class MapKey {
+private:
+    uintptr_t bits;
+
+    static uintptr_t tagged(Symbol key) { return (static_cast<uintptr_t>(key.getId()) << 1) | 1; }
+
+public:
+    MapKey(Symbol key) : bits(tagged(key)) {}
+
+    // The symbol when the name is interned already, otherwise a key viewing
+    // `name`, which must outlive it
+    static MapKey of(const std::string& name) {
+        Symbol symbol;
+        MapKey key(symbol);
+        if (Symbol::find(name, symbol)) {
+            key.bits = tagged(symbol);
+        } else {
+            key.bits = reinterpret_cast<uintptr_t>(&name);
+        }
+        return key;
+    }
+
+    bool isSymbol() const { return (bits & 1) != 0; }
+    bool is(Symbol key) const { return bits == tagged(key); }
+    Symbol getSymbol() const { return Symbol::fromId(static_cast<uint32_t>(bits >> 1)); }  // Only if isSymbol()
+
+    const std::string& str() const {
+        return isSymbol() ? SymbolTable::instance().name(static_cast<uint32_t>(bits >> 1))
+                          : *reinterpret_cast<const std::string*>(bits);
+    }
+    operator const std::string&() const { return str(); }
+};
+
+// Insertion-ordered hash map used for SynthFlow objects (Value::MapType).
+//
+// Entries are stored contiguously in insertion order, so iteration (printing,
+// keys(), values(), JSON output) is deterministic. Maps with fewer than
+// kSmallLimit keys have no index and are scanned linearly by symbol ID, which
+// beats hashing for the small request/response objects most code builds.
+// Larger maps add an open-addressing (linear probing) index of entry positions.
+//
+// String keys hash by their text. A name can be interned after a string key
+// for it was stored (a module loaded later uses it), so a symbol that misses
+// is looked up again by text while the map holds any string keys.
+template <typename V>
+class ObjectMap {
+public:
+    using value_type = std::pair<MapKey, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    static constexpr size_t kSmallLimit = 8;
+
+private:
+    std::vector<value_type> entries;
+    std::vector<uint32_t> index;  // Entry position + 1 per bucket (0 = empty); empty in small mode
+    unsigned shift = 0;           // 64 - log2(index.size())
+    uint32_t stringKeys = 0;      // Entries keyed by a string, which own their text
+
+    size_t bucketFor(uint64_t hash) const {
+        // Fibonacci hashing spreads the sequential symbol IDs over the table
+        return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+    static uint64_t hashOf(Symbol key) { return key.getId(); }
+    static uint64_t hashOf(const std::string& text) { return std::hash<std::string>()(text); }
+    static uint64_t hashOf(const MapKey& key) {
+        return key.isSymbol() ? hashOf(key.getSymbol()) : hashOf(key.str());
+    }
+
+    void insertIndex(size_t position) {
+        size_t mask = index.size() - 1;
+        size_t bucket = bucketFor(hashOf(entries[position].first));
+        while (index[bucket] != 0) {
+            bucket = (bucket + 1) & mask;
+        }
+        index[bucket] = static_cast<uint32_t>(position + 1);
+    }
+
+    void rebuildIndex() {
+        index.clear();
+        if (entries.size() < kSmallLimit) {
+            return;
+        }
+        // Keep the load factor at or below 1/2
+        size_t capacity = 16;
+        unsigned bits = 4;
+        while (capacity < entries.size() * 2) {
+            capacity *= 2;
+            ++bits;
+        }
+        index.assign(capacity, 0);
+        shift = 64 - bits;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            insertIndex(i);
+        }
+    }
+
+    // Position of the entry matching `matches`, found by probing from `hash`
+    template <typename Match>
+    size_t probe(uint64_t hash, Match matches) const {
+        if (index.empty()) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (matches(entries[i].first)) {
+                    return i;
+                }
+            }
+            return entries.size();
+        }
+        size_t mask = index.size() - 1;
+        for (size_t bucket = bucketFor(hash);; bucket = (bucket + 1) & mask) {
+            uint32_t slot = index[bucket];
+            if (slot == 0) {
+                return entries.size();
+            }
+            if (matches(entries[slot - 1].first)) {
+                return slot - 1;
+            }
+        }
+    }
+
+    size_t positionOfText(const std::string& text) const {
+        return probe(hashOf(text), [&](const MapKey& entry) { return !entry.isSymbol() && entry.str() == text; });
+    }
+
+    size_t position(Symbol key) const {
+        size_t pos = probe(hashOf(key), [key](const MapKey& entry) { return entry.is(key); });
+        if (pos == entries.size() && stringKeys != 0) {
+            return positionOfText(key.str());
+        }
+        return pos;
+    }
+
+    size_t position(const MapKey& key) const {
+        if (key.isSymbol()) {
+            return position(key.getSymbol());
+        }
+        // Interned since the key was made
+        Symbol symbol;
+        if (Symbol::find(key.str(), symbol)) {
+            return position(symbol);
+        }
+        return stringKeys != 0 ? positionOfText(key.str()) : entries.size();
+    }
+
+    // Appends an entry for a key the map does not hold
+    V& append(const MapKey& key) {
+        Symbol symbol;
+        if (key.isSymbol()) {
+            entries.emplace_back(key, V());
+        } else if (Symbol::find(key.str(), symbol)) {
+            entries.emplace_back(MapKey(symbol), V());
+        } else {
+            entries.emplace_back(MapKey::of(*new std::string(key.str())), V());
+            ++stringKeys;
+        }
+        if (!index.empty() && entries.size() * 2 <= index.size()) {
+            insertIndex(entries.size() - 1);
+        } else if (entries.size() >= kSmallLimit) {
+            rebuildIndex();
+        }
+        return entries.back().second;
+    }
+
+    void release(const MapKey& key) {
+        if (!key.isSymbol()) {
+            delete &key.str();
+            --stringKeys;
+        }
+    }
+
+public:
+    ObjectMap() = default;
+    ObjectMap(const ObjectMap&) = delete;
+    ObjectMap& operator=(const ObjectMap&) = delete;
+    ~ObjectMap() {
+        if (stringKeys != 0) {
+            clear();
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    iterator find(Symbol key) { return entries.begin() + position(key); }
+    const_iterator find(Symbol key) const { return entries.begin() + position(key); }
+    iterator find(const MapKey& key) { return entries.begin() + position(key); }
+    const_iterator find(const MapKey& key) const { return entries.begin() + position(key); }
+    size_t count(Symbol key) const { return position(key) < entries.size() ? 1 : 0; }
+    size_t count(const MapKey& key) const { return position(key) < entries.size() ? 1 : 0; }
+
+    // Positional access for inline caches: a cached position stays valid until
+    // an erase shifts the entries, so callers re-check the key at that position
+    size_t positionOf(Symbol key) const { return position(key); }
+    bool hasKeyAt(size_t pos, Symbol key) const {
+        return pos < entries.size() && entries[pos].first.is(key);
+    }
+    V& valueAt(size_t pos) { return entries[pos].second; }
+
+    V& operator[](Symbol key) {
+        size_t pos = position(key);
+        if (pos < entries.size()) {
+            return entries[pos].second;
+        }
+        return append(MapKey(key));
+    }
+    V& operator[](const MapKey& key) {
+        size_t pos = position(key);
+        if (pos < entries.size()) {
+            return entries[pos].second;
+        }
+        return append(key);
+    }
+
+    V& at(Symbol key) {
+        size_t pos = position(key);
+        if (pos == entries.size()) {
+            throw std::out_of_range("ObjectMap::at: missing key " + key.str());
+        }
+        return entries[pos].second;
+    }
+    const V& at(Symbol key) const { return const_cast<ObjectMap*>(this)->at(key); }
+
+    // Erasing keeps the remaining entries in insertion order
+    iterator erase(iterator it) {
+        size_t pos = static_cast<size_t>(it - entries.begin());
+        release(it->first);
+        entries.erase(it);
+        rebuildIndex();
+        return entries.begin() + pos;
+    }
+    size_t erase(Symbol key) {
+        size_t pos = position(key);
+        if (pos == entries.size()) {
+            return 0;
+        }
+        erase(entries.begin() + pos);
+        return 1;
+    }
+
+    void clear() {
+        for (const auto& entry : entries) {
+            release(entry.first);
+        }
+        entries.clear();
+        index.clear();
+    }
+};
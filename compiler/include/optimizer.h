@@ -1,36 +1,361 @@
 #pragma once
 #include "ast.h"
+#include <cstdint>
+#include <map>
 #include <memory>
-#include <vector>
+#include <ostream>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+// AST optimizer: passes that rewrite the program before the resolver (-O, -OO,
+// --passes), then `specialize` after it
+
+// Visits every node of a program, children first; a visit may replace() its
+// node or remove() its statement (an if, loop, function or try body is emptied)
+class ASTRewriter : public ASTVisitor {
+public:
+    void visit(IntegerLiteral* node) override;
+    void visit(FloatLiteral* node) override;
+    void visit(StringLiteral* node) override;
+    void visit(BooleanLiteral* node) override;
+    void visit(NullLiteral* node) override;
+    void visit(Identifier* node) override;
+    void visit(BinaryExpression* node) override;
+    void visit(UnaryExpression* node) override;
+    void visit(AssignmentExpression* node) override;
+    void visit(CallExpression* node) override;
+    void visit(ArrayLiteral* node) override;
+    void visit(ArrayIndexExpression* node) override;
+    void visit(ArrayAssignmentExpression* node) override;
+    void visit(LambdaExpression* node) override;
+    void visit(MatchExpression* node) override;
+    void visit(CompoundAssignment* node) override;
+    void visit(UpdateExpression* node) override;
+    void visit(InterpolatedString* node) override;
+    void visit(MapLiteral* node) override;
+    void visit(MemberExpression* node) override;
+    void visit(MethodCallExpression* node) override;
+    void visit(SelfExpression* node) override;
+
+    void visit(VariableDeclaration* node) override;
+    void visit(ExpressionStatement* node) override;
+    void visit(BlockStatement* node) override;
+    void visit(IfStatement* node) override;
+    void visit(WhileStatement* node) override;
+    void visit(ForStatement* node) override;
+    void visit(BreakStatement* node) override;
+    void visit(ContinueStatement* node) override;
+    void visit(FunctionDeclaration* node) override;
+    void visit(ReturnStatement* node) override;
+    void visit(TryStatement* node) override;
+    void visit(ImportStatement* node) override;
+    void visit(StructDeclaration* node) override;
+
+protected:
+    size_t changes = 0;  // Nodes replaced or removed so far
+
+    // Rewrite each statement of a block (or of the program) in order,
+    // dropping removed ones
+    virtual void visitStatements(std::vector<std::unique_ptr<Statement>>& statements);
+
+    void rewrite(std::unique_ptr<Expression>& expr);
+    void rewrite(std::unique_ptr<Statement>& stmt);  // Left null if removed
+    void rewrite(std::unique_ptr<BlockStatement>& block);
+
+    // Called by a visit after its children have been rewritten
+    void replace(std::unique_ptr<Expression> expr);
+    void replace(std::unique_ptr<Statement> stmt);
+    void remove();
+
+private:
+    std::unique_ptr<Expression> expressionReplacement;
+    std::unique_ptr<Statement> statementReplacement;
+    bool statementRemoved = false;
+
+    void discardReplacement();
+};
+
+// A copy of `expr` in which each identifier named in `names` is replaced by a
+// copy of the expression it maps to. nullptr if `expr` contains a node that
+// cannot be moved to another scope: lambdas, self, and assignments.
+std::unique_ptr<Expression> cloneExpression(const Expression* expr,
+                                            const std::unordered_map<std::string, const Expression*>& names = {});
+
+// Whether two expressions are the same code: the same operators, calls,
+// fields and names over equal literals. Lambdas, matches, `self` and
+// anything that assigns are never the same as anything.
+bool sameExpression(const Expression* a, const Expression* b);
+
+// What a call to a builtin can do, from least to most. Calls are made by
+// name, so a call only reaches the builtin where nothing in the program (or
+// in a module it imports) declares or assigns that name.
+enum class BuiltinEffect : uint8_t {
+    None,       // Computes a new value from its arguments (or raises)
+    Allocates,  // Returns an array or map holding its arguments
+    Mutates,    // Changes the array passed as its first argument
+    External,   // Touches only the world outside the program: I/O, time, the OS
+    CallsBack,  // May run program code or define globals; so may any name that is not a builtin
+};
+BuiltinEffect builtinEffect(const std::string& name);
+
+// A program or a module it imports, and how it declares and uses names
+struct ProgramUnit {
+    struct Function {
+        FunctionDeclaration* decl;
+        size_t index;  // Of the top-level statement
+        bool nested;   // Declared inside another statement
+    };
+    struct Import {
+        std::string moduleName;
+        std::string modulePath;
+        size_t index;
+        bool nested;
+        size_t target = 0;  // Unit of the module
+    };
+
+    std::string key;  // Empty for the program
+    std::vector<std::unique_ptr<Statement>>* statements = nullptr;
+    std::unordered_map<std::string, int> declared;  // Declarations of each name, in every scope
+    std::unordered_set<std::string> topLevel;        // Names declared by a top-level statement
+    std::unordered_set<std::string> assigned;        // Names assigned to anywhere
+    std::vector<Function> functions;
+    std::vector<Import> imports;
+    int multiplicity = 0;  // How many times the unit runs: 1, or 2 for more than once
+    size_t inertEnd = 0;   // Top-level statements before this one run no user code
+};
+
+// The program and every module it imports, directly or not, for the passes
+// that look across modules (-OO): calls by name reach a function wherever it
+// was declared. Modules are read from their source, as they will be loaded.
+class ProgramUnits {
+public:
+    std::vector<std::unique_ptr<ProgramUnit>> units;  // The program first
+    std::unordered_map<std::string, int> functions;   // Declarations of each function name (2 = more than once)
+    std::unordered_set<std::string> names;             // Every name declared or assigned anywhere
+    bool complete = false;  // Every imported module could be read and parsed
+
+    // Top-level functions every call by name reaches: declared once, in a
+    // unit that runs once, before anything that could call them runs
+    std::unordered_map<std::string, std::pair<const ProgramUnit*, FunctionDeclaration*>> candidates;
+
+    // Scan `program` and the modules it imports; if one cannot be read,
+    // `complete` is false and nothing else is known
+    void analyze(std::vector<std::unique_ptr<Statement>>& program);
+    ProgramUnit* loadModule(const std::string& moduleName, const std::string& modulePath);  // nullptr on failure
+    ProgramUnit* findModule(const std::string& moduleName, const std::string& modulePath) const;
+
+private:
+    std::map<std::string, std::vector<std::unique_ptr<Statement>>> modules;  // Parsed module sources
+
+    bool reachedEarly(const ProgramUnit& unit, std::unordered_map<const ProgramUnit*, bool>& memo);
+    bool inertModule(const ProgramUnit& unit, std::unordered_map<const ProgramUnit*, int>& memo);
+};
+
+// One pass of the pipeline
+class OptimizerPass : public ASTRewriter {
+public:
+    virtual const char* name() const = 0;
+
+    // Rewrite `program`; returns how many nodes were replaced or removed
+    size_t run(std::vector<std::unique_ptr<Statement>>& program);
+    // The same for a module the last program run() imports, as it is loaded
+    // (`import name` or `import name from path`)
+    size_t runModule(std::vector<std::unique_ptr<Statement>>& module, const std::string& moduleName,
+                     const std::string& modulePath);
+
+    // Whether the last program run() used the source of imported modules, so
+    // its result is only valid while those are unchanged
+    virtual bool dependsOnImports() const { return false; }
+
+protected:
+    // Called before each walk with the statements about to be rewritten;
+    // `moduleName` is empty for a program
+    virtual void begin(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+                       const std::string& modulePath);
+};
+
+// Replaces operators on literals with their result, unless evaluating them
+// would raise or give a value no literal spells
+class ConstantFoldingPass : public OptimizerPass {
+public:
+    const char* name() const override { return "fold"; }
+
+    void visit(BinaryExpression* node) override;
+    void visit(UnaryExpression* node) override;
+};
+
+// Removes branches of literal conditions and statements after a return, break
+// or continue (declarations excepted), and merges blocks that declare nothing
+class DeadCodeEliminationPass : public OptimizerPass {
+public:
+    const char* name() const override { return "dce"; }
+
+    void visit(IfStatement* node) override;
+    void visit(WhileStatement* node) override;
+    void visit(ForStatement* node) override;
+
+protected:
+    void visitStatements(std::vector<std::unique_ptr<Statement>>& statements) override;
+};
+
+// Replaces calls to small, non-recursive top-level functions with their body
+// (-OO); arguments that cannot be substituted go through fresh variables
+class FunctionInliningPass : public OptimizerPass {
+public:
+    static constexpr size_t kMaxSize = 40;      // Nodes in an inlined body
+    static constexpr size_t kMaxPerBlock = 16;  // Calls inlined ahead of the statements of one block
+
+    FunctionInliningPass();
+    ~FunctionInliningPass() override;
+
+    const char* name() const override { return "inline"; }
+    bool dependsOnImports() const override;
+
+    void visit(CallExpression* node) override;
+
+protected:
+    void begin(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+               const std::string& modulePath) override;
+    void visitStatements(std::vector<std::unique_ptr<Statement>>& statements) override;
 
-// AST Optimizer - performs compile-time optimizations
-class Optimizer {
 private:
-    // Track used variables for dead code elimination
-    std::unordered_set<std::string> usedVariables;
-    
-    // Constant folding helpers
-    std::unique_ptr<Expression> foldBinaryExpression(BinaryExpression* node);
-    std::unique_ptr<Expression> foldUnaryExpression(UnaryExpression* node);
-    
-    // Dead code elimination helpers
-    void collectUsedVariables(Expression* expr);
-    bool isVariableUsed(const std::string& name) const;
-    
-public:
-    Optimizer() = default;
-    
-    // Main optimization passes
+    struct Analysis;
+    std::unique_ptr<Analysis> analysis;
+};
+
+// Compile-time function evaluation (-OO): replaces constants and pure calls on
+// constant operands with the literal they evaluate to, within kFuel steps
+class CompileTimeEvaluationPass : public OptimizerPass {
+public:
+    static constexpr size_t kFuel = 100000;       // Expressions and statements one evaluation runs
+    static constexpr size_t kRunFuel = 2000000;   // The same for all evaluations of one run
+    static constexpr size_t kMaxDepth = 64;       // Nested calls
+    static constexpr size_t kMaxLength = 4096;    // Characters or elements of a value an evaluation makes
+    static constexpr size_t kMaxLiteral = 256;    // Elements of an array or map literal it writes
+
+    CompileTimeEvaluationPass();
+    ~CompileTimeEvaluationPass() override;
+
+    const char* name() const override { return "ctfe"; }
+    bool dependsOnImports() const override;
+
+    void visit(Identifier* node) override;
+    void visit(BinaryExpression* node) override;
+    void visit(UnaryExpression* node) override;
+    void visit(CallExpression* node) override;
+    void visit(ArrayIndexExpression* node) override;
+    void visit(LambdaExpression* node) override;
+    void visit(InterpolatedString* node) override;
+    void visit(MemberExpression* node) override;
+    void visit(FunctionDeclaration* node) override;
+
+protected:
+    void begin(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+               const std::string& modulePath) override;
+    void visitStatements(std::vector<std::unique_ptr<Statement>>& statements) override;
+
+private:
+    struct Analysis;
+    std::unique_ptr<Analysis> analysis;
+
+    // Replace `node` with the literal of its value, if it has a constant one
+    void fold(Expression* node, bool freshResult);
+};
+
+// Base of the passes that reuse one evaluation of a pure expression (-OO)
+// when nothing in between can change what it reads
+class RedundancyPass : public OptimizerPass {
+public:
+    RedundancyPass();
+    ~RedundancyPass() override;
+
+    bool dependsOnImports() const override;
+
+    void visit(FunctionDeclaration* node) override;
+
+protected:
+    struct Analysis;
+    std::unique_ptr<Analysis> analysis;
+
+    void begin(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+               const std::string& modulePath) override;
+};
+
+// Loop-invariant code motion: stores a pure expression the loop condition
+// evaluates first, and the loop cannot change, in a variable before the loop
+class LoopInvariantCodeMotionPass : public RedundancyPass {
+public:
+    const char* name() const override { return "licm"; }
+
+    void visit(WhileStatement* node) override;
+    void visit(ForStatement* node) override;
+};
+
+// Common subexpression elimination: stores a pure call, field or element read
+// the following statements of a block repeat in a variable before the first
+class CommonSubexpressionEliminationPass : public RedundancyPass {
+public:
+    const char* name() const override { return "cse"; }
+
+protected:
+    void visitStatements(std::vector<std::unique_ptr<Statement>>& statements) override;
+};
+
+// Runs a pipeline of passes over a program and records what each run did.
+// -O1 runs every pass once; -O2 repeats the pipeline until a round changes
+// nothing (or kMaxRounds have run), so one pass can act on another's output.
+class Optimizer {
+public:
+    static constexpr size_t kMaxRounds = 4;
+
+    struct PassRun {
+        std::string pass;
+        size_t round;    // From 1
+        double ms;
+        size_t changes;
+    };
+
+    // The pass that runs after the resolver, at every level (-O0 included)
+    static constexpr const char* kSpecializePass = "specialize";
+
+    explicit Optimizer(int level = 1);
+    // Exactly these passes, in this order, once; throws on an unknown name
+    explicit Optimizer(const std::vector<std::string>& passNames);
+
+    // Names of the passes run at `level`, and of every known pass
+    static std::vector<std::string> pipeline(int level);
+    static std::vector<std::string> availablePasses();
+    static std::unique_ptr<OptimizerPass> createPass(const std::string& name);  // nullptr if unknown or `specialize`
+
     void optimize(std::vector<std::unique_ptr<Statement>>& statements);
-    
-    // Individual optimizations
-    std::unique_ptr<Expression> optimizeExpression(std::unique_ptr<Expression> expr);
-    std::unique_ptr<Statement> optimizeStatement(std::unique_ptr<Statement> stmt);
-    
-    // Constant folding pass
-    void constantFoldingPass(std::vector<std::unique_ptr<Statement>>& statements);
-    
-    // Dead code elimination pass
-    void deadCodeEliminationPass(std::vector<std::unique_ptr<Statement>>& statements);
+    // Run the same passes over a module the optimized program imports (not
+    // recorded in runs())
+    void optimizeModule(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+                        const std::string& modulePath);
+
+    // Run the type specializer over the resolved program, if `specialize` is
+    // one of the passes (recorded in runs())
+    void specialize(const std::vector<std::unique_ptr<Statement>>& statements);
+
+    // Whether there are passes to run before the resolver, and whether
+    // `specialize` is one of the passes
+    bool rewrites() const { return !passes.empty(); }
+    bool specializes() const { return specializeTypes; }
+
+    // Whether the optimized program is only valid while the modules it
+    // imports are unchanged (so its bytecode must not be cached)
+    bool dependsOnImports() const;
+
+    const std::vector<PassRun>& runs() const { return history; }
+
+    // One line per pass run: time and changes (--print-passes)
+    void printReport(std::ostream& out) const;
+
+private:
+    std::vector<std::unique_ptr<OptimizerPass>> passes;
+    bool specializeTypes = false;
+    size_t maxRounds;
+    std::vector<PassRun> history;
 };
@@ -28,11 +28,13 @@ private:
     std::unique_ptr<Expression> parseArrayLiteral();
     std::unique_ptr<Expression> parseIndexExpression(std::unique_ptr<Expression> array);
     
-    std::unique_ptr<Statement> parseStatement();
+    std::unique_ptr<Statement> parseStatement();      // Records the statement's line
+    std::unique_ptr<Statement> parseStatementKind();
     std::unique_ptr<Statement> parseExpressionStatement();
     std::unique_ptr<Statement> parseVariableDeclaration();
     std::unique_ptr<Statement> parseConstDeclaration();
     std::unique_ptr<Statement> parseFunctionDeclaration();
+    std::string parseTypeName(const char* error);  // A type annotation, with '?' when nullable
     std::unique_ptr<Statement> parseBlockStatement();
     std::unique_ptr<Statement> parseIfStatement();
     std::unique_ptr<Statement> parseWhileStatement();
@@ -0,0 +1,104 @@
+#pragma once
+#include "ast.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Scope resolution pass - runs between Parser::parse() and Interpreter::execute().
+//
+// Every local variable reference is bound to a (depth, slot) pair: depth is the
+// number of frames to walk up from the current one, slot is the index inside
+// that frame. Names that are not declared in any enclosing local scope keep
+// depth -1 and are looked up by name in the global/module environment.
+//
+// The scopes created here mirror the frames the interpreter creates at runtime:
+//   - a function (or lambda) frame holds its parameters and the locals declared
+//     directly in its body
+//   - a block or for-initializer frame exists only if it declares something
+//   - a catch clause gets a one-slot frame for the error variable
+//
+// A frame is marked captured if a function is declared anywhere inside it.
+// Only captured frames have to outlive their scope; the interpreter keeps the
+// rest in its FrameArena.
+class Resolver : public ASTVisitor {
+private:
+    struct Scope {
+        std::unordered_map<std::string, int> slots;
+        int size = 0;
+        bool captured = false;
+        std::shared_ptr<Scope> parent;
+    };
+
+    // Function bodies are resolved after the enclosing scopes are complete, so a
+    // function sees locals declared after it in the same scope (as it would at runtime)
+    struct PendingFunction {
+        const std::vector<std::string>* parameters;
+        BlockStatement* blockBody;
+        Expression* exprBody;
+        int* frameSize;
+        bool* frameCaptured;
+        std::shared_ptr<Scope> closure;
+    };
+
+    std::shared_ptr<Scope> current;  // nullptr = global scope (named bindings)
+    std::vector<PendingFunction> pending;
+
+    void beginScope();
+    int endScope();
+    int declare(const std::string& name);
+    void resolveName(const std::string& name, int& depth, int& slot) const;
+    void markCaptured();
+    void resolveStatements(const std::vector<std::unique_ptr<Statement>>& statements);
+    void resolvePending();
+    static bool declaresLocals(const std::vector<std::unique_ptr<Statement>>& statements);
+
+public:
+    Resolver() = default;
+
+    // Annotate a parsed program (or module) in place
+    void resolve(const std::vector<std::unique_ptr<Statement>>& statements);
+
+    // Expression visitors
+    void visit(IntegerLiteral* node) override;
+    void visit(FloatLiteral* node) override;
+    void visit(StringLiteral* node) override;
+    void visit(BooleanLiteral* node) override;
+    void visit(NullLiteral* node) override;
+    void visit(Identifier* node) override;
+    void visit(BinaryExpression* node) override;
+    void visit(UnaryExpression* node) override;
+    void visit(AssignmentExpression* node) override;
+    void visit(CallExpression* node) override;
+    void visit(ArrayLiteral* node) override;
+    void visit(ArrayIndexExpression* node) override;
+    void visit(ArrayAssignmentExpression* node) override;
+    void visit(LambdaExpression* node) override;
+    void visit(MatchExpression* node) override;
+    void visit(CompoundAssignment* node) override;
+    void visit(UpdateExpression* node) override;
+    void visit(InterpolatedString* node) override;
+
+    // SADK Expression visitors (Agent Development Kit)
+    void visit(MapLiteral* node) override;
+    void visit(MemberExpression* node) override;
+    void visit(MethodCallExpression* node) override;
+    void visit(SelfExpression* node) override;
+
+    // Statement visitors
+    void visit(VariableDeclaration* node) override;
+    void visit(ExpressionStatement* node) override;
+    void visit(BlockStatement* node) override;
+    void visit(IfStatement* node) override;
+    void visit(WhileStatement* node) override;
+    void visit(ForStatement* node) override;
+    void visit(BreakStatement* node) override;
+    void visit(ContinueStatement* node) override;
+    void visit(FunctionDeclaration* node) override;
+    void visit(ReturnStatement* node) override;
+    void visit(TryStatement* node) override;
+
+    // SADK Statement visitors (Agent Development Kit)
+    void visit(ImportStatement* node) override;
+    void visit(StructDeclaration* node) override;
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// Process-wide string interning.
+//
+// Identifier names, member and method names, map keys and struct field names
+// are interned once (AST nodes do it at parse time) and are afterwards compared
+// and hashed as 32-bit IDs. Interned strings live for the rest of the process,
+// so strings that arrive at run time (request data, computed map keys) are
+// looked up with find(), never interned.
+class SymbolTable {
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+    std::deque<std::string> names;  // Indexed by ID; deque keeps references stable
+    
+    SymbolTable();
+    
+public:
+    static SymbolTable& instance();
+    
+    static constexpr uint32_t kNotFound = UINT32_MAX;
+    
+    uint32_t intern(const std::string& name);
+    uint32_t find(const std::string& name) const;  // ID if interned, else kNotFound; never adds
+    const std::string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+};
+
+class Symbol {
+private:
+    uint32_t id;
+    
+public:
+    Symbol() : id(0) {}  // ID 0 is the empty string
+    // Interning is explicit for strings built at run time, which would
+    // otherwise grow the table for good; a literal names a fixed symbol
+    explicit Symbol(const std::string& name) : id(SymbolTable::instance().intern(name)) {}
+    explicit Symbol(const char* name) : Symbol(std::string(name)) {}
+    template <size_t N>
+    Symbol(const char (&literal)[N]) : Symbol(static_cast<const char*>(literal)) {}
+    
+    // The symbol with an ID taken from a symbol earlier, as MapKey stores it
+    static Symbol fromId(uint32_t id) {
+        Symbol symbol;
+        symbol.id = id;
+        return symbol;
+    }
+    
+    // The symbol of an already interned name, without interning it; false if
+    // no symbol has that name
+    static bool find(const std::string& name, Symbol& symbol) {
+        uint32_t found = SymbolTable::instance().find(name);
+        if (found == SymbolTable::kNotFound) {
+            return false;
+        }
+        symbol.id = found;
+        return true;
+    }
+    
+    uint32_t getId() const { return id; }
+    bool empty() const { return id == 0; }
+    
+    const std::string& str() const { return SymbolTable::instance().name(id); }
+    operator const std::string&() const { return str(); }
+    
+    bool operator==(const Symbol& other) const { return id == other.id; }
+    bool operator!=(const Symbol& other) const { return id != other.id; }
+};
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(const Symbol& symbol) const noexcept { return symbol.getId(); }
+};
+}  // namespace std
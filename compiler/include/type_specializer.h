@@ -0,0 +1,103 @@
+#pragma once
+#include "ast.h"
+#include "types.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The optimizer's `specialize` pass, run after the Resolver: infers local,
+// parameter and result types and marks int and float operations for the engines
+class TypeSpecializer : public ASTVisitor {
+private:
+    // Function results are keyed by their declaration
+    using Key = const void*;
+
+    // Walks beyond this leave the types that are still changing as they are;
+    // at worst a guard fails
+    static constexpr int kMaxRounds = 16;
+
+    TypeInference inference;  // Builtin result types and annotations
+
+    // Inferred types: TypeKind::UNKNOWN until something is assigned, ANY once
+    // two different types are
+    std::unordered_map<uint64_t, TypeKind> variables;  // Frame instance and slot
+    std::unordered_map<Key, TypeKind> results;          // Function and lambda results
+    std::unordered_map<std::string, FunctionDeclaration*> functions;  // Callable by name
+
+    std::vector<uint32_t> frames;  // Frame instances of the scopes being walked, innermost last
+    uint32_t nextFrame = 0;
+    Key function = nullptr;        // Function or lambda whose returns are being walked
+    TypeKind type = TypeKind::UNKNOWN;  // Type of the last expression walked
+    bool changed = false;
+    bool marking = false;
+    size_t marked = 0;  // Operations marked by the last walk
+
+    static TypeKind join(TypeKind a, TypeKind b);
+    static TypeKind binaryType(BinaryOp op, TypeKind left, TypeKind right);
+    static TypeKind compoundType(BinaryOp op, TypeKind current, TypeKind value);
+    static TypeKind annotated(const std::string& annotation);
+
+    TypeKind typeOf(Expression* expr);
+    void beginFrame();
+    void endFrame();
+    uint64_t variableKey(int depth, int slot) const;
+    TypeKind variable(int depth, int slot) const;
+    void assign(int depth, int slot, TypeKind value);
+    void returns(Key fn, TypeKind value);
+    void walkFunction(Key fn, const std::vector<std::string>& parameters,
+                      const std::vector<std::string>* parameterTypes, TypeKind resultType,
+                      BlockStatement* blockBody, Expression* exprBody);
+    void walkStatements(const std::vector<std::unique_ptr<Statement>>& statements);
+
+public:
+    TypeSpecializer() = default;
+
+    // Infer the types of a resolved program (or module) and mark its
+    // operations in place; returns how many were marked
+    size_t specialize(const std::vector<std::unique_ptr<Statement>>& statements);
+
+    // Expression visitors
+    void visit(IntegerLiteral* node) override;
+    void visit(FloatLiteral* node) override;
+    void visit(StringLiteral* node) override;
+    void visit(BooleanLiteral* node) override;
+    void visit(NullLiteral* node) override;
+    void visit(Identifier* node) override;
+    void visit(BinaryExpression* node) override;
+    void visit(UnaryExpression* node) override;
+    void visit(AssignmentExpression* node) override;
+    void visit(CallExpression* node) override;
+    void visit(ArrayLiteral* node) override;
+    void visit(ArrayIndexExpression* node) override;
+    void visit(ArrayAssignmentExpression* node) override;
+    void visit(LambdaExpression* node) override;
+    void visit(MatchExpression* node) override;
+    void visit(CompoundAssignment* node) override;
+    void visit(UpdateExpression* node) override;
+    void visit(InterpolatedString* node) override;
+
+    // SADK Expression visitors (Agent Development Kit)
+    void visit(MapLiteral* node) override;
+    void visit(MemberExpression* node) override;
+    void visit(MethodCallExpression* node) override;
+    void visit(SelfExpression* node) override;
+
+    // Statement visitors
+    void visit(VariableDeclaration* node) override;
+    void visit(ExpressionStatement* node) override;
+    void visit(BlockStatement* node) override;
+    void visit(IfStatement* node) override;
+    void visit(WhileStatement* node) override;
+    void visit(ForStatement* node) override;
+    void visit(BreakStatement* node) override;
+    void visit(ContinueStatement* node) override;
+    void visit(FunctionDeclaration* node) override;
+    void visit(ReturnStatement* node) override;
+    void visit(TryStatement* node) override;
+
+    // SADK Statement visitors (Agent Development Kit)
+    void visit(ImportStatement* node) override;
+    void visit(StructDeclaration* node) override;
+};
@@ -408,6 +408,7 @@ public:
         else if (typeName == "bool") result = Type::makeBool();
         else if (typeName == "void") result = Type::makeVoid();
         else if (typeName == "any") result = Type::makeAny();
+        else if (typeName == "array") result = Type::makeArray(Type::makeAny());
         else result = std::make_shared<Type>(TypeKind::STRUCT, typeName);
         
         if (nullable) return Type::makeNullable(result);
@@ -1,87 +1,170 @@
 #pragma once
 #include "bytecode.h"
+#include "bytecode_cache.h"
+#include "interpreter.h"
 #include <vector>
-#include <stack>
 #include <memory>
-#include <variant>
-#include <functional>
 #include <string>
 #include <unordered_map>
-#include <iostream>
 
-// Runtime value for VM
-class VMValue {
-public:
-    using ArrayType = std::vector<VMValue>;
-    
-    std::variant<
-        std::monostate,  // null
-        int64_t,         // integer
-        double,          // float
-        std::string,     // string
-        bool,            // boolean
-        std::shared_ptr<ArrayType>  // array
-    > data;
-    
-    VMValue() : data(std::monostate{}) {}
-    VMValue(int64_t v) : data(v) {}
-    VMValue(double v) : data(v) {}
-    VMValue(const std::string& v) : data(v) {}
-    VMValue(bool v) : data(v) {}
-    VMValue(std::shared_ptr<ArrayType> v) : data(v) {}
-    
-    bool isNull() const { return std::holds_alternative<std::monostate>(data); }
-    bool isInt() const { return std::holds_alternative<int64_t>(data); }
-    bool isFloat() const { return std::holds_alternative<double>(data); }
-    bool isString() const { return std::holds_alternative<std::string>(data); }
-    bool isBool() const { return std::holds_alternative<bool>(data); }
-    bool isArray() const { return std::holds_alternative<std::shared_ptr<ArrayType>>(data); }
-    
-    int64_t asInt() const { return std::get<int64_t>(data); }
-    double asFloat() const { 
-        if (isInt()) return static_cast<double>(asInt());
-        return std::get<double>(data); 
-    }
-    const std::string& asString() const { return std::get<std::string>(data); }
-    bool asBool() const { return std::get<bool>(data); }
-    
-    std::string toString() const;
-    bool isTruthy() const;
+// Virtual Machine - executes bytecode
+//
+// The VM runs on the interpreter's Value type and shares its runtime: the
+// builtins are the interpreter's global bindings, and operators, member
+// access, native methods and struct constructors go through the same code,
+// so a program prints the same output and raises the same errors on either
+// engine.
+//
+// Arithmetic, comparison and indexing instructions are quickened: after one
+// execution the VM rewrites them in place into a form specialized for the
+// operand types it saw, guarded by a cheap type check that reverts to the
+// generic form.
+//
+// On Linux x86-64, hot functions are also compiled to machine code (see
+// jit.h) and run there until they reach an instruction it does not handle.
+//
+// Each call's registers live on the value stack, except for frames a nested
+// function closes over (CompiledFunction::frameCaptured), which are
+// heap-allocated Environments shared with those closures.
+//
+// Try blocks cost nothing until an error is raised: the compiler records each
+// one in its function's handler table, and the dispatch loop looks the
+// faulting instruction up there, popping frames until one catches the error.
+
+// Quickening counters (reported by --quicken-stats)
+struct QuickeningStats {
+    uint64_t quickened = 0;    // Instructions rewritten into a specialized form
+    uint64_t deoptimized = 0;  // Specialized instructions reverted by a failed guard
 };
 
-// Virtual Machine - executes bytecode
+// JIT counters (reported by --jit-stats)
+struct JitStats {
+    uint64_t compiled = 0;    // Functions compiled to machine code
+    uint64_t entries = 0;     // Transfers from the interpreter into machine code
+    uint64_t guardExits = 0;  // Returns to the interpreter on a failed type check
+    uint64_t discarded = 0;   // Machine code dropped after too many failed checks
+};
+
+class Jit;
+class VMProfiler;
+
 class VM {
+public:
+    VM();
+    ~VM();
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    // Run a compiled program; its top-level names are bound in the global environment
+    void run(BytecodeChunk chunk);
+
+    // Compile imported modules through `cache` (not owned; null disables it)
+    void setBytecodeCache(const BytecodeCache* cache) { bytecodeCache = cache; }
+
+    // Compile hot functions to machine code (the default where the JIT is
+    // supported). A function is hot once its calls and loop back edges reach
+    // `threshold`.
+    void setJit(bool enabled, uint32_t threshold = kDefaultJitThreshold);
+
+    // Record an opcode profile of the run in `profiler` (not owned; null
+    // stops profiling). Turns the JIT off.
+    void setProfiler(VMProfiler* profiler);
+
+    // Inline cache counters (reported by --ic-stats)
+    const InlineCacheStats& getInlineCacheStats() const { return cacheStats; }
+    const QuickeningStats& getQuickeningStats() const { return quickeningStats; }
+    const JitStats& getJitStats() const { return jitStats; }
+
+    static constexpr uint32_t kDefaultJitThreshold = 1000;
+
 private:
-    BytecodeChunk* chunk;
-    size_t ip = 0;  // Instruction pointer
-    std::vector<VMValue> stack;
-    std::vector<VMValue> globals;
-    
-    // Call frame for function calls
+    friend class Jit;  // Generated code calls the runtime through VM state
+    struct LoadedChunk;
+
+    // A declared function and the frame it closes over
+    struct Function {
+        CompiledFunction* code = nullptr;
+        LoadedChunk* chunk = nullptr;
+        std::shared_ptr<Environment> closure;
+    };
+
+    // Resolved target of a call, valid while Environment::functionEpoch is unchanged
+    struct CallCache {
+        uint64_t epoch = 0;
+        const Function* function = nullptr;        // A declared function, or
+        const Value::FunctionType* native = nullptr;  // a builtin
+    };
+
+    // A chunk prepared for execution, with the state its instructions cache
+    struct LoadedChunk {
+        BytecodeChunk bytecode;
+        std::shared_ptr<Environment> env;   // Global or module scope
+        std::vector<Value> constants;
+        std::vector<Symbol> names;
+        std::vector<Symbol> functionNames;
+        std::vector<Value*> globals;        // Binding per name, once found in `env`
+        std::vector<CallCache> calls;       // Per name
+        std::vector<InlineCache> members;   // Per member site
+    };
+
+    // Code is not const: quickening rewrites instructions in place
     struct CallFrame {
-        size_t returnAddress;
-        size_t stackBase;
+        CompiledFunction* function;
+        LoadedChunk* chunk;
+        Instruction* ip;                    // Next instruction (saved while calling out)
+        Value* registers;
+        Value* base;                        // Stack height to restore on return
+        std::shared_ptr<Environment> heap;  // Captured frames only
+        std::shared_ptr<Environment> closure;  // Functions that use upvalues only
     };
-    std::stack<CallFrame> callStack;
-    
-    // Built-in functions
-    std::unordered_map<std::string, std::function<VMValue(std::vector<VMValue>&)>> builtins;
-    
-    // Stack operations
-    void push(const VMValue& value);
-    VMValue pop();
-    VMValue& peek(int offset = 0);
-    
-    // Execute single instruction
-    bool executeInstruction();
-    
-public:
-    VM();
-    
-    // Run bytecode
-    void run(BytecodeChunk& bytecode);
-    
-    // Register built-in function
-    void registerBuiltin(const std::string& name, 
-                        std::function<VMValue(std::vector<VMValue>&)> func);
+
+    static constexpr size_t kStackSize = 1 << 20;  // Values (address space only until used)
+    static constexpr size_t kMaxFrames = 1 << 16;  // Call depth
+    static constexpr uint8_t kMaxDeopts = 2;  // Guard failures after which an instruction stays generic
+
+    Interpreter runtime;  // Builtins, global environment and struct constructors
+    InlineCacheStats cacheStats;
+    QuickeningStats quickeningStats;
+    JitStats jitStats;
+    const BytecodeCache* bytecodeCache = nullptr;
+    std::unique_ptr<Jit> jit;  // Null when disabled or unsupported
+    uint32_t jitThreshold = kDefaultJitThreshold;
+    VMProfiler* profiler = nullptr;
+
+    Value* stack;
+    Value* stackEnd;
+    Value* sp;
+    std::vector<CallFrame> frames;
+    std::vector<std::unique_ptr<LoadedChunk>> chunks;  // Main program and imported modules
+    std::unordered_map<Symbol, Function> functions;
+
+    void popTo(Value* target) {
+        while (sp > target) {
+            (--sp)->~Value();
+        }
+    }
+    [[noreturn]] static void overflow();
+
+    LoadedChunk& load(BytecodeChunk bytecode, std::shared_ptr<Environment> env);
+    void runChunk(LoadedChunk& chunk);
+    void enter(const Function& function, Value* args, uint32_t argc);
+    void resolveCall(LoadedChunk& chunk, uint32_t name);
+    BytecodeChunk compileModule(const ImportInfo& info, const std::string& source);  // Through the cache, if set
+
+    // On a call to or back edge at `ip`, run the function's native code if it
+    // has (or now gets) any, and move `ip` to where the interpreter resumes.
+    // An error raised in native code leaves `ip` just past the instruction
+    // that raised it, as if the interpreter had run it.
+    void jitEntry(CallFrame& frame, Instruction*& ip);
+
+    // Resume at the catch clause of the innermost try block around the
+    // instruction each frame is running, popping the frames without one down
+    // to `baseDepth`. False if no frame of this run catches the error.
+    bool unwind(const std::exception& error, size_t baseDepth);
+
+    // Run until the frame at `baseDepth` returns, catching errors raised in
+    // the frames above it
+    void execute(size_t baseDepth);
+    template <bool kProfile>
+    void dispatch(size_t baseDepth);  // kProfile: report each instruction to `profiler`
 };
@@ -0,0 +1,115 @@
+#pragma once
+#include "bytecode.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Opcode profile of a VM run (--vm-profile)
+//
+// The VM calls step() before every instruction it dispatches, so the profile
+// sees the dynamic instruction stream:
+// - per opcode, how often it ran and the time until the next instruction
+//   started (the handler's cost plus the profiler's own, which is about the
+//   same for every opcode)
+// - how often each opcode was directly followed by each other one, the
+//   candidates for superinstructions
+// - per function and instruction, how often it ran; the report maps these
+//   back to source lines through the functions' line tables and sums them
+//   over each loop (the instructions between a back edge and its target)
+//
+// finish() copies each function's name, lines and loops out of its code, so
+// the report can be printed after the VM that ran the program is gone.
+//
+// A VM without a profiler runs a dispatch loop compiled without the hook, so
+// profiling costs nothing when it is off. The JIT is turned off while
+// profiling: instructions run in native code would not be seen.
+class VMProfiler {
+public:
+    // Per-instruction counters for `function`, indexed by pc
+    uint64_t* countsFor(const CompiledFunction& function) {
+        auto& counts = functions[&function];
+        if (counts.size() < function.code.size()) {
+            counts.resize(function.code.size(), 0);
+        }
+        return counts.data();
+    }
+
+    void step(OpCode op) {
+        uint64_t now = ticks();
+        auto index = static_cast<size_t>(op);
+        if (previous < kOpCodeCount) {
+            opcodeTicks[previous] += now - lastTick;
+            ++pairs[previous * kOpCodeCount + index];
+        } else {
+            startTick = now;
+            startTime = std::chrono::steady_clock::now();
+        }
+        ++opcodeCounts[index];
+        previous = index;
+        lastTick = now;
+    }
+
+    // Close the last instruction's timing once the program has finished, and
+    // take what the report needs from the functions that ran
+    void finish();
+
+    // Opcode table, top pairs, functions and hot loops
+    void printReport(std::ostream& out) const;
+    std::string toJson() const;
+
+private:
+    static constexpr size_t kNone = kOpCodeCount;
+
+    // A function's counters with what the report needs of its code
+    struct FunctionProfile {
+        std::string name;
+        std::vector<uint64_t> counts;  // Per pc
+        std::vector<uint32_t> lines;   // Source line per pc, 0 where unknown
+        std::vector<std::pair<size_t, size_t>> backEdges;  // Target and pc of each jump back
+    };
+
+    struct Loop {
+        const FunctionProfile* function;
+        size_t start;  // Back edge target
+        size_t end;    // Back edge
+        uint64_t instructions;
+    };
+
+    uint64_t opcodeCounts[kOpCodeCount] = {};
+    uint64_t opcodeTicks[kOpCodeCount] = {};
+    std::vector<uint64_t> pairs = std::vector<uint64_t>(kOpCodeCount * kOpCodeCount, 0);  // [first][second]
+    std::unordered_map<const CompiledFunction*, std::vector<uint64_t>> functions;  // Until finish()
+    std::vector<FunctionProfile> profiles;
+
+    size_t previous = kNone;
+    uint64_t lastTick = 0;
+    uint64_t startTick = 0;
+    uint64_t endTick = 0;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point endTime;
+
+    // Time stamp counter where there is one: much cheaper than the clock
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    uint64_t totalInstructions() const;
+    double ticksToMs(uint64_t ticks) const;
+    std::vector<size_t> hotOpcodes() const;
+    std::vector<std::pair<size_t, uint64_t>> hotPairs(size_t limit) const;  // Pair index, count
+    std::vector<const FunctionProfile*> hotFunctions() const;
+    std::vector<Loop> hotLoops(size_t limit) const;
+    static uint64_t functionInstructions(const FunctionProfile& function);
+};
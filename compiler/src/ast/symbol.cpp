@@ -0,0 +1,26 @@
+#include "../../include/symbol.h"
+
+SymbolTable::SymbolTable() {
+    intern("");  // Reserve ID 0 for the empty string
+}
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+
+uint32_t SymbolTable::intern(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(names.size());
+    names.push_back(name);
+    ids.emplace(names.back(), id);
+    return id;
+}
+
+uint32_t SymbolTable::find(const std::string& name) const {
+    auto it = ids.find(name);
+    return it != ids.end() ? it->second : kNotFound;
+}
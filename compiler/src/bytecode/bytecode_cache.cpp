@@ -0,0 +1,662 @@
+#include "../../include/bytecode_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[4] = {'S', 'F', 'B', 'C'};
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "Instructions are copied as raw bytes");
+
+enum class ConstantTag : uint8_t { Int, Float, String, Bool };
+
+class Writer {
+public:
+    std::string out;
+
+    template <typename T>
+    void scalar(T value) {
+        static_assert(std::is_arithmetic<T>::value, "scalar() writes numbers");
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void string(const std::string& value) {
+        scalar(static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+    void strings(const std::vector<std::string>& values) {
+        scalar(static_cast<uint32_t>(values.size()));
+        for (const auto& value : values) {
+            string(value);
+        }
+    }
+};
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+    template <typename T>
+    T scalar() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+    std::string string() {
+        uint32_t size = scalar<uint32_t>();
+        const char* bytes = take(size);
+        return std::string(bytes, size);
+    }
+    std::vector<std::string> strings() {
+        std::vector<std::string> values(count(sizeof(uint32_t)));
+        for (auto& value : values) {
+            value = string();
+        }
+        return values;
+    }
+    // An element count, checked against the bytes left for elements of at
+    // least `minSize` bytes so a corrupt count cannot trigger a huge allocation
+    uint32_t count(size_t minSize) {
+        uint32_t n = scalar<uint32_t>();
+        if (static_cast<size_t>(end - pos) / minSize < n) {
+            fail("truncated");
+        }
+        return n;
+    }
+    const char* take(size_t size) {
+        if (static_cast<size_t>(end - pos) < size) {
+            fail("truncated");
+        }
+        const char* start = pos;
+        pos += size;
+        return start;
+    }
+    bool atEnd() const { return pos == end; }
+
+    [[noreturn]] static void fail(const std::string& reason) {
+        throw std::runtime_error("Invalid bytecode cache: " + reason);
+    }
+
+private:
+    const char* pos;
+    const char* end;
+};
+
+void writePayload(Writer& w, const BytecodeChunk& chunk) {
+    w.scalar(static_cast<uint32_t>(chunk.constants.size()));
+    for (const auto& constant : chunk.constants) {
+        if (auto* i = std::get_if<int64_t>(&constant)) {
+            w.scalar(static_cast<uint8_t>(ConstantTag::Int));
+            w.scalar(*i);
+        } else if (auto* d = std::get_if<double>(&constant)) {
+            w.scalar(static_cast<uint8_t>(ConstantTag::Float));
+            w.scalar(*d);
+        } else if (auto* s = std::get_if<std::string>(&constant)) {
+            w.scalar(static_cast<uint8_t>(ConstantTag::String));
+            w.string(*s);
+        } else {
+            w.scalar(static_cast<uint8_t>(ConstantTag::Bool));
+            w.scalar(static_cast<uint8_t>(std::get<bool>(constant)));
+        }
+    }
+
+    w.strings(chunk.names);
+
+    w.scalar(static_cast<uint32_t>(chunk.functions.size()));
+    for (const auto& function : chunk.functions) {
+        w.string(function.name);
+        w.strings(function.parameters);
+        w.scalar(static_cast<int32_t>(function.registerCount));
+        w.scalar(static_cast<uint8_t>((function.frameCaptured ? 1 : 0) | (function.usesUpvalues ? 2 : 0)));
+        w.scalar(static_cast<uint32_t>(function.code.size()));
+        for (Instruction instruction : function.code) {
+            instruction.deopts = 0;
+            w.out.append(reinterpret_cast<const char*>(&instruction), sizeof(Instruction));
+        }
+        w.scalar(static_cast<uint32_t>(function.lines.size()));
+        for (const LineRun& run : function.lines) {
+            w.scalar(run.pc);
+            w.scalar(run.line);
+        }
+        w.scalar(static_cast<uint32_t>(function.handlers.size()));
+        for (const ExceptionHandler& handler : function.handlers) {
+            w.scalar(handler.start);
+            w.scalar(handler.end);
+            w.scalar(handler.target);
+            w.scalar(handler.messageRegister);
+        }
+    }
+
+    w.scalar(static_cast<uint32_t>(chunk.memberSites.size()));
+    for (uint32_t site : chunk.memberSites) {
+        w.scalar(site);
+    }
+
+    w.scalar(static_cast<uint32_t>(chunk.mapLayouts.size()));
+    for (const auto& layout : chunk.mapLayouts) {
+        w.scalar(static_cast<uint32_t>(layout.keys.size()));
+        for (int32_t key : layout.keys) {
+            w.scalar(key);
+        }
+    }
+
+    w.scalar(static_cast<uint32_t>(chunk.structs.size()));
+    for (const auto& info : chunk.structs) {
+        w.string(info.name);
+        w.strings(info.fields);
+    }
+
+    w.scalar(static_cast<uint32_t>(chunk.imports.size()));
+    for (const auto& info : chunk.imports) {
+        w.string(info.moduleName);
+        w.string(info.modulePath);
+    }
+}
+
+// The VM trusts compiled code: every operand must stay inside the frame and
+// the tables it indexes, and control must never run off the end of a function
+void checkOperands(const BytecodeChunk& chunk) {
+    for (uint32_t site : chunk.memberSites) {
+        if (site >= chunk.names.size()) {
+            Reader::fail("bad member site");
+        }
+    }
+    for (const auto& layout : chunk.mapLayouts) {
+        for (int32_t key : layout.keys) {
+            if (key >= 0 && static_cast<size_t>(key) >= chunk.names.size()) {
+                Reader::fail("bad map layout");
+            }
+        }
+    }
+
+    // The function each one is declared in, to resolve upvalue depths
+    std::vector<int> declaredIn(chunk.functions.size(), -1);
+    for (size_t f = 0; f < chunk.functions.size(); ++f) {
+        for (const auto& instr : chunk.functions[f].code) {
+            if (instr.opcode != OpCode::DECLARE_FUNCTION) {
+                continue;
+            }
+            uint32_t index = instr.bx();
+            if (index == 0 || index >= chunk.functions.size() ||
+                (declaredIn[index] >= 0 && declaredIn[index] != static_cast<int>(f))) {
+                Reader::fail("bad function declaration");
+            }
+            declaredIn[index] = static_cast<int>(f);
+        }
+    }
+
+    for (size_t f = 0; f < chunk.functions.size(); ++f) {
+        const CompiledFunction& function = chunk.functions[f];
+        auto registers = static_cast<uint32_t>(function.registerCount);
+        auto size = static_cast<uint32_t>(function.code.size());
+        if (function.parameters.size() > registers) {
+            Reader::fail("bad register count");
+        }
+        if (size == 0 || (function.code.back().opcode != OpCode::RETURN &&
+                          function.code.back().opcode != OpCode::JUMP &&
+                          function.code.back().opcode != OpCode::RAISE)) {
+            Reader::fail("function does not end in a jump or return");
+        }
+
+        auto reg = [&](uint32_t first, uint32_t count = 1) {
+            if (first + count > registers) {
+                Reader::fail("bad register operand");
+            }
+        };
+        auto rk = [&](uint16_t operand) {
+            if (operand & kConstantOperand) {
+                if ((operand & kMaxOperand) >= chunk.constants.size()) {
+                    Reader::fail("bad constant operand");
+                }
+            } else {
+                reg(operand);
+            }
+        };
+        auto index = [](uint32_t value, size_t tableSize) {
+            if (value >= tableSize) {
+                Reader::fail("bad table index");
+            }
+        };
+        auto jump = [&](uint32_t target) {
+            if (target >= size) {
+                Reader::fail("bad jump target");
+            }
+        };
+
+        for (uint32_t pc = 0; pc < size; ++pc) {
+            const Instruction& instr = function.code[pc];
+            switch (instr.opcode) {
+                case OpCode::LOAD_CONST:
+                    reg(instr.a);
+                    index(instr.bx(), chunk.constants.size());
+                    break;
+                case OpCode::LOAD_BOOL:
+                case OpCode::LOAD_NULL:
+                case OpCode::LOAD_SELF:
+                case OpCode::INC:
+                case OpCode::DEC:
+                    reg(instr.a);
+                    break;
+                case OpCode::MOVE:
+                    reg(instr.a);
+                    reg(instr.b);
+                    break;
+                case OpCode::CLEAR_LOCALS:
+                    reg(instr.a, instr.b);
+                    break;
+                case OpCode::LOAD_UPVALUE:
+                case OpCode::STORE_UPVALUE: {
+                    reg(instr.a);
+                    // Frame c functions out: each frame on the way is a heap frame
+                    int owner = static_cast<int>(f);
+                    for (uint32_t depth = 0; depth < instr.c && owner >= 0; ++depth) {
+                        owner = declaredIn[owner];
+                        if (owner > 0 && !chunk.functions[owner].frameCaptured) {
+                            owner = -1;
+                        }
+                    }
+                    if (!function.usesUpvalues || instr.c == 0 || owner < 0 ||
+                        instr.b >= static_cast<uint32_t>(chunk.functions[owner].registerCount)) {
+                        Reader::fail("bad upvalue");
+                    }
+                    break;
+                }
+                case OpCode::LOAD_GLOBAL:
+                case OpCode::STORE_GLOBAL:
+                case OpCode::DEFINE_GLOBAL:
+                    reg(instr.a);
+                    index(instr.bx(), chunk.names.size());
+                    break;
+                case OpCode::NEG:
+                case OpCode::NOT:
+                    reg(instr.a);
+                    rk(instr.b);
+                    break;
+                case OpCode::TEST_EQ:
+                case OpCode::TEST_NE:
+                case OpCode::TEST_LT:
+                case OpCode::TEST_GT:
+                case OpCode::TEST_LE:
+                case OpCode::TEST_GE:
+                case OpCode::TEST_EQ_INT:
+                case OpCode::TEST_NE_INT:
+                case OpCode::TEST_LT_INT:
+                case OpCode::TEST_GT_INT:
+                case OpCode::TEST_LE_INT:
+                case OpCode::TEST_GE_INT:
+                    // Skips the next instruction
+                    rk(instr.b);
+                    rk(instr.c);
+                    jump(pc + 2);
+                    break;
+                case OpCode::JUMP:
+                    jump(instr.bx());
+                    break;
+                case OpCode::JUMP_IF_FALSE:
+                case OpCode::JUMP_IF_TRUE:
+                    reg(instr.a);
+                    jump(instr.bx());
+                    break;
+                case OpCode::CALL:
+                    // The result lands in R(a) even without arguments
+                    reg(instr.a, std::max<uint32_t>(instr.c, 1));
+                    index(instr.b, chunk.names.size());
+                    break;
+                case OpCode::RETURN:
+                    rk(instr.a);
+                    break;
+                case OpCode::DECLARE_FUNCTION:
+                    break;
+                case OpCode::MAKE_ARRAY:
+                case OpCode::BUILD_STRING:
+                    reg(instr.a);
+                    reg(instr.b, instr.c);
+                    break;
+                case OpCode::MAKE_MAP: {
+                    reg(instr.a);
+                    index(instr.c, chunk.mapLayouts.size());
+                    // A computed key takes a register of its own before the value
+                    uint32_t entries = 0;
+                    for (int32_t key : chunk.mapLayouts[instr.c].keys) {
+                        entries += key >= 0 ? 1 : 2;
+                    }
+                    reg(instr.b, entries);
+                    break;
+                }
+                case OpCode::INDEX:
+                case OpCode::INDEX_ARRAY_INT:
+                    reg(instr.a);
+                    reg(instr.b);
+                    rk(instr.c);
+                    break;
+                case OpCode::INDEX_SET:
+                    reg(instr.a);
+                    rk(instr.b);
+                    rk(instr.c);
+                    break;
+                case OpCode::GET_MEMBER:
+                    reg(instr.a);
+                    reg(instr.b);
+                    index(instr.c, chunk.memberSites.size());
+                    break;
+                case OpCode::CALL_METHOD:
+                    reg(instr.a, instr.c + 1u);
+                    index(instr.b, chunk.memberSites.size());
+                    break;
+                case OpCode::RAISE:
+                    index(instr.bx(), chunk.constants.size());
+                    if (!std::holds_alternative<std::string>(chunk.constants[instr.bx()])) {
+                        Reader::fail("bad constant operand");
+                    }
+                    break;
+                case OpCode::DEFINE_STRUCT:
+                    index(instr.bx(), chunk.structs.size());
+                    break;
+                case OpCode::IMPORT:
+                    reg(instr.a);
+                    index(instr.bx(), chunk.imports.size());
+                    break;
+                case OpCode::BRANCH_EQ:
+                case OpCode::BRANCH_NE:
+                case OpCode::BRANCH_LT:
+                case OpCode::BRANCH_GT:
+                case OpCode::BRANCH_LE:
+                case OpCode::BRANCH_GE:
+                case OpCode::BRANCH_EQ_INT:
+                case OpCode::BRANCH_NE_INT:
+                case OpCode::BRANCH_LT_INT:
+                case OpCode::BRANCH_GT_INT:
+                case OpCode::BRANCH_LE_INT:
+                case OpCode::BRANCH_GE_INT:
+                    jump(instr.a);
+                    rk(instr.b);
+                    rk(instr.c);
+                    break;
+                case OpCode::INC_BRANCH_LT:
+                    reg(instr.a);
+                    rk(instr.b);
+                    jump(instr.c);
+                    break;
+                default:
+                    // R(a) = RK(b) op RK(c): arithmetic, comparisons and their typed forms
+                    reg(instr.a);
+                    rk(instr.b);
+                    rk(instr.c);
+                    break;
+            }
+        }
+    }
+}
+
+BytecodeChunk readPayload(Reader& r) {
+    BytecodeChunk chunk;
+
+    uint32_t constantCount = r.count(2);
+    chunk.constants.reserve(constantCount);
+    for (uint32_t i = 0; i < constantCount; ++i) {
+        switch (static_cast<ConstantTag>(r.scalar<uint8_t>())) {
+            case ConstantTag::Int: chunk.constants.emplace_back(r.scalar<int64_t>()); break;
+            case ConstantTag::Float: chunk.constants.emplace_back(r.scalar<double>()); break;
+            case ConstantTag::String: chunk.constants.emplace_back(r.string()); break;
+            case ConstantTag::Bool: chunk.constants.emplace_back(r.scalar<uint8_t>() != 0); break;
+            default: Reader::fail("bad constant");
+        }
+    }
+
+    chunk.names = r.strings();
+
+    chunk.functions.resize(r.count(25));
+    for (auto& function : chunk.functions) {
+        function.name = r.string();
+        function.parameters = r.strings();
+        function.registerCount = r.scalar<int32_t>();
+        uint8_t flags = r.scalar<uint8_t>();
+        function.frameCaptured = (flags & 1) != 0;
+        function.usesUpvalues = (flags & 2) != 0;
+        uint32_t codeSize = r.count(sizeof(Instruction));
+        const char* code = r.take(codeSize * sizeof(Instruction));
+        function.code.assign(codeSize, Instruction(OpCode::LOAD_NULL));
+        if (codeSize > 0) {
+            std::memcpy(function.code.data(), code, codeSize * sizeof(Instruction));
+        }
+        for (const auto& instruction : function.code) {
+            // Only the compiler's opcodes: forms the VM quickened are never stored
+            if (instruction.opcode > kLastCompiledOpCode || instruction.deopts != 0) {
+                Reader::fail("bad instruction");
+            }
+        }
+        function.lines.resize(r.count(2 * sizeof(uint32_t)));
+        for (auto& run : function.lines) {
+            run.pc = r.scalar<uint32_t>();
+            run.line = r.scalar<uint32_t>();
+            if (run.pc >= codeSize || (&run != function.lines.data() && run.pc <= (&run - 1)->pc)) {
+                Reader::fail("bad line table");
+            }
+        }
+        function.handlers.resize(r.count(3 * sizeof(uint32_t) + sizeof(uint16_t)));
+        for (auto& handler : function.handlers) {
+            handler.start = r.scalar<uint32_t>();
+            handler.end = r.scalar<uint32_t>();
+            handler.target = r.scalar<uint32_t>();
+            handler.messageRegister = r.scalar<uint16_t>();
+            if (handler.start > handler.end || handler.end > codeSize || handler.target >= codeSize ||
+                handler.messageRegister >= function.registerCount) {
+                Reader::fail("bad handler table");
+            }
+        }
+        if (function.registerCount < 0 || function.registerCount > static_cast<int>(kMaxOperand) + 1) {
+            Reader::fail("bad register count");
+        }
+    }
+    if (chunk.functions.empty()) {
+        Reader::fail("no top-level code");
+    }
+
+    chunk.memberSites.resize(r.count(sizeof(uint32_t)));
+    for (auto& site : chunk.memberSites) {
+        site = r.scalar<uint32_t>();
+    }
+
+    chunk.mapLayouts.resize(r.count(sizeof(uint32_t)));
+    for (auto& layout : chunk.mapLayouts) {
+        layout.keys.resize(r.count(sizeof(int32_t)));
+        for (auto& key : layout.keys) {
+            key = r.scalar<int32_t>();
+        }
+    }
+
+    chunk.structs.resize(r.count(2 * sizeof(uint32_t)));
+    for (auto& info : chunk.structs) {
+        info.name = r.string();
+        info.fields = r.strings();
+    }
+
+    chunk.imports.resize(r.count(2 * sizeof(uint32_t)));
+    for (auto& info : chunk.imports) {
+        info.moduleName = r.string();
+        info.modulePath = r.string();
+    }
+
+    if (!r.atEnd()) {
+        Reader::fail("trailing data");
+    }
+    checkOperands(chunk);
+    return chunk;
+}
+
+std::string hex(uint64_t value) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+}  // namespace
+
+uint64_t hashBytes(const char* data, size_t size, uint64_t seed) {
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string serializeChunk(const BytecodeChunk& chunk, uint64_t sourceHash, const std::string& compilerTag) {
+    Writer payload;
+    writePayload(payload, chunk);
+
+    Writer w;
+    w.out.append(kMagic, sizeof(kMagic));
+    w.scalar(kBytecodeFormatVersion);
+    w.string(compilerTag);
+    w.scalar(sourceHash);
+    w.scalar(static_cast<uint64_t>(payload.out.size()));
+    w.scalar(hashBytes(payload.out.data(), payload.out.size()));
+    w.out += payload.out;
+    return std::move(w.out);
+}
+
+BytecodeChunk deserializeChunk(const char* data, size_t size, uint64_t sourceHash, const std::string& compilerTag) {
+    Reader r(data, size);
+    if (std::memcmp(r.take(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0) {
+        Reader::fail("not a bytecode file");
+    }
+    if (r.scalar<uint32_t>() != kBytecodeFormatVersion) {
+        Reader::fail("format version mismatch");
+    }
+    if (r.string() != compilerTag) {
+        Reader::fail("compiled by a different compiler");
+    }
+    if (r.scalar<uint64_t>() != sourceHash) {
+        Reader::fail("source changed");
+    }
+    uint64_t payloadSize = r.scalar<uint64_t>();
+    uint64_t checksum = r.scalar<uint64_t>();
+    const char* payload = r.take(payloadSize);
+    if (!r.atEnd() || hashBytes(payload, payloadSize) != checksum) {
+        Reader::fail("checksum mismatch");
+    }
+
+    Reader body(payload, payloadSize);
+    return readPayload(body);
+}
+
+// =============================================================================
+// BytecodeCache
+// =============================================================================
+
+BytecodeCache::BytecodeCache(std::string directory, std::string compilerTag)
+    : directory(std::move(directory)), compilerTag(std::move(compilerTag)) {}
+
+std::string BytecodeCache::defaultDirectory() {
+    if (const char* dir = std::getenv("SYNTHFLOW_CACHE_DIR")) {
+        return dir;
+    }
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg) + "/synthflow";
+    }
+    #ifdef _WIN32
+    const char* home = std::getenv("LOCALAPPDATA");
+    #else
+    const char* home = std::getenv("HOME");
+    #endif
+    if (home) {
+        return std::string(home) + "/.cache/synthflow";
+    }
+    return ".synthflow_cache";
+}
+
+uint64_t BytecodeCache::sourceHash(const std::string& source) const {
+    return hashBytes(source.data(), source.size());
+}
+
+std::string BytecodeCache::entryPath(const std::string& source) const {
+    // The compiler tag is part of the key: different versions or options
+    // never overwrite each other's entries
+    uint64_t key = hashBytes(compilerTag.data(), compilerTag.size(), sourceHash(source));
+    return directory + "/" + hex(key) + ".sfc";
+}
+
+std::optional<BytecodeChunk> BytecodeCache::load(const std::string& source) const {
+    std::string path = entryPath(source);
+    try {
+        #ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return std::nullopt;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string data = buffer.str();
+        return deserializeChunk(data.data(), data.size(), sourceHash(source), compilerTag);
+        #else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return std::nullopt;
+        }
+        try {
+            BytecodeChunk chunk = deserializeChunk(static_cast<const char*>(mapped), size, sourceHash(source), compilerTag);
+            ::munmap(mapped, size);
+            return chunk;
+        } catch (...) {
+            ::munmap(mapped, size);
+            throw;
+        }
+        #endif
+    } catch (const std::runtime_error&) {
+        // Stale or damaged: recompile, and let store() replace it
+        return std::nullopt;
+    }
+}
+
+void BytecodeCache::store(const std::string& source, const BytecodeChunk& chunk) const {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        return;
+    }
+
+    std::string path = entryPath(source);
+    std::string temp = path + "." + std::to_string(getpid()) + ".tmp";
+    std::string data = serializeChunk(chunk, sourceHash(source), compilerTag);
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+            file.close();
+            std::filesystem::remove(temp, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        std::filesystem::remove(temp, error);
+    }
+}
@@ -1,280 +1,906 @@
 #include "../../include/bytecode_compiler.h"
+#include "../../include/bytecode_peephole.h"
+#include <algorithm>
 #include <stdexcept>
 
-uint32_t BytecodeCompiler::resolveVariable(const std::string& name) {
-    if (inFunction) {
-        auto it = localVariables.find(name);
-        if (it != localVariables.end()) {
-            return it->second;
+namespace {
+
+// Comparisons that compile to a conditional test when used as a condition
+bool testOpcode(BinaryOp op, OpCode& opcode) {
+    switch (op) {
+        case BinaryOp::Eq: opcode = OpCode::TEST_EQ; return true;
+        case BinaryOp::Ne: opcode = OpCode::TEST_NE; return true;
+        case BinaryOp::Lt: opcode = OpCode::TEST_LT; return true;
+        case BinaryOp::Gt: opcode = OpCode::TEST_GT; return true;
+        case BinaryOp::Le: opcode = OpCode::TEST_LE; return true;
+        case BinaryOp::Ge: opcode = OpCode::TEST_GE; return true;
+        default: return false;
+    }
+}
+
+// The quickened form of `op` for operands the TypeSpecializer inferred, or
+// `op` itself. Its guard reverts the instruction if they turn out otherwise.
+OpCode specialized(OpCode op, BinaryExpression::OperandTypes types) {
+    using OperandTypes = BinaryExpression::OperandTypes;
+    if (types == OperandTypes::IntInt) {
+        switch (op) {
+            case OpCode::ADD: return OpCode::ADD_INT;
+            case OpCode::SUB: return OpCode::SUB_INT;
+            case OpCode::MUL: return OpCode::MUL_INT;
+            case OpCode::MOD: return OpCode::MOD_INT;
+            case OpCode::EQ: return OpCode::EQ_INT;
+            case OpCode::NE: return OpCode::NE_INT;
+            case OpCode::LT: return OpCode::LT_INT;
+            case OpCode::GT: return OpCode::GT_INT;
+            case OpCode::LE: return OpCode::LE_INT;
+            case OpCode::GE: return OpCode::GE_INT;
+            case OpCode::TEST_EQ: return OpCode::TEST_EQ_INT;
+            case OpCode::TEST_NE: return OpCode::TEST_NE_INT;
+            case OpCode::TEST_LT: return OpCode::TEST_LT_INT;
+            case OpCode::TEST_GT: return OpCode::TEST_GT_INT;
+            case OpCode::TEST_LE: return OpCode::TEST_LE_INT;
+            case OpCode::TEST_GE: return OpCode::TEST_GE_INT;
+            default: return op;
         }
     }
-    auto it = globalVariables.find(name);
-    if (it != globalVariables.end()) {
+    if (types == OperandTypes::FloatFloat) {
+        switch (op) {
+            case OpCode::ADD: return OpCode::ADD_FLOAT;
+            case OpCode::SUB: return OpCode::SUB_FLOAT;
+            case OpCode::MUL: return OpCode::MUL_FLOAT;
+            case OpCode::DIV: return OpCode::DIV_FLOAT;
+            default: return op;
+        }
+    }
+    return op;
+}
+
+}  // namespace
+
+size_t BytecodeCompiler::emit(OpCode op, uint16_t a, uint16_t b, uint16_t c) {
+    auto& function = currentFunction();
+    auto pc = static_cast<uint32_t>(function.code.size());
+    auto& lines = function.lines;
+    if (lines.empty() || lines.back().line != line) {
+        if (!lines.empty() && lines.back().pc == pc) {
+            lines.pop_back();
+        }
+        if (lines.empty() || lines.back().line != line) {
+            lines.push_back({pc, line});
+        }
+    }
+    function.code.push_back(Instruction(op, a, b, c));
+    return pc;
+}
+
+size_t BytecodeCompiler::emitBx(OpCode op, uint16_t a, uint32_t bx) {
+    size_t offset = emit(op, a);
+    currentFunction().code[offset].setBx(bx);
+    return offset;
+}
+
+uint32_t BytecodeCompiler::nameIndex(const std::string& name) {
+    auto it = nameIndices.find(name);
+    if (it != nameIndices.end()) {
         return it->second;
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    uint32_t index = static_cast<uint32_t>(chunk.names.size());
+    chunk.names.push_back(name);
+    nameIndices[name] = index;
+    return index;
+}
+
+uint16_t BytecodeCompiler::narrow(size_t value, const char* what) {
+    if (value > 0xFFFF) {
+        throw std::runtime_error(std::string("Too many ") + what + " in one module");
+    }
+    return static_cast<uint16_t>(value);
+}
+
+uint16_t BytecodeCompiler::checkRegister(int reg) {
+    if (reg > static_cast<int>(kMaxOperand)) {
+        throw std::runtime_error("Function '" + currentFunction().name + "' needs too many registers");
+    }
+    auto& compiled = currentFunction();
+    compiled.registerCount = std::max(compiled.registerCount, reg + 1);
+    return static_cast<uint16_t>(reg);
+}
+
+uint16_t BytecodeCompiler::allocTemps(int count) {
+    FunctionState& fn = functions.back();
+    int first = fn.nextSlot + fn.temps;
+    fn.temps += count;
+    if (count > 0) {
+        checkRegister(first + count - 1);
+    }
+    return static_cast<uint16_t>(first);
 }
 
-uint32_t BytecodeCompiler::declareVariable(const std::string& name) {
-    if (inFunction) {
-        uint32_t index = nextLocalIndex++;
-        localVariables[name] = index;
-        return index;
+bool BytecodeCompiler::isTemp(uint16_t operand) const {
+    return !(operand & kConstantOperand) && operand >= functions.back().nextSlot;
+}
+
+uint16_t BytecodeCompiler::destination() {
+    return target >= 0 ? static_cast<uint16_t>(target) : allocTemp();
+}
+
+void BytecodeCompiler::setResult(uint16_t operand) {
+    if (target >= 0 && operand != target) {
+        moveTo(static_cast<uint16_t>(target), operand);
+        result = static_cast<uint16_t>(target);
+    } else if (target == kAnyRegister && (operand & kConstantOperand)) {
+        result = allocTemp();
+        moveTo(result, operand);
     } else {
-        uint32_t index = static_cast<uint32_t>(globalVariables.size());
-        globalVariables[name] = index;
-        return index;
+        result = operand;
     }
 }
 
-BytecodeChunk BytecodeCompiler::compile(const std::vector<std::unique_ptr<Statement>>& statements) {
-    chunk = BytecodeChunk();
-    
+void BytecodeCompiler::setConstantResult(const ConstantValue& value) {
+    uint32_t index = constantIndex(value);
+    if (index > kMaxOperand) {
+        // Out of RK range: load it like any other value
+        result = destination();
+        emitBx(OpCode::LOAD_CONST, result, index);
+        return;
+    }
+    setResult(static_cast<uint16_t>(index | kConstantOperand));
+}
+
+void BytecodeCompiler::moveTo(uint16_t reg, uint16_t operand) {
+    if (operand & kConstantOperand) {
+        emitBx(OpCode::LOAD_CONST, reg, operand & kMaxOperand);
+    } else if (operand != reg) {
+        emit(OpCode::MOVE, reg, operand);
+    }
+}
+
+uint16_t BytecodeCompiler::compileExpression(Expression* expr, int where) {
+    int saved = target;
+    target = where;
+    expr->accept(*this);
+    target = saved;
+    return result;
+}
+
+void BytecodeCompiler::compileInto(Expression* expr, uint16_t reg) {
+    uint16_t operand = compileExpression(expr, reg);
+    moveTo(reg, operand);
+}
+
+uint16_t BytecodeCompiler::compileOperandBefore(Expression* expr, bool laterIsPure, bool needRegister) {
+    uint16_t operand = compileExpression(expr, needRegister ? kAnyRegister : kAnyOperand);
+    if (!laterIsPure && !(operand & kConstantOperand) && !isTemp(operand)) {
+        uint16_t copy = allocTemp();
+        emit(OpCode::MOVE, copy, operand);
+        return copy;
+    }
+    return operand;
+}
+
+// Expressions that cannot assign to a variable or run user code
+bool BytecodeCompiler::isPure(Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+        case NodeKind::FloatLiteral:
+        case NodeKind::StringLiteral:
+        case NodeKind::BooleanLiteral:
+        case NodeKind::NullLiteral:
+        case NodeKind::Identifier:
+        case NodeKind::SelfExpression:
+        case NodeKind::LambdaExpression:
+            return true;
+        case NodeKind::BinaryExpression: {
+            auto* binary = static_cast<BinaryExpression*>(expr);
+            return isPure(binary->left.get()) && isPure(binary->right.get());
+        }
+        case NodeKind::UnaryExpression:
+            return isPure(static_cast<UnaryExpression*>(expr)->operand.get());
+        case NodeKind::MemberExpression:
+            return isPure(static_cast<MemberExpression*>(expr)->object.get());
+        case NodeKind::ArrayIndexExpression: {
+            auto* index = static_cast<ArrayIndexExpression*>(expr);
+            return isPure(index->array.get()) && isPure(index->index.get());
+        }
+        default:
+            return false;
+    }
+}
+
+size_t BytecodeCompiler::compileCondition(Expression* condition) {
+    int mark = functions.back().temps;
+    size_t jump = kNoJump;
+
+    OpCode test;
+    if (condition->kind == NodeKind::BooleanLiteral && static_cast<BooleanLiteral*>(condition)->value) {
+        // Always true: nothing to test
+    } else if (condition->kind == NodeKind::BinaryExpression &&
+               testOpcode(static_cast<BinaryExpression*>(condition)->binaryOp, test)) {
+        auto* binary = static_cast<BinaryExpression*>(condition);
+        uint16_t left = compileOperandBefore(binary->left.get(), isPure(binary->right.get()));
+        uint16_t right = compileOperand(binary->right.get());
+        emit(specialized(test, binary->operandTypes), 0, left, right);
+        jump = emitBx(OpCode::JUMP, 0, 0);
+    } else if (condition->kind == NodeKind::UnaryExpression &&
+               static_cast<UnaryExpression*>(condition)->unaryOp == UnaryOp::Not) {
+        uint16_t operand = compileRegister(static_cast<UnaryExpression*>(condition)->operand.get());
+        jump = emitBx(OpCode::JUMP_IF_TRUE, operand, 0);
+    } else {
+        uint16_t operand = compileRegister(condition);
+        jump = emitBx(OpCode::JUMP_IF_FALSE, operand, 0);
+    }
+
+    releaseTemps(mark);
+    return jump;
+}
+
+void BytecodeCompiler::beginScope(int frameSize, bool captured) {
+    FunctionState& fn = functions.back();
+    scopes.push_back({functions.size() - 1, fn.nextSlot});
+    fn.nextSlot += frameSize;
+    if (frameSize > 0) {
+        checkRegister(fn.nextSlot - 1);
+    }
+
+    // A closure may observe the scope's slots, which the tree-walker would
+    // have given a fresh frame each time it is entered
+    if (captured && frameSize > 0) {
+        emit(OpCode::CLEAR_LOCALS, static_cast<uint16_t>(scopes.back().base), static_cast<uint16_t>(frameSize));
+    }
+}
+
+int BytecodeCompiler::localRegister(int depth, int slot) {
+    if (depth < 0) {
+        return -1;
+    }
+    const Scope& scope = scopes[scopes.size() - 1 - static_cast<size_t>(depth)];
+    if (scope.function != functions.size() - 1) {
+        return -1;
+    }
+    return scope.base + slot;
+}
+
+void BytecodeCompiler::emitLoad(uint16_t reg, int depth, int slot, const std::string& name) {
+    if (depth < 0) {
+        emitBx(OpCode::LOAD_GLOBAL, reg, nameIndex(name));
+        return;
+    }
+    const Scope& scope = scopes[scopes.size() - 1 - static_cast<size_t>(depth)];
+    auto index = static_cast<uint16_t>(scope.base + slot);
+    size_t hops = functions.size() - 1 - scope.function;
+    if (hops == 0) {
+        moveTo(reg, index);
+    } else {
+        currentFunction().usesUpvalues = true;
+        emit(OpCode::LOAD_UPVALUE, reg, index, static_cast<uint16_t>(hops));
+    }
+}
+
+void BytecodeCompiler::emitStore(uint16_t reg, int depth, int slot, const std::string& name) {
+    if (depth < 0) {
+        emitBx(OpCode::STORE_GLOBAL, reg, nameIndex(name));
+        return;
+    }
+    const Scope& scope = scopes[scopes.size() - 1 - static_cast<size_t>(depth)];
+    auto index = static_cast<uint16_t>(scope.base + slot);
+    size_t hops = functions.size() - 1 - scope.function;
+    if (hops == 0) {
+        moveTo(index, reg);
+    } else {
+        currentFunction().usesUpvalues = true;
+        emit(OpCode::STORE_UPVALUE, reg, index, static_cast<uint16_t>(hops));
+    }
+}
+
+void BytecodeCompiler::emitDefine(uint16_t reg, int slot, const std::string& name) {
+    if (slot < 0) {
+        emitBx(OpCode::DEFINE_GLOBAL, reg, nameIndex(name));
+        return;
+    }
+    moveTo(static_cast<uint16_t>(scopes.back().base + slot), reg);
+}
+
+void BytecodeCompiler::emitRaise(const std::string& message) {
+    emitBx(OpCode::RAISE, 0, constantIndex(message));
+    // Never reached; gives the expression a register
+    result = destination();
+}
+
+void BytecodeCompiler::emitReturnNull() {
+    uint16_t reg = allocTemp();
+    emit(OpCode::LOAD_NULL, reg);
+    emit(OpCode::RETURN, reg);
+}
+
+void BytecodeCompiler::compileStatement(Statement* statement) {
+    // Temporaries do not outlive the statement that needed them
+    int mark = functions.back().temps;
+    // Code emitted after a nested statement, like a loop's back edge,
+    // belongs to the enclosing one
+    uint32_t enclosing = line;
+    if (statement->line > 0) {
+        line = statement->line;
+    }
+    statement->accept(*this);
+    line = enclosing;
+    releaseTemps(mark);
+}
+
+void BytecodeCompiler::compileStatements(const std::vector<std::unique_ptr<Statement>>& statements) {
     for (const auto& stmt : statements) {
-        stmt->accept(*this);
+        compileStatement(stmt.get());
     }
-    
-    chunk.emit(OpCode::HALT);
-    return chunk;
 }
 
+
+BytecodeChunk BytecodeCompiler::compile(const std::vector<std::unique_ptr<Statement>>& statements) {
+    chunk = BytecodeChunk();
+    functions.clear();
+    scopes.clear();
+    nameIndices.clear();
+
+    // Top-level code is function 0; its locals are those of top-level blocks
+    CompiledFunction main;
+    main.name = "<main>";
+    main.frameCaptured = true;
+    chunk.functions.push_back(std::move(main));
+    functions.emplace_back(0);
+
+    compileStatements(statements);
+    emitReturnNull();
+
+    functions.clear();
+    optimizePeephole(chunk);
+    return std::move(chunk);
+}
+
+// Literals: RK constants where an operand will do
 void BytecodeCompiler::visit(IntegerLiteral* node) {
-    uint32_t index = chunk.addConstant(node->value);
-    chunk.emit(OpCode::PUSH_INT, index);
+    setConstantResult(node->value);
 }
 
 void BytecodeCompiler::visit(FloatLiteral* node) {
-    uint32_t index = chunk.addConstant(node->value);
-    chunk.emit(OpCode::PUSH_FLOAT, index);
+    setConstantResult(node->value);
 }
 
 void BytecodeCompiler::visit(StringLiteral* node) {
-    uint32_t index = chunk.addConstant(node->value);
-    chunk.emit(OpCode::PUSH_STRING, index);
+    setConstantResult(node->value);
 }
 
 void BytecodeCompiler::visit(BooleanLiteral* node) {
-    uint32_t index = chunk.addConstant(node->value);
-    chunk.emit(OpCode::PUSH_BOOL, index);
+    result = destination();
+    emit(OpCode::LOAD_BOOL, result, node->value ? 1 : 0);
 }
 
 void BytecodeCompiler::visit(NullLiteral* node) {
     (void)node;
-    chunk.emit(OpCode::PUSH_NULL);
+    result = destination();
+    emit(OpCode::LOAD_NULL, result);
 }
 
 void BytecodeCompiler::visit(Identifier* node) {
-    uint32_t index = resolveVariable(node->name);
-    if (inFunction) {
-        chunk.emit(OpCode::LOAD_VAR, index);
-    } else {
-        chunk.emit(OpCode::LOAD_GLOBAL, index);
+    int local = localRegister(node->depth, node->slot);
+    if (local >= 0) {
+        setResult(static_cast<uint16_t>(local));
+        return;
     }
+    result = destination();
+    emitLoad(result, node->depth, node->slot, node->name);
 }
 
 void BytecodeCompiler::visit(BinaryExpression* node) {
-    node->left->accept(*this);
-    node->right->accept(*this);
-    
-    if (node->op == "+") chunk.emit(OpCode::ADD);
-    else if (node->op == "-") chunk.emit(OpCode::SUB);
-    else if (node->op == "*") chunk.emit(OpCode::MUL);
-    else if (node->op == "/") chunk.emit(OpCode::DIV);
-    else if (node->op == "%") chunk.emit(OpCode::MOD);
-    else if (node->op == "==") chunk.emit(OpCode::EQ);
-    else if (node->op == "!=") chunk.emit(OpCode::NE);
-    else if (node->op == "<") chunk.emit(OpCode::LT);
-    else if (node->op == ">") chunk.emit(OpCode::GT);
-    else if (node->op == "<=") chunk.emit(OpCode::LE);
-    else if (node->op == ">=") chunk.emit(OpCode::GE);
-    else if (node->op == "&&" || node->op == "and") chunk.emit(OpCode::AND);
-    else if (node->op == "||" || node->op == "or") chunk.emit(OpCode::OR);
+    OpCode op;
+    switch (node->binaryOp) {
+        case BinaryOp::Add: op = OpCode::ADD; break;
+        case BinaryOp::Sub: op = OpCode::SUB; break;
+        case BinaryOp::Mul: op = OpCode::MUL; break;
+        case BinaryOp::Div: op = OpCode::DIV; break;
+        case BinaryOp::Mod: op = OpCode::MOD; break;
+        case BinaryOp::Eq:  op = OpCode::EQ; break;
+        case BinaryOp::Ne:  op = OpCode::NE; break;
+        case BinaryOp::Lt:  op = OpCode::LT; break;
+        case BinaryOp::Gt:  op = OpCode::GT; break;
+        case BinaryOp::Le:  op = OpCode::LE; break;
+        case BinaryOp::Ge:  op = OpCode::GE; break;
+        case BinaryOp::And: op = OpCode::AND; break;
+        case BinaryOp::Or:  op = OpCode::OR; break;
+        default:
+            compileExpression(node->left.get(), kDiscard);
+            compileExpression(node->right.get(), kDiscard);
+            emitRaise("Unknown binary operator: " + node->op);
+            return;
+    }
+
+    // Both operands are always evaluated: && and || do not short-circuit
+    int mark = functions.back().temps;
+    uint16_t left = compileOperandBefore(node->left.get(), isPure(node->right.get()));
+    uint16_t right = compileOperand(node->right.get());
+    releaseTemps(mark);
+    result = destination();
+    emit(specialized(op, node->operandTypes), result, left, right);
 }
 
 void BytecodeCompiler::visit(UnaryExpression* node) {
-    node->operand->accept(*this);
-    
-    if (node->op == "-") chunk.emit(OpCode::NEG);
-    else if (node->op == "!" || node->op == "not") chunk.emit(OpCode::NOT);
+    int mark = functions.back().temps;
+    uint16_t operand = compileOperand(node->operand.get());
+    releaseTemps(mark);
+
+    switch (node->unaryOp) {
+        case UnaryOp::Neg: result = destination(); emit(OpCode::NEG, result, operand); break;
+        case UnaryOp::Not: result = destination(); emit(OpCode::NOT, result, operand); break;
+        case UnaryOp::Unknown: emitRaise("Unknown unary operator: " + node->op); break;
+    }
 }
 
 void BytecodeCompiler::visit(AssignmentExpression* node) {
-    node->right->accept(*this);
-    
-    if (auto* id = dynamic_cast<Identifier*>(node->left.get())) {
-        uint32_t index = resolveVariable(id->name);
-        if (inFunction) {
-            chunk.emit(OpCode::STORE_VAR, index);
-        } else {
-            chunk.emit(OpCode::STORE_GLOBAL, index);
-        }
+    if (node->depth < 0 && node->left->kind != NodeKind::Identifier) {
+        compileExpression(node->right.get(), kDiscard);
+        emitRaise("Invalid assignment target");
+        return;
     }
+    const std::string& name = static_cast<Identifier*>(node->left.get())->name;
+
+    int local = localRegister(node->depth, node->slot);
+    if (local >= 0) {
+        compileInto(node->right.get(), static_cast<uint16_t>(local));
+        setResult(static_cast<uint16_t>(local));
+        return;
+    }
+    uint16_t value = destination();
+    compileInto(node->right.get(), value);
+    emitStore(value, node->depth, node->slot, name);
+    result = value;
 }
 
 void BytecodeCompiler::visit(CallExpression* node) {
-    // Push arguments
-    for (auto& arg : node->arguments) {
-        arg->accept(*this);
+    // Arguments go in consecutive registers; the result replaces the first
+    int mark = functions.back().temps;
+    int argc = static_cast<int>(node->arguments.size());
+    uint16_t base = allocTemps(std::max(argc, 1));
+    for (int i = 0; i < argc; ++i) {
+        compileInto(node->arguments[static_cast<size_t>(i)].get(), static_cast<uint16_t>(base + i));
     }
-    
-    // Emit call with argument count
-    uint32_t argCount = static_cast<uint32_t>(node->arguments.size());
-    chunk.emit(OpCode::CALL, argCount);
+
+    // The callee is resolved by name at runtime (user functions, then builtins)
+    emit(OpCode::CALL, base, narrow(nameIndex(node->callee), "names"), narrow(node->arguments.size(), "arguments"));
+    releaseTemps(mark + 1);
+    setResult(base);
 }
 
 void BytecodeCompiler::visit(ArrayLiteral* node) {
-    for (auto& elem : node->elements) {
-        elem->accept(*this);
+    int mark = functions.back().temps;
+    int count = static_cast<int>(node->elements.size());
+    uint16_t base = allocTemps(count);
+    for (int i = 0; i < count; ++i) {
+        compileInto(node->elements[static_cast<size_t>(i)].get(), static_cast<uint16_t>(base + i));
     }
-    chunk.emit(OpCode::MAKE_ARRAY, static_cast<uint32_t>(node->elements.size()));
+    releaseTemps(mark);
+    result = destination();
+    emit(OpCode::MAKE_ARRAY, result, base, narrow(node->elements.size(), "array elements"));
 }
 
 void BytecodeCompiler::visit(ArrayIndexExpression* node) {
-    node->array->accept(*this);
-    node->index->accept(*this);
-    chunk.emit(OpCode::INDEX);
+    int mark = functions.back().temps;
+    uint16_t array = compileOperandBefore(node->array.get(), isPure(node->index.get()), true);
+    uint16_t index = compileOperand(node->index.get());
+    releaseTemps(mark);
+    result = destination();
+    emit(node->arrayIntIndex ? OpCode::INDEX_ARRAY_INT : OpCode::INDEX, result, array, index);
 }
 
 void BytecodeCompiler::visit(ArrayAssignmentExpression* node) {
-    node->array->accept(*this);
-    node->index->accept(*this);
-    node->value->accept(*this);
-    chunk.emit(OpCode::INDEX_SET);
+    bool valueIsPure = isPure(node->value.get());
+    uint16_t array = compileOperandBefore(node->array.get(), isPure(node->index.get()) && valueIsPure, true);
+    uint16_t index = compileOperandBefore(node->index.get(), valueIsPure);
+    uint16_t value = compileOperand(node->value.get());
+    emit(OpCode::INDEX_SET, array, index, value);
+    setResult(value);
 }
 
-void BytecodeCompiler::visit(VariableDeclaration* node) {
-    if (node->initializer) {
-        node->initializer->accept(*this);
+void BytecodeCompiler::visit(LambdaExpression* node) {
+    // Lambdas are not callable yet; like the interpreter, they evaluate to a placeholder
+    (void)node;
+    setConstantResult(std::string("<lambda>"));
+}
+
+void BytecodeCompiler::visit(MatchExpression* node) {
+    // The subject is evaluated once, before any pattern
+    bool patternsArePure = true;
+    for (auto& matchCase : node->cases) {
+        if (matchCase.pattern && !isPure(matchCase.pattern.get())) {
+            patternsArePure = false;
+        }
+    }
+    uint16_t subject = compileOperandBefore(node->subject.get(), patternsArePure);
+    uint16_t dest = destination();
+
+    std::vector<size_t> endJumps;
+    bool hasDefault = false;
+    for (auto& matchCase : node->cases) {
+        size_t nextCase = 0;
+        if (matchCase.pattern) {
+            int mark = functions.back().temps;
+            uint16_t pattern = compileOperand(matchCase.pattern.get());
+            uint16_t matched = allocTemp();
+            emit(OpCode::MATCH, matched, subject, pattern);
+            nextCase = emitBx(OpCode::JUMP_IF_FALSE, matched, 0);
+            releaseTemps(mark);
+        }
+        compileInto(matchCase.result.get(), dest);
+        endJumps.push_back(emitBx(OpCode::JUMP, 0, 0));
+        if (!matchCase.pattern) {
+            hasDefault = true;
+            break;  // Later cases are unreachable
+        }
+        patchJump(nextCase);
+    }
+
+    // No match found
+    if (!hasDefault) {
+        emit(OpCode::LOAD_NULL, dest);
+    }
+    for (size_t jump : endJumps) {
+        patchJump(jump);
+    }
+    result = dest;
+}
+
+void BytecodeCompiler::visit(CompoundAssignment* node) {
+    if (node->target->kind != NodeKind::Identifier) {
+        emitRaise("Compound assignment target must be an identifier");
+        return;
+    }
+    const std::string& name = static_cast<Identifier*>(node->target.get())->name;
+
+    OpCode op;
+    switch (node->binaryOp) {
+        case BinaryOp::Add: op = OpCode::COMPOUND_ADD; break;
+        case BinaryOp::Sub: op = OpCode::COMPOUND_SUB; break;
+        case BinaryOp::Mul: op = OpCode::COMPOUND_MUL; break;
+        case BinaryOp::Div: op = OpCode::COMPOUND_DIV; break;
+        default: op = OpCode::LOAD_NULL; break;  // Other operators yield null
+    }
+
+    // The current value is read before the right-hand side is evaluated
+    int local = localRegister(node->depth, node->slot);
+    if (local >= 0) {
+        auto reg = static_cast<uint16_t>(local);
+        uint16_t current = reg;
+        if (!isPure(node->value.get())) {
+            current = allocTemp();
+            emit(OpCode::MOVE, current, reg);
+        }
+        uint16_t value = compileOperand(node->value.get());
+        emit(op, reg, current, value);
+        setResult(reg);
+        return;
+    }
+
+    uint16_t current = destination();
+    emitLoad(current, node->depth, node->slot, name);
+    uint16_t value = compileOperand(node->value.get());
+    emit(op, current, current, value);
+    emitStore(current, node->depth, node->slot, name);
+    result = current;
+}
+
+void BytecodeCompiler::visit(UpdateExpression* node) {
+    if (node->operand->kind != NodeKind::Identifier) {
+        emitRaise("Update expression operand must be an identifier");
+        return;
+    }
+    const std::string& name = static_cast<Identifier*>(node->operand.get())->name;
+    OpCode op = node->increment ? OpCode::INC : OpCode::DEC;
+    bool keepOld = !node->prefix && target != kDiscard;  // Postfix leaves the old value
+
+    int local = localRegister(node->depth, node->slot);
+    if (local >= 0) {
+        auto reg = static_cast<uint16_t>(local);
+        if (!keepOld) {
+            emit(op, reg);
+            setResult(reg);
+            return;
+        }
+        result = target >= 0 && target != reg ? static_cast<uint16_t>(target) : allocTemp();
+        emit(OpCode::MOVE, result, reg);
+        emit(op, reg);
+        return;
+    }
+
+    uint16_t current = destination();
+    emitLoad(current, node->depth, node->slot, name);
+    if (!keepOld) {
+        emit(op, current);
+        emitStore(current, node->depth, node->slot, name);
     } else {
-        chunk.emit(OpCode::PUSH_NULL);
+        uint16_t updated = allocTemp();
+        emit(OpCode::MOVE, updated, current);
+        emit(op, updated);
+        emitStore(updated, node->depth, node->slot, name);
+    }
+    result = current;
+}
+
+void BytecodeCompiler::visit(InterpolatedString* node) {
+    int mark = functions.back().temps;
+    uint16_t base = allocTemps(static_cast<int>(node->parts.size()));
+    for (size_t i = 0; i < node->parts.size(); ++i) {
+        auto& part = node->parts[i];
+        auto reg = static_cast<uint16_t>(base + i);
+        if (part.isExpression) {
+            compileInto(part.expr.get(), reg);
+        } else {
+            emitBx(OpCode::LOAD_CONST, reg, constantIndex(part.text));
+        }
     }
-    
-    uint32_t index = declareVariable(node->name);
-    if (inFunction) {
-        chunk.emit(OpCode::STORE_VAR, index);
+    releaseTemps(mark);
+    result = destination();
+    emit(OpCode::BUILD_STRING, result, base, narrow(node->parts.size(), "interpolation parts"));
+}
+
+// SADK expressions
+void BytecodeCompiler::visit(MapLiteral* node) {
+    int mark = functions.back().temps;
+    MapLayout layout;
+    int count = 0;
+    for (size_t i = 0; i < node->entries.size(); ++i) {
+        count += node->keySymbols[i].empty() ? 2 : 1;
+    }
+    uint16_t base = allocTemps(count);
+    auto reg = base;
+    for (size_t i = 0; i < node->entries.size(); ++i) {
+        auto& entry = node->entries[i];
+        if (node->keySymbols[i].empty()) {
+            compileInto(entry.first.get(), reg++);
+            layout.keys.push_back(-1);
+        } else {
+            layout.keys.push_back(static_cast<int32_t>(nameIndex(node->keySymbols[i].str())));
+        }
+        compileInto(entry.second.get(), reg++);
+    }
+    chunk.mapLayouts.push_back(std::move(layout));
+    releaseTemps(mark);
+    result = destination();
+    emit(OpCode::MAKE_MAP, result, base, narrow(chunk.mapLayouts.size() - 1, "map literals"));
+}
+
+void BytecodeCompiler::visit(MemberExpression* node) {
+    int mark = functions.back().temps;
+    uint16_t object = compileRegister(node->object.get());
+    releaseTemps(mark);
+    chunk.memberSites.push_back(nameIndex(node->member));
+    result = destination();
+    emit(OpCode::GET_MEMBER, result, object, narrow(chunk.memberSites.size() - 1, "member accesses"));
+}
+
+void BytecodeCompiler::visit(MethodCallExpression* node) {
+    // The receiver and the arguments go in consecutive registers; the result replaces the receiver
+    int mark = functions.back().temps;
+    uint16_t base = allocTemps(static_cast<int>(node->arguments.size()) + 1);
+    compileInto(node->object.get(), base);
+    for (size_t i = 0; i < node->arguments.size(); ++i) {
+        compileInto(node->arguments[i].get(), static_cast<uint16_t>(base + 1 + i));
+    }
+    chunk.memberSites.push_back(nameIndex(node->method));
+    emit(OpCode::CALL_METHOD, base, narrow(chunk.memberSites.size() - 1, "member accesses"),
+         narrow(node->arguments.size(), "arguments"));
+    releaseTemps(mark + 1);
+    setResult(base);
+}
+
+void BytecodeCompiler::visit(SelfExpression* node) {
+    (void)node;
+    result = destination();
+    emit(OpCode::LOAD_SELF, result);
+}
+
+// Statements
+void BytecodeCompiler::visit(VariableDeclaration* node) {
+    if (node->slot >= 0) {
+        auto reg = static_cast<uint16_t>(scopes.back().base + node->slot);
+        if (node->initializer) {
+            compileInto(node->initializer.get(), reg);
+        } else {
+            emit(OpCode::LOAD_NULL, reg);
+        }
+        return;
+    }
+
+    uint16_t value;
+    if (node->initializer) {
+        value = compileRegister(node->initializer.get());
     } else {
-        chunk.emit(OpCode::STORE_GLOBAL, index);
+        value = allocTemp();
+        emit(OpCode::LOAD_NULL, value);
     }
+    emitDefine(value, node->slot, node->name);
 }
 
 void BytecodeCompiler::visit(ExpressionStatement* node) {
-    node->expression->accept(*this);
-    chunk.emit(OpCode::POP);
+    compileExpression(node->expression.get(), kDiscard);
 }
 
 void BytecodeCompiler::visit(BlockStatement* node) {
-    for (auto& stmt : node->statements) {
-        stmt->accept(*this);
+    // Blocks that declare nothing have no scope of their own
+    if (node->frameSize == 0) {
+        compileStatements(node->statements);
+        return;
     }
+    beginScope(node->frameSize, node->frameCaptured);
+    compileStatements(node->statements);
+    endScope();
 }
 
 void BytecodeCompiler::visit(IfStatement* node) {
-    node->condition->accept(*this);
-    
-    size_t jumpIfFalse = chunk.emit(OpCode::JUMP_IF_FALSE, 0);
-    
-    node->thenBranch->accept(*this);
-    
+    size_t jumpIfFalse = compileCondition(node->condition.get());
+
+    compileStatement(node->thenBranch.get());
+
     if (node->elseBranch) {
-        size_t jumpOver = chunk.emit(OpCode::JUMP, 0);
-        chunk.patchJump(jumpIfFalse, static_cast<uint32_t>(chunk.code.size()));
-        node->elseBranch->accept(*this);
-        chunk.patchJump(jumpOver, static_cast<uint32_t>(chunk.code.size()));
-    } else {
-        chunk.patchJump(jumpIfFalse, static_cast<uint32_t>(chunk.code.size()));
+        size_t jumpOver = emitBx(OpCode::JUMP, 0, 0);
+        if (jumpIfFalse != kNoJump) {
+            patchJump(jumpIfFalse);
+        }
+        compileStatement(node->elseBranch.get());
+        patchJump(jumpOver);
+    } else if (jumpIfFalse != kNoJump) {
+        patchJump(jumpIfFalse);
     }
 }
 
 void BytecodeCompiler::visit(WhileStatement* node) {
-    size_t loopStart = chunk.code.size();
-    
-    node->condition->accept(*this);
-    size_t exitJump = chunk.emit(OpCode::JUMP_IF_FALSE, 0);
-    
-    node->body->accept(*this);
-    chunk.emit(OpCode::JUMP, static_cast<uint32_t>(loopStart));
-    
-    chunk.patchJump(exitJump, static_cast<uint32_t>(chunk.code.size()));
+    FunctionState& fn = functions.back();
+    size_t loopStart = here();
+    fn.loops.push_back({loopStart, {}, {}});
+
+    size_t exitJump = compileCondition(node->condition.get());
+
+    compileStatement(node->body.get());
+    emitBx(OpCode::JUMP, 0, static_cast<uint32_t>(loopStart));
+
+    if (exitJump != kNoJump) {
+        patchJump(exitJump);
+    }
+    Loop loop = std::move(functions.back().loops.back());
+    functions.back().loops.pop_back();
+    for (size_t jump : loop.breakJumps) {
+        patchJump(jump);
+    }
 }
 
 void BytecodeCompiler::visit(ForStatement* node) {
+    if (node->frameSize > 0) {
+        beginScope(node->frameSize, node->frameCaptured);
+    }
     if (node->initializer) {
-        node->initializer->accept(*this);
+        compileStatement(node->initializer.get());
     }
-    
-    size_t loopStart = chunk.code.size();
-    
+
+    size_t loopStart = here();
+    FunctionState& fn = functions.back();
+    fn.loops.push_back({loopStart, {}, {}});
+
+    size_t exitJump = kNoJump;
     if (node->condition) {
-        node->condition->accept(*this);
-    } else {
-        chunk.emit(OpCode::PUSH_BOOL, chunk.addConstant(true));
+        exitJump = compileCondition(node->condition.get());
+    }
+
+    compileStatement(node->body.get());
+
+    // Continue runs the increment before testing the condition again
+    Loop loop = std::move(functions.back().loops.back());
+    functions.back().loops.pop_back();
+    for (size_t jump : loop.continueJumps) {
+        patchJump(jump);
     }
-    
-    size_t exitJump = chunk.emit(OpCode::JUMP_IF_FALSE, 0);
-    
-    node->body->accept(*this);
-    
     if (node->increment) {
-        node->increment->accept(*this);
-        chunk.emit(OpCode::POP);
+        int mark = functions.back().temps;
+        compileExpression(node->increment.get(), kDiscard);
+        releaseTemps(mark);
+    }
+    emitBx(OpCode::JUMP, 0, static_cast<uint32_t>(loopStart));
+
+    if (exitJump != kNoJump) {
+        patchJump(exitJump);
+    }
+    for (size_t jump : loop.breakJumps) {
+        patchJump(jump);
+    }
+    if (node->frameSize > 0) {
+        endScope();
     }
-    
-    chunk.emit(OpCode::JUMP, static_cast<uint32_t>(loopStart));
-    chunk.patchJump(exitJump, static_cast<uint32_t>(chunk.code.size()));
 }
 
 void BytecodeCompiler::visit(BreakStatement* node) {
     (void)node;
-    // TODO: Implement break with jump stack
+    FunctionState& fn = functions.back();
+    if (fn.loops.empty()) {
+        // A stray break ends the function (or the program), as in the interpreter
+        emitReturnNull();
+        return;
+    }
+    size_t jump = emitBx(OpCode::JUMP, 0, 0);
+    functions.back().loops.back().breakJumps.push_back(jump);
 }
 
 void BytecodeCompiler::visit(ContinueStatement* node) {
     (void)node;
-    // TODO: Implement continue with jump stack
+    FunctionState& fn = functions.back();
+    if (fn.loops.empty()) {
+        emitReturnNull();
+        return;
+    }
+    Loop& loop = functions.back().loops.back();
+    loop.continueJumps.push_back(emitBx(OpCode::JUMP, 0, static_cast<uint32_t>(loop.start)));
 }
 
 void BytecodeCompiler::visit(FunctionDeclaration* node) {
-    // TODO: Compile function to separate chunk
-    (void)node;
+    CompiledFunction compiled;
+    compiled.name = node->name;
+    compiled.parameters = node->parameters;
+    compiled.frameCaptured = node->frameCaptured;
+    auto index = static_cast<uint32_t>(chunk.functions.size());
+    chunk.functions.push_back(std::move(compiled));
+    emitBx(OpCode::DECLARE_FUNCTION, 0, index);
+
+    // The body shares the function's scope, which starts with the parameters
+    functions.emplace_back(index);
+    beginScope(node->frameSize, false);
+    compileStatements(node->body->statements);
+    emitReturnNull();
+    endScope();
+    functions.pop_back();
 }
 
 void BytecodeCompiler::visit(ReturnStatement* node) {
     if (node->value) {
-        node->value->accept(*this);
+        emit(OpCode::RETURN, compileOperand(node->value.get()));
     } else {
-        chunk.emit(OpCode::PUSH_NULL);
+        emitReturnNull();
     }
-    chunk.emit(OpCode::RETURN);
 }
 
 void BytecodeCompiler::visit(TryStatement* node) {
-    // Simplified try/catch - just execute try block for now
+    // Entering and leaving the block runs no code: the VM looks up the
+    // handler table only when an error is raised
+    auto start = static_cast<uint32_t>(here());
     if (node->tryBlock) {
-        node->tryBlock->accept(*this);
+        compileStatement(node->tryBlock.get());
+    }
+    auto end = static_cast<uint32_t>(here());
+    size_t jumpOver = emitBx(OpCode::JUMP, 0, 0);
+
+    // The VM resumes here with the error message in the register of the
+    // catch clause's one-slot scope. Blocks nested in this one were added
+    // first, so the innermost block covering an instruction comes first.
+    beginScope(1, false);
+    auto messageRegister = static_cast<uint16_t>(scopes.back().base);
+    currentFunction().handlers.push_back({start, end, static_cast<uint32_t>(here()), messageRegister});
+    if (node->catchBlock) {
+        compileStatement(node->catchBlock.get());
+    }
+    endScope();
+    patchJump(jumpOver);
+}
+
+// SADK statements
+void BytecodeCompiler::visit(ImportStatement* node) {
+    chunk.imports.push_back({node->moduleName, node->modulePath});
+    auto import = static_cast<uint32_t>(chunk.imports.size() - 1);
+    uint16_t reg = node->slot >= 0 ? static_cast<uint16_t>(scopes.back().base + node->slot) : allocTemp();
+    emitBx(OpCode::IMPORT, reg, import);
+    if (node->slot < 0) {
+        emitDefine(reg, node->slot, node->alias.empty() ? node->moduleName : node->alias);
     }
 }
 
-void BytecodeCompiler::visit(LambdaExpression* node) {
-    (void)node;
-    // TODO: Implement lambda bytecode
-}
-
-void BytecodeCompiler::visit(MatchExpression* node) {
-    (void)node;
-    // TODO: Implement match bytecode
-}
-
-void BytecodeCompiler::visit(CompoundAssignment* node) {
-    (void)node;
-    // TODO: Implement compound assignment bytecode
-}
-
-void BytecodeCompiler::visit(UpdateExpression* node) {
-    (void)node;
-    // TODO: Implement update expression bytecode
-}
-
-void BytecodeCompiler::visit(InterpolatedString* node) {
-    (void)node;
-    // TODO: Implement interpolated string bytecode
+void BytecodeCompiler::visit(StructDeclaration* node) {
+    // Methods are not bound at runtime yet; only the constructor is
+    StructInfo info;
+    info.name = node->name;
+    for (const auto& field : node->fields) {
+        info.fields.push_back(field.name);
+    }
+    chunk.structs.push_back(std::move(info));
+    emitBx(OpCode::DEFINE_STRUCT, 0, static_cast<uint32_t>(chunk.structs.size() - 1));
 }
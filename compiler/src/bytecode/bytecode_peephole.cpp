@@ -0,0 +1,516 @@
+#include "../../include/bytecode_peephole.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr size_t kNoTarget = static_cast<size_t>(-1);
+
+// Fused branches keep their target in a 16-bit operand
+constexpr size_t kMaxFusedTarget = 0xFFFF;
+
+// Each round can expose more work for the next (a removed store makes the
+// one before it dead, a threaded jump becomes a jump to the next instruction)
+constexpr int kMaxRounds = 4;
+
+// The generic form of a quickened opcode the compiler emitted for typed
+// operands; the pass treats the two alike
+OpCode genericForm(OpCode op) {
+    switch (op) {
+        case OpCode::ADD_INT: case OpCode::ADD_FLOAT: return OpCode::ADD;
+        case OpCode::SUB_INT: case OpCode::SUB_FLOAT: return OpCode::SUB;
+        case OpCode::MUL_INT: case OpCode::MUL_FLOAT: return OpCode::MUL;
+        case OpCode::MOD_INT: return OpCode::MOD;
+        case OpCode::DIV_FLOAT: return OpCode::DIV;
+        case OpCode::EQ_INT: return OpCode::EQ;
+        case OpCode::NE_INT: return OpCode::NE;
+        case OpCode::LT_INT: return OpCode::LT;
+        case OpCode::GT_INT: return OpCode::GT;
+        case OpCode::LE_INT: return OpCode::LE;
+        case OpCode::GE_INT: return OpCode::GE;
+        case OpCode::TEST_EQ_INT: return OpCode::TEST_EQ;
+        case OpCode::TEST_NE_INT: return OpCode::TEST_NE;
+        case OpCode::TEST_LT_INT: return OpCode::TEST_LT;
+        case OpCode::TEST_GT_INT: return OpCode::TEST_GT;
+        case OpCode::TEST_LE_INT: return OpCode::TEST_LE;
+        case OpCode::TEST_GE_INT: return OpCode::TEST_GE;
+        case OpCode::BRANCH_EQ_INT: return OpCode::BRANCH_EQ;
+        case OpCode::BRANCH_NE_INT: return OpCode::BRANCH_NE;
+        case OpCode::BRANCH_LT_INT: return OpCode::BRANCH_LT;
+        case OpCode::BRANCH_GT_INT: return OpCode::BRANCH_GT;
+        case OpCode::BRANCH_LE_INT: return OpCode::BRANCH_LE;
+        case OpCode::BRANCH_GE_INT: return OpCode::BRANCH_GE;
+        case OpCode::INDEX_ARRAY_INT: return OpCode::INDEX;
+        default: return op;
+    }
+}
+
+bool isTest(OpCode op) {
+    op = genericForm(op);
+    return op >= OpCode::TEST_EQ && op <= OpCode::TEST_GE;
+}
+
+// The branch a test fuses into; an int test gives an int branch
+OpCode branchFor(OpCode test) {
+    switch (test) {
+        case OpCode::TEST_EQ_INT: return OpCode::BRANCH_EQ_INT;
+        case OpCode::TEST_NE_INT: return OpCode::BRANCH_NE_INT;
+        case OpCode::TEST_LT_INT: return OpCode::BRANCH_LT_INT;
+        case OpCode::TEST_GT_INT: return OpCode::BRANCH_GT_INT;
+        case OpCode::TEST_LE_INT: return OpCode::BRANCH_LE_INT;
+        case OpCode::TEST_GE_INT: return OpCode::BRANCH_GE_INT;
+        case OpCode::TEST_EQ: return OpCode::BRANCH_EQ;
+        case OpCode::TEST_NE: return OpCode::BRANCH_NE;
+        case OpCode::TEST_LT: return OpCode::BRANCH_LT;
+        case OpCode::TEST_GT: return OpCode::BRANCH_GT;
+        case OpCode::TEST_LE: return OpCode::BRANCH_LE;
+        default: return OpCode::BRANCH_GE;
+    }
+}
+
+size_t jumpTarget(const Instruction& instr) {
+    switch (genericForm(instr.opcode)) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            return instr.bx();
+        case OpCode::BRANCH_EQ:
+        case OpCode::BRANCH_NE:
+        case OpCode::BRANCH_LT:
+        case OpCode::BRANCH_GT:
+        case OpCode::BRANCH_LE:
+        case OpCode::BRANCH_GE:
+            return instr.a;
+        case OpCode::INC_BRANCH_LT:
+            return instr.c;
+        default:
+            return kNoTarget;
+    }
+}
+
+// False if `target` does not fit the instruction's target operand
+bool setJumpTarget(Instruction& instr, size_t target) {
+    switch (instr.opcode) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            instr.setBx(static_cast<uint32_t>(target));
+            return true;
+        case OpCode::INC_BRANCH_LT:
+            if (target > kMaxFusedTarget) return false;
+            instr.c = static_cast<uint16_t>(target);
+            return true;
+        default:
+            if (target > kMaxFusedTarget) return false;
+            instr.a = static_cast<uint16_t>(target);
+            return true;
+    }
+}
+
+bool fallsThrough(OpCode op) {
+    return op != OpCode::JUMP && op != OpCode::RETURN && op != OpCode::RAISE;
+}
+
+template <typename Visit>
+void forEachSuccessor(const std::vector<Instruction>& code, size_t pc, Visit visit) {
+    const Instruction& instr = code[pc];
+    if (isTest(instr.opcode)) {
+        // Either runs the jump that follows or skips it
+        visit(pc + 1);
+        visit(pc + 2);
+        return;
+    }
+    size_t target = jumpTarget(instr);
+    if (target != kNoTarget) {
+        visit(target);
+    }
+    if (fallsThrough(instr.opcode)) {
+        visit(pc + 1);
+    }
+}
+
+// Drop the instructions not kept and renumber the jump targets, the line
+// table and the handler table. A target that was dropped moves to the next
+// instruction kept after it.
+bool compact(CompiledFunction& function, const std::vector<bool>& keep) {
+    auto& code = function.code;
+    std::vector<size_t> position(code.size() + 1);
+    size_t kept = 0;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        position[pc] = kept;
+        if (keep[pc]) ++kept;
+    }
+    position[code.size()] = kept;
+    if (kept == code.size()) {
+        return false;
+    }
+
+    size_t out = 0;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        if (!keep[pc]) continue;
+        Instruction instr = code[pc];
+        size_t target = jumpTarget(instr);
+        if (target != kNoTarget) {
+            // Targets only move down, so they still fit
+            setJumpTarget(instr, position[std::min(target, code.size())]);
+        }
+        code[out++] = instr;
+    }
+    code.erase(code.begin() + static_cast<std::ptrdiff_t>(out), code.end());
+
+    // A run whose instructions were all dropped gives way to the next one
+    std::vector<LineRun> lines;
+    for (const LineRun& run : function.lines) {
+        auto pc = static_cast<uint32_t>(position[std::min<size_t>(run.pc, position.size() - 1)]);
+        if (!lines.empty() && lines.back().pc == pc) lines.pop_back();
+        if (pc < code.size() && (lines.empty() || lines.back().line != run.line)) lines.push_back({pc, run.line});
+    }
+    function.lines = std::move(lines);
+
+    for (ExceptionHandler& handler : function.handlers) {
+        handler.start = static_cast<uint32_t>(position[handler.start]);
+        handler.end = static_cast<uint32_t>(position[handler.end]);
+        handler.target = static_cast<uint32_t>(position[handler.target]);
+    }
+    return true;
+}
+
+// Follow unconditional jumps; a jump to itself (an empty endless loop) ends the chain
+size_t finalTarget(const std::vector<Instruction>& code, size_t target) {
+    for (size_t hops = 0; hops < code.size() && target < code.size(); ++hops) {
+        const Instruction& instr = code[target];
+        if (instr.opcode != OpCode::JUMP || instr.bx() == target) break;
+        target = instr.bx();
+    }
+    return target;
+}
+
+bool threadJumps(std::vector<Instruction>& code) {
+    bool changed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        Instruction& instr = code[pc];
+        size_t target = jumpTarget(instr);
+        if (target == kNoTarget) continue;
+
+        size_t final = finalTarget(code, target);
+        if (final != target && setJumpTarget(instr, final)) {
+            changed = true;
+        }
+        if (instr.opcode == OpCode::JUMP && final < code.size() && code[final].opcode == OpCode::RETURN) {
+            instr = code[final];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// A loop ends in a jump back to its condition, `TEST_op b, c; JUMP exit`,
+// and its exit follows that jump. The back edge becomes BRANCH_op into the
+// body, falling through to the exit, and an INC of the tested register just
+// before it merges with it into INC_BRANCH_LT.
+bool fuseLoopBranches(CompiledFunction& function, std::vector<bool>& keep) {
+    auto& code = function.code;
+    if (code.size() > kMaxFusedTarget) {
+        return false;
+    }
+    std::vector<bool> isTarget(code.size() + 2, false);
+    for (const auto& instr : code) {
+        size_t target = jumpTarget(instr);
+        if (target != kNoTarget && target < isTarget.size()) isTarget[target] = true;
+    }
+    for (const ExceptionHandler& handler : function.handlers) {
+        isTarget[handler.target] = true;
+    }
+
+    bool changed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        if (code[pc].opcode != OpCode::JUMP) continue;
+        size_t test = code[pc].bx();
+        if (test + 1 >= code.size() || !isTest(code[test].opcode)) continue;
+
+        // When the condition fails the branch falls through, which must lead
+        // to the exit: the jump after the test, or the RETURN it became
+        const Instruction& leave = code[test + 1];
+        const Instruction* next = pc + 1 < code.size() ? &code[pc + 1] : nullptr;
+        bool reachesExit = false;
+        if (leave.opcode == OpCode::JUMP) {
+            reachesExit = leave.bx() == pc + 1 || (next && next->opcode == OpCode::JUMP && next->bx() == leave.bx());
+        } else if (leave.opcode == OpCode::RETURN) {
+            reachesExit = next && next->opcode == OpCode::RETURN && next->a == leave.a;
+        }
+        if (!reachesExit) continue;
+
+        const Instruction& condition = code[test];
+        Instruction branch(branchFor(condition.opcode), static_cast<uint16_t>(test + 2), condition.b, condition.c);
+        isTarget[test + 2] = true;
+        changed = true;
+
+        const Instruction* previous = pc > 0 ? &code[pc - 1] : nullptr;
+        if (genericForm(branch.opcode) == OpCode::BRANCH_LT && previous && previous->opcode == OpCode::INC &&
+            previous->a == branch.b && !(branch.b & kConstantOperand) && !isTarget[pc]) {
+            code[pc - 1] = Instruction(OpCode::INC_BRANCH_LT, branch.b, branch.c, branch.a);
+            keep[pc] = false;
+        } else {
+            code[pc] = branch;
+        }
+    }
+    return changed;
+}
+
+bool markJumpsToNext(const std::vector<Instruction>& code, std::vector<bool>& keep) {
+    bool changed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        // The jump after a test is the one it skips: it stays even if it goes nowhere
+        bool guarded = pc > 0 && isTest(code[pc - 1].opcode);
+        if (code[pc].opcode == OpCode::JUMP && code[pc].bx() == pc + 1 && !guarded) {
+            keep[pc] = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Catch clauses are only reached through the handler table
+bool markUnreachable(const CompiledFunction& function, std::vector<bool>& keep) {
+    const auto& code = function.code;
+    std::vector<bool> reached(code.size(), false);
+    std::vector<size_t> work;
+    auto visit = [&](size_t pc) {
+        if (pc < code.size() && !reached[pc]) {
+            reached[pc] = true;
+            work.push_back(pc);
+        }
+    };
+    visit(0);
+    for (const ExceptionHandler& handler : function.handlers) {
+        visit(handler.target);
+    }
+    while (!work.empty()) {
+        size_t pc = work.back();
+        work.pop_back();
+        forEachSuccessor(code, pc, visit);
+    }
+
+    bool changed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        if (!reached[pc]) {
+            keep[pc] = false;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Registers read by an instruction; false for an opcode whose reads are not modeled
+bool registerUses(const Instruction& instr, const BytecodeChunk& chunk, std::vector<uint32_t>& uses) {
+    uses.clear();
+    auto rk = [&](uint16_t operand) {
+        if (!(operand & kConstantOperand)) uses.push_back(operand);
+    };
+    auto range = [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) uses.push_back(first + i);
+    };
+
+    switch (genericForm(instr.opcode)) {
+        case OpCode::LOAD_CONST:
+        case OpCode::LOAD_BOOL:
+        case OpCode::LOAD_NULL:
+        case OpCode::CLEAR_LOCALS:
+        case OpCode::LOAD_UPVALUE:
+        case OpCode::LOAD_GLOBAL:
+        case OpCode::LOAD_SELF:
+        case OpCode::JUMP:
+        case OpCode::DECLARE_FUNCTION:
+        case OpCode::RAISE:
+        case OpCode::DEFINE_STRUCT:
+        case OpCode::IMPORT:
+            return true;
+        case OpCode::MOVE:
+        case OpCode::INDEX:
+        case OpCode::GET_MEMBER:
+            uses.push_back(instr.b);
+            if (genericForm(instr.opcode) == OpCode::INDEX) rk(instr.c);
+            return true;
+        case OpCode::STORE_UPVALUE:
+        case OpCode::STORE_GLOBAL:
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::INC:
+        case OpCode::DEC:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            uses.push_back(instr.a);
+            return true;
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+        case OpCode::COMPOUND_ADD: case OpCode::COMPOUND_SUB: case OpCode::COMPOUND_MUL: case OpCode::COMPOUND_DIV:
+        case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::GT: case OpCode::LE: case OpCode::GE:
+        case OpCode::MATCH: case OpCode::AND: case OpCode::OR:
+        case OpCode::TEST_EQ: case OpCode::TEST_NE: case OpCode::TEST_LT:
+        case OpCode::TEST_GT: case OpCode::TEST_LE: case OpCode::TEST_GE:
+        case OpCode::BRANCH_EQ: case OpCode::BRANCH_NE: case OpCode::BRANCH_LT:
+        case OpCode::BRANCH_GT: case OpCode::BRANCH_LE: case OpCode::BRANCH_GE:
+            rk(instr.b);
+            rk(instr.c);
+            return true;
+        case OpCode::NEG:
+        case OpCode::NOT:
+            rk(instr.b);
+            return true;
+        case OpCode::INC_BRANCH_LT:
+            uses.push_back(instr.a);
+            rk(instr.b);
+            return true;
+        case OpCode::RETURN:
+            rk(instr.a);
+            return true;
+        case OpCode::CALL:
+            range(instr.a, instr.c);
+            return true;
+        case OpCode::CALL_METHOD:
+            range(instr.a, instr.c + 1u);
+            return true;
+        case OpCode::MAKE_ARRAY:
+        case OpCode::BUILD_STRING:
+            range(instr.b, instr.c);
+            return true;
+        case OpCode::MAKE_MAP: {
+            if (instr.c >= chunk.mapLayouts.size()) return false;
+            uint32_t count = 0;
+            for (int32_t key : chunk.mapLayouts[instr.c].keys) {
+                count += key < 0 ? 2 : 1;
+            }
+            range(instr.b, count);
+            return true;
+        }
+        case OpCode::INDEX_SET:
+            uses.push_back(instr.a);
+            rk(instr.b);
+            rk(instr.c);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The register an instruction overwrites, or -1
+int registerDefinition(const Instruction& instr) {
+    switch (genericForm(instr.opcode)) {
+        case OpCode::STORE_UPVALUE:
+        case OpCode::STORE_GLOBAL:
+        case OpCode::DEFINE_GLOBAL:
+        case OpCode::CLEAR_LOCALS:
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+        case OpCode::RETURN:
+        case OpCode::DECLARE_FUNCTION:
+        case OpCode::INDEX_SET:
+        case OpCode::RAISE:
+        case OpCode::DEFINE_STRUCT:
+        case OpCode::TEST_EQ: case OpCode::TEST_NE: case OpCode::TEST_LT:
+        case OpCode::TEST_GT: case OpCode::TEST_LE: case OpCode::TEST_GE:
+        case OpCode::BRANCH_EQ: case OpCode::BRANCH_NE: case OpCode::BRANCH_LT:
+        case OpCode::BRANCH_GT: case OpCode::BRANCH_LE: case OpCode::BRANCH_GE:
+            return -1;
+        default:
+            return instr.a;
+    }
+}
+
+// Writes that cannot fail or have any other effect
+bool isRemovableStore(OpCode op) {
+    return op == OpCode::LOAD_CONST || op == OpCode::LOAD_BOOL || op == OpCode::LOAD_NULL || op == OpCode::MOVE;
+}
+
+// Backward liveness over the function's registers, one bit per register
+bool markDeadStores(const CompiledFunction& function, const BytecodeChunk& chunk, std::vector<bool>& keep) {
+    const auto& code = function.code;
+    // A handler may read any register written before the error
+    if (function.frameCaptured || !function.handlers.empty() || function.registerCount <= 0) {
+        return false;
+    }
+
+    auto registers = static_cast<uint32_t>(function.registerCount);
+    std::vector<std::vector<uint32_t>> uses(code.size());
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        if (!registerUses(code[pc], chunk, uses[pc])) {
+            return false;
+        }
+        for (uint32_t reg : uses[pc]) {
+            if (reg >= registers) return false;
+        }
+    }
+
+    size_t words = (registers + 63) / 64;
+    std::vector<uint64_t> liveIn(code.size() * words, 0);
+    std::vector<uint64_t> live(words);
+    auto liveOut = [&](size_t pc) {
+        std::fill(live.begin(), live.end(), 0);
+        forEachSuccessor(code, pc, [&](size_t next) {
+            if (next >= code.size()) return;
+            for (size_t w = 0; w < words; ++w) live[w] |= liveIn[next * words + w];
+        });
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t pc = code.size(); pc-- > 0;) {
+            liveOut(pc);
+            int def = registerDefinition(code[pc]);
+            if (def >= 0 && static_cast<uint32_t>(def) < registers) {
+                live[static_cast<size_t>(def) / 64] &= ~(uint64_t(1) << (def % 64));
+            }
+            for (uint32_t reg : uses[pc]) {
+                live[reg / 64] |= uint64_t(1) << (reg % 64);
+            }
+            for (size_t w = 0; w < words; ++w) {
+                if (liveIn[pc * words + w] != live[w]) {
+                    liveIn[pc * words + w] = live[w];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    bool removed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        const Instruction& instr = code[pc];
+        if (!isRemovableStore(instr.opcode) || instr.a >= registers) continue;
+        liveOut(pc);
+        if (!(live[instr.a / 64] & (uint64_t(1) << (instr.a % 64)))) {
+            keep[pc] = false;
+            removed = true;
+        }
+    }
+    return removed;
+}
+
+}  // namespace
+
+void optimizePeephole(CompiledFunction& function, const BytecodeChunk& chunk) {
+    auto& code = function.code;
+    for (int round = 0; round < kMaxRounds; ++round) {
+        // Fusion first: threading may turn the loop's exit jump into a RETURN
+        std::vector<bool> keep(code.size(), true);
+        bool changed = fuseLoopBranches(function, keep);
+        compact(function, keep);
+        changed |= threadJumps(code);
+
+        keep.assign(code.size(), true);
+        markJumpsToNext(code, keep);
+        markUnreachable(function, keep);
+        changed |= compact(function, keep);
+
+        keep.assign(code.size(), true);
+        markDeadStores(function, chunk, keep);
+        changed |= compact(function, keep);
+
+        if (!changed) break;
+    }
+}
+
+void optimizePeephole(BytecodeChunk& chunk) {
+    for (auto& function : chunk.functions) {
+        optimizePeephole(function, chunk);
+    }
+}
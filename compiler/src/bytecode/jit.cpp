@@ -0,0 +1,813 @@
+#include "../../include/jit.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#ifdef SYNTHFLOW_JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct Jit::CallSite {
+    Jit* jit;
+    VM* vm;
+    VM::LoadedChunk* chunk;
+    uint32_t name;  // names[] index of the callee
+    uint32_t argc;
+    std::vector<Value> argv;  // Kept between calls for its capacity
+};
+
+struct Jit::MemberSite {
+    Jit* jit;
+    Symbol member;
+    InlineCache* cache;
+    InlineCacheStats* stats;
+};
+
+struct NativeCode {
+    CompiledFunction* function = nullptr;
+    void* memory = nullptr;
+    size_t mappedSize = 0;
+    uint32_t (*entry)(Value* registers, uint32_t pc) = nullptr;
+    std::vector<bool> entries;            // Instructions worth entering native code at
+    std::deque<Jit::CallSite> calls;      // Addressed by the code, so never moved
+    std::deque<Jit::MemberSite> members;
+    uint32_t guardExits = 0;
+};
+
+namespace {
+
+// Runtime calls made from native code return one of these
+enum : int {
+    kDone = 0,
+    kGuardFailed = 1,  // Leave native code at the instruction, as a failed type check
+    kLeave = 2,        // Leave native code at the instruction
+};
+
+// Set in the value native code returns when it left on a failed type check
+constexpr uint32_t kGuardExit = 0x80000000u;
+
+}  // namespace
+
+int Jit::callBuiltin(CallSite* site, Value* args) noexcept {
+    try {
+        VM& vm = *site->vm;
+        VM::CallCache& cache = site->chunk->calls[site->name];
+        if (cache.epoch != Environment::functionEpoch) {
+            vm.resolveCall(*site->chunk, site->name);
+        }
+        if (!cache.native) {
+            return kLeave;  // A declared function: the interpreter enters it
+        }
+        std::vector<Value> argv = std::move(site->argv);
+        argv.assign(std::make_move_iterator(args), std::make_move_iterator(args + site->argc));
+        args[0] = (*cache.native)(argv, vm.runtime);
+        argv.clear();
+        site->argv = std::move(argv);
+        return kDone;
+    } catch (...) {
+        site->jit->pending = std::current_exception();
+        return kLeave;
+    }
+}
+
+int Jit::getMember(MemberSite* site, Value* dst, const Value* object) noexcept {
+    try {
+        *dst = loadMember(*object, site->member, *site->cache, *site->stats);
+        return kDone;
+    } catch (...) {
+        site->jit->pending = std::current_exception();
+        return kLeave;
+    }
+}
+
+Jit::Jit(JitStats& stats) : stats(stats) {}
+
+Jit::~Jit() {
+#ifdef SYNTHFLOW_JIT_X64
+    for (const auto& native : code) {
+        munmap(native->memory, native->mappedSize);
+    }
+#endif
+}
+
+uint32_t Jit::run(NativeCode& native, Value* registers, uint32_t pc) {
+    if (!native.entries[pc]) {
+        return pc;
+    }
+    ++stats.entries;
+    uint32_t exit = native.entry(registers, pc);
+    if (pending) {
+        return exit;
+    }
+    if (exit & kGuardExit) {
+        exit &= ~kGuardExit;
+        ++stats.guardExits;
+        if (++native.guardExits > kMaxGuardExits) {
+            native.function->native = nullptr;
+            ++stats.discarded;
+        }
+    }
+    return exit;
+}
+
+void Jit::rethrow() {
+    std::exception_ptr error = pending;
+    pending = nullptr;
+    std::rethrow_exception(error);
+}
+
+#ifdef SYNTHFLOW_JIT_X64
+
+namespace {
+
+uint8_t tag(Value::Type type) { return static_cast<uint8_t>(type); }
+
+// Runtime calls. None of them may throw: there are no unwind tables for the
+// native frames they are called from.
+void assignValue(Value* dst, const Value* src) noexcept {
+    *dst = *src;
+}
+
+void clearValue(Value* dst) noexcept {
+    *dst = Value();
+}
+
+int indexArray(Value* dst, const Value* array, const Value* index) noexcept {
+    if (!array->isArray() || !index->isInt()) {
+        return kGuardFailed;
+    }
+    auto i = static_cast<size_t>(index->asInt());
+    const auto& elements = *array->asArray();
+    if (i >= elements.size()) {
+        return kLeave;  // The interpreter raises the error
+    }
+    Value element = elements[i];
+    *dst = std::move(element);
+    return kDone;
+}
+
+int loadField(Value* dst, const Value* object, const Shape* shape, uint64_t slot) noexcept {
+    if (!object->isStruct() || object->asStruct().shape != shape) {
+        return kGuardFailed;
+    }
+    Value field = object->asStruct().slots[slot];
+    *dst = std::move(field);
+    return kDone;
+}
+
+// The generated code reads and writes Values in place: a one-byte type tag at
+// offset 0 and the payload at offset 8
+bool layoutMatches() {
+    auto tagOf = [](const Value& v) {
+        uint8_t t;
+        std::memcpy(&t, static_cast<const void*>(&v), 1);
+        return t;
+    };
+    auto payloadOf = [](const Value& v) {
+        uint64_t p;
+        std::memcpy(&p, static_cast<const char*>(static_cast<const void*>(&v)) + 8, 8);
+        return p;
+    };
+    double half = 0.5;
+    uint64_t halfBits;
+    std::memcpy(&halfBits, &half, 8);
+    return tagOf(Value()) == tag(Value::Type::Null) && payloadOf(Value()) == 0 &&
+           tagOf(Value(int64_t(-2))) == tag(Value::Type::Int) && payloadOf(Value(int64_t(-2))) == uint64_t(-2) &&
+           tagOf(Value(0.5)) == tag(Value::Type::Float) && payloadOf(Value(0.5)) == halfBits &&
+           tagOf(Value(true)) == tag(Value::Type::Bool) && payloadOf(Value(true)) == 1 &&
+           payloadOf(Value(false)) == 0 && tagOf(Value("s")) >= tag(Value::Type::String);
+}
+
+enum Reg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7 };
+enum Xmm : uint8_t { XMM0 = 0, XMM1 = 1 };
+
+// Condition codes, as encoded in Jcc and SETcc
+enum Cond : uint8_t {
+    kBelow = 0x2,
+    kAboveEqual = 0x3,
+    kEqual = 0x4,
+    kNotEqual = 0x5,
+    kLess = 0xC,
+    kGreaterEqual = 0xD,
+    kLessEqual = 0xE,
+    kGreater = 0xF,
+};
+
+// Encoder for the x86-64 instructions the templates use. Memory operands are
+// always [rbx + disp32]: rbx holds the register file.
+class Assembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    size_t size() const { return bytes.size(); }
+    void emit8(uint8_t b) { bytes.push_back(b); }
+    void emit32(uint32_t v) {
+        for (int i = 0; i < 4; ++i) emit8(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void emit64(uint64_t v) {
+        for (int i = 0; i < 8; ++i) emit8(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void push(Reg r) { emit8(0x50 + r); }
+    void pop(Reg r) { emit8(0x58 + r); }
+    void ret() { emit8(0xC3); }
+
+    void movLoad(Reg dst, int32_t disp) { rexW(); emit8(0x8B); mem(dst, disp); }
+    void movStore(int32_t disp, Reg src) { rexW(); emit8(0x89); mem(src, disp); }
+    void movImm(Reg dst, uint64_t imm) { rexW(); emit8(0xB8 + dst); emit64(imm); }
+    void mov(Reg dst, Reg src) { rexW(); emit8(0x89); modrm(src, dst); }
+    void lea(Reg dst, int32_t disp) { rexW(); emit8(0x8D); mem(dst, disp); }
+
+    void add(Reg dst, Reg src) { rexW(); emit8(0x01); modrm(src, dst); }
+    void sub(Reg dst, Reg src) { rexW(); emit8(0x29); modrm(src, dst); }
+    void imul(Reg dst, Reg src) { rexW(); emit8(0x0F); emit8(0xAF); modrm(dst, src); }
+    void cmp(Reg a, Reg b) { rexW(); emit8(0x39); modrm(b, a); }  // Flags of a - b
+    void test(Reg a, Reg b) { rexW(); emit8(0x85); modrm(b, a); }
+    void shl1(Reg r) { rexW(); emit8(0xD1); modrm(4, r); }
+    void addImm(Reg r, int8_t imm) { rexW(); emit8(0x83); modrm(0, r); emit8(static_cast<uint8_t>(imm)); }
+    void addMem(int32_t disp, int8_t imm) { rexW(); emit8(0x83); mem(0, disp); emit8(static_cast<uint8_t>(imm)); }
+    void cmpMem(int32_t disp, int8_t imm) { rexW(); emit8(0x83); mem(7, disp); emit8(static_cast<uint8_t>(imm)); }
+
+    // Type tags (one byte)
+    void storeByte(int32_t disp, uint8_t imm) { emit8(0xC6); mem(0, disp); emit8(imm); }
+    void cmpByte(int32_t disp, uint8_t imm) { emit8(0x80); mem(7, disp); emit8(imm); }
+    void loadByte(int32_t disp) { emit8(0x0F); emit8(0xB6); mem(RAX, disp); }  // movzx eax, byte
+    void cmpAl(uint8_t imm) { emit8(0x3C); emit8(imm); }
+
+    // Status in eax
+    void movEax(uint32_t imm) { emit8(0xB8); emit32(imm); }
+    void testEax() { emit8(0x85); emit8(0xC0); }
+    void cmpEax(int8_t imm) { emit8(0x83); emit8(0xF8); emit8(static_cast<uint8_t>(imm)); }
+    void setcc(Cond c) { emit8(0x0F); emit8(0x90 | c); emit8(0xC0); emit8(0x0F); emit8(0xB6); emit8(0xC0); }
+
+    void movsdLoad(Xmm dst, int32_t disp) { emit8(0xF2); emit8(0x0F); emit8(0x10); mem(dst, disp); }
+    void movsdStore(int32_t disp, Xmm src) { emit8(0xF2); emit8(0x0F); emit8(0x11); mem(src, disp); }
+    void movq(Xmm dst, Reg src) { emit8(0x66); rexW(); emit8(0x0F); emit8(0x6E); modrm(dst, src); }
+    void sse(uint8_t op, Xmm dst, Xmm src) { emit8(0xF2); emit8(0x0F); emit8(op); modrm(dst, src); }
+
+    void call(const void* fn) {
+        movImm(RAX, reinterpret_cast<uint64_t>(fn));
+        emit8(0xFF);
+        emit8(0xD0);
+    }
+
+    // Jumps take a 32-bit displacement, patched through bind()
+    size_t jmp() { emit8(0xE9); emit32(0); return size() - 4; }
+    size_t jcc(Cond c) { emit8(0x0F); emit8(0x80 | c); emit32(0); return size() - 4; }
+    void bind(size_t at, size_t target) {
+        auto displacement = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        for (int i = 0; i < 4; ++i) bytes[at + i] = static_cast<uint8_t>(displacement >> (8 * i));
+    }
+
+private:
+    void rexW() { emit8(0x48); }
+    void modrm(uint8_t reg, uint8_t rm) { emit8(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))); }
+    void mem(uint8_t reg, int32_t disp) {
+        emit8(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | RBX));
+        emit32(static_cast<uint32_t>(disp));
+    }
+};
+
+// SSE2 scalar double operations
+constexpr uint8_t kAddsd = 0x58;
+constexpr uint8_t kMulsd = 0x59;
+constexpr uint8_t kSubsd = 0x5C;
+constexpr uint8_t kDivsd = 0x5E;
+
+int32_t tagAt(uint32_t reg) { return static_cast<int32_t>(reg * sizeof(Value)); }
+int32_t payloadAt(uint32_t reg) { return tagAt(reg) + 8; }
+
+// An RK operand: a register, or a constant known when compiling
+struct Operand {
+    const Value* constant;
+    uint32_t reg;
+};
+
+// Instruction templates, with the labels and exits that tie them together
+//
+// The generated function is `uint32_t f(Value* registers, uint32_t pc)`: it
+// jumps through a table to the code for `pc` and returns the index of the
+// instruction to resume at in the interpreter.
+class Generator {
+public:
+    Assembler a;
+
+    Generator(const Value* constants, size_t instructions)
+        : constants(constants), labels(instructions + 1) {
+        a.push(RBX);  // Also aligns the stack for calls
+        a.mov(RBX, RDI);
+        a.emit8(0x89);  // mov eax, esi
+        a.emit8(0xF0);
+        a.emit8(0x48);  // lea rcx, [rip + table]
+        a.emit8(0x8D);
+        a.emit8(0x0D);
+        a.emit32(0);
+        tableFixup = a.size() - 4;
+        a.emit8(0x48);  // movsxd rax, dword [rcx + rax * 4]
+        a.emit8(0x63);
+        a.emit8(0x04);
+        a.emit8(0x81);
+        a.add(RAX, RCX);
+        a.emit8(0xFF);  // jmp rax
+        a.emit8(0xE0);
+    }
+
+    void begin(uint32_t instruction) {
+        pc = instruction;
+        labels[pc] = a.size();
+    }
+
+    Operand operand(uint16_t rk) const {
+        if (rk & kConstantOperand) {
+            return {&constants[rk & kMaxOperand], 0};
+        }
+        return {nullptr, rk};
+    }
+
+    // Leave native code at this instruction
+    void exit(uint32_t flags = 0) { exits[pc | flags].push_back(a.jmp()); }
+    void exitIf(Cond c, uint32_t flags = 0) { exits[pc | flags].push_back(a.jcc(c)); }
+
+    // Leave as a failed check unless `op` holds a `type`; false if `op` is a
+    // constant of another type, so the check always fails
+    bool guard(const Operand& op, Value::Type type) {
+        if (op.constant) {
+            return op.constant->getType() == type;
+        }
+        a.cmpByte(tagAt(op.reg), tag(type));
+        exitIf(kNotEqual, kGuardExit);
+        return true;
+    }
+    bool guard(uint32_t reg, Value::Type type) { return guard(Operand{nullptr, reg}, type); }
+
+    // Release the value in `reg` if it is on the heap, before storing over it
+    void prepareStore(uint32_t reg) {
+        a.cmpByte(tagAt(reg), tag(Value::Type::String));
+        size_t inline_ = a.jcc(kBelow);
+        a.lea(RDI, tagAt(reg));
+        a.call(reinterpret_cast<const void*>(&clearValue));
+        a.bind(inline_, a.size());
+    }
+
+    void loadInt(Reg r, const Operand& op) {
+        if (op.constant) a.movImm(r, static_cast<uint64_t>(op.constant->asInt()));
+        else a.movLoad(r, payloadAt(op.reg));
+    }
+    void loadFloat(Xmm x, const Operand& op) {
+        if (op.constant) {
+            double value = op.constant->asFloat();
+            uint64_t bits;
+            std::memcpy(&bits, &value, 8);
+            a.movImm(RCX, bits);
+            a.movq(x, RCX);
+        } else {
+            a.movsdLoad(x, payloadAt(op.reg));
+        }
+    }
+    void store(uint32_t reg, Value::Type type, Reg payload) {
+        a.storeByte(tagAt(reg), tag(type));
+        a.movStore(payloadAt(reg), payload);
+    }
+
+    // Pointer argument: a register's address, or the constant's
+    void pointerArg(Reg r, const Operand& op) {
+        if (op.constant) a.movImm(r, reinterpret_cast<uint64_t>(op.constant));
+        else a.lea(r, tagAt(op.reg));
+    }
+
+    // After a runtime call: carry on if it returned kDone, else leave here
+    void checkStatus() {
+        a.testEax();
+        size_t done = a.jcc(kEqual);
+        a.cmpEax(kGuardFailed);
+        exitIf(kEqual, kGuardExit);
+        exit();
+        a.bind(done, a.size());
+    }
+
+    void jumpTo(uint32_t target) { branches.emplace_back(a.jmp(), target); }
+    void jumpIf(Cond c, uint32_t target) { branches.emplace_back(a.jcc(c), target); }
+
+    // Epilogue, exit stubs and the entry table; returns the finished code
+    std::vector<uint8_t> finish() {
+        size_t instructions = labels.size() - 1;
+        begin(static_cast<uint32_t>(instructions));
+        exit();
+
+        size_t epilogue = a.size();
+        a.pop(RBX);
+        a.ret();
+        for (const auto& [value, sites] : exits) {
+            for (size_t site : sites) a.bind(site, a.size());
+            a.movEax(value);
+            a.bind(a.jmp(), epilogue);
+        }
+        for (const auto& [site, target] : branches) {
+            a.bind(site, labels[target]);
+        }
+
+        while (a.size() % 4 != 0) a.emit8(0xCC);
+        size_t table = a.size();
+        a.bind(tableFixup, table);
+        for (size_t i = 0; i < instructions; ++i) {
+            a.emit32(static_cast<uint32_t>(static_cast<int64_t>(labels[i]) - static_cast<int64_t>(table)));
+        }
+        return std::move(a.bytes);
+    }
+
+private:
+    const Value* constants;
+    std::vector<size_t> labels;  // Code offset per instruction
+    std::vector<std::pair<size_t, uint32_t>> branches;  // Jump displacement, target instruction
+    std::map<uint32_t, std::vector<size_t>> exits;      // Exit value, jump displacements
+    size_t tableFixup = 0;
+    uint32_t pc = 0;
+};
+
+Cond condition(OpCode op) {
+    switch (op) {
+    case OpCode::EQ_INT: case OpCode::TEST_EQ_INT: case OpCode::BRANCH_EQ_INT: return kEqual;
+    case OpCode::NE_INT: case OpCode::TEST_NE_INT: case OpCode::BRANCH_NE_INT: return kNotEqual;
+    case OpCode::LT_INT: case OpCode::TEST_LT_INT: case OpCode::BRANCH_LT_INT: return kLess;
+    case OpCode::GT_INT: case OpCode::TEST_GT_INT: case OpCode::BRANCH_GT_INT: return kGreater;
+    case OpCode::LE_INT: case OpCode::TEST_LE_INT: case OpCode::BRANCH_LE_INT: return kLessEqual;
+    default: return kGreaterEqual;
+    }
+}
+
+// Generic forms the interpreter quickens the first time they run
+bool quickenable(OpCode op) {
+    switch (op) {
+    case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+    case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::GT: case OpCode::LE: case OpCode::GE:
+    case OpCode::TEST_EQ: case OpCode::TEST_NE: case OpCode::TEST_LT:
+    case OpCode::TEST_GT: case OpCode::TEST_LE: case OpCode::TEST_GE:
+    case OpCode::BRANCH_EQ: case OpCode::BRANCH_NE: case OpCode::BRANCH_LT:
+    case OpCode::BRANCH_GT: case OpCode::BRANCH_LE: case OpCode::BRANCH_GE:
+    case OpCode::INDEX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Target of a compiled jump or branch, or -1
+int64_t branchTarget(const Instruction& instr) {
+    switch (instr.opcode) {
+    case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE:
+        return instr.bx();
+    case OpCode::BRANCH_EQ_INT: case OpCode::BRANCH_NE_INT: case OpCode::BRANCH_LT_INT:
+    case OpCode::BRANCH_GT_INT: case OpCode::BRANCH_LE_INT: case OpCode::BRANCH_GE_INT:
+        return instr.a;
+    case OpCode::INC_BRANCH_LT:
+        return instr.c;
+    default:
+        return -1;
+    }
+}
+
+bool isTest(OpCode op) {
+    return op >= OpCode::TEST_EQ_INT && op <= OpCode::TEST_GE_INT;
+}
+
+}  // namespace
+
+bool Jit::supported() {
+    static const bool matches = layoutMatches();
+    return matches;
+}
+
+bool Jit::compile(VM& vm, CompiledFunction& function, VM::LoadedChunk& chunk) {
+    function.hotness = 0;
+    if (function.jitCompiles >= kMaxCompiles) {
+        return false;
+    }
+    ++function.jitCompiles;
+
+    auto native = std::make_unique<NativeCode>();
+    native->function = &function;
+    const std::vector<Instruction>& instructions = function.code;
+    native->entries.assign(instructions.size(), false);
+    Generator gen(chunk.constants.data(), instructions.size());
+    Assembler& a = gen.a;
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        auto pc = static_cast<uint32_t>(i);
+        const Instruction& instr = instructions[i];
+        gen.begin(pc);
+        bool compiled = true;
+
+        switch (instr.opcode) {
+        case OpCode::LOAD_CONST: {
+            const Value& constant = chunk.constants[instr.bx()];
+            if (constant.getType() == Value::Type::String) {
+                a.lea(RDI, tagAt(instr.a));
+                a.movImm(RSI, reinterpret_cast<uint64_t>(&constant));
+                a.call(reinterpret_cast<const void*>(&assignValue));
+                break;
+            }
+            gen.prepareStore(instr.a);
+            uint64_t payload;
+            if (constant.isInt()) {
+                payload = static_cast<uint64_t>(constant.asInt());
+            } else if (constant.isFloat()) {
+                double value = constant.asFloat();
+                std::memcpy(&payload, &value, 8);
+            } else {
+                payload = constant.asBool() ? 1 : 0;
+            }
+            a.movImm(RAX, payload);
+            gen.store(instr.a, constant.getType(), RAX);
+            break;
+        }
+        case OpCode::LOAD_BOOL:
+        case OpCode::LOAD_NULL: {
+            bool isBool = instr.opcode == OpCode::LOAD_BOOL;
+            gen.prepareStore(instr.a);
+            a.movImm(RAX, isBool && instr.b != 0 ? 1 : 0);
+            gen.store(instr.a, isBool ? Value::Type::Bool : Value::Type::Null, RAX);
+            break;
+        }
+        case OpCode::MOVE: {
+            if (instr.a == instr.b) break;
+            // Inline values are copied as 16 bytes; a heap value on either
+            // side goes through its refcounting assignment
+            a.cmpByte(tagAt(instr.b), tag(Value::Type::String));
+            size_t slowSource = a.jcc(kAboveEqual);
+            a.cmpByte(tagAt(instr.a), tag(Value::Type::String));
+            size_t slowTarget = a.jcc(kAboveEqual);
+            a.movLoad(RAX, tagAt(instr.b));
+            a.movLoad(RCX, payloadAt(instr.b));
+            a.movStore(tagAt(instr.a), RAX);
+            a.movStore(payloadAt(instr.a), RCX);
+            size_t done = a.jmp();
+            a.bind(slowSource, a.size());
+            a.bind(slowTarget, a.size());
+            a.lea(RDI, tagAt(instr.a));
+            a.lea(RSI, tagAt(instr.b));
+            a.call(reinterpret_cast<const void*>(&assignValue));
+            a.bind(done, a.size());
+            break;
+        }
+
+        case OpCode::ADD_INT:
+        case OpCode::SUB_INT:
+        case OpCode::MUL_INT: {
+            Operand lhs = gen.operand(instr.b);
+            Operand rhs = gen.operand(instr.c);
+            if (!gen.guard(lhs, Value::Type::Int) || !gen.guard(rhs, Value::Type::Int)) {
+                gen.exit(kGuardExit);
+                compiled = false;
+                break;
+            }
+            gen.prepareStore(instr.a);
+            gen.loadInt(RAX, lhs);
+            gen.loadInt(RCX, rhs);
+            if (instr.opcode == OpCode::ADD_INT) a.add(RAX, RCX);
+            else if (instr.opcode == OpCode::SUB_INT) a.sub(RAX, RCX);
+            else a.imul(RAX, RCX);
+            gen.store(instr.a, Value::Type::Int, RAX);
+            break;
+        }
+        case OpCode::ADD_FLOAT:
+        case OpCode::SUB_FLOAT:
+        case OpCode::MUL_FLOAT:
+        case OpCode::DIV_FLOAT: {
+            Operand lhs = gen.operand(instr.b);
+            Operand rhs = gen.operand(instr.c);
+            if (!gen.guard(lhs, Value::Type::Float) || !gen.guard(rhs, Value::Type::Float)) {
+                gen.exit(kGuardExit);
+                compiled = false;
+                break;
+            }
+            if (instr.opcode == OpCode::DIV_FLOAT) {
+                // The generic form reports division by zero (of either sign)
+                if (rhs.constant) {
+                    if (rhs.constant->asFloat() == 0.0) {
+                        gen.exit(kGuardExit);
+                        compiled = false;
+                        break;
+                    }
+                } else {
+                    a.movLoad(RAX, payloadAt(rhs.reg));
+                    a.shl1(RAX);
+                    a.test(RAX, RAX);
+                    gen.exitIf(kEqual, kGuardExit);
+                }
+            }
+            gen.prepareStore(instr.a);
+            gen.loadFloat(XMM0, lhs);
+            gen.loadFloat(XMM1, rhs);
+            uint8_t op = instr.opcode == OpCode::ADD_FLOAT   ? kAddsd
+                         : instr.opcode == OpCode::SUB_FLOAT ? kSubsd
+                         : instr.opcode == OpCode::MUL_FLOAT ? kMulsd
+                                                             : kDivsd;
+            a.sse(op, XMM0, XMM1);
+            a.storeByte(tagAt(instr.a), tag(Value::Type::Float));
+            a.movsdStore(payloadAt(instr.a), XMM0);
+            break;
+        }
+
+        case OpCode::EQ_INT: case OpCode::NE_INT: case OpCode::LT_INT:
+        case OpCode::GT_INT: case OpCode::LE_INT: case OpCode::GE_INT:
+        case OpCode::TEST_EQ_INT: case OpCode::TEST_NE_INT: case OpCode::TEST_LT_INT:
+        case OpCode::TEST_GT_INT: case OpCode::TEST_LE_INT: case OpCode::TEST_GE_INT:
+        case OpCode::BRANCH_EQ_INT: case OpCode::BRANCH_NE_INT: case OpCode::BRANCH_LT_INT:
+        case OpCode::BRANCH_GT_INT: case OpCode::BRANCH_LE_INT: case OpCode::BRANCH_GE_INT: {
+            Operand lhs = gen.operand(instr.b);
+            Operand rhs = gen.operand(instr.c);
+            if (!gen.guard(lhs, Value::Type::Int) || !gen.guard(rhs, Value::Type::Int)) {
+                gen.exit(kGuardExit);
+                compiled = false;
+                break;
+            }
+            bool produces = instr.opcode <= OpCode::GE_INT;
+            if (produces) {
+                gen.prepareStore(instr.a);
+            }
+            gen.loadInt(RAX, lhs);
+            gen.loadInt(RCX, rhs);
+            a.cmp(RAX, RCX);
+            Cond holds = condition(instr.opcode);
+            if (produces) {
+                a.setcc(holds);
+                gen.store(instr.a, Value::Type::Bool, RAX);
+            } else if (instr.opcode <= OpCode::TEST_GE_INT) {
+                gen.jumpIf(holds, std::min<uint32_t>(pc + 2, static_cast<uint32_t>(instructions.size())));  // Skip the next one
+            } else {
+                gen.jumpIf(holds, instr.a);
+            }
+            break;
+        }
+        case OpCode::INC:
+        case OpCode::DEC:
+            gen.guard(instr.a, Value::Type::Int);
+            a.addMem(payloadAt(instr.a), instr.opcode == OpCode::INC ? 1 : -1);
+            break;
+        case OpCode::INC_BRANCH_LT: {
+            Operand limit = gen.operand(instr.b);
+            if (!gen.guard(limit, Value::Type::Int)) {
+                gen.exit(kGuardExit);
+                compiled = false;
+                break;
+            }
+            gen.guard(instr.a, Value::Type::Int);
+            a.movLoad(RAX, payloadAt(instr.a));
+            a.addImm(RAX, 1);
+            a.movStore(payloadAt(instr.a), RAX);
+            gen.loadInt(RCX, limit);
+            a.cmp(RAX, RCX);
+            gen.jumpIf(kLess, instr.c);
+            break;
+        }
+
+        case OpCode::JUMP:
+            gen.jumpTo(instr.bx());
+            break;
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE: {
+            // Bools, null and ints inline; other values leave native code
+            bool onTrue = instr.opcode == OpCode::JUMP_IF_TRUE;
+            uint32_t target = instr.bx();
+            a.loadByte(tagAt(instr.a));
+            a.cmpAl(tag(Value::Type::Bool));
+            size_t notBool = a.jcc(kNotEqual);
+            a.cmpByte(payloadAt(instr.a), 0);
+            gen.jumpIf(onTrue ? kNotEqual : kEqual, target);
+            size_t next = a.jmp();
+            a.bind(notBool, a.size());
+            a.cmpAl(tag(Value::Type::Null));
+            size_t notNull = a.jcc(kNotEqual);
+            if (!onTrue) gen.jumpTo(target);
+            size_t nextFromNull = a.jmp();
+            a.bind(notNull, a.size());
+            a.cmpAl(tag(Value::Type::Int));
+            gen.exitIf(kNotEqual);
+            a.cmpMem(payloadAt(instr.a), 0);
+            gen.jumpIf(onTrue ? kNotEqual : kEqual, target);
+            a.bind(next, a.size());
+            a.bind(nextFromNull, a.size());
+            break;
+        }
+
+        case OpCode::INDEX_ARRAY_INT:
+            a.lea(RDI, tagAt(instr.a));
+            a.lea(RSI, tagAt(instr.b));
+            gen.pointerArg(RDX, gen.operand(instr.c));
+            a.call(reinterpret_cast<const void*>(&indexArray));
+            gen.checkStatus();
+            break;
+        case OpCode::GET_MEMBER: {
+            native->members.push_back({this, chunk.names[chunk.bytecode.memberSites[instr.c]],
+                                       &chunk.members[instr.c], &vm.cacheStats});
+            a.movImm(RDI, reinterpret_cast<uint64_t>(&native->members.back()));
+            a.lea(RSI, tagAt(instr.a));
+            a.lea(RDX, tagAt(instr.b));
+            a.call(reinterpret_cast<const void*>(&Jit::getMember));
+            gen.checkStatus();
+            break;
+        }
+        case OpCode::GET_FIELD: {
+            // The shape and slot the interpreter cached for this site
+            const InlineCache::Entry& site = chunk.members[instr.c].entries[0];
+            a.lea(RDI, tagAt(instr.a));
+            a.lea(RSI, tagAt(instr.b));
+            a.movImm(RDX, reinterpret_cast<uint64_t>(site.shape));
+            a.movImm(RCX, site.position);
+            a.call(reinterpret_cast<const void*>(&loadField));
+            gen.checkStatus();
+            break;
+        }
+        case OpCode::CALL: {
+            // Builtins are called from here; a declared function is entered
+            // by the interpreter
+            const VM::CallCache& cache = chunk.calls[instr.b];
+            if (cache.epoch == Environment::functionEpoch && cache.function) {
+                compiled = false;
+                gen.exit();
+                break;
+            }
+            native->calls.push_back({this, &vm, &chunk, instr.b, instr.c, {}});
+            a.movImm(RDI, reinterpret_cast<uint64_t>(&native->calls.back()));
+            a.lea(RSI, tagAt(instr.a));
+            a.call(reinterpret_cast<const void*>(&Jit::callBuiltin));
+            gen.checkStatus();
+            break;
+        }
+
+        default:
+            // A generic instruction the interpreter has not quickened yet
+            // counts as a failed check the first time round, so the function
+            // is recompiled once it has type feedback
+            compiled = false;
+            gen.exit(function.jitCompiles == 1 && quickenable(instr.opcode) &&
+                             instr.deopts <= VM::kMaxDeopts
+                         ? kGuardExit
+                         : 0);
+            break;
+        }
+        native->entries[i] = compiled;
+    }
+
+    // Entering and leaving native code costs about as much as interpreting a
+    // few instructions, so only enter where native code can go round a loop,
+    // or runs a long stretch before leaving (a call to a short function would
+    // run a few instructions and return)
+    constexpr uint32_t kMinStretch = 8;
+    std::vector<bool> loops(instructions.size() + 2, false);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = instructions.size(); i-- > 0;) {
+            if (!native->entries[i] || loops[i]) continue;
+            auto pc = static_cast<uint32_t>(i);
+            const Instruction& instr = instructions[i];
+            int64_t target = branchTarget(instr);
+            bool reaches = (target >= 0 && (target <= pc || loops[static_cast<size_t>(target)])) ||
+                           (instr.opcode != OpCode::JUMP && loops[i + 1]) ||
+                           (isTest(instr.opcode) && loops[i + 2]);
+            if (reaches) {
+                loops[i] = true;
+                changed = true;
+            }
+        }
+    }
+    uint32_t stretch = 0;
+    for (size_t i = instructions.size(); i-- > 0;) {
+        stretch = native->entries[i] ? stretch + 1 : 0;
+        native->entries[i] = loops[i] || stretch >= kMinStretch;
+    }
+
+    std::vector<uint8_t> bytes = gen.finish();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t mappedSize = (bytes.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (mprotect(memory, mappedSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mappedSize);
+        return false;
+    }
+
+    native->memory = memory;
+    native->mappedSize = mappedSize;
+    native->entry = reinterpret_cast<uint32_t (*)(Value*, uint32_t)>(memory);
+    function.native = native.get();
+    code.push_back(std::move(native));
+    ++stats.compiled;
+    return true;
+}
+
+#else
+
+bool Jit::supported() {
+    return false;
+}
+
+bool Jit::compile(VM&, CompiledFunction&, VM::LoadedChunk&) {
+    return false;
+}
+
+#endif
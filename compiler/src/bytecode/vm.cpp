@@ -1,329 +1,956 @@
 #include "../../include/vm.h"
+#include "../../include/jit.h"
+#include "../../include/vm_profiler.h"
+#include "../../include/bytecode_compiler.h"
+#include <algorithm>
+#include <new>
 #include <stdexcept>
-#include <sstream>
-
-std::string VMValue::toString() const {
-    if (isNull()) return "null";
-    if (isInt()) return std::to_string(asInt());
-    if (isFloat()) return std::to_string(asFloat());
-    if (isString()) return asString();
-    if (isBool()) return asBool() ? "true" : "false";
-    if (isArray()) {
-        std::string result = "[";
-        auto arr = std::get<std::shared_ptr<ArrayType>>(data);
-        for (size_t i = 0; i < arr->size(); ++i) {
-            if (i > 0) result += ", ";
-            result += (*arr)[i].toString();
-        }
-        return result + "]";
-    }
-    return "<unknown>";
+
+namespace {
+
+const Symbol selfSymbol("self");
+
+Value constantValue(const ConstantValue& constant) {
+    if (auto* i = std::get_if<int64_t>(&constant)) return Value(*i);
+    if (auto* f = std::get_if<double>(&constant)) return Value(*f);
+    if (auto* s = std::get_if<std::string>(&constant)) return Value(*s);
+    return Value(std::get<bool>(constant));
 }
 
-bool VMValue::isTruthy() const {
-    if (isNull()) return false;
-    if (isBool()) return asBool();
-    if (isInt()) return asInt() != 0;
-    if (isFloat()) return asFloat() != 0.0;
-    if (isString()) return !asString().empty();
-    if (isArray()) return !std::get<std::shared_ptr<ArrayType>>(data)->empty();
-    return true;
+// Operand pairs the fast paths handle; anything else goes through binaryOperation
+inline bool bothInt(const Value& a, const Value& b) { return a.isInt() && b.isInt(); }
+inline bool bothFloat(const Value& a, const Value& b) { return a.isFloat() && b.isFloat(); }
+
+// Interpolation: short pieces are gathered in a buffer and long string values
+// joined as ropes, as in the tree-walker
+Value buildString(Value* parts, size_t count) {
+    Value result{std::string()};
+    std::string buffer;
+    for (size_t i = 0; i < count; ++i) {
+        const Value& part = parts[i];
+        if (part.isString() && part.stringLength() >= Value::kRopeMinLength) {
+            result = Value::concat(Value::concat(result, Value(std::move(buffer))), part);
+            buffer.clear();
+        } else if (part.isString()) {
+            buffer.append(part.asStringView());
+        } else {
+            buffer += part.toString();
+        }
+    }
+    return Value::concat(result, Value(std::move(buffer)));
+}
+
+// Every opcode, in declaration order: the threaded dispatch table is built from this list
+#define SYNTHFLOW_VM_OPCODES(X)                                                          \
+    X(LOAD_CONST) X(LOAD_BOOL) X(LOAD_NULL) X(MOVE) X(CLEAR_LOCALS)                      \
+    X(LOAD_UPVALUE) X(STORE_UPVALUE) X(LOAD_GLOBAL) X(STORE_GLOBAL) X(DEFINE_GLOBAL)     \
+    X(LOAD_SELF)                                                                         \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(NEG) X(INC) X(DEC)                              \
+    X(COMPOUND_ADD) X(COMPOUND_SUB) X(COMPOUND_MUL) X(COMPOUND_DIV)                      \
+    X(EQ) X(NE) X(LT) X(GT) X(LE) X(GE) X(MATCH)                                         \
+    X(TEST_EQ) X(TEST_NE) X(TEST_LT) X(TEST_GT) X(TEST_LE) X(TEST_GE)                    \
+    X(AND) X(OR) X(NOT)                                                                  \
+    X(JUMP) X(JUMP_IF_FALSE) X(JUMP_IF_TRUE)                                             \
+    X(CALL) X(RETURN) X(DECLARE_FUNCTION)                                                \
+    X(MAKE_ARRAY) X(MAKE_MAP) X(INDEX) X(INDEX_SET) X(GET_MEMBER) X(CALL_METHOD)         \
+    X(BUILD_STRING)                                                                      \
+    X(RAISE)                                                                             \
+    X(DEFINE_STRUCT) X(IMPORT)                                                           \
+    X(BRANCH_EQ) X(BRANCH_NE) X(BRANCH_LT) X(BRANCH_GT) X(BRANCH_LE) X(BRANCH_GE)        \
+    X(INC_BRANCH_LT)                                                                     \
+    X(ADD_INT) X(SUB_INT) X(MUL_INT) X(MOD_INT)                                          \
+    X(ADD_FLOAT) X(SUB_FLOAT) X(MUL_FLOAT) X(DIV_FLOAT) X(ADD_STR)                       \
+    X(EQ_INT) X(NE_INT) X(LT_INT) X(GT_INT) X(LE_INT) X(GE_INT)                          \
+    X(TEST_EQ_INT) X(TEST_NE_INT) X(TEST_LT_INT) X(TEST_GT_INT) X(TEST_LE_INT)           \
+    X(TEST_GE_INT)                                                                       \
+    X(BRANCH_EQ_INT) X(BRANCH_NE_INT) X(BRANCH_LT_INT) X(BRANCH_GT_INT) X(BRANCH_LE_INT) \
+    X(BRANCH_GE_INT) X(INDEX_ARRAY_INT) X(GET_FIELD)
+
+#define SYNTHFLOW_VM_OPCODE_ENTRY(op) OpCode::op,
+constexpr OpCode kOpCodeOrder[] = {SYNTHFLOW_VM_OPCODES(SYNTHFLOW_VM_OPCODE_ENTRY)};
+#undef SYNTHFLOW_VM_OPCODE_ENTRY
+
+constexpr bool opcodeListMatchesEnum() {
+    size_t count = sizeof(kOpCodeOrder) / sizeof(kOpCodeOrder[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (static_cast<size_t>(kOpCodeOrder[i]) != i) {
+            return false;
+        }
+    }
+    return count == kOpCodeCount;
+}
+static_assert(opcodeListMatchesEnum(), "SYNTHFLOW_VM_OPCODES must list every OpCode in order");
+
+#define SYNTHFLOW_VM_OPCODE_NAME(op) #op,
+constexpr const char* kOpCodeNames[] = {SYNTHFLOW_VM_OPCODES(SYNTHFLOW_VM_OPCODE_NAME)};
+#undef SYNTHFLOW_VM_OPCODE_NAME
+
+}  // namespace
+
+const char* opcodeName(OpCode op) {
+    auto index = static_cast<size_t>(op);
+    return index < kOpCodeCount ? kOpCodeNames[index] : "?";
 }
 
 VM::VM() {
-    // Register built-in functions
-    registerBuiltin("print", [](std::vector<VMValue>& args) -> VMValue {
-        for (size_t i = 0; i < args.size(); ++i) {
-            if (i > 0) std::cout << " ";
-            std::cout << args[i].toString();
-        }
-        std::cout << "\n";
-        return VMValue();
-    });
-    
-    registerBuiltin("len", [](std::vector<VMValue>& args) -> VMValue {
-        if (args.empty()) return VMValue(0LL);
-        if (args[0].isString()) return VMValue(static_cast<int64_t>(args[0].asString().length()));
-        if (args[0].isArray()) return VMValue(static_cast<int64_t>(std::get<std::shared_ptr<VMValue::ArrayType>>(args[0].data)->size()));
-        return VMValue(0LL);
-    });
-    
-    registerBuiltin("str", [](std::vector<VMValue>& args) -> VMValue {
-        if (args.empty()) return VMValue("");
-        return VMValue(args[0].toString());
-    });
+    // Only the pages the program actually uses are ever touched
+    stack = static_cast<Value*>(::operator new(kStackSize * sizeof(Value)));
+    stackEnd = stack + kStackSize;
+    sp = stack;
+    // Reserved up front so frames never move while the dispatch loop points at them
+    frames.reserve(kMaxFrames);
+    setJit(true);
 }
 
-void VM::push(const VMValue& value) {
-    stack.push_back(value);
+VM::~VM() {
+    frames.clear();
+    popTo(stack);
+    ::operator delete(stack);
 }
 
-VMValue VM::pop() {
-    if (stack.empty()) {
-        throw std::runtime_error("Stack underflow");
+void VM::setJit(bool enabled, uint32_t threshold) {
+    jitThreshold = threshold;
+    if (!enabled) {
+        jit.reset();
+    } else if (!jit && Jit::supported()) {
+        jit = std::make_unique<Jit>(jitStats);
     }
-    VMValue value = stack.back();
-    stack.pop_back();
-    return value;
 }
 
-VMValue& VM::peek(int offset) {
-    return stack[stack.size() - 1 - offset];
+void VM::setProfiler(VMProfiler* newProfiler) {
+    profiler = newProfiler;
+    if (profiler) {
+        setJit(false);
+    }
 }
 
-void VM::registerBuiltin(const std::string& name, 
-                        std::function<VMValue(std::vector<VMValue>&)> func) {
-    builtins[name] = func;
+void VM::overflow() {
+    throw std::runtime_error("Stack overflow");
 }
 
-bool VM::executeInstruction() {
-    if (ip >= chunk->code.size()) return false;
-    
-    Instruction& instr = chunk->code[ip++];
-    
-    switch (instr.opcode) {
-        case OpCode::PUSH_INT:
-            push(VMValue(std::get<int64_t>(chunk->constants[instr.operand])));
-            break;
-            
-        case OpCode::PUSH_FLOAT:
-            push(VMValue(std::get<double>(chunk->constants[instr.operand])));
-            break;
-            
-        case OpCode::PUSH_STRING:
-            push(VMValue(std::get<std::string>(chunk->constants[instr.operand])));
-            break;
-            
-        case OpCode::PUSH_BOOL:
-            push(VMValue(std::get<bool>(chunk->constants[instr.operand])));
-            break;
-            
-        case OpCode::PUSH_NULL:
-            push(VMValue());
-            break;
-            
-        case OpCode::POP:
-            pop();
-            break;
-            
-        case OpCode::DUP:
-            push(peek());
-            break;
-            
-        case OpCode::LOAD_GLOBAL: {
-            uint32_t index = instr.operand;
-            if (index >= globals.size()) {
-                globals.resize(index + 1);
-            }
-            push(globals[index]);
-            break;
-        }
-        
-        case OpCode::STORE_GLOBAL: {
-            uint32_t index = instr.operand;
-            if (index >= globals.size()) {
-                globals.resize(index + 1);
-            }
-            globals[index] = peek();
-            break;
-        }
-        
-        case OpCode::ADD: {
-            VMValue right = pop();
-            VMValue left = pop();
-            if (left.isInt() && right.isInt()) {
-                push(VMValue(left.asInt() + right.asInt()));
-            } else if (left.isString() || right.isString()) {
-                push(VMValue(left.toString() + right.toString()));
-            } else {
-                push(VMValue(left.asFloat() + right.asFloat()));
-            }
-            break;
-        }
-        
-        case OpCode::SUB: {
-            VMValue right = pop();
-            VMValue left = pop();
-            if (left.isInt() && right.isInt()) {
-                push(VMValue(left.asInt() - right.asInt()));
-            } else {
-                push(VMValue(left.asFloat() - right.asFloat()));
-            }
-            break;
-        }
-        
-        case OpCode::MUL: {
-            VMValue right = pop();
-            VMValue left = pop();
-            if (left.isInt() && right.isInt()) {
-                push(VMValue(left.asInt() * right.asInt()));
-            } else {
-                push(VMValue(left.asFloat() * right.asFloat()));
-            }
-            break;
-        }
-        
-        case OpCode::DIV: {
-            VMValue right = pop();
-            VMValue left = pop();
-            if (right.isInt() && right.asInt() == 0) {
-                throw std::runtime_error("Division by zero");
-            }
-            if (right.isFloat() && right.asFloat() == 0.0) {
-                throw std::runtime_error("Division by zero");
-            }
-            if (left.isInt() && right.isInt()) {
-                push(VMValue(left.asInt() / right.asInt()));
-            } else {
-                push(VMValue(left.asFloat() / right.asFloat()));
-            }
-            break;
-        }
-        
-        case OpCode::MOD: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.asInt() % right.asInt()));
-            break;
-        }
-        
-        case OpCode::NEG:
-            if (peek().isInt()) {
-                push(VMValue(-pop().asInt()));
-            } else {
-                push(VMValue(-pop().asFloat()));
-            }
-            break;
-        
-        case OpCode::EQ: {
-            VMValue right = pop();
-            VMValue left = pop();
-            if (left.isInt() && right.isInt()) {
-                push(VMValue(left.asInt() == right.asInt()));
-            } else if (left.isString() && right.isString()) {
-                push(VMValue(left.asString() == right.asString()));
-            } else {
-                push(VMValue(left.asFloat() == right.asFloat()));
+VM::LoadedChunk& VM::load(BytecodeChunk bytecode, std::shared_ptr<Environment> env) {
+    auto chunk = std::make_unique<LoadedChunk>();
+    chunk->bytecode = std::move(bytecode);
+    chunk->env = std::move(env);
+
+    // Literals are built once; string constants are shared, not copied, on each push
+    for (const auto& constant : chunk->bytecode.constants) {
+        chunk->constants.push_back(constantValue(constant));
+    }
+    for (const auto& name : chunk->bytecode.names) {
+        chunk->names.emplace_back(name);
+    }
+    for (const auto& function : chunk->bytecode.functions) {
+        chunk->functionNames.emplace_back(function.name);
+    }
+    chunk->globals.assign(chunk->names.size(), nullptr);
+    chunk->calls.resize(chunk->names.size());
+    chunk->members.resize(chunk->bytecode.memberSites.size());
+
+    chunks.push_back(std::move(chunk));
+    return *chunks.back();
+}
+
+BytecodeChunk VM::compileModule(const ImportInfo& info, const std::string& source) {
+    // A transformed module's code depends on more than its source (the
+    // optimizer looks at the whole program), so it is not cached
+    const BytecodeCache* cache = hasModuleTransform() ? nullptr : bytecodeCache;
+    if (cache) {
+        if (auto cached = cache->load(source)) {
+            return std::move(*cached);
+        }
+    }
+
+    auto statements = parseModule(source, info.moduleName, info.modulePath);
+    resolveModule(statements);
+    BytecodeCompiler compiler;
+    BytecodeChunk chunk = compiler.compile(statements);
+
+    if (cache) {
+        cache->store(source, chunk);
+    }
+    return chunk;
+}
+
+void VM::run(BytecodeChunk chunk) {
+    runChunk(load(std::move(chunk), runtime.getGlobalEnv()));
+}
+
+void VM::runChunk(LoadedChunk& chunk) {
+    CompiledFunction& main = chunk.bytecode.functions[0];
+
+    CallFrame frame;
+    frame.function = &main;
+    frame.chunk = &chunk;
+    frame.ip = main.code.data();
+    frame.base = sp;
+    frame.heap = std::make_shared<Environment>(chunk.env, static_cast<size_t>(main.registerCount));
+    frame.registers = main.registerCount > 0 ? &frame.heap->slotAt(0, 0) : nullptr;
+
+    if (frames.size() == kMaxFrames) {
+        overflow();
+    }
+    size_t baseDepth = frames.size();
+    frames.push_back(std::move(frame));
+    execute(baseDepth);
+}
+
+void VM::enter(const Function& function, Value* args, uint32_t argc) {
+    CompiledFunction* code = function.code;
+    auto registerCount = static_cast<uint32_t>(code->registerCount);
+    if (frames.size() == kMaxFrames) {
+        overflow();
+    }
+
+    // Extra arguments are dropped and missing ones are null
+    argc = std::min(argc, static_cast<uint32_t>(code->parameters.size()));
+
+    CallFrame frame;
+    frame.function = code;
+    frame.chunk = function.chunk;
+    frame.ip = code->code.data();
+    frame.base = sp;
+    if (code->frameCaptured) {
+        // The registers live in the heap frame the closures will share
+        frame.heap = std::make_shared<Environment>(function.closure, static_cast<size_t>(registerCount));
+        for (uint32_t i = 0; i < argc; ++i) {
+            frame.heap->slotAt(0, static_cast<int>(i)) = std::move(args[i]);
+        }
+        frame.registers = registerCount > 0 ? &frame.heap->slotAt(0, 0) : nullptr;
+    } else {
+        // Parameters are the first registers; the rest start out null
+        if (static_cast<size_t>(stackEnd - sp) < registerCount) {
+            overflow();
+        }
+        for (uint32_t i = 0; i < argc; ++i) {
+            new (sp++) Value(std::move(args[i]));
+        }
+        for (uint32_t i = argc; i < registerCount; ++i) {
+            new (sp++) Value();
+        }
+        frame.registers = frame.base;
+    }
+    if (code->usesUpvalues) {
+        frame.closure = function.closure;
+    }
+    frames.push_back(std::move(frame));
+}
+
+// Same precedence as the tree-walker: declared functions, then global builtins
+void VM::resolveCall(LoadedChunk& chunk, uint32_t name) {
+    CallCache& cache = chunk.calls[name];
+    Symbol symbol = chunk.names[name];
+    cache.function = nullptr;
+    cache.native = nullptr;
+
+    auto it = functions.find(symbol);
+    if (it != functions.end()) {
+        cache.function = &it->second;
+    } else if (const Value* funcVal = runtime.getGlobalEnv()->find(symbol)) {
+        if (funcVal->isFunction()) {
+            cache.native = funcVal->asFunction().get();
+        }
+    }
+    if (!cache.function && !cache.native) {
+        cache.epoch = 0;
+        throw std::runtime_error("Undefined function: " + symbol.str());
+    }
+    cache.epoch = Environment::functionEpoch;
+}
+
+void VM::jitEntry(CallFrame& frame, Instruction*& ip) {
+    CompiledFunction& function = *frame.function;
+    if (!function.native &&
+        (++function.hotness < jitThreshold || !jit->compile(*this, function, *frame.chunk))) {
+        return;
+    }
+    Instruction* code = function.code.data();
+    ip = code + jit->run(*function.native, frame.registers, static_cast<uint32_t>(ip - code));
+    if (jit->raised()) {
+        ++ip;
+        jit->rethrow();
+    }
+}
+
+bool VM::unwind(const std::exception& error, size_t baseDepth) {
+    while (frames.size() > baseDepth) {
+        CallFrame& frame = frames.back();
+        CompiledFunction& function = *frame.function;
+        // Every frame's ip is just past the instruction that raised the error
+        // or made the call it came from
+        auto pc = static_cast<uint32_t>(frame.ip - function.code.data() - 1);
+        for (const ExceptionHandler& handler : function.handlers) {
+            if (pc >= handler.start && pc < handler.end) {
+                // The frames above are gone, so the stack is back at this frame's height
+                frame.registers[handler.messageRegister] = Value(std::string(error.what()));
+                frame.ip = function.code.data() + handler.target;
+                return true;
             }
-            break;
-        }
-        
-        case OpCode::NE: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.toString() != right.toString()));
-            break;
-        }
-        
-        case OpCode::LT: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.asFloat() < right.asFloat()));
-            break;
-        }
-        
-        case OpCode::GT: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.asFloat() > right.asFloat()));
-            break;
-        }
-        
-        case OpCode::LE: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.asFloat() <= right.asFloat()));
-            break;
-        }
-        
-        case OpCode::GE: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.asFloat() >= right.asFloat()));
-            break;
-        }
-        
-        case OpCode::AND: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.isTruthy() && right.isTruthy()));
-            break;
-        }
-        
-        case OpCode::OR: {
-            VMValue right = pop();
-            VMValue left = pop();
-            push(VMValue(left.isTruthy() || right.isTruthy()));
-            break;
-        }
-        
-        case OpCode::NOT:
-            push(VMValue(!pop().isTruthy()));
-            break;
-        
-        case OpCode::JUMP:
-            ip = instr.operand;
-            break;
-            
-        case OpCode::JUMP_IF_FALSE:
-            if (!pop().isTruthy()) {
-                ip = instr.operand;
+        }
+        popTo(frame.base);
+        frames.pop_back();
+    }
+    return false;
+}
+
+void VM::execute(size_t baseDepth) {
+    if (profiler) {
+        dispatch<true>(baseDepth);
+    } else {
+        dispatch<false>(baseDepth);
+    }
+}
+
+// Instruction dispatch. With GCC and Clang each handler jumps straight to the
+// next one through a table of label addresses (direct threading), so every
+// handler ends in its own indirect branch; other compilers, and builds with
+// SYNTHFLOW_VM_SWITCH_DISPATCH defined, run a switch in a loop.
+//
+// A computed goto leaves the handler's scope without running destructors, so
+// a handler never reaches SYNTHFLOW_VM_NEXT with an object (Value, vector,
+// shared_ptr) in scope: it builds them in an inner block closed first.
+#if defined(__GNUC__) && !defined(SYNTHFLOW_VM_SWITCH_DISPATCH)
+#define SYNTHFLOW_VM_THREADED 1
+#endif
+
+#ifdef SYNTHFLOW_VM_THREADED
+#define SYNTHFLOW_VM_CASE(op) op_##op:
+#define SYNTHFLOW_VM_NEXT()                                                \
+    do {                                                                   \
+        instr = *ip++;                                                     \
+        SYNTHFLOW_VM_PROFILE();                                            \
+        goto *dispatchTable[static_cast<uint8_t>(instr.opcode)];           \
+    } while (0)
+#define SYNTHFLOW_VM_DISPATCH_BEGIN \
+    for (;;) {                      \
+        try {                       \
+            SYNTHFLOW_VM_NEXT();
+#define SYNTHFLOW_VM_DISPATCH_END \
+        }                         \
+        SYNTHFLOW_VM_CATCH        \
+    }
+// Labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define SYNTHFLOW_VM_CASE(op) case OpCode::op:
+#define SYNTHFLOW_VM_NEXT() break
+#define SYNTHFLOW_VM_DISPATCH_BEGIN   \
+    for (;;) {                        \
+        try {                         \
+            for (;;) {                \
+                instr = *ip++;        \
+                SYNTHFLOW_VM_PROFILE(); \
+                switch (instr.opcode) {
+#define SYNTHFLOW_VM_DISPATCH_END \
+                }                 \
+            }                     \
+        }                         \
+        SYNTHFLOW_VM_CATCH        \
+    }
+#endif
+
+// The handler loop runs in a try block, which costs nothing until an error is
+// raised. A catch clause in this run resumes the loop at the clause; otherwise
+// the error propagates with the frames of this run gone.
+#define SYNTHFLOW_VM_CATCH                          \
+    catch (const std::exception& error) {           \
+        frame->ip = ip;                             \
+        if (!unwind(error, baseDepth)) throw;       \
+        reload();                                   \
+    }
+
+// Compiled out of the dispatch loop that runs without a profiler
+#define SYNTHFLOW_VM_PROFILE()                     \
+    if constexpr (kProfile) {                      \
+        ++pcCounts[ip - 1 - code];                 \
+        profiler->step(instr.opcode);              \
+    }
+
+// Quickening rewrites the instruction being executed (ip[-1]) in place.
+// Instructions that keep failing their guard are left generic.
+#define SYNTHFLOW_VM_QUICKEN(op)                    \
+    if (ip[-1].deopts <= kMaxDeopts) {              \
+        ip[-1].opcode = OpCode::op;                 \
+        ++quickeningStats.quickened;                \
+    }
+#define SYNTHFLOW_VM_DEOPTIMIZE(generic)            \
+    {                                               \
+        ip[-1].opcode = OpCode::generic;            \
+        ++ip[-1].deopts;                            \
+        ++quickeningStats.deoptimized;              \
+        --ip;                                       \
+        SYNTHFLOW_VM_NEXT();                        \
+    }
+
+// Calls and taken backward branches (loop back edges) are where the JIT takes
+// over a hot function
+#define SYNTHFLOW_VM_JUMP(target)                                \
+    {                                                            \
+        Instruction* dest = code + (target);                     \
+        bool backEdge = dest < ip;                               \
+        ip = dest;                                               \
+        if (backEdge && jit) jitEntry(*frame, ip);               \
+    }
+
+template <bool kProfile>
+void VM::dispatch(size_t baseDepth) {
+    CallFrame* frame = &frames.back();
+    Instruction* code = frame->function->code.data();
+    Instruction* ip = frame->ip;
+    Value* regs = frame->registers;
+    LoadedChunk* chunk = frame->chunk;
+    const Value* constants = chunk->constants.data();
+    uint64_t* pcCounts = kProfile ? profiler->countsFor(*frame->function) : nullptr;
+
+    // Calls and returns switch to another frame
+    auto reload = [&]() {
+        frame = &frames.back();
+        code = frame->function->code.data();
+        ip = frame->ip;
+        regs = frame->registers;
+        chunk = frame->chunk;
+        constants = chunk->constants.data();
+        if constexpr (kProfile) {
+            pcCounts = profiler->countsFor(*frame->function);
+        }
+    };
+
+#define RK(operand) \
+    (((operand) & kConstantOperand) ? constants[(operand) & kMaxOperand] : regs[(operand)])
+
+#ifdef SYNTHFLOW_VM_THREADED
+#define SYNTHFLOW_VM_LABEL(op) &&op_##op,
+    static const void* const dispatchTable[] = {SYNTHFLOW_VM_OPCODES(SYNTHFLOW_VM_LABEL)};
+#undef SYNTHFLOW_VM_LABEL
+#endif
+
+    Instruction instr = *ip;
+    SYNTHFLOW_VM_DISPATCH_BEGIN
+    // Loads and moves
+    SYNTHFLOW_VM_CASE(LOAD_CONST)
+        regs[instr.a] = chunk->constants[instr.bx()];
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(LOAD_BOOL)
+        regs[instr.a] = Value(instr.b != 0);
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(LOAD_NULL)
+        regs[instr.a] = Value();
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(MOVE)
+        regs[instr.a] = regs[instr.b];
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(CLEAR_LOCALS)
+        for (uint32_t i = 0; i < instr.b; ++i) {
+            regs[instr.a + i] = Value();
+        }
+        SYNTHFLOW_VM_NEXT();
+
+    // Variables
+    SYNTHFLOW_VM_CASE(LOAD_UPVALUE)
+        regs[instr.a] = frame->closure->slotAt(instr.c - 1, instr.b);
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(STORE_UPVALUE)
+        frame->closure->slotAt(instr.c - 1, instr.b) = regs[instr.a];
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(LOAD_GLOBAL) {
+        uint32_t name = instr.bx();
+        Value* binding = chunk->globals[name];
+        if (!binding) {
+            // Names bound in an enclosing scope (module -> global) are not cached,
+            // since the module may shadow them later
+            binding = chunk->env->find(chunk->names[name]);
+            if (!binding) {
+                regs[instr.a] = chunk->env->get(chunk->names[name]);
+                SYNTHFLOW_VM_NEXT();
             }
-            break;
-            
-        case OpCode::JUMP_IF_TRUE:
-            if (pop().isTruthy()) {
-                ip = instr.operand;
+            chunk->globals[name] = binding;
+        }
+        regs[instr.a] = *binding;
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(STORE_GLOBAL) {
+        uint32_t name = instr.bx();
+        const Value& value = regs[instr.a];
+        Value* binding = chunk->globals[name];
+        if (!binding) {
+            binding = chunk->env->find(chunk->names[name]);
+            if (!binding) {
+                chunk->env->set(chunk->names[name], value);
+                SYNTHFLOW_VM_NEXT();
             }
-            break;
-        
-        case OpCode::PRINT: {
-            VMValue val = pop();
-            std::cout << val.toString() << "\n";
-            break;
-        }
-        
-        case OpCode::MAKE_ARRAY: {
-            auto arr = std::make_shared<VMValue::ArrayType>();
-            for (uint32_t i = 0; i < instr.operand; ++i) {
-                arr->insert(arr->begin(), pop());
+            chunk->globals[name] = binding;
+        }
+        // Same bookkeeping as Environment::set
+        if (binding->isFunction() || value.isFunction()) {
+            ++Environment::functionEpoch;
+        }
+        *binding = value;
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(DEFINE_GLOBAL)
+        chunk->env->define(chunk->names[instr.bx()], regs[instr.a]);
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(LOAD_SELF)
+        // 'self' should be defined in the current environment when inside a method
+        if (!chunk->env->exists(selfSymbol)) {
+            throw std::runtime_error("'self' is not defined in current context");
+        }
+        regs[instr.a] = chunk->env->get(selfSymbol);
+        SYNTHFLOW_VM_NEXT();
+
+    // Arithmetic: the generic forms quicken themselves for the operand types they see
+    SYNTHFLOW_VM_CASE(ADD) {
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothInt(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(ADD_INT);
+            regs[instr.a] = Value(a.asInt() + b.asInt());
+        } else if (bothFloat(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(ADD_FLOAT);
+            regs[instr.a] = Value(a.asFloat() + b.asFloat());
+        } else {
+            if (a.isString() && b.isString()) {
+                SYNTHFLOW_VM_QUICKEN(ADD_STR);
             }
-            push(VMValue(arr));
-            break;
-        }
-        
-        case OpCode::INDEX: {
-            VMValue index = pop();
-            VMValue arr = pop();
-            if (!arr.isArray()) {
-                throw std::runtime_error("Cannot index non-array");
+            regs[instr.a] = binaryOperation(BinaryOp::Add, a, b);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(SUB) {
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothInt(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(SUB_INT);
+            regs[instr.a] = Value(a.asInt() - b.asInt());
+        } else if (bothFloat(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(SUB_FLOAT);
+            regs[instr.a] = Value(a.asFloat() - b.asFloat());
+        } else {
+            regs[instr.a] = binaryOperation(BinaryOp::Sub, a, b);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(MUL) {
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothInt(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(MUL_INT);
+            regs[instr.a] = Value(a.asInt() * b.asInt());
+        } else if (bothFloat(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(MUL_FLOAT);
+            regs[instr.a] = Value(a.asFloat() * b.asFloat());
+        } else {
+            regs[instr.a] = binaryOperation(BinaryOp::Mul, a, b);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(DIV) {
+        // Division always produces a float; the generic path reports division by zero
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothFloat(a, b) && b.asFloat() != 0.0) {
+            SYNTHFLOW_VM_QUICKEN(DIV_FLOAT);
+            regs[instr.a] = Value(a.asFloat() / b.asFloat());
+        } else {
+            regs[instr.a] = binaryOperation(BinaryOp::Div, a, b);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(MOD) {
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothInt(a, b)) {
+            SYNTHFLOW_VM_QUICKEN(MOD_INT);
+        }
+        regs[instr.a] = binaryOperation(BinaryOp::Mod, a, b);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(NEG)
+        regs[instr.a] = unaryOperation(UnaryOp::Neg, RK(instr.b));
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(INC) {
+        Value& value = regs[instr.a];
+        if (value.isInt()) value = Value(value.asInt() + 1);
+        else value = updateOperation(value, true);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(DEC) {
+        Value& value = regs[instr.a];
+        if (value.isInt()) value = Value(value.asInt() - 1);
+        else value = updateOperation(value, false);
+        SYNTHFLOW_VM_NEXT();
+    }
+
+    // Compound assignment
+    SYNTHFLOW_VM_CASE(COMPOUND_ADD) {
+        const Value& a = RK(instr.b);
+        const Value& b = RK(instr.c);
+        if (bothInt(a, b)) regs[instr.a] = Value(a.asInt() + b.asInt());
+        else regs[instr.a] = compoundOperation(BinaryOp::Add, a, b);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(COMPOUND_SUB)
+        regs[instr.a] = compoundOperation(BinaryOp::Sub, RK(instr.b), RK(instr.c));
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(COMPOUND_MUL)
+        regs[instr.a] = compoundOperation(BinaryOp::Mul, RK(instr.b), RK(instr.c));
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(COMPOUND_DIV)
+        regs[instr.a] = compoundOperation(BinaryOp::Div, RK(instr.b), RK(instr.c));
+        SYNTHFLOW_VM_NEXT();
+
+    // Comparisons, and the tests and branches they guard
+#define SYNTHFLOW_VM_COMPARE(OPCODE, TEST_OPCODE, BRANCH_OPCODE, BINARY_OP, CMP)      \
+    SYNTHFLOW_VM_CASE(OPCODE) {                                                       \
+        const Value& a = RK(instr.b);                                                 \
+        const Value& b = RK(instr.c);                                                 \
+        if (bothInt(a, b)) {                                                          \
+            SYNTHFLOW_VM_QUICKEN(OPCODE##_INT);                                       \
+            regs[instr.a] = Value(a.asInt() CMP b.asInt());                           \
+        } else if (bothFloat(a, b)) {                                                 \
+            regs[instr.a] = Value(a.asFloat() CMP b.asFloat());                       \
+        } else {                                                                      \
+            regs[instr.a] = binaryOperation(BinaryOp::BINARY_OP, a, b);               \
+        }                                                                             \
+        SYNTHFLOW_VM_NEXT();                                                          \
+    }                                                                                 \
+    SYNTHFLOW_VM_CASE(TEST_OPCODE) {                                                  \
+        const Value& a = RK(instr.b);                                                 \
+        const Value& b = RK(instr.c);                                                 \
+        bool holds;                                                                   \
+        if (bothInt(a, b)) {                                                          \
+            SYNTHFLOW_VM_QUICKEN(TEST_OPCODE##_INT);                                  \
+            holds = a.asInt() CMP b.asInt();                                          \
+        } else if (bothFloat(a, b)) {                                                 \
+            holds = a.asFloat() CMP b.asFloat();                                      \
+        } else {                                                                      \
+            holds = binaryOperation(BinaryOp::BINARY_OP, a, b).isTruthy();            \
+        }                                                                             \
+        if (holds) ++ip;                                                              \
+        SYNTHFLOW_VM_NEXT();                                                          \
+    }                                                                                 \
+    SYNTHFLOW_VM_CASE(BRANCH_OPCODE) {                                                \
+        const Value& a = RK(instr.b);                                                 \
+        const Value& b = RK(instr.c);                                                 \
+        bool holds;                                                                   \
+        if (bothInt(a, b)) {                                                          \
+            SYNTHFLOW_VM_QUICKEN(BRANCH_OPCODE##_INT);                                \
+            holds = a.asInt() CMP b.asInt();                                          \
+        } else if (bothFloat(a, b)) {                                                 \
+            holds = a.asFloat() CMP b.asFloat();                                      \
+        } else {                                                                      \
+            holds = binaryOperation(BinaryOp::BINARY_OP, a, b).isTruthy();            \
+        }                                                                             \
+        if (holds) SYNTHFLOW_VM_JUMP(instr.a)                                         \
+        SYNTHFLOW_VM_NEXT();                                                          \
+    }
+    SYNTHFLOW_VM_COMPARE(EQ, TEST_EQ, BRANCH_EQ, Eq, ==)
+    SYNTHFLOW_VM_COMPARE(NE, TEST_NE, BRANCH_NE, Ne, !=)
+    SYNTHFLOW_VM_COMPARE(LT, TEST_LT, BRANCH_LT, Lt, <)
+    SYNTHFLOW_VM_COMPARE(GT, TEST_GT, BRANCH_GT, Gt, >)
+    SYNTHFLOW_VM_COMPARE(LE, TEST_LE, BRANCH_LE, Le, <=)
+    SYNTHFLOW_VM_COMPARE(GE, TEST_GE, BRANCH_GE, Ge, >=)
+#undef SYNTHFLOW_VM_COMPARE
+    SYNTHFLOW_VM_CASE(MATCH)
+        regs[instr.a] = Value(matchesPattern(RK(instr.b), RK(instr.c)));
+        SYNTHFLOW_VM_NEXT();
+
+    // Logical operations (both operands were evaluated)
+    SYNTHFLOW_VM_CASE(AND)
+        regs[instr.a] = Value(RK(instr.b).isTruthy() && RK(instr.c).isTruthy());
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(OR)
+        regs[instr.a] = Value(RK(instr.b).isTruthy() || RK(instr.c).isTruthy());
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(NOT)
+        regs[instr.a] = Value(!RK(instr.b).isTruthy());
+        SYNTHFLOW_VM_NEXT();
+
+    // Control flow
+    SYNTHFLOW_VM_CASE(JUMP)
+        SYNTHFLOW_VM_JUMP(instr.bx())
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(JUMP_IF_FALSE)
+        if (!regs[instr.a].isTruthy()) {
+            SYNTHFLOW_VM_JUMP(instr.bx())
+        }
+        SYNTHFLOW_VM_NEXT();
+    SYNTHFLOW_VM_CASE(JUMP_IF_TRUE)
+        if (regs[instr.a].isTruthy()) {
+            SYNTHFLOW_VM_JUMP(instr.bx())
+        }
+        SYNTHFLOW_VM_NEXT();
+
+    // Functions
+    SYNTHFLOW_VM_CASE(CALL) {
+        CallCache& cache = chunk->calls[instr.b];
+        if (cache.epoch != Environment::functionEpoch) {
+            resolveCall(*chunk, instr.b);
+        }
+        if (cache.function) {
+            frame->ip = ip;
+            enter(*cache.function, regs + instr.a, instr.c);
+            reload();
+            if (jit) jitEntry(*frame, ip);
+            SYNTHFLOW_VM_NEXT();
+        }
+        {
+            Value* args = regs + instr.a;
+            std::vector<Value> argv(std::make_move_iterator(args), std::make_move_iterator(args + instr.c));
+            regs[instr.a] = (*cache.native)(argv, runtime);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(RETURN) {
+        {
+            Value result = RK(instr.a);
+            popTo(frame->base);
+            frames.pop_back();
+            if (frames.size() == baseDepth) {
+                return;
             }
-            auto arrPtr = std::get<std::shared_ptr<VMValue::ArrayType>>(arr.data);
-            size_t idx = static_cast<size_t>(index.asInt());
-            if (idx >= arrPtr->size()) {
-                throw std::runtime_error("Array index out of bounds");
+            reload();
+            // The caller resumes after its CALL, whose first register takes the result
+            regs[ip[-1].a] = std::move(result);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(DECLARE_FUNCTION) {
+        uint32_t index = instr.bx();
+        Function& function = functions[chunk->functionNames[index]];
+        function.code = &chunk->bytecode.functions[index];
+        function.chunk = chunk;
+        function.closure = frame->heap;
+        ++Environment::functionEpoch;
+        SYNTHFLOW_VM_NEXT();
+    }
+
+    // Arrays and maps
+    SYNTHFLOW_VM_CASE(MAKE_ARRAY) {
+        {
+            Value* elements = regs + instr.b;
+            auto arr = Value::make<Value::ArrayType>(std::make_move_iterator(elements),
+                                                          std::make_move_iterator(elements + instr.c));
+            regs[instr.a] = Value(arr);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(MAKE_MAP) {
+        {
+            const MapLayout& layout = chunk->bytecode.mapLayouts[instr.c];
+            auto map = Value::make<Value::MapType>();
+            Value* entry = regs + instr.b;
+            for (int32_t key : layout.keys) {
+                if (key >= 0) {
+                    (*map)[chunk->names[static_cast<size_t>(key)]] = std::move(*entry++);
+                } else {
+                    // Computed keys are not interned
+                    const Value& keyVal = *entry++;
+                    (*map)[MapKey::of(keyVal.isString() ? keyVal.asString() : keyVal.toString())] =
+                        std::move(*entry++);
+                }
             }
-            push((*arrPtr)[idx]);
-            break;
+            regs[instr.a] = Value(map);
         }
-        
-        case OpCode::HALT:
-            return false;
-            
-        default:
-            throw std::runtime_error("Unknown opcode");
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(INDEX) {
+        const Value& arr = regs[instr.b];
+        const Value& idx = RK(instr.c);
+        if (!arr.isArray()) {
+            throw std::runtime_error("Cannot index non-array");
+        }
+        if (!idx.isInt()) {
+            throw std::runtime_error("Array index must be integer");
+        }
+        SYNTHFLOW_VM_QUICKEN(INDEX_ARRAY_INT);
+        auto index = static_cast<size_t>(idx.asInt());
+        const auto& elements = *arr.asArray();
+        if (index >= elements.size()) {
+            throw std::runtime_error("Array index out of bounds");
+        }
+        // Copied before the store, which may release the array
+        regs[instr.a] = Value(elements[index]);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(INDEX_SET) {
+        const Value& arr = regs[instr.a];
+        const Value& idx = RK(instr.b);
+        if (!arr.isArray()) {
+            throw std::runtime_error("Cannot index non-array");
+        }
+        if (!idx.isInt()) {
+            throw std::runtime_error("Array index must be integer");
+        }
+        auto index = static_cast<size_t>(idx.asInt());
+        auto& elements = *arr.asArray();
+        if (index >= elements.size()) {
+            throw std::runtime_error("Array index out of bounds");
+        }
+        elements[index] = RK(instr.c);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(GET_MEMBER) {
+        Symbol member = chunk->names[chunk->bytecode.memberSites[instr.c]];
+        InlineCache& cache = chunk->members[instr.c];
+        // A site whose first receiver is a struct becomes a slot load for its shape
+        bool quicken = regs[instr.b].isStruct() && cache.size == 0;
+        regs[instr.a] = loadMember(regs[instr.b], member, cache, cacheStats);
+        if (quicken && cache.size == 1) SYNTHFLOW_VM_QUICKEN(GET_FIELD);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(CALL_METHOD) {
+        {
+            Symbol method = chunk->names[chunk->bytecode.memberSites[instr.b]];
+            Value* object = regs + instr.a;
+            std::vector<Value> args(std::make_move_iterator(object + 1), std::make_move_iterator(object + 1 + instr.c));
+            regs[instr.a] = invokeMethod(*object, method, args, chunk->members[instr.b], cacheStats);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+
+    // Strings
+    SYNTHFLOW_VM_CASE(BUILD_STRING)
+        regs[instr.a] = buildString(regs + instr.b, instr.c);
+        SYNTHFLOW_VM_NEXT();
+
+    // Exceptions
+    SYNTHFLOW_VM_CASE(RAISE)
+        throw std::runtime_error(chunk->constants[instr.bx()].asString());
+
+    // Declarations
+    SYNTHFLOW_VM_CASE(DEFINE_STRUCT) {
+        {
+            const StructInfo& info = chunk->bytecode.structs[instr.bx()];
+            std::vector<Symbol> fields(info.fields.begin(), info.fields.end());
+            runtime.defineStruct(info.name, fields);
+        }
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(IMPORT) {
+        {
+            const ImportInfo& info = chunk->bytecode.imports[instr.bx()];
+            std::string source = readModuleSource(info.moduleName, info.modulePath);
+            BytecodeChunk module = compileModule(info, source);
+
+            // The module runs in its own environment; its bindings become the export map
+            auto moduleEnv = std::make_shared<Environment>(runtime.getGlobalEnv());
+            frame->ip = ip;
+            runChunk(load(std::move(module), moduleEnv));
+            reload();
+            regs[instr.a] = exportModule(*moduleEnv);
+        }
+        SYNTHFLOW_VM_NEXT();
     }
-    
-    return true;
-}
 
-void VM::run(BytecodeChunk& bytecode) {
-    chunk = &bytecode;
-    ip = 0;
-    stack.clear();
-    globals.clear();
-    
-    while (executeInstruction()) {
-        // Continue execution
+    // Superinstructions
+    SYNTHFLOW_VM_CASE(INC_BRANCH_LT) {
+        Value& counter = regs[instr.a];
+        if (counter.isInt()) counter = Value(counter.asInt() + 1);
+        else counter = updateOperation(counter, true);
+        const Value& limit = RK(instr.b);
+        bool holds;
+        if (bothInt(counter, limit)) {
+            holds = counter.asInt() < limit.asInt();
+        } else if (bothFloat(counter, limit)) {
+            holds = counter.asFloat() < limit.asFloat();
+        } else {
+            holds = binaryOperation(BinaryOp::Lt, counter, limit).isTruthy();
+        }
+        if (holds) SYNTHFLOW_VM_JUMP(instr.c)
+        SYNTHFLOW_VM_NEXT();
+    }
+
+    // Quickened forms: a failed guard reverts the instruction and runs the generic form
+#define SYNTHFLOW_VM_SPECIALIZED(OPCODE, GENERIC, GUARD, RESULT) \
+    SYNTHFLOW_VM_CASE(OPCODE) {                                  \
+        const Value& a = RK(instr.b);                            \
+        const Value& b = RK(instr.c);                            \
+        if (!(GUARD)) SYNTHFLOW_VM_DEOPTIMIZE(GENERIC)           \
+        regs[instr.a] = Value(RESULT);                           \
+        SYNTHFLOW_VM_NEXT();                                     \
+    }
+    SYNTHFLOW_VM_SPECIALIZED(ADD_INT, ADD, bothInt(a, b), a.asInt() + b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(SUB_INT, SUB, bothInt(a, b), a.asInt() - b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(MUL_INT, MUL, bothInt(a, b), a.asInt() * b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(MOD_INT, MOD, bothInt(a, b), a.asInt() % b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(ADD_FLOAT, ADD, bothFloat(a, b), a.asFloat() + b.asFloat())
+    SYNTHFLOW_VM_SPECIALIZED(SUB_FLOAT, SUB, bothFloat(a, b), a.asFloat() - b.asFloat())
+    SYNTHFLOW_VM_SPECIALIZED(MUL_FLOAT, MUL, bothFloat(a, b), a.asFloat() * b.asFloat())
+    SYNTHFLOW_VM_SPECIALIZED(DIV_FLOAT, DIV, bothFloat(a, b) && b.asFloat() != 0.0, a.asFloat() / b.asFloat())
+    SYNTHFLOW_VM_SPECIALIZED(ADD_STR, ADD, a.isString() && b.isString(), Value::concat(a, b))
+    SYNTHFLOW_VM_SPECIALIZED(EQ_INT, EQ, bothInt(a, b), a.asInt() == b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(NE_INT, NE, bothInt(a, b), a.asInt() != b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(LT_INT, LT, bothInt(a, b), a.asInt() < b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(GT_INT, GT, bothInt(a, b), a.asInt() > b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(LE_INT, LE, bothInt(a, b), a.asInt() <= b.asInt())
+    SYNTHFLOW_VM_SPECIALIZED(GE_INT, GE, bothInt(a, b), a.asInt() >= b.asInt())
+#undef SYNTHFLOW_VM_SPECIALIZED
+#define SYNTHFLOW_VM_SPECIALIZED_TEST(OPCODE, GENERIC, CMP)     \
+    SYNTHFLOW_VM_CASE(OPCODE) {                                 \
+        const Value& a = RK(instr.b);                           \
+        const Value& b = RK(instr.c);                           \
+        if (!bothInt(a, b)) SYNTHFLOW_VM_DEOPTIMIZE(GENERIC)    \
+        if (a.asInt() CMP b.asInt()) ++ip;                      \
+        SYNTHFLOW_VM_NEXT();                                    \
     }
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_EQ_INT, TEST_EQ, ==)
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_NE_INT, TEST_NE, !=)
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_LT_INT, TEST_LT, <)
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_GT_INT, TEST_GT, >)
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_LE_INT, TEST_LE, <=)
+    SYNTHFLOW_VM_SPECIALIZED_TEST(TEST_GE_INT, TEST_GE, >=)
+#undef SYNTHFLOW_VM_SPECIALIZED_TEST
+#define SYNTHFLOW_VM_SPECIALIZED_BRANCH(OPCODE, GENERIC, CMP)   \
+    SYNTHFLOW_VM_CASE(OPCODE) {                                 \
+        const Value& a = RK(instr.b);                           \
+        const Value& b = RK(instr.c);                           \
+        if (!bothInt(a, b)) SYNTHFLOW_VM_DEOPTIMIZE(GENERIC)    \
+        if (a.asInt() CMP b.asInt()) SYNTHFLOW_VM_JUMP(instr.a) \
+        SYNTHFLOW_VM_NEXT();                                    \
+    }
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_EQ_INT, BRANCH_EQ, ==)
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_NE_INT, BRANCH_NE, !=)
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_LT_INT, BRANCH_LT, <)
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_GT_INT, BRANCH_GT, >)
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_LE_INT, BRANCH_LE, <=)
+    SYNTHFLOW_VM_SPECIALIZED_BRANCH(BRANCH_GE_INT, BRANCH_GE, >=)
+#undef SYNTHFLOW_VM_SPECIALIZED_BRANCH
+    SYNTHFLOW_VM_CASE(INDEX_ARRAY_INT) {
+        const Value& arr = regs[instr.b];
+        const Value& idx = RK(instr.c);
+        if (!arr.isArray() || !idx.isInt()) SYNTHFLOW_VM_DEOPTIMIZE(INDEX)
+        auto index = static_cast<size_t>(idx.asInt());
+        const auto& elements = *arr.asArray();
+        if (index >= elements.size()) {
+            throw std::runtime_error("Array index out of bounds");
+        }
+        // Copied before the store, which may release the array
+        regs[instr.a] = Value(elements[index]);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_CASE(GET_FIELD) {
+        const Value& object = regs[instr.b];
+        const InlineCache::Entry& site = chunk->members[instr.c].entries[0];
+        if (!object.isStruct() || object.asStruct().shape != site.shape) SYNTHFLOW_VM_DEOPTIMIZE(GET_MEMBER)
+        ++cacheStats.memberHits;
+        regs[instr.a] = Value(object.asStruct().slots[site.position]);
+        SYNTHFLOW_VM_NEXT();
+    }
+    SYNTHFLOW_VM_DISPATCH_END
+#undef RK
 }
+
+#ifdef SYNTHFLOW_VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+#undef SYNTHFLOW_VM_QUICKEN
+#undef SYNTHFLOW_VM_DEOPTIMIZE
+#undef SYNTHFLOW_VM_PROFILE
+#undef SYNTHFLOW_VM_CATCH
+#undef SYNTHFLOW_VM_JUMP
+#undef SYNTHFLOW_VM_CASE
+#undef SYNTHFLOW_VM_NEXT
+#undef SYNTHFLOW_VM_DISPATCH_BEGIN
+#undef SYNTHFLOW_VM_DISPATCH_END
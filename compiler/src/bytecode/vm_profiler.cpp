@@ -0,0 +1,270 @@
+#include "../../include/vm_profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace {
+
+constexpr size_t kTopPairs = 20;
+constexpr size_t kTopLoops = 10;
+constexpr size_t kNotBackEdge = static_cast<size_t>(-1);
+
+// Where the instruction at `pc` jumps back to, or kNotBackEdge
+size_t backEdgeTarget(const Instruction& instr, size_t pc) {
+    size_t target;
+    switch (instr.opcode) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+            target = instr.bx();
+            break;
+        case OpCode::BRANCH_EQ: case OpCode::BRANCH_NE: case OpCode::BRANCH_LT:
+        case OpCode::BRANCH_GT: case OpCode::BRANCH_LE: case OpCode::BRANCH_GE:
+        case OpCode::BRANCH_EQ_INT: case OpCode::BRANCH_NE_INT: case OpCode::BRANCH_LT_INT:
+        case OpCode::BRANCH_GT_INT: case OpCode::BRANCH_LE_INT: case OpCode::BRANCH_GE_INT:
+            target = instr.a;
+            break;
+        case OpCode::INC_BRANCH_LT:
+            target = instr.c;
+            break;
+        default:
+            return kNotBackEdge;
+    }
+    return target <= pc ? target : kNotBackEdge;
+}
+
+double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+}
+
+std::string escapeJson(const std::string& s) {
+    std::string result;
+    for (char c : s) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default: result += c; break;
+        }
+    }
+    return result;
+}
+
+// Source lines of instructions [start, end] of a function, e.g. "12-15"
+std::string lineRange(const std::vector<uint32_t>& lines, size_t start, size_t end) {
+    uint32_t first = 0;
+    uint32_t last = 0;
+    for (size_t pc = start; pc <= end && pc < lines.size(); ++pc) {
+        uint32_t line = lines[pc];
+        if (line == 0) continue;
+        first = first ? std::min(first, line) : line;
+        last = std::max(last, line);
+    }
+    if (first == 0) return "?";
+    return first == last ? std::to_string(first) : std::to_string(first) + "-" + std::to_string(last);
+}
+
+}  // namespace
+
+void VMProfiler::finish() {
+    if (previous < kOpCodeCount) {
+        endTick = ticks();
+        endTime = std::chrono::steady_clock::now();
+        opcodeTicks[previous] += endTick - lastTick;
+        previous = kNone;
+    }
+
+    // The code belongs to the VM, which may not outlive the profiler
+    for (const auto& entry : functions) {
+        const CompiledFunction& function = *entry.first;
+        FunctionProfile profile;
+        profile.name = function.name;
+        profile.counts = entry.second;
+        for (size_t pc = 0; pc < function.code.size(); ++pc) {
+            profile.lines.push_back(function.lineAt(pc));
+            size_t target = backEdgeTarget(function.code[pc], pc);
+            if (target != kNotBackEdge) profile.backEdges.emplace_back(target, pc);
+        }
+        profiles.push_back(std::move(profile));
+    }
+    functions.clear();
+}
+
+uint64_t VMProfiler::totalInstructions() const {
+    uint64_t total = 0;
+    for (uint64_t count : opcodeCounts) {
+        total += count;
+    }
+    return total;
+}
+
+double VMProfiler::ticksToMs(uint64_t count) const {
+    if (endTick <= startTick) return 0.0;
+    double elapsed = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return static_cast<double>(count) * elapsed / static_cast<double>(endTick - startTick);
+}
+
+std::vector<size_t> VMProfiler::hotOpcodes() const {
+    std::vector<size_t> ops;
+    for (size_t op = 0; op < kOpCodeCount; ++op) {
+        if (opcodeCounts[op] > 0) ops.push_back(op);
+    }
+    std::stable_sort(ops.begin(), ops.end(), [&](size_t x, size_t y) { return opcodeCounts[x] > opcodeCounts[y]; });
+    return ops;
+}
+
+std::vector<std::pair<size_t, uint64_t>> VMProfiler::hotPairs(size_t limit) const {
+    std::vector<std::pair<size_t, uint64_t>> result;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (pairs[i] > 0) result.emplace_back(i, pairs[i]);
+    }
+    std::stable_sort(result.begin(), result.end(), [](const auto& x, const auto& y) { return x.second > y.second; });
+    if (result.size() > limit) result.resize(limit);
+    return result;
+}
+
+uint64_t VMProfiler::functionInstructions(const FunctionProfile& function) {
+    uint64_t total = 0;
+    for (uint64_t count : function.counts) {
+        total += count;
+    }
+    return total;
+}
+
+std::vector<const VMProfiler::FunctionProfile*> VMProfiler::hotFunctions() const {
+    std::vector<std::pair<const FunctionProfile*, uint64_t>> totals;
+    for (const auto& profile : profiles) {
+        uint64_t total = functionInstructions(profile);
+        if (total > 0) totals.emplace_back(&profile, total);
+    }
+    // Ties by name, so the order does not depend on the order functions first ran
+    std::sort(totals.begin(), totals.end(), [](const auto& x, const auto& y) {
+        return x.second != y.second ? x.second > y.second : x.first->name < y.first->name;
+    });
+    std::vector<const FunctionProfile*> result;
+    for (const auto& entry : totals) {
+        result.push_back(entry.first);
+    }
+    return result;
+}
+
+std::vector<VMProfiler::Loop> VMProfiler::hotLoops(size_t limit) const {
+    std::vector<Loop> loops;
+    for (const auto& profile : profiles) {
+        for (const auto& edge : profile.backEdges) {
+            size_t start = edge.first;
+            size_t pc = edge.second;
+            if (profile.counts[pc] == 0) continue;
+            uint64_t instructions = 0;
+            for (size_t i = start; i <= pc; ++i) {
+                instructions += profile.counts[i];
+            }
+            loops.push_back({&profile, start, pc, instructions});
+        }
+    }
+    std::sort(loops.begin(), loops.end(), [](const Loop& x, const Loop& y) {
+        if (x.instructions != y.instructions) return x.instructions > y.instructions;
+        return x.function->name != y.function->name ? x.function->name < y.function->name : x.start < y.start;
+    });
+    if (loops.size() > limit) loops.resize(limit);
+    return loops;
+}
+
+void VMProfiler::printReport(std::ostream& out) const {
+    uint64_t total = totalInstructions();
+    out << "VM profile: " << total << " instructions, "
+        << std::fixed << std::setprecision(1) << ticksToMs(endTick - startTick) << " ms" << std::endl;
+
+    out << std::endl << "  opcode              count      %   time ms  ns/op" << std::endl;
+    for (size_t op : hotOpcodes()) {
+        double ms = ticksToMs(opcodeTicks[op]);
+        out << "  " << std::left << std::setw(16) << opcodeName(static_cast<OpCode>(op)) << std::right
+            << std::setw(11) << opcodeCounts[op]
+            << std::setw(7) << std::setprecision(1) << percent(opcodeCounts[op], total)
+            << std::setw(10) << std::setprecision(2) << ms
+            << std::setw(7) << std::setprecision(1) << ms * 1e6 / static_cast<double>(opcodeCounts[op])
+            << std::endl;
+    }
+
+    out << std::endl << "  opcode pair                          count      %" << std::endl;
+    for (const auto& pair : hotPairs(kTopPairs)) {
+        std::string name = std::string(opcodeName(static_cast<OpCode>(pair.first / kOpCodeCount))) + " -> " +
+                           opcodeName(static_cast<OpCode>(pair.first % kOpCodeCount));
+        out << "  " << std::left << std::setw(32) << name << std::right
+            << std::setw(11) << pair.second
+            << std::setw(7) << std::setprecision(1) << percent(pair.second, total) << std::endl;
+    }
+
+    out << std::endl << "  function                 lines     instructions      %" << std::endl;
+    for (const FunctionProfile* function : hotFunctions()) {
+        uint64_t count = functionInstructions(*function);
+        out << "  " << std::left << std::setw(24) << function->name << std::right
+            << std::setw(7) << lineRange(function->lines, 0, function->lines.size())
+            << std::setw(16) << count
+            << std::setw(7) << std::setprecision(1) << percent(count, total) << std::endl;
+    }
+
+    out << std::endl << "  hot loop                 lines     instructions      %" << std::endl;
+    for (const Loop& loop : hotLoops(kTopLoops)) {
+        out << "  " << std::left << std::setw(24) << loop.function->name << std::right
+            << std::setw(7) << lineRange(loop.function->lines, loop.start, loop.end)
+            << std::setw(16) << loop.instructions
+            << std::setw(7) << std::setprecision(1) << percent(loop.instructions, total) << std::endl;
+    }
+}
+
+std::string VMProfiler::toJson() const {
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"instructions\": " << totalInstructions()
+         << ",\n  \"ms\": " << ticksToMs(endTick - startTick) << ",\n  \"opcodes\": [";
+    const char* separator = "\n";
+    for (size_t op : hotOpcodes()) {
+        json << separator << "    {\"opcode\": \"" << opcodeName(static_cast<OpCode>(op))
+             << "\", \"count\": " << opcodeCounts[op] << ", \"ms\": " << ticksToMs(opcodeTicks[op]) << "}";
+        separator = ",\n";
+    }
+
+    json << "\n  ],\n  \"pairs\": [";
+    separator = "\n";
+    for (const auto& pair : hotPairs(pairs.size())) {
+        json << separator << "    {\"first\": \"" << opcodeName(static_cast<OpCode>(pair.first / kOpCodeCount))
+             << "\", \"second\": \"" << opcodeName(static_cast<OpCode>(pair.first % kOpCodeCount))
+             << "\", \"count\": " << pair.second << "}";
+        separator = ",\n";
+    }
+
+    json << "\n  ],\n  \"functions\": [";
+    separator = "\n";
+    for (const FunctionProfile* function : hotFunctions()) {
+        // Instructions per source line
+        std::map<uint32_t, uint64_t> lines;
+        const auto& counts = function->counts;
+        for (size_t pc = 0; pc < function->lines.size(); ++pc) {
+            if (counts[pc] > 0) lines[function->lines[pc]] += counts[pc];
+        }
+        json << separator << "    {\"name\": \"" << escapeJson(function->name)
+             << "\", \"lines\": \"" << lineRange(function->lines, 0, function->lines.size()) << "\""
+             << ", \"instructions\": " << functionInstructions(*function) << ", \"byLine\": {";
+        const char* lineSeparator = "";
+        for (const auto& line : lines) {
+            json << lineSeparator << "\"" << line.first << "\": " << line.second;
+            lineSeparator = ", ";
+        }
+        json << "}}";
+        separator = ",\n";
+    }
+
+    json << "\n  ],\n  \"loops\": [";
+    separator = "\n";
+    for (const Loop& loop : hotLoops(static_cast<size_t>(-1))) {
+        json << separator << "    {\"function\": \"" << escapeJson(loop.function->name)
+             << "\", \"lines\": \"" << lineRange(loop.function->lines, loop.start, loop.end)
+             << "\", \"instructions\": " << loop.instructions << "}";
+        separator = ",\n";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
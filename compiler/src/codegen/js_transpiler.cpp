@@ -16,6 +16,18 @@ void JSTranspiler::emitLine(const std::string& code) {
     output << code << "\n";
 }
 
+// A block on its own (the optimizer leaves one for an if with a constant
+// condition) is laid out like the other statements
+void JSTranspiler::emitStatement(Statement* stmt) {
+    if (stmt->kind != NodeKind::BlockStatement) {
+        stmt->accept(*this);
+        return;
+    }
+    indent();
+    stmt->accept(*this);
+    emit("\n");
+}
+
 std::string JSTranspiler::transpile(const std::vector<std::unique_ptr<Statement>>& statements) {
     // Add runtime header
     output << "// Generated by SynthFlow JavaScript Transpiler\n";
@@ -32,7 +44,7 @@ std::string JSTranspiler::transpile(const std::vector<std::unique_ptr<Statement>
     output << "\n// User Code\n";
     
     for (const auto& stmt : statements) {
-        stmt->accept(*this);
+        emitStatement(stmt.get());
     }
     
     return output.str();
@@ -62,20 +74,36 @@ void JSTranspiler::visit(BinaryExpression* node) {
     emit("(");
     node->left->accept(*this);
     
-    std::string op = node->op;
-    if (op == "and") op = "&&";
-    else if (op == "or") op = "||";
+    const char* op = nullptr;
+    switch (node->binaryOp) {
+        case BinaryOp::Add: op = "+"; break;
+        case BinaryOp::Sub: op = "-"; break;
+        case BinaryOp::Mul: op = "*"; break;
+        case BinaryOp::Div: op = "/"; break;
+        case BinaryOp::Mod: op = "%"; break;
+        case BinaryOp::Eq: op = "=="; break;
+        case BinaryOp::Ne: op = "!="; break;
+        case BinaryOp::Lt: op = "<"; break;
+        case BinaryOp::Gt: op = ">"; break;
+        case BinaryOp::Le: op = "<="; break;
+        case BinaryOp::Ge: op = ">="; break;
+        case BinaryOp::And: op = "&&"; break;
+        case BinaryOp::Or: op = "||"; break;
+        case BinaryOp::Unknown: break;
+    }
     
-    emit(" " + op + " ");
+    emit(" " + (op ? std::string(op) : node->op) + " ");
     node->right->accept(*this);
     emit(")");
 }
 
 void JSTranspiler::visit(UnaryExpression* node) {
-    std::string op = node->op;
-    if (op == "not") op = "!";
+    switch (node->unaryOp) {
+        case UnaryOp::Neg: emit("-"); break;
+        case UnaryOp::Not: emit("!"); break;
+        case UnaryOp::Unknown: emit(node->op); break;
+    }
     
-    emit(op);
     node->operand->accept(*this);
 }
 
@@ -138,7 +166,7 @@ void JSTranspiler::visit(BlockStatement* node) {
     emit("{\n");
     indentLevel++;
     for (const auto& stmt : node->statements) {
-        stmt->accept(*this);
+        emitStatement(stmt.get());
     }
     indentLevel--;
     indent();
@@ -174,7 +202,8 @@ void JSTranspiler::visit(ForStatement* node) {
     
     if (node->initializer) {
         // Handle variable declaration differently
-        if (auto* varDecl = dynamic_cast<VariableDeclaration*>(node->initializer.get())) {
+        if (node->initializer->kind == NodeKind::VariableDeclaration) {
+            auto* varDecl = static_cast<VariableDeclaration*>(node->initializer.get());
             emit("let " + varDecl->name + " = ");
             if (varDecl->initializer) {
                 varDecl->initializer->accept(*this);
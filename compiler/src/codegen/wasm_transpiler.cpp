@@ -125,7 +125,8 @@ std::string WasmTranspiler::transpile(const std::vector<std::unique_ptr<Statemen
 
     // First pass: collect struct declarations
     for (const auto& stmt : statements) {
-        if (auto* structDecl = dynamic_cast<StructDeclaration*>(stmt.get())) {
+        if (stmt->kind == NodeKind::StructDeclaration) {
+            auto* structDecl = static_cast<StructDeclaration*>(stmt.get());
             int structSize = 0;
             std::vector<std::pair<std::string, std::string>> fields;
             for (const auto& field : structDecl->fields) {
@@ -139,7 +140,8 @@ std::string WasmTranspiler::transpile(const std::vector<std::unique_ptr<Statemen
 
     // First pass: collect function declarations
     for (const auto& stmt : statements) {
-        if (auto* funcDecl = dynamic_cast<FunctionDeclaration*>(stmt.get())) {
+        if (stmt->kind == NodeKind::FunctionDeclaration) {
+            auto* funcDecl = static_cast<FunctionDeclaration*>(stmt.get());
             functionNames.push_back(funcDecl->name);
         }
     }
@@ -215,8 +217,7 @@ std::string WasmTranspiler::transpile(const std::vector<std::unique_ptr<Statemen
 
     // Generate code for each statement - functions and structs first
     for (const auto& stmt : statements) {
-        if (dynamic_cast<FunctionDeclaration*>(stmt.get()) ||
-            dynamic_cast<StructDeclaration*>(stmt.get())) {
+        if (stmt->kind == NodeKind::FunctionDeclaration || stmt->kind == NodeKind::StructDeclaration) {
             stmt->accept(*this);
         }
     }
@@ -237,8 +238,7 @@ std::string WasmTranspiler::transpile(const std::vector<std::unique_ptr<Statemen
     // Generate top-level statements (variables, expressions, etc.)
     inFunction = true;
     for (const auto& stmt : statements) {
-        if (!dynamic_cast<FunctionDeclaration*>(stmt.get()) &&
-            !dynamic_cast<StructDeclaration*>(stmt.get())) {
+        if (stmt->kind != NodeKind::FunctionDeclaration && stmt->kind != NodeKind::StructDeclaration) {
             stmt->accept(*this);
         }
     }
@@ -314,10 +314,8 @@ void WasmTranspiler::visit(Identifier* node) {
 }
 
 void WasmTranspiler::visit(BinaryExpression* node) {
-    std::string op = node->op;
-
     // Handle string concatenation
-    if (op == "+" && dynamic_cast<StringLiteral*>(node->left.get())) {
+    if (node->binaryOp == BinaryOp::Add && node->left->kind == NodeKind::StringLiteral) {
         // String concatenation - for now, just return left pointer
         // TODO: Implement proper string concatenation with new allocation
         node->left->accept(*this);
@@ -332,60 +330,62 @@ void WasmTranspiler::visit(BinaryExpression* node) {
     emit(" ");
 
     // Then emit the operation
-    if (op == "+") emit("(f64.add)");
-    else if (op == "-") emit("(f64.sub)");
-    else if (op == "*") emit("(f64.mul)");
-    else if (op == "/") emit("(f64.div)");
-    else if (op == "%") {
-        // Modulo: use rem instruction for f64
-        // Stack: a b -> a % b
-        // We need to be careful - save values first
-        // Actually, we can use the stack directly:
-        // a b f64.rem
-        emit("(f64.rem)");
-    }
-    else if (op == "==" || op == "!=") {
-        emit(op == "==" ? "(f64.eq)" : "(f64.ne)");
-    }
-    else if (op == "<") emit("(f64.lt)");
-    else if (op == "<=") emit("(f64.le)");
-    else if (op == ">") emit("(f64.gt)");
-    else if (op == ">=") emit("(f64.ge)");
-    else if (op == "&&" || op == "and") {
-        // Convert f64 to i32 for logical ops
-        // Left operand is f64, right is f64
-        // (f64.ne (f64.const 0)) converts f64 to i32 bool
-        emit("(f64.const 0) (f64.ne) ");  // left -> i32 bool
-        emit("(f64.const 0) (f64.ne) ");  // right -> i32 bool
-        emit("i32.and (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
-    }
-    else if (op == "||" || op == "or") {
-        emit("(f64.const 0) (f64.ne) ");
-        emit("(f64.const 0) (f64.ne) ");
-        emit("i32.or (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
-    }
-    else {
-        emit(";; unsupported op: " + op);
+    switch (node->binaryOp) {
+        case BinaryOp::Add: emit("(f64.add)"); break;
+        case BinaryOp::Sub: emit("(f64.sub)"); break;
+        case BinaryOp::Mul: emit("(f64.mul)"); break;
+        case BinaryOp::Div: emit("(f64.div)"); break;
+        case BinaryOp::Mod:
+            // Modulo: a b f64.rem, operating on the stack directly
+            emit("(f64.rem)");
+            break;
+        case BinaryOp::Eq: emit("(f64.eq)"); break;
+        case BinaryOp::Ne: emit("(f64.ne)"); break;
+        case BinaryOp::Lt: emit("(f64.lt)"); break;
+        case BinaryOp::Le: emit("(f64.le)"); break;
+        case BinaryOp::Gt: emit("(f64.gt)"); break;
+        case BinaryOp::Ge: emit("(f64.ge)"); break;
+        case BinaryOp::And:
+            // Convert f64 to i32 for logical ops
+            // Left operand is f64, right is f64
+            // (f64.ne (f64.const 0)) converts f64 to i32 bool
+            emit("(f64.const 0) (f64.ne) ");  // left -> i32 bool
+            emit("(f64.const 0) (f64.ne) ");  // right -> i32 bool
+            emit("i32.and (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
+            break;
+        case BinaryOp::Or:
+            emit("(f64.const 0) (f64.ne) ");
+            emit("(f64.const 0) (f64.ne) ");
+            emit("i32.or (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
+            break;
+        case BinaryOp::Unknown:
+            emit(";; unsupported op: " + node->op);
+            break;
     }
 }
 
 void WasmTranspiler::visit(UnaryExpression* node) {
-    std::string op = node->op;
     node->operand->accept(*this);
 
-    if (op == "-") {
-        emit(" (f64.neg)");
-    } else if (op == "!" || op == "not") {
-        emit(" (f64.const 0) (f64.eq) (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
+    switch (node->unaryOp) {
+        case UnaryOp::Neg:
+            emit(" (f64.neg)");
+            break;
+        case UnaryOp::Not:
+            emit(" (f64.const 0) (f64.eq) (if (result f64) (then (f64.const 1)) (else (f64.const 0)))");
+            break;
+        case UnaryOp::Unknown:
+            break;
     }
 }
 
 void WasmTranspiler::visit(AssignmentExpression* node) {
     // Get the variable name from left side
-    if (auto* id = dynamic_cast<Identifier*>(node->left.get())) {
+    if (node->left->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->left.get());
         node->right->accept(*this);
         emit(" (local.set $" + id->name + ")");
-    } else if (dynamic_cast<MemberExpression*>(node->left.get())) {
+    } else if (node->left->kind == NodeKind::MemberExpression) {
         // Handle member assignment: obj.field = value
         // For now, simplified - proper implementation needs to track struct offsets
         node->right->accept(*this);
@@ -397,7 +397,8 @@ void WasmTranspiler::visit(CallExpression* node) {
     // Handle print specially for strings
     if (node->callee == "print" && !node->arguments.empty()) {
         // Check if first argument is a string literal
-        if (auto* strLit = dynamic_cast<StringLiteral*>(node->arguments[0].get())) {
+        if (node->arguments[0]->kind == NodeKind::StringLiteral) {
+            auto* strLit = static_cast<StringLiteral*>(node->arguments[0].get());
             int offset = allocateString(strLit->value);
             emit("(i32.const " + std::to_string(offset) + ")");
             emit(" (i32.const " + std::to_string(strLit->value.length()) + ")");
@@ -630,23 +631,28 @@ void WasmTranspiler::visit(MatchExpression* node) {
 }
 
 void WasmTranspiler::visit(CompoundAssignment* node) {
-    if (auto* id = dynamic_cast<Identifier*>(node->target.get())) {
+    if (node->target->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->target.get());
         emit("(local.get $" + id->name + ") ");
         node->value->accept(*this);
 
-        if (node->op == "+=") emit(" (f64.add)");
-        else if (node->op == "-=") emit(" (f64.sub)");
-        else if (node->op == "*=") emit(" (f64.mul)");
-        else if (node->op == "/=") emit(" (f64.div)");
+        switch (node->binaryOp) {
+            case BinaryOp::Add: emit(" (f64.add)"); break;
+            case BinaryOp::Sub: emit(" (f64.sub)"); break;
+            case BinaryOp::Mul: emit(" (f64.mul)"); break;
+            case BinaryOp::Div: emit(" (f64.div)"); break;
+            default: break;
+        }
 
         emit(" (local.set $" + id->name + ")");
     }
 }
 
 void WasmTranspiler::visit(UpdateExpression* node) {
-    if (auto* id = dynamic_cast<Identifier*>(node->operand.get())) {
+    if (node->operand->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->operand.get());
         emit("(local.get $" + id->name + ") (f64.const 1) ");
-        emit(node->op == "++" ? "(f64.add)" : "(f64.sub)");
+        emit(node->increment ? "(f64.add)" : "(f64.sub)");
         emit(" (local.set $" + id->name + ")");
     }
 }
@@ -746,7 +752,8 @@ void WasmTranspiler::visit(MapLiteral* node) {
 
 void WasmTranspiler::visit(MemberExpression* node) {
     // Check if object is an identifier and we know its type
-    if (auto* id = dynamic_cast<Identifier*>(node->object.get())) {
+    if (node->object->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->object.get());
         std::string varName = id->name;
         std::string varType = variableTypes.count(varName) ? variableTypes[varName] : "";
 
@@ -815,7 +822,8 @@ void WasmTranspiler::visit(MethodCallExpression* node) {
     }
 
     // Check if this is a known struct method
-    if (auto* id = dynamic_cast<Identifier*>(node->object.get())) {
+    if (node->object->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->object.get());
         std::string varName = id->name;
         std::string varType = variableTypes.count(varName) ? variableTypes[varName] : "";
 
@@ -856,9 +864,9 @@ void WasmTranspiler::visit(VariableDeclaration* node) {
         isPointerType = true;
     } else if (node->initializer) {
         // Check if initializer is a string, array, or map literal
-        if (dynamic_cast<StringLiteral*>(node->initializer.get()) ||
-            dynamic_cast<ArrayLiteral*>(node->initializer.get()) ||
-            dynamic_cast<MapLiteral*>(node->initializer.get())) {
+        if (node->initializer->kind == NodeKind::StringLiteral ||
+            node->initializer->kind == NodeKind::ArrayLiteral ||
+            node->initializer->kind == NodeKind::MapLiteral) {
             isPointerType = true;
         }
     }
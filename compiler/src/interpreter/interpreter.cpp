@@ -1,6 +1,8 @@
 #include "../../include/interpreter.h"
 #include "../../include/lexer.h"
 #include "../../include/parser.h"
+#include "../../include/resolver.h"
+#include "../../include/type_specializer.h"
 #include "../../include/http_client.h"
 #include "../../include/http_server.h"
 #include <iostream>
@@ -14,6 +16,7 @@
 #include <algorithm>
 #include <regex>
 #include <ctime>
+#include <optional>
 
 // Platform-specific includes for OS/subprocess functionality
 #ifdef _WIN32
@@ -42,7 +45,245 @@
 
 #include <cstring>  // Required for memset, memcpy on Linux
 
+// Interned names the interpreter dispatches on
+namespace sym {
+const Symbol length("length");
+const Symbol self("self");
+const Symbol typeTag("__type__");
+const Symbol clear("clear");
+const Symbol contains("contains");
+const Symbol endsWith("endsWith");
+const Symbol indexOf("indexOf");
+const Symbol insert("insert");
+const Symbol keys("keys");
+const Symbol pop("pop");
+const Symbol push("push");
+const Symbol remove("remove");
+const Symbol replace("replace");
+const Symbol shift("shift");
+const Symbol slice("slice");
+const Symbol split("split");
+const Symbol startsWith("startsWith");
+const Symbol substring("substring");
+const Symbol toLower("toLower");
+const Symbol toUpper("toUpper");
+const Symbol trim("trim");
+const Symbol unshift("unshift");
+const Symbol values("values");
+}  // namespace sym
+
 // Value methods
+void Value::release() {
+    if (!isHeap() || --heap->refCount != 0) {
+        return;
+    }
+    switch (type) {
+        case Type::String:   destroyString(static_cast<StringObject*>(heap)); break;
+        case Type::Array:    delete static_cast<Cell<ArrayType>*>(heap); break;
+        case Type::Function: delete static_cast<Cell<FunctionType>*>(heap); break;
+        case Type::Map:      delete static_cast<Cell<MapType>*>(heap); break;
+        case Type::Struct:   delete static_cast<StructObject*>(heap); break;
+        default: break;
+    }
+}
+
+// Rope and slice cells hold references to other cells. Free them with a work
+// list rather than recursively: a rope built by appending in a loop is as
+// deep as the number of appends.
+void Value::destroyString(StringObject* s) {
+    if (s->kind == StringObject::Kind::Flat) {
+        delete s;
+        return;
+    }
+    std::vector<StringObject*> dead{s};
+    while (!dead.empty()) {
+        StringObject* cell = dead.back();
+        dead.pop_back();
+        for (StringObject* child : {cell->left, cell->right}) {
+            if (child && --child->refCount == 0) {
+                dead.push_back(child);
+            }
+        }
+        delete cell;
+    }
+}
+
+// Replace a rope or slice with its contents; every copy of the value sees the flat cell
+const std::string& Value::flatten(StringObject* s) {
+    std::string out;
+    out.reserve(s->length);
+    if (s->kind == StringObject::Kind::Slice) {
+        out.append(s->left->value, s->offset, s->length);
+    } else {
+        // In-order walk with an explicit stack, for the same reason as destroyString
+        std::vector<const StringObject*> stack{s->right, s->left};
+        while (!stack.empty()) {
+            const StringObject* cell = stack.back();
+            stack.pop_back();
+            switch (cell->kind) {
+                case StringObject::Kind::Flat:
+                    out += cell->value;
+                    break;
+                case StringObject::Kind::Slice:
+                    out.append(cell->left->value, cell->offset, cell->length);
+                    break;
+                case StringObject::Kind::Rope:
+                    stack.push_back(cell->right);
+                    stack.push_back(cell->left);
+                    break;
+            }
+        }
+    }
+    
+    StringObject* left = s->left;
+    StringObject* right = s->right;
+    s->kind = StringObject::Kind::Flat;
+    s->value = std::move(out);
+    s->left = nullptr;
+    s->right = nullptr;
+    s->offset = 0;
+    for (StringObject* child : {left, right}) {
+        if (child && --child->refCount == 0) {
+            destroyString(child);
+        }
+    }
+    return s->value;
+}
+
+std::string_view Value::asStringView() const {
+    StringObject* s = stringCell();
+    switch (s->kind) {
+        case StringObject::Kind::Flat:
+            return s->value;
+        case StringObject::Kind::Slice:
+            return std::string_view(s->left->value).substr(s->offset, s->length);
+        case StringObject::Kind::Rope:
+            break;
+    }
+    return flatten(s);
+}
+
+Value Value::concat(const Value& a, const Value& b) {
+    StringObject* left = a.stringCell();
+    StringObject* right = b.stringCell();
+    if (right->length == 0) return a;
+    if (left->length == 0) return b;
+    
+    size_t length = left->length + right->length;
+    if (length < kRopeMinLength) {
+        std::string flat;
+        flat.reserve(length);
+        flat.append(a.asStringView());
+        flat.append(b.asStringView());
+        return Value(std::move(flat));
+    }
+    
+    auto* rope = new StringObject(std::string());
+    rope->kind = StringObject::Kind::Rope;
+    rope->length = length;
+    
+    // Appending a short piece to a rope that ends in a short leaf: merge the
+    // two into a new leaf so ropes built piece by piece keep few, larger nodes
+    StringObject* tail = left->kind == StringObject::Kind::Rope ? left->right : nullptr;
+    if (tail && tail->kind == StringObject::Kind::Flat &&
+        tail->length + right->length < kRopeMinLength) {
+        std::string merged;
+        merged.reserve(tail->length + right->length);
+        merged.append(tail->value);
+        merged.append(b.asStringView());
+        rope->left = left->left;
+        rope->right = new StringObject(std::move(merged));
+        ++rope->left->refCount;
+    } else {
+        rope->left = left;
+        rope->right = right;
+        ++left->refCount;
+        ++right->refCount;
+    }
+    return Value(rope);
+}
+
+Value Value::substring(const Value& s, size_t pos, size_t count) {
+    StringObject* cell = s.stringCell();
+    if (pos > cell->length) pos = cell->length;
+    if (count > cell->length - pos) count = cell->length - pos;
+    if (pos == 0 && count == cell->length) return s;
+    if (count < kSliceMinLength) {
+        return Value(std::string(s.asStringView().substr(pos, count)));
+    }
+    
+    // Views always point at a flat string
+    if (cell->kind == StringObject::Kind::Rope) {
+        flatten(cell);
+    }
+    StringObject* base = cell;
+    if (cell->kind == StringObject::Kind::Slice) {
+        base = cell->left;
+        pos += cell->offset;
+    }
+    
+    auto* slice = new StringObject(std::string());
+    slice->kind = StringObject::Kind::Slice;
+    slice->length = count;
+    slice->left = base;
+    slice->offset = pos;
+    ++base->refCount;
+    return Value(slice);
+}
+
+void Value::StructObject::remove(size_t slot) {
+    shape = shape->withoutField(shape->fieldAt(slot));
+    slots.erase(slots.begin() + static_cast<std::ptrdiff_t>(slot));
+}
+
+void Value::StructObject::clear() {
+    shape = Shape::root(shape->typeName());
+    slots.clear();
+}
+
+// Shapes
+const Shape* Shape::root(const std::string& typeName) {
+    static std::unordered_map<std::string, std::unique_ptr<Shape>> roots;
+    auto& shape = roots[typeName];
+    if (!shape) {
+        shape.reset(new Shape(typeName, nullptr));
+        shape->rootShape = shape.get();
+    }
+    return shape.get();
+}
+
+int Shape::slotOf(Symbol field) const {
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i] == field) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+const Shape* Shape::withField(Symbol field) const {
+    for (const auto& child : transitions) {
+        if (child->fields.back() == field) {
+            return child.get();
+        }
+    }
+    std::unique_ptr<Shape> child(new Shape(name, rootShape));
+    child->fields = fields;
+    child->fields.push_back(field);
+    transitions.push_back(std::move(child));
+    return transitions.back().get();
+}
+
+const Shape* Shape::withoutField(Symbol field) const {
+    const Shape* shape = rootShape;
+    for (Symbol kept : fields) {
+        if (kept != field) {
+            shape = shape->withField(kept);
+        }
+    }
+    return shape;
+}
+
 std::string Value::toString() const {
     if (isNull()) return "null";
     if (isInt()) return std::to_string(asInt());
@@ -51,7 +292,7 @@ std::string Value::toString() const {
         oss << asFloat();
         return oss.str();
     }
-    if (isString()) return asString();
+    if (isString()) return std::string(asStringView());
     if (isBool()) return asBool() ? "true" : "false";
     if (isArray()) {
         std::string result = "[";
@@ -69,12 +310,23 @@ std::string Value::toString() const {
         bool first = true;
         for (const auto& [key, val] : *m) {
             if (!first) result += ", ";
-            result += "\"" + key + "\": " + val.toString();
+            result += "\"" + key.str() + "\": " + val.toString();
             first = false;
         }
         result += "}";
         return result;
     }
+    if (isStruct()) {
+        // Printed like the map a struct instance used to be
+        std::string result = "{";
+        const auto& instance = asStruct();
+        for (size_t i = 0; i < instance.slots.size(); ++i) {
+            if (i > 0) result += ", ";
+            result += "\"" + instance.shape->fieldAt(i).str() + "\": " + instance.slots[i].toString();
+        }
+        result += "}";
+        return result;
+    }
     if (isFunction()) return "<function>";
     return "<unknown>";
 }
@@ -84,17 +336,33 @@ bool Value::isTruthy() const {
     if (isBool()) return asBool();
     if (isInt()) return asInt() != 0;
     if (isFloat()) return asFloat() != 0.0;
-    if (isString()) return !asString().empty();
+    if (isString()) return stringLength() != 0;
     if (isArray()) return !asArray()->empty();
     return true;
 }
 
 // Environment methods
-void Environment::define(const std::string& name, const Value& value) {
-    variables[name] = value;
+uint64_t Environment::functionEpoch = 1;
+
+void Environment::define(Symbol name, const Value& value) {
+    Value& binding = variables[name];
+    if (binding.isFunction() || value.isFunction()) {
+        ++functionEpoch;
+    }
+    binding = value;
+}
+
+const Value* Environment::find(Symbol name) const {
+    auto it = variables.find(name);
+    return it != variables.end() ? &it->second : nullptr;
 }
 
-Value Environment::get(const std::string& name) const {
+Value* Environment::find(Symbol name) {
+    auto it = variables.find(name);
+    return it != variables.end() ? &it->second : nullptr;
+}
+
+Value Environment::get(Symbol name) const {
     auto it = variables.find(name);
     if (it != variables.end()) {
         return it->second;
@@ -102,12 +370,15 @@ Value Environment::get(const std::string& name) const {
     if (parent) {
         return parent->get(name);
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    throw std::runtime_error("Undefined variable: " + name.str());
 }
 
-void Environment::set(const std::string& name, const Value& value) {
+void Environment::set(Symbol name, const Value& value) {
     auto it = variables.find(name);
     if (it != variables.end()) {
+        if (it->second.isFunction() || value.isFunction()) {
+            ++functionEpoch;
+        }
         it->second = value;
         return;
     }
@@ -115,15 +386,74 @@ void Environment::set(const std::string& name, const Value& value) {
         parent->set(name, value);
         return;
     }
-    throw std::runtime_error("Undefined variable: " + name);
+    throw std::runtime_error("Undefined variable: " + name.str());
 }
 
-bool Environment::exists(const std::string& name) const {
+bool Environment::exists(Symbol name) const {
     if (variables.find(name) != variables.end()) return true;
     if (parent) return parent->exists(name);
     return false;
 }
 
+Value* FrameArena::allocate(size_t count) {
+    // Move on to the next chunk that fits; a skipped tail is reclaimed when
+    // the frames allocated after it are released
+    while (current < chunks.size() && used + count > chunks[current].size) {
+        ++current;
+        used = 0;
+    }
+    if (current == chunks.size()) {
+        size_t size = std::max(count, kChunkValues);
+        chunks.push_back({std::make_unique<Value[]>(size), size});
+    }
+    Value* slots = chunks[current].values.get() + used;
+    used += count;
+    return slots;
+}
+
+namespace {
+
+// Activation frame for a block, loop or call
+//
+// A captured frame is heap-allocated and shared with the closures declared in
+// it. Any other frame keeps its Environment here on the C++ stack and its
+// slots in the FrameArena; the shared_ptr it hands out owns nothing, so
+// copying it costs no refcount traffic, and everything is released on exit.
+class Frame {
+public:
+    Frame(FrameArena& arena, std::shared_ptr<Environment> parent, int slotCount, bool captured)
+        : arena(arena) {
+        if (captured) {
+            env = std::make_shared<Environment>(std::move(parent), static_cast<size_t>(slotCount));
+            return;
+        }
+        mark = arena.mark();
+        count = static_cast<size_t>(slotCount);
+        slots = arena.allocate(count);
+        local.emplace(std::move(parent), slots);
+        env = std::shared_ptr<Environment>(std::shared_ptr<Environment>(), &*local);
+    }
+    ~Frame() {
+        if (local) {
+            arena.release(mark, slots, count);
+        }
+    }
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+    
+    const std::shared_ptr<Environment>& get() const { return env; }
+    
+private:
+    FrameArena& arena;
+    FrameArena::Mark mark;
+    Value* slots = nullptr;
+    size_t count = 0;
+    std::optional<Environment> local;
+    std::shared_ptr<Environment> env;
+};
+
+}  // namespace
+
 // Interpreter constructor
 Interpreter::Interpreter() {
     globalEnv = std::make_shared<Environment>();
@@ -134,7 +464,7 @@ Interpreter::Interpreter() {
 // Register built-in functions
 void Interpreter::registerBuiltins() {
     // print function
-    globalEnv->define("print", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("print", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             for (size_t i = 0; i < args.size(); ++i) {
                 if (i > 0) std::cout << " ";
@@ -146,7 +476,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // input function
-    globalEnv->define("input", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("input", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (!args.empty()) {
                 std::cout << args[0].toString();
@@ -158,11 +488,11 @@ void Interpreter::registerBuiltins() {
     )));
     
     // len function
-    globalEnv->define("len", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("len", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("len() requires an argument");
             if (args[0].isString()) {
-                return Value(static_cast<int64_t>(args[0].asString().length()));
+                return Value(static_cast<int64_t>(args[0].stringLength()));
             }
             if (args[0].isArray()) {
                 return Value(static_cast<int64_t>(args[0].asArray()->size()));
@@ -172,7 +502,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // str function
-    globalEnv->define("str", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("str", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value("");
             return Value(args[0].toString());
@@ -180,7 +510,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // int function
-    globalEnv->define("int", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("int", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value(int64_t(0));
             if (args[0].isInt()) return args[0];
@@ -198,7 +528,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // float function
-    globalEnv->define("float", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("float", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value(0.0);
             if (args[0].isFloat()) return args[0];
@@ -215,7 +545,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // read_file function
-    globalEnv->define("read_file", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("read_file", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("read_file() requires a string path");
@@ -231,7 +561,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // write_file function
-    globalEnv->define("write_file", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("write_file", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString()) {
                 throw std::runtime_error("write_file() requires path and content");
@@ -248,7 +578,7 @@ void Interpreter::registerBuiltins() {
     // ===== Gemini API Built-in Functions =====
     
     // gemini_set_api_key(key) - Set the Gemini API key
-    globalEnv->define("gemini_set_api_key", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("gemini_set_api_key", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("gemini_set_api_key() requires a string API key");
@@ -259,14 +589,14 @@ void Interpreter::registerBuiltins() {
     )));
     
     // gemini_has_api_key() - Check if API key is set
-    globalEnv->define("gemini_has_api_key", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("gemini_has_api_key", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             return Value(http::gemini::hasApiKey());
         }
     )));
     
     // gemini_complete(prompt) - Generate text from prompt
-    globalEnv->define("gemini_complete", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("gemini_complete", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("gemini_complete() requires a prompt string");
@@ -281,7 +611,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // gemini_chat(systemPrompt, userMessage) - Chat with system instruction
-    globalEnv->define("gemini_chat", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("gemini_chat", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 throw std::runtime_error("gemini_chat() requires systemPrompt and userMessage strings");
@@ -300,7 +630,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // http_get(url) - Perform HTTP GET request
-    globalEnv->define("http_get", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("http_get", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("http_get() requires a URL string");
@@ -309,7 +639,7 @@ void Interpreter::registerBuiltins() {
             http::Response response = client.get(args[0].asString());
             
             // Return a map with status, body, and error
-            auto resultMap = std::make_shared<Value::MapType>();
+            auto resultMap = Value::make<Value::MapType>();
             (*resultMap)["status"] = Value(static_cast<int64_t>(response.statusCode));
             (*resultMap)["body"] = Value(response.body);
             (*resultMap)["error"] = Value(response.error);
@@ -318,7 +648,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // http_post(url, body) - Perform HTTP POST request
-    globalEnv->define("http_post", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("http_post", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 throw std::runtime_error("http_post() requires URL and body strings");
@@ -327,7 +657,7 @@ void Interpreter::registerBuiltins() {
             http::Response response = client.post(args[0].asString(), args[1].asString());
             
             // Return a map with status, body, and error
-            auto resultMap = std::make_shared<Value::MapType>();
+            auto resultMap = Value::make<Value::MapType>();
             (*resultMap)["status"] = Value(static_cast<int64_t>(response.statusCode));
             (*resultMap)["body"] = Value(response.body);
             (*resultMap)["error"] = Value(response.error);
@@ -338,7 +668,7 @@ void Interpreter::registerBuiltins() {
     // ===== Array Functions =====
     
     // append(array, element) - Append element to array (mutating), return new length
-    globalEnv->define("append", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("append", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("append() requires array and element arguments");
@@ -353,7 +683,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // push(array, element) - Push element to end of array (mutating), return new length
-    globalEnv->define("push", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("push", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("push() requires array and element arguments");
@@ -368,7 +698,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // pop(array) - Remove and return last element from array (mutating)
-    globalEnv->define("pop", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("pop", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) {
                 throw std::runtime_error("pop() requires an array argument");
@@ -387,7 +717,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // slice(array, start, end) - Return a new array slice (non-mutating)
-    globalEnv->define("slice", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("slice", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) {
                 throw std::runtime_error("slice() requires at least an array argument");
@@ -406,7 +736,7 @@ void Interpreter::registerBuiltins() {
                 end = static_cast<size_t>(args[2].asInt());
                 if (end > arr->size()) end = arr->size();
             }
-            auto newArr = std::make_shared<Value::ArrayType>();
+            auto newArr = Value::make<Value::ArrayType>();
             for (size_t i = start; i < end; ++i) {
                 newArr->push_back((*arr)[i]);
             }
@@ -415,7 +745,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // shift(array) - Remove and return first element (mutating)
-    globalEnv->define("shift", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("shift", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) {
                 throw std::runtime_error("shift() requires an array argument");
@@ -434,7 +764,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // unshift(array, element) - Add element to beginning (mutating), return new length
-    globalEnv->define("unshift", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("unshift", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("unshift() requires array and element arguments");
@@ -449,7 +779,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // indexOf(array, element) - Return index of element, or -1
-    globalEnv->define("indexOf", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("indexOf", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("indexOf() requires array and element arguments");
@@ -470,7 +800,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // contains(array, element) - Check if element exists in array
-    globalEnv->define("contains", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("contains", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("contains() requires array and element arguments");
@@ -491,7 +821,7 @@ void Interpreter::registerBuiltins() {
     )));
 
     // typeof(value) - Return type of value as string
-    globalEnv->define("typeof", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("typeof", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value("undefined");
             const Value& v = args[0];
@@ -501,14 +831,14 @@ void Interpreter::registerBuiltins() {
             if (v.isFloat()) return Value("float");
             if (v.isString()) return Value("string");
             if (v.isArray()) return Value("array");
-            if (v.isMap()) return Value("map");
+            if (v.isMap() || v.isStruct()) return Value("map");
             if (v.isFunction()) return Value("function");
             return Value("unknown");
         }
     )));
     
     // range(start, end) or range(end) - Create array of integers
-    globalEnv->define("range", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("range", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) {
                 throw std::runtime_error("range() requires at least one argument");
@@ -520,7 +850,7 @@ void Interpreter::registerBuiltins() {
                 start = args[0].asInt();
                 end = args[1].asInt();
             }
-            auto arr = std::make_shared<Value::ArrayType>();
+            auto arr = Value::make<Value::ArrayType>();
             for (int64_t i = start; i < end; ++i) {
                 arr->push_back(Value(i));
             }
@@ -531,7 +861,7 @@ void Interpreter::registerBuiltins() {
     // ===== Math Functions =====
     
     // abs(x) - Absolute value
-    globalEnv->define("abs", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("abs", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("abs() requires an argument");
             if (args[0].isInt()) return Value(std::abs(args[0].asInt()));
@@ -540,7 +870,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // sqrt(x) - Square root
-    globalEnv->define("sqrt", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("sqrt", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("sqrt() requires an argument");
             return Value(std::sqrt(args[0].asFloat()));
@@ -548,7 +878,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // pow(base, exp) - Power function
-    globalEnv->define("pow", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("pow", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2) throw std::runtime_error("pow() requires two arguments");
             return Value(std::pow(args[0].asFloat(), args[1].asFloat()));
@@ -556,28 +886,28 @@ void Interpreter::registerBuiltins() {
     )));
     
     // sin(x), cos(x), exp(x), ln(x)
-    globalEnv->define("sin", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("sin", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("sin() requires an argument");
             return Value(std::sin(args[0].asFloat()));
         }
     )));
     
-    globalEnv->define("cos", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("cos", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("cos() requires an argument");
             return Value(std::cos(args[0].asFloat()));
         }
     )));
     
-    globalEnv->define("exp", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("exp", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("exp() requires an argument");
             return Value(std::exp(args[0].asFloat()));
         }
     )));
     
-    globalEnv->define("ln", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("ln", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("ln() requires an argument");
             return Value(std::log(args[0].asFloat()));
@@ -585,21 +915,21 @@ void Interpreter::registerBuiltins() {
     )));
     
     // floor, ceil, round
-    globalEnv->define("floor", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("floor", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("floor() requires an argument");
             return Value(static_cast<int64_t>(std::floor(args[0].asFloat())));
         }
     )));
     
-    globalEnv->define("ceil", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("ceil", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("ceil() requires an argument");
             return Value(static_cast<int64_t>(std::ceil(args[0].asFloat())));
         }
     )));
     
-    globalEnv->define("round", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("round", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) throw std::runtime_error("round() requires an argument");
             return Value(static_cast<int64_t>(std::round(args[0].asFloat())));
@@ -613,7 +943,7 @@ void Interpreter::registerBuiltins() {
     
     // route(path, handler) or route("METHOD path", handler)
     // Minimal API: route("/api/users", json(users))
-    globalEnv->define("route", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("route", Value(Value::make<Value::FunctionType>(
         [this](std::vector<Value>& args, Interpreter& interp) -> Value {
             if (args.size() < 2) {
                 throw std::runtime_error("route() requires path and handler");
@@ -632,7 +962,7 @@ void Interpreter::registerBuiltins() {
             
             // Store handler with unique name
             std::string handlerName = "__web_handler_" + std::to_string(routeHandlerCounter++);
-            globalEnv->define(handlerName, args[1]);
+            globalEnv->define(Symbol(handlerName), args[1]);
             
             // Register route
             web::RouteRegistry::instance().addRoute(method, path, handlerName);
@@ -642,7 +972,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // serve(port) - Start HTTP server
-    globalEnv->define("serve", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("serve", Value(Value::make<Value::FunctionType>(
         [this](std::vector<Value>& args, Interpreter& interp) -> Value {
             int port = 3000;
             if (!args.empty()) {
@@ -673,26 +1003,26 @@ void Interpreter::registerBuiltins() {
                 
                 // Get handler
                 try {
-                    Value handler = globalEnv->get(route->handlerName);
+                    Value handler = globalEnv->get(Symbol(route->handlerName));
                     
                     if (handler.isFunction()) {
                         // Create request object for handler
-                        auto reqMap = std::make_shared<std::map<std::string, Value>>();
+                        auto reqMap = Value::make<Value::MapType>();
                         (*reqMap)["method"] = Value(req.method);
                         (*reqMap)["path"] = Value(req.path);
                         (*reqMap)["body"] = Value(req.body);
                         
-                        // Add params
-                        auto paramsMap = std::make_shared<std::map<std::string, Value>>();
+                        // Add params; request data is keyed by string, never interned
+                        auto paramsMap = Value::make<Value::MapType>();
                         for (const auto& [k, v] : params) {
-                            (*paramsMap)[k] = Value(v);
+                            (*paramsMap)[MapKey::of(k)] = Value(v);
                         }
                         (*reqMap)["params"] = Value(paramsMap);
                         
                         // Add query params
-                        auto queryMap = std::make_shared<std::map<std::string, Value>>();
+                        auto queryMap = Value::make<Value::MapType>();
                         for (const auto& [k, v] : req.queryParams) {
-                            (*queryMap)[k] = Value(v);
+                            (*queryMap)[MapKey::of(k)] = Value(v);
                         }
                         (*reqMap)["query"] = Value(queryMap);
                         
@@ -723,6 +1053,9 @@ void Interpreter::registerBuiltins() {
                                 res.contentType = "application/json";
                                 res.body = result.toString();
                             }
+                        } else if (result.isStruct()) {
+                            res.contentType = "application/json";
+                            res.body = result.toString();
                         } else {
                             res.body = result.toString();
                         }
@@ -770,9 +1103,9 @@ void Interpreter::registerBuiltins() {
     )));
     
     // json(data) - Create JSON response block
-    globalEnv->define("json", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("json", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
-            auto resultMap = std::make_shared<std::map<std::string, Value>>();
+            auto resultMap = Value::make<Value::MapType>();
             (*resultMap)["__type"] = Value("json");
             if (!args.empty()) {
                 (*resultMap)["content"] = args[0];
@@ -784,9 +1117,9 @@ void Interpreter::registerBuiltins() {
     )));
     
     // html(content) - Create HTML response block
-    globalEnv->define("html", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("html", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
-            auto resultMap = std::make_shared<std::map<std::string, Value>>();
+            auto resultMap = Value::make<Value::MapType>();
             (*resultMap)["__type"] = Value("html");
             if (!args.empty()) {
                 (*resultMap)["content"] = args[0];
@@ -798,7 +1131,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // text(content) - Create text response
-    globalEnv->define("text", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("text", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value("");
             return args[0];
@@ -806,7 +1139,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // use(middleware...) - Add middleware
-    globalEnv->define("use", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("use", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             for (auto& arg : args) {
                 if (arg.isString()) {
@@ -820,7 +1153,7 @@ void Interpreter::registerBuiltins() {
     // ===== OS & Subprocess Built-in Functions =====
     
     // __builtin_exec(cmd) - Execute command and return result map
-    globalEnv->define("__builtin_exec", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_exec", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_exec() requires a command string");
@@ -855,7 +1188,7 @@ void Interpreter::registerBuiltins() {
                 #endif
             }
             
-            auto resultMap = std::make_shared<Value::MapType>();
+            auto resultMap = Value::make<Value::MapType>();
             (*resultMap)["stdout"] = Value(output);
             (*resultMap)["stderr"] = Value(error);
             (*resultMap)["returncode"] = Value(static_cast<int64_t>(returnCode));
@@ -864,7 +1197,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_shell(cmd) - Execute through shell
-    globalEnv->define("__builtin_shell", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_shell", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter& interp) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_shell() requires a command string");
@@ -884,7 +1217,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_env_get(key) - Get environment variable
-    globalEnv->define("__builtin_env_get", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_env_get", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_env_get() requires a key string");
@@ -896,7 +1229,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_env_set(key, value) - Set environment variable
-    globalEnv->define("__builtin_env_set", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_env_set", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 throw std::runtime_error("__builtin_env_set() requires key and value strings");
@@ -912,7 +1245,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_getcwd() - Get current working directory
-    globalEnv->define("__builtin_getcwd", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_getcwd", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             char buffer[4096];
             if (getcwd(buffer, sizeof(buffer)) != nullptr) {
@@ -923,7 +1256,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_chdir(path) - Change working directory
-    globalEnv->define("__builtin_chdir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_chdir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_chdir() requires a path string");
@@ -933,7 +1266,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_platform() - Get OS name
-    globalEnv->define("__builtin_platform", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_platform", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             return Value("windows");
@@ -946,7 +1279,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_arch() - Get architecture
-    globalEnv->define("__builtin_arch", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_arch", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #if defined(__x86_64__) || defined(_M_X64)
             return Value("x86_64");
@@ -961,7 +1294,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_hostname() - Get hostname
-    globalEnv->define("__builtin_hostname", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_hostname", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             char hostname[256];
             #ifdef _WIN32
@@ -975,7 +1308,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_username() - Get current username
-    globalEnv->define("__builtin_username", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_username", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             char username[256];
@@ -990,7 +1323,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_homedir() - Get home directory
-    globalEnv->define("__builtin_homedir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_homedir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             const char* home = std::getenv("USERPROFILE");
@@ -1002,7 +1335,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tempdir() - Get temp directory
-    globalEnv->define("__builtin_tempdir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tempdir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             char temp[MAX_PATH];
@@ -1016,7 +1349,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_path_exists(path) - Check if path exists
-    globalEnv->define("__builtin_path_exists", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_path_exists", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_path_exists() requires a path string");
@@ -1027,7 +1360,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_is_file(path) - Check if path is a file
-    globalEnv->define("__builtin_is_file", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_is_file", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_is_file() requires a path string");
@@ -1044,7 +1377,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_is_dir(path) - Check if path is a directory
-    globalEnv->define("__builtin_is_dir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_is_dir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_is_dir() requires a path string");
@@ -1061,13 +1394,13 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_listdir(path) - List directory contents
-    globalEnv->define("__builtin_listdir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_listdir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_listdir() requires a path string");
             }
             
-            auto entries = std::make_shared<Value::ArrayType>();
+            auto entries = Value::make<Value::ArrayType>();
             std::string path = args[0].asString();
             
             #ifdef _WIN32
@@ -1103,7 +1436,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_mkdir(path) - Create directory
-    globalEnv->define("__builtin_mkdir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_mkdir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_mkdir() requires a path string");
@@ -1117,7 +1450,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_remove(path) - Remove file
-    globalEnv->define("__builtin_remove", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_remove", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_remove() requires a path string");
@@ -1127,7 +1460,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_rmdir(path) - Remove directory
-    globalEnv->define("__builtin_rmdir", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_rmdir", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_rmdir() requires a path string");
@@ -1141,7 +1474,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_rename(src, dest) - Rename/move file
-    globalEnv->define("__builtin_rename", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_rename", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 throw std::runtime_error("__builtin_rename() requires source and dest strings");
@@ -1151,7 +1484,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_getpid() - Get process ID
-    globalEnv->define("__builtin_getpid", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_getpid", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             return Value(static_cast<int64_t>(GetCurrentProcessId()));
@@ -1162,7 +1495,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_exit(code) - Exit program
-    globalEnv->define("__builtin_exit", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_exit", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             int code = 0;
             if (!args.empty() && args[0].isInt()) {
@@ -1174,7 +1507,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_time() - Get Unix timestamp in seconds
-    globalEnv->define("__builtin_time", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_time", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             auto now = std::chrono::system_clock::now();
             auto epoch = now.time_since_epoch();
@@ -1184,7 +1517,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_time_ms() - Get Unix timestamp in milliseconds
-    globalEnv->define("__builtin_time_ms", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_time_ms", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             auto now = std::chrono::system_clock::now();
             auto epoch = now.time_since_epoch();
@@ -1194,7 +1527,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_sleep(ms) - Sleep for milliseconds
-    globalEnv->define("__builtin_sleep", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_sleep", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value();
             int64_t ms = args[0].isInt() ? args[0].asInt() : static_cast<int64_t>(args[0].asFloat());
@@ -1204,23 +1537,23 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_substring(str, start, end) - Get substring
-    globalEnv->define("__builtin_substring", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_substring", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isString()) {
                 throw std::runtime_error("__builtin_substring() requires string, start, end");
             }
-            std::string str = args[0].asString();
+            int64_t length = static_cast<int64_t>(args[0].stringLength());
             int64_t start = args[1].asInt();
             int64_t end = args[2].asInt();
             if (start < 0) start = 0;
-            if (end > static_cast<int64_t>(str.length())) end = str.length();
+            if (end > length) end = length;
             if (start >= end) return Value("");
-            return Value(str.substr(start, end - start));
+            return Value::substring(args[0], start, end - start);
         }
     )));
     
     // __builtin_which(program) - Find executable
-    globalEnv->define("__builtin_which", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_which", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter& interp) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_which() requires a program name");
@@ -1258,7 +1591,7 @@ void Interpreter::registerBuiltins() {
     // ========================================
     
     // __builtin_tcp_connect(host, port) - Connect TCP socket
-    globalEnv->define("__builtin_tcp_connect", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_connect", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isInt()) {
                 throw std::runtime_error("__builtin_tcp_connect(host, port) requires string and int");
@@ -1274,7 +1607,7 @@ void Interpreter::registerBuiltins() {
             
             int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
             if (sock < 0) {
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["connected"] = Value(false);
                 (*result)["error"] = Value("Failed to create socket");
@@ -1294,7 +1627,7 @@ void Interpreter::registerBuiltins() {
                 #else
                 close(sock);
                 #endif
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["connected"] = Value(false);
                 (*result)["error"] = Value("Failed to resolve hostname");
@@ -1309,14 +1642,14 @@ void Interpreter::registerBuiltins() {
                 #else
                 close(sock);
                 #endif
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["connected"] = Value(false);
                 (*result)["error"] = Value("Connection failed");
                 return Value(result);
             }
             
-            auto result = std::make_shared<std::map<std::string, Value>>();
+            auto result = Value::make<Value::MapType>();
             (*result)["fd"] = Value(static_cast<int64_t>(sock));
             (*result)["connected"] = Value(true);
             (*result)["host"] = Value(host);
@@ -1326,7 +1659,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tcp_send(fd, data) - Send data over TCP
-    globalEnv->define("__builtin_tcp_send", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_send", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isInt() || !args[1].isString()) {
                 throw std::runtime_error("__builtin_tcp_send(fd, data) requires int and string");
@@ -1339,7 +1672,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tcp_recv(fd, maxBytes) - Receive data from TCP
-    globalEnv->define("__builtin_tcp_recv", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_recv", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isInt() || !args[1].isInt()) {
                 throw std::runtime_error("__builtin_tcp_recv(fd, maxBytes) requires two ints");
@@ -1354,7 +1687,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tcp_close(fd) - Close TCP socket
-    globalEnv->define("__builtin_tcp_close", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_close", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value();
             int sock = static_cast<int>(args[0].asInt());
@@ -1368,7 +1701,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tcp_listen(port) - Create TCP server
-    globalEnv->define("__builtin_tcp_listen", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_listen", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) {
                 throw std::runtime_error("__builtin_tcp_listen(port) requires int");
@@ -1382,7 +1715,7 @@ void Interpreter::registerBuiltins() {
             
             int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
             if (sock < 0) {
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["listening"] = Value(false);
                 return Value(result);
@@ -1407,7 +1740,7 @@ void Interpreter::registerBuiltins() {
                 #else
                 close(sock);
                 #endif
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["listening"] = Value(false);
                 (*result)["error"] = Value("Bind failed");
@@ -1420,14 +1753,14 @@ void Interpreter::registerBuiltins() {
                 #else
                 close(sock);
                 #endif
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["listening"] = Value(false);
                 (*result)["error"] = Value("Listen failed");
                 return Value(result);
             }
             
-            auto result = std::make_shared<std::map<std::string, Value>>();
+            auto result = Value::make<Value::MapType>();
             (*result)["fd"] = Value(static_cast<int64_t>(sock));
             (*result)["listening"] = Value(true);
             (*result)["port"] = Value(static_cast<int64_t>(port));
@@ -1436,7 +1769,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_tcp_accept(fd) - Accept incoming connection
-    globalEnv->define("__builtin_tcp_accept", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_tcp_accept", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) {
                 throw std::runtime_error("__builtin_tcp_accept(fd) requires int");
@@ -1447,13 +1780,13 @@ void Interpreter::registerBuiltins() {
             int clientSock = static_cast<int>(accept(serverSock, (struct sockaddr*)&clientAddr, &clientLen));
             
             if (clientSock < 0) {
-                auto result = std::make_shared<std::map<std::string, Value>>();
+                auto result = Value::make<Value::MapType>();
                 (*result)["fd"] = Value(static_cast<int64_t>(-1));
                 (*result)["connected"] = Value(false);
                 return Value(result);
             }
             
-            auto result = std::make_shared<std::map<std::string, Value>>();
+            auto result = Value::make<Value::MapType>();
             (*result)["fd"] = Value(static_cast<int64_t>(clientSock));
             (*result)["connected"] = Value(true);
             (*result)["remote_addr"] = Value(std::string(inet_ntoa(clientAddr.sin_addr)));
@@ -1463,7 +1796,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_dns_lookup(hostname) - DNS resolve
-    globalEnv->define("__builtin_dns_lookup", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_dns_lookup", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) {
                 throw std::runtime_error("__builtin_dns_lookup(hostname) requires string");
@@ -1485,7 +1818,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_port_check(host, port, timeout_ms) - Check if port is open
-    globalEnv->define("__builtin_port_check", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_port_check", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3) {
                 throw std::runtime_error("__builtin_port_check(host, port, timeout) requires 3 args");
@@ -1543,7 +1876,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_get_local_ip() - Get local IP address
-    globalEnv->define("__builtin_get_local_ip", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_get_local_ip", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             char hostname[256];
             if (gethostname(hostname, sizeof(hostname)) != 0) {
@@ -1565,7 +1898,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_udp_create() - Create UDP socket
-    globalEnv->define("__builtin_udp_create", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_udp_create", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             #ifdef _WIN32
             WSADATA wsaData;
@@ -1573,7 +1906,7 @@ void Interpreter::registerBuiltins() {
             #endif
             
             int sock = static_cast<int>(socket(AF_INET, SOCK_DGRAM, 0));
-            auto result = std::make_shared<std::map<std::string, Value>>();
+            auto result = Value::make<Value::MapType>();
             (*result)["fd"] = Value(static_cast<int64_t>(sock));
             (*result)["type"] = Value("udp");
             return Value(result);
@@ -1581,7 +1914,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_udp_sendto(fd, host, port, data) - Send UDP packet
-    globalEnv->define("__builtin_udp_sendto", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_udp_sendto", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 4) {
                 throw std::runtime_error("__builtin_udp_sendto requires fd, host, port, data");
@@ -1607,7 +1940,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_udp_close(fd) - Close UDP socket
-    globalEnv->define("__builtin_udp_close", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_udp_close", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value();
             int sock = static_cast<int>(args[0].asInt());
@@ -1625,7 +1958,7 @@ void Interpreter::registerBuiltins() {
     // ========================================
     
     // __builtin_base64url_encode(data) - Base64 URL-safe encode
-    globalEnv->define("__builtin_base64url_encode", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_base64url_encode", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) return Value("");
             std::string data = args[0].asString();
@@ -1655,7 +1988,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_base64url_decode(data) - Base64 URL-safe decode
-    globalEnv->define("__builtin_base64url_decode", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_base64url_decode", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) return Value("");
             std::string data = args[0].asString();
@@ -1696,7 +2029,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_regex_test(pattern, text) - Test regex match
-    globalEnv->define("__builtin_regex_test", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_regex_test", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 return Value(false);
@@ -1711,27 +2044,27 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_split(str, delimiter) - Split string
-    globalEnv->define("__builtin_split", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_split", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
-                return Value(std::make_shared<std::vector<Value>>());
+                return Value(Value::make<Value::ArrayType>());
             }
-            std::string str = args[0].asString();
+            std::string_view str = args[0].asStringView();
             std::string delim = args[1].asString();
-            auto result = std::make_shared<std::vector<Value>>();
+            auto result = Value::make<Value::ArrayType>();
             
             size_t pos = 0, prev = 0;
-            while ((pos = str.find(delim, prev)) != std::string::npos) {
-                result->push_back(Value(str.substr(prev, pos - prev)));
+            while ((pos = str.find(delim, prev)) != std::string_view::npos) {
+                result->push_back(Value::substring(args[0], prev, pos - prev));
                 prev = pos + delim.length();
             }
-            result->push_back(Value(str.substr(prev)));
+            result->push_back(Value::substring(args[0], prev, str.length() - prev));
             return Value(result);
         }
     )));
     
     // __builtin_join(arr, delimiter) - Join array
-    globalEnv->define("__builtin_join", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_join", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isArray() || !args[1].isString()) {
                 return Value("");
@@ -1748,19 +2081,19 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_trim(str) - Trim whitespace
-    globalEnv->define("__builtin_trim", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_trim", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) return Value("");
-            std::string str = args[0].asString();
+            std::string_view str = args[0].asStringView();
             size_t start = str.find_first_not_of(" \t\n\r");
-            if (start == std::string::npos) return Value("");
+            if (start == std::string_view::npos) return Value("");
             size_t end = str.find_last_not_of(" \t\n\r");
-            return Value(str.substr(start, end - start + 1));
+            return Value::substring(args[0], start, end - start + 1);
         }
     )));
     
     // __builtin_lowercase(str) - Convert to lowercase
-    globalEnv->define("__builtin_lowercase", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_lowercase", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) return Value("");
             std::string str = args[0].asString();
@@ -1770,7 +2103,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_starts_with(str, prefix) - Check prefix
-    globalEnv->define("__builtin_starts_with", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_starts_with", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 return Value(false);
@@ -1783,7 +2116,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_contains(str, search) - Check if contains
-    globalEnv->define("__builtin_contains", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_contains", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 return Value(false);
@@ -1793,7 +2126,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_replace_all(str, from, to) - Replace all occurrences
-    globalEnv->define("__builtin_replace_all", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_replace_all", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isString() || !args[1].isString() || !args[2].isString()) {
                 return Value("");
@@ -1813,7 +2146,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_json_stringify(map) - Convert map to JSON string
-    globalEnv->define("__builtin_json_stringify", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_json_stringify", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty()) return Value("{}");
             return Value(args[0].toString());
@@ -1821,15 +2154,15 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_json_parse(str) - Parse JSON to map (simplified)
-    globalEnv->define("__builtin_json_parse", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_json_parse", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             // Simplified - just return empty map for now
-            return Value(std::make_shared<std::map<std::string, Value>>());
+            return Value(Value::make<Value::MapType>());
         }
     )));
     
     // __builtin_random_bytes(length) - Generate random bytes (hex)
-    globalEnv->define("__builtin_random_bytes", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_random_bytes", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value("");
             int length = static_cast<int>(args[0].asInt());
@@ -1849,7 +2182,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_uuid() - Generate UUID v4
-    globalEnv->define("__builtin_uuid", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_uuid", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             static const char hex_chars[] = "0123456789abcdef";
             std::string uuid;
@@ -1871,7 +2204,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_secure_compare(a, b) - Constant-time comparison
-    globalEnv->define("__builtin_secure_compare", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_secure_compare", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 return Value(false);
@@ -1893,13 +2226,20 @@ void Interpreter::registerBuiltins() {
     // ========================================
     
     // __builtin_keys(map) - Get map keys as array
-    globalEnv->define("__builtin_keys", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_keys", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
+            auto keys = Value::make<Value::ArrayType>();
+            if (!args.empty() && args[0].isStruct()) {
+                const Shape* shape = args[0].asStruct().shape;
+                for (size_t i = 0; i < shape->size(); ++i) {
+                    keys->push_back(Value(shape->fieldAt(i)));
+                }
+                return Value(keys);
+            }
             if (args.empty() || !args[0].isMap()) {
-                return Value(std::make_shared<std::vector<Value>>());
+                return Value(keys);
             }
             auto map = args[0].asMap();
-            auto keys = std::make_shared<std::vector<Value>>();
             for (const auto& [key, _] : *map) {
                 keys->push_back(Value(key));
             }
@@ -1908,7 +2248,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_index_of(str, search, start) - Find index of substring
-    globalEnv->define("__builtin_index_of", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_index_of", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isString() || !args[1].isString()) {
                 return Value(static_cast<int64_t>(-1));
@@ -1930,7 +2270,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_uppercase(str) - Convert to uppercase
-    globalEnv->define("__builtin_uppercase", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_uppercase", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isString()) return Value("");
             std::string str = args[0].asString();
@@ -1940,7 +2280,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_ends_with(str, suffix) - Check suffix
-    globalEnv->define("__builtin_ends_with", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_ends_with", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 2 || !args[0].isString() || !args[1].isString()) {
                 return Value(false);
@@ -1961,7 +2301,7 @@ void Interpreter::registerBuiltins() {
     static int64_t nextBufferId = 1;
     
     // __builtin_alloc_buffer(size) - Allocate memory buffer
-    globalEnv->define("__builtin_alloc_buffer", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_alloc_buffer", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value(static_cast<int64_t>(0));
             int64_t size = args[0].asInt();
@@ -1974,7 +2314,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_free_buffer(id) - Free memory buffer
-    globalEnv->define("__builtin_free_buffer", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_free_buffer", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value(false);
             int64_t id = args[0].asInt();
@@ -1988,7 +2328,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_buffer_write(id, offset, data) - Write to buffer
-    globalEnv->define("__builtin_buffer_write", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_buffer_write", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isInt() || !args[1].isInt() || !args[2].isArray()) {
                 return Value(false);
@@ -2008,16 +2348,16 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_buffer_read(id, offset, length) - Read from buffer
-    globalEnv->define("__builtin_buffer_read", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_buffer_read", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isInt() || !args[1].isInt() || !args[2].isInt()) {
-                return Value(std::make_shared<std::vector<Value>>());
+                return Value(Value::make<Value::ArrayType>());
             }
             int64_t id = args[0].asInt();
             int64_t offset = args[1].asInt();
             int64_t length = args[2].asInt();
             
-            auto result = std::make_shared<std::vector<Value>>();
+            auto result = Value::make<Value::ArrayType>();
             auto it = memoryBuffers.find(id);
             if (it == memoryBuffers.end()) return Value(result);
             
@@ -2029,7 +2369,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_time_ms() - Get current time in milliseconds
-    globalEnv->define("__builtin_time_ms", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_time_ms", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value {
             auto now = std::chrono::system_clock::now();
             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
@@ -2038,7 +2378,7 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_sleep(ms) - Sleep for milliseconds
-    globalEnv->define("__builtin_sleep", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_sleep", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.empty() || !args[0].isInt()) return Value();
             int64_t ms = args[0].asInt();
@@ -2048,72 +2388,72 @@ void Interpreter::registerBuiltins() {
     )));
     
     // __builtin_substring(str, start, end) - Get substring
-    globalEnv->define("__builtin_substring", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_substring", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>& args, Interpreter&) -> Value {
             if (args.size() < 3 || !args[0].isString() || !args[1].isInt() || !args[2].isInt()) {
                 return Value("");
             }
-            std::string str = args[0].asString();
+            int64_t length = static_cast<int64_t>(args[0].stringLength());
             int64_t start = args[1].asInt();
             int64_t end = args[2].asInt();
             
             if (start < 0) start = 0;
-            if (end > static_cast<int64_t>(str.length())) end = str.length();
+            if (end > length) end = length;
             if (start >= end) return Value("");
             
-            return Value(str.substr(start, end - start));
+            return Value::substring(args[0], start, end - start);
         }
     )));
     
     // Placeholder FFI functions (would need native implementation)
-    globalEnv->define("__builtin_load_library", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_load_library", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(0)); }
     )));
-    globalEnv->define("__builtin_unload_library", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_unload_library", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(); }
     )));
-    globalEnv->define("__builtin_get_proc_address", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_get_proc_address", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(0)); }
     )));
-    globalEnv->define("__builtin_ffi_call", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_ffi_call", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(); }
     )));
-    globalEnv->define("__builtin_mmap", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_mmap", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(0)); }
     )));
-    globalEnv->define("__builtin_munmap", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_munmap", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(false); }
     )));
     
     // GPIO/I2C/SPI placeholders
-    globalEnv->define("__builtin_gpio_mode", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_gpio_mode", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(true); }
     )));
-    globalEnv->define("__builtin_gpio_write", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_gpio_write", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(true); }
     )));
-    globalEnv->define("__builtin_gpio_read", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_gpio_read", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(0)); }
     )));
-    globalEnv->define("__builtin_i2c_open", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_i2c_open", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(1)); }
     )));
-    globalEnv->define("__builtin_i2c_write", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_i2c_write", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(true); }
     )));
-    globalEnv->define("__builtin_i2c_read", Value(std::make_shared<Value::FunctionType>(
-        [](std::vector<Value>&, Interpreter&) -> Value { return Value(std::make_shared<std::vector<Value>>()); }
+    globalEnv->define("__builtin_i2c_read", Value(Value::make<Value::FunctionType>(
+        [](std::vector<Value>&, Interpreter&) -> Value { return Value(Value::make<Value::ArrayType>()); }
     )));
-    globalEnv->define("__builtin_i2c_close", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_i2c_close", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(true); }
     )));
-    globalEnv->define("__builtin_spi_open", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_spi_open", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(static_cast<int64_t>(1)); }
     )));
-    globalEnv->define("__builtin_spi_transfer", Value(std::make_shared<Value::FunctionType>(
-        [](std::vector<Value>&, Interpreter&) -> Value { return Value(std::make_shared<std::vector<Value>>()); }
+    globalEnv->define("__builtin_spi_transfer", Value(Value::make<Value::FunctionType>(
+        [](std::vector<Value>&, Interpreter&) -> Value { return Value(Value::make<Value::ArrayType>()); }
     )));
-    globalEnv->define("__builtin_spi_close", Value(std::make_shared<Value::FunctionType>(
+    globalEnv->define("__builtin_spi_close", Value(Value::make<Value::FunctionType>(
         [](std::vector<Value>&, Interpreter&) -> Value { return Value(true); }
     )));
 }
@@ -2122,7 +2462,11 @@ void Interpreter::registerBuiltins() {
 void Interpreter::execute(const std::vector<std::unique_ptr<Statement>>& statements) {
     for (const auto& stmt : statements) {
         stmt->accept(*this);
+        if (completion.isAbrupt()) {
+            break;  // Top-level return ends the program
+        }
     }
+    completion = Completion();
 }
 
 // Helper to evaluate expression
@@ -2132,64 +2476,60 @@ Value Interpreter::evaluate(Expression* expr) {
 }
 
 // Call a function
-Value Interpreter::callFunction(const std::string& name, std::vector<Value>& args) {
-    // Check for user-defined function
-    auto it = userFunctions.find(name);
-    if (it != userFunctions.end()) {
-        const UserFunction& func = it->second;
-        
-        // Create new environment with closure
-        auto funcEnv = std::make_shared<Environment>(func.closure);
-        
-        // Bind parameters
-        for (size_t i = 0; i < func.parameters.size(); ++i) {
-            if (i < args.size()) {
-                funcEnv->define(func.parameters[i], args[i]);
-            } else {
-                funcEnv->define(func.parameters[i], Value());
-            }
-        }
-        
-        // Save current environment and switch
-        auto prevEnv = currentEnv;
-        currentEnv = funcEnv;
-        
-        Value result;
-        try {
-            func.body->accept(*this);
-        } catch (const ReturnException& ret) {
-            // Handle return value
-            if (ret.hasValue) {
-                if (ret.isArray) {
-                    result = Value(std::static_pointer_cast<Value::ArrayType>(ret.complexValue));
-                } else if (ret.isMap) {
-                    result = Value(std::static_pointer_cast<Value::MapType>(ret.complexValue));
-                } else if (std::holds_alternative<int64_t>(ret.primitiveValue)) {
-                    result = Value(std::get<int64_t>(ret.primitiveValue));
-                } else if (std::holds_alternative<double>(ret.primitiveValue)) {
-                    result = Value(std::get<double>(ret.primitiveValue));
-                } else if (std::holds_alternative<std::string>(ret.primitiveValue)) {
-                    result = Value(std::get<std::string>(ret.primitiveValue));
-                } else if (std::holds_alternative<bool>(ret.primitiveValue)) {
-                    result = Value(std::get<bool>(ret.primitiveValue));
-                }
+Value Interpreter::callUserFunction(const UserFunction& func, std::vector<Value>& args) {
+    // Create new frame with closure; parameters occupy the first slots
+    Frame frame(frameArena, func.closure, func.frameSize, func.frameCaptured);
+    
+    // Bind parameters
+    for (size_t i = 0; i < func.parameters.size() && i < args.size(); ++i) {
+        frame.get()->defineSlot(static_cast<int>(i), args[i]);
+    }
+    
+    // Save current environment and switch
+    auto prevEnv = currentEnv;
+    currentEnv = frame.get();
+    
+    // The body shares the function frame (the Resolver merged their scopes)
+    try {
+        for (auto& stmt : func.body->statements) {
+            stmt->accept(*this);
+            if (completion.isAbrupt()) {
+                break;
             }
         }
-        
-        // Restore environment
+    } catch (...) {
         currentEnv = prevEnv;
-        return result;
+        throw;
+    }
+    
+    // Only a return carries a value; a stray break/continue stops at the call boundary
+    Value result;
+    if (completion.type == Completion::Type::Return) {
+        result = std::move(completion.value);
+    }
+    completion = Completion();
+    
+    // Restore environment
+    currentEnv = prevEnv;
+    return result;
+}
+
+Value Interpreter::callFunction(Symbol name, std::vector<Value>& args) {
+    // Check for user-defined function
+    auto it = userFunctions.find(name);
+    if (it != userFunctions.end()) {
+        return callUserFunction(it->second, args);
     }
     
     // Check for built-in function
-    if (globalEnv->exists(name)) {
-        Value funcVal = globalEnv->get(name);
-        if (funcVal.isFunction()) {
-            return (*funcVal.asFunction())(args, *this);
+    if (const Value* funcVal = globalEnv->find(name)) {
+        if (funcVal->isFunction()) {
+            auto func = funcVal->asFunction();  // Keep it alive if the call rebinds the name
+            return (*func)(args, *this);
         }
     }
     
-    throw std::runtime_error("Undefined function: " + name);
+    throw std::runtime_error("Undefined function: " + name.str());
 }
 
 // Visitor implementations
@@ -2214,104 +2554,247 @@ void Interpreter::visit(NullLiteral* node) {
 }
 
 void Interpreter::visit(Identifier* node) {
-    lastValue = currentEnv->get(node->name);
+    if (node->depth >= 0) {
+        lastValue = currentEnv->slotAt(node->depth, node->slot);
+    } else {
+        lastValue = currentEnv->get(node->symbol);
+    }
+}
+
+// `+` with a string on either side; the other operand is converted with toString()
+Value concatValues(const Value& left, const Value& right) {
+    return Value::concat(left.isString() ? left : Value(left.toString()),
+                         right.isString() ? right : Value(right.toString()));
+}
+
+// Int-int fast path; returns false if the operator has no int specialization
+static bool evalIntInt(BinaryOp op, int64_t a, int64_t b, Value& out) {
+    switch (op) {
+        case BinaryOp::Add: out = Value(a + b); return true;
+        case BinaryOp::Sub: out = Value(a - b); return true;
+        case BinaryOp::Mul: out = Value(a * b); return true;
+        case BinaryOp::Mod: out = Value(a % b); return true;
+        case BinaryOp::Eq:  out = Value(a == b); return true;
+        case BinaryOp::Ne:  out = Value(a != b); return true;
+        case BinaryOp::Lt:  out = Value(a < b); return true;
+        case BinaryOp::Gt:  out = Value(a > b); return true;
+        case BinaryOp::Le:  out = Value(a <= b); return true;
+        case BinaryOp::Ge:  out = Value(a >= b); return true;
+        default: return false;  // Division always produces a float
+    }
+}
+
+// Float-float fast path; returns false if the operator has no float specialization
+static bool evalFloatFloat(BinaryOp op, double a, double b, Value& out) {
+    switch (op) {
+        case BinaryOp::Add: out = Value(a + b); return true;
+        case BinaryOp::Sub: out = Value(a - b); return true;
+        case BinaryOp::Mul: out = Value(a * b); return true;
+        case BinaryOp::Div:
+            if (b == 0.0) return false;  // Let the generic path report it
+            out = Value(a / b);
+            return true;
+        case BinaryOp::Eq:  out = Value(a == b); return true;
+        case BinaryOp::Ne:  out = Value(a != b); return true;
+        case BinaryOp::Lt:  out = Value(a < b); return true;
+        case BinaryOp::Gt:  out = Value(a > b); return true;
+        case BinaryOp::Le:  out = Value(a <= b); return true;
+        case BinaryOp::Ge:  out = Value(a >= b); return true;
+        default: return false;
+    }
+}
+
+// Generic path for binary operators, used when the operand types have no fast path
+Value binaryOperation(BinaryOp op, const Value& left, const Value& right) {
+    switch (op) {
+        // Arithmetic operations
+        case BinaryOp::Add:
+            if (left.isString() || right.isString()) {
+                return concatValues(left, right);
+            }
+            if (left.isFloat() || right.isFloat()) {
+                return Value(left.asFloat() + right.asFloat());
+            }
+            return Value(left.asInt() + right.asInt());
+        case BinaryOp::Sub:
+            if (left.isFloat() || right.isFloat()) {
+                return Value(left.asFloat() - right.asFloat());
+            }
+            return Value(left.asInt() - right.asInt());
+        case BinaryOp::Mul:
+            if (left.isFloat() || right.isFloat()) {
+                return Value(left.asFloat() * right.asFloat());
+            }
+            return Value(left.asInt() * right.asInt());
+        case BinaryOp::Div:
+            if (right.asFloat() == 0.0) {
+                throw std::runtime_error("Division by zero");
+            }
+            return Value(left.asFloat() / right.asFloat());
+        case BinaryOp::Mod:
+            return Value(left.asInt() % right.asInt());
+        
+        // Comparison operations
+        case BinaryOp::Eq:
+            if (left.isString() && right.isString()) {
+                return Value(left.asStringView() == right.asStringView());
+            }
+            if (left.isNumber() && right.isNumber()) {
+                return Value(left.asFloat() == right.asFloat());
+            }
+            if (left.isBool() && right.isBool()) {
+                return Value(left.asBool() == right.asBool());
+            }
+            return Value(false);
+        case BinaryOp::Ne:
+            if (left.isString() && right.isString()) {
+                return Value(left.asStringView() != right.asStringView());
+            }
+            if (left.isNumber() && right.isNumber()) {
+                return Value(left.asFloat() != right.asFloat());
+            }
+            return Value(true);
+        case BinaryOp::Lt:
+            return Value(left.asFloat() < right.asFloat());
+        case BinaryOp::Gt:
+            return Value(left.asFloat() > right.asFloat());
+        case BinaryOp::Le:
+            return Value(left.asFloat() <= right.asFloat());
+        case BinaryOp::Ge:
+            return Value(left.asFloat() >= right.asFloat());
+        
+        // Logical operations
+        case BinaryOp::And:
+            return Value(left.isTruthy() && right.isTruthy());
+        case BinaryOp::Or:
+            return Value(left.isTruthy() || right.isTruthy());
+        
+        case BinaryOp::Unknown:
+            break;
+    }
+    throw std::runtime_error("Unknown binary operator");
+}
+
+Value unaryOperation(UnaryOp op, const Value& operand) {
+    switch (op) {
+        case UnaryOp::Neg:
+            if (operand.isFloat()) {
+                return Value(-operand.asFloat());
+            }
+            return Value(-operand.asInt());
+        case UnaryOp::Not:
+            return Value(!operand.isTruthy());
+        case UnaryOp::Unknown:
+            break;
+    }
+    throw std::runtime_error("Unknown unary operator");
+}
+
+// Compound assignment keeps integer division and yields null for operators it does not support
+Value compoundOperation(BinaryOp op, const Value& current, const Value& value) {
+    switch (op) {
+        case BinaryOp::Add:
+            if (current.isString() || value.isString()) {
+                return concatValues(current, value);
+            }
+            if (current.isInt() && value.isInt()) {
+                return Value(current.asInt() + value.asInt());
+            }
+            return Value(current.asFloat() + value.asFloat());
+        case BinaryOp::Sub:
+            if (current.isInt() && value.isInt()) {
+                return Value(current.asInt() - value.asInt());
+            }
+            return Value(current.asFloat() - value.asFloat());
+        case BinaryOp::Mul:
+            if (current.isInt() && value.isInt()) {
+                return Value(current.asInt() * value.asInt());
+            }
+            return Value(current.asFloat() * value.asFloat());
+        case BinaryOp::Div:
+            if (current.isInt() && value.isInt()) {
+                return Value(current.asInt() / value.asInt());
+            }
+            return Value(current.asFloat() / value.asFloat());
+        default:
+            return Value();
+    }
+}
+
+Value updateOperation(const Value& current, bool increment) {
+    int64_t delta = increment ? 1 : -1;
+    if (current.isInt()) {
+        return Value(current.asInt() + delta);
+    }
+    return Value(current.asFloat() + static_cast<double>(delta));
+}
+
+// Match cases compare ints, strings and bools; anything else never matches
+bool matchesPattern(const Value& subject, const Value& pattern) {
+    if (subject.isInt() && pattern.isInt()) {
+        return subject.asInt() == pattern.asInt();
+    }
+    if (subject.isString() && pattern.isString()) {
+        return subject.asStringView() == pattern.asStringView();
+    }
+    if (subject.isBool() && pattern.isBool()) {
+        return subject.asBool() == pattern.asBool();
+    }
+    return false;
 }
 
 void Interpreter::visit(BinaryExpression* node) {
     Value left = evaluate(node->left.get());
     Value right = evaluate(node->right.get());
-    const std::string& op = node->op;
-    
-    // Arithmetic operations
-    if (op == "+") {
-        if (left.isString() || right.isString()) {
-            lastValue = Value(left.toString() + right.toString());
-        } else if (left.isFloat() || right.isFloat()) {
-            lastValue = Value(left.asFloat() + right.asFloat());
-        } else {
-            lastValue = Value(left.asInt() + right.asInt());
-        }
-    } else if (op == "-") {
-        if (left.isFloat() || right.isFloat()) {
-            lastValue = Value(left.asFloat() - right.asFloat());
+    
+    // The fast path is chosen from the operand types seen on first evaluation;
+    // a node that later sees other types falls back to the generic path for good
+    using OperandTypes = BinaryExpression::OperandTypes;
+    if (node->operandTypes == OperandTypes::Unknown) {
+        if (left.isInt() && right.isInt()) {
+            node->operandTypes = OperandTypes::IntInt;
+        } else if (left.isFloat() && right.isFloat()) {
+            node->operandTypes = OperandTypes::FloatFloat;
         } else {
-            lastValue = Value(left.asInt() - right.asInt());
+            node->operandTypes = OperandTypes::Generic;
         }
-    } else if (op == "*") {
-        if (left.isFloat() || right.isFloat()) {
-            lastValue = Value(left.asFloat() * right.asFloat());
-        } else {
-            lastValue = Value(left.asInt() * right.asInt());
-        }
-    } else if (op == "/") {
-        if (right.asFloat() == 0.0) {
-            throw std::runtime_error("Division by zero");
-        }
-        lastValue = Value(left.asFloat() / right.asFloat());
-    } else if (op == "%") {
-        lastValue = Value(left.asInt() % right.asInt());
-    }
-    // Comparison operations
-    else if (op == "==") {
-        if (left.isString() && right.isString()) {
-            lastValue = Value(left.asString() == right.asString());
-        } else if (left.isNumber() && right.isNumber()) {
-            lastValue = Value(left.asFloat() == right.asFloat());
-        } else if (left.isBool() && right.isBool()) {
-            lastValue = Value(left.asBool() == right.asBool());
+    }
+    if (node->operandTypes == OperandTypes::IntInt) {
+        if (left.isInt() && right.isInt()) {
+            if (evalIntInt(node->binaryOp, left.asInt(), right.asInt(), lastValue)) return;
         } else {
-            lastValue = Value(false);
+            node->operandTypes = OperandTypes::Generic;
         }
-    } else if (op == "!=") {
-        if (left.isString() && right.isString()) {
-            lastValue = Value(left.asString() != right.asString());
-        } else if (left.isNumber() && right.isNumber()) {
-            lastValue = Value(left.asFloat() != right.asFloat());
+    } else if (node->operandTypes == OperandTypes::FloatFloat) {
+        if (left.isFloat() && right.isFloat()) {
+            if (evalFloatFloat(node->binaryOp, left.asFloat(), right.asFloat(), lastValue)) return;
         } else {
-            lastValue = Value(true);
+            node->operandTypes = OperandTypes::Generic;
         }
-    } else if (op == "<") {
-        lastValue = Value(left.asFloat() < right.asFloat());
-    } else if (op == ">") {
-        lastValue = Value(left.asFloat() > right.asFloat());
-    } else if (op == "<=") {
-        lastValue = Value(left.asFloat() <= right.asFloat());
-    } else if (op == ">=") {
-        lastValue = Value(left.asFloat() >= right.asFloat());
-    }
-    // Logical operations
-    else if (op == "&&" || op == "and") {
-        lastValue = Value(left.isTruthy() && right.isTruthy());
-    } else if (op == "||" || op == "or") {
-        lastValue = Value(left.isTruthy() || right.isTruthy());
     }
-    else {
-        throw std::runtime_error("Unknown binary operator: " + op);
+    
+    if (node->binaryOp == BinaryOp::Unknown) {
+        throw std::runtime_error("Unknown binary operator: " + node->op);
     }
+    lastValue = binaryOperation(node->binaryOp, left, right);
 }
 
 void Interpreter::visit(UnaryExpression* node) {
     Value operand = evaluate(node->operand.get());
-    const std::string& op = node->op;
-    
-    if (op == "-") {
-        if (operand.isFloat()) {
-            lastValue = Value(-operand.asFloat());
-        } else {
-            lastValue = Value(-operand.asInt());
-        }
-    } else if (op == "!" || op == "not") {
-        lastValue = Value(!operand.isTruthy());
-    } else {
-        throw std::runtime_error("Unknown unary operator: " + op);
+    if (node->unaryOp == UnaryOp::Unknown) {
+        throw std::runtime_error("Unknown unary operator: " + node->op);
     }
+    lastValue = unaryOperation(node->unaryOp, operand);
 }
 
 void Interpreter::visit(AssignmentExpression* node) {
     Value value = evaluate(node->right.get());
     
-    if (auto* id = dynamic_cast<Identifier*>(node->left.get())) {
-        currentEnv->set(id->name, value);
+    if (node->depth >= 0) {
+        currentEnv->slotAt(node->depth, node->slot) = value;
+        lastValue = value;
+    } else if (node->left->kind == NodeKind::Identifier) {
+        currentEnv->set(static_cast<Identifier*>(node->left.get())->symbol, value);
         lastValue = value;
     } else {
         throw std::runtime_error("Invalid assignment target");
@@ -2320,14 +2803,42 @@ void Interpreter::visit(AssignmentExpression* node) {
 
 void Interpreter::visit(CallExpression* node) {
     std::vector<Value> args;
+    args.reserve(node->arguments.size());
     for (auto& arg : node->arguments) {
         args.push_back(evaluate(arg.get()));
     }
-    lastValue = callFunction(node->callee, args);
+    
+    // Resolve the callee once per function epoch, with the same precedence as
+    // callFunction: user functions first, then builtins bound in the global scope
+    CallSiteCache& cache = node->cache;
+    if (cache.epoch != Environment::functionEpoch) {
+        cache.function = nullptr;
+        cache.native = nullptr;
+        auto it = userFunctions.find(node->calleeSymbol);
+        if (it != userFunctions.end()) {
+            cache.function = &it->second;
+        } else if (const Value* funcVal = globalEnv->find(node->calleeSymbol)) {
+            if (funcVal->isFunction()) {
+                cache.native = funcVal->asFunction().get();
+            }
+        }
+        if (!cache.function && !cache.native) {
+            cache.epoch = 0;
+            throw std::runtime_error("Undefined function: " + node->callee);
+        }
+        cache.epoch = Environment::functionEpoch;
+    }
+    
+    if (cache.function) {
+        lastValue = callUserFunction(*cache.function, args);
+    } else {
+        // The global binding owns the builtin and cannot change without bumping the epoch
+        lastValue = (*static_cast<const Value::FunctionType*>(cache.native))(args, *this);
+    }
 }
 
 void Interpreter::visit(ArrayLiteral* node) {
-    auto arr = std::make_shared<Value::ArrayType>();
+    auto arr = Value::make<Value::ArrayType>();
     for (auto& elem : node->elements) {
         arr->push_back(evaluate(elem.get()));
     }
@@ -2379,11 +2890,15 @@ void Interpreter::visit(VariableDeclaration* node) {
     if (node->initializer) {
         value = evaluate(node->initializer.get());
     }
-    currentEnv->define(node->name, value);
+    if (node->slot >= 0) {
+        currentEnv->defineSlot(node->slot, value);
+    } else {
+        currentEnv->define(node->symbol, value);
+    }
     
     // Track if this is a const variable
     if (node->isConst) {
-        constVariables[node->name] = true;
+        constVariables[node->symbol] = true;
     }
 }
 
@@ -2392,12 +2907,31 @@ void Interpreter::visit(ExpressionStatement* node) {
 }
 
 void Interpreter::visit(BlockStatement* node) {
-    auto blockEnv = std::make_shared<Environment>(currentEnv);
+    // Blocks that declare nothing run in the enclosing frame
+    if (node->frameSize == 0) {
+        for (auto& stmt : node->statements) {
+            stmt->accept(*this);
+            if (completion.isAbrupt()) {
+                return;
+            }
+        }
+        return;
+    }
+    
+    Frame frame(frameArena, currentEnv, node->frameSize, node->frameCaptured);
     auto prevEnv = currentEnv;
-    currentEnv = blockEnv;
+    currentEnv = frame.get();
     
-    for (auto& stmt : node->statements) {
-        stmt->accept(*this);
+    try {
+        for (auto& stmt : node->statements) {
+            stmt->accept(*this);
+            if (completion.isAbrupt()) {
+                break;
+            }
+        }
+    } catch (...) {
+        currentEnv = prevEnv;
+        throw;
     }
     
     currentEnv = prevEnv;
@@ -2415,48 +2949,68 @@ void Interpreter::visit(IfStatement* node) {
 
 void Interpreter::visit(WhileStatement* node) {
     while (evaluate(node->condition.get()).isTruthy()) {
-        try {
-            node->body->accept(*this);
-        } catch (const BreakException&) {
-            break;
-        } catch (const ContinueException&) {
-            continue;
+        node->body->accept(*this);
+        
+        if (completion.isAbrupt()) {
+            if (completion.type == Completion::Type::Break) {
+                completion.type = Completion::Type::Normal;
+                break;
+            }
+            if (completion.type == Completion::Type::Continue) {
+                completion.type = Completion::Type::Normal;
+                continue;
+            }
+            break;  // Return propagates to the enclosing call
         }
     }
 }
 
 void Interpreter::visit(ForStatement* node) {
-    auto forEnv = std::make_shared<Environment>(currentEnv);
     auto prevEnv = currentEnv;
-    currentEnv = forEnv;
-    
-    if (node->initializer) {
-        node->initializer->accept(*this);
+    std::optional<Frame> frame;
+    if (node->frameSize > 0) {
+        frame.emplace(frameArena, currentEnv, node->frameSize, node->frameCaptured);
+        currentEnv = frame->get();
     }
     
-    while (!node->condition || evaluate(node->condition.get()).isTruthy()) {
-        try {
-            node->body->accept(*this);
-        } catch (const BreakException&) {
-            break;
-        } catch (const ContinueException&) {
-            // Continue to increment
+    try {
+        if (node->initializer) {
+            node->initializer->accept(*this);
         }
         
-        if (node->increment) {
-            evaluate(node->increment.get());
+        while (!node->condition || evaluate(node->condition.get()).isTruthy()) {
+            node->body->accept(*this);
+            
+            if (completion.isAbrupt()) {
+                if (completion.type == Completion::Type::Break) {
+                    completion.type = Completion::Type::Normal;
+                    break;
+                }
+                if (completion.type == Completion::Type::Return) {
+                    break;  // Propagates to the enclosing call
+                }
+                // Continue falls through to the increment
+                completion.type = Completion::Type::Normal;
+            }
+            
+            if (node->increment) {
+                evaluate(node->increment.get());
+            }
         }
+    } catch (...) {
+        currentEnv = prevEnv;
+        throw;
     }
     
     currentEnv = prevEnv;
 }
 
 void Interpreter::visit(BreakStatement*) {
-    throw BreakException();
+    completion.type = Completion::Type::Break;
 }
 
 void Interpreter::visit(ContinueStatement*) {
-    throw ContinueException();
+    completion.type = Completion::Type::Continue;
 }
 
 void Interpreter::visit(FunctionDeclaration* node) {
@@ -2464,47 +3018,36 @@ void Interpreter::visit(FunctionDeclaration* node) {
     func.parameters = node->parameters;
     func.body = node->body.get();
     func.closure = currentEnv;
+    func.frameSize = node->frameSize;
+    func.frameCaptured = node->frameCaptured;
     
-    userFunctions[node->name] = func;
+    userFunctions[Symbol(node->name)] = func;
+    ++Environment::functionEpoch;
 }
 
 void Interpreter::visit(ReturnStatement* node) {
+    Value val;
     if (node->value) {
-        Value val = evaluate(node->value.get());
-        
-        if (val.isInt()) {
-            throw ReturnException(val.asInt());
-        } else if (val.isFloat()) {
-            throw ReturnException(val.asFloat());
-        } else if (val.isString()) {
-            throw ReturnException(val.asString());
-        } else if (val.isBool()) {
-            throw ReturnException(val.asBool());
-        } else if (val.isArray()) {
-            ReturnException ret;
-            ret.setArray(val.asArray());
-            throw ret;
-        } else if (val.isMap()) {
-            ReturnException ret;
-            ret.setMap(val.asMap());
-            throw ret;
-        } else {
-            throw ReturnException();
-        }
+        val = evaluate(node->value.get());
     }
-    throw ReturnException();
+    completion.type = Completion::Type::Return;
+    completion.value = std::move(val);
 }
 
 void Interpreter::visit(TryStatement* node) {
+    auto savedEnv = currentEnv;
     try {
         // Execute try block
         if (node->tryBlock) {
             node->tryBlock->accept(*this);
         }
     } catch (const std::exception& e) {
-        // Create catch environment with error variable
-        auto catchEnv = std::make_shared<Environment>(currentEnv);
-        catchEnv->define(node->errorVariable, Value(std::string(e.what())));
+        // Unwind to the frame the try statement started in
+        currentEnv = savedEnv;
+        
+        // Create catch frame with the error variable in its only slot
+        auto catchEnv = std::make_shared<Environment>(currentEnv, 1);
+        catchEnv->defineSlot(0, Value(std::string(e.what())));
         
         auto prevEnv = currentEnv;
         currentEnv = catchEnv;
@@ -2536,18 +3079,7 @@ void Interpreter::visit(MatchExpression* node) {
         }
         
         Value pattern = evaluate(matchCase.pattern.get());
-        
-        // Simple equality check
-        bool matches = false;
-        if (subject.isInt() && pattern.isInt()) {
-            matches = subject.asInt() == pattern.asInt();
-        } else if (subject.isString() && pattern.isString()) {
-            matches = subject.asString() == pattern.asString();
-        } else if (subject.isBool() && pattern.isBool()) {
-            matches = subject.asBool() == pattern.asBool();
-        }
-        
-        if (matches) {
+        if (matchesPattern(subject, pattern)) {
             lastValue = evaluate(matchCase.result.get());
             return;
         }
@@ -2558,89 +3090,67 @@ void Interpreter::visit(MatchExpression* node) {
 }
 
 void Interpreter::visit(CompoundAssignment* node) {
-    auto* id = dynamic_cast<Identifier*>(node->target.get());
-    if (!id) {
+    if (node->target->kind != NodeKind::Identifier) {
         throw std::runtime_error("Compound assignment target must be an identifier");
     }
+    auto* id = static_cast<Identifier*>(node->target.get());
     
-    Value current = currentEnv->get(id->name);
+    Value current = node->depth >= 0 ? currentEnv->slotAt(node->depth, node->slot)
+                                     : currentEnv->get(id->symbol);
     Value value = evaluate(node->value.get());
-    Value result;
+    Value result = compoundOperation(node->binaryOp, current, value);
     
-    if (node->op == "+=") {
-        if (current.isString() || value.isString()) {
-            result = Value(current.toString() + value.toString());
-        } else if (current.isInt() && value.isInt()) {
-            result = Value(current.asInt() + value.asInt());
-        } else {
-            result = Value(current.asFloat() + value.asFloat());
-        }
-    } else if (node->op == "-=") {
-        if (current.isInt() && value.isInt()) {
-            result = Value(current.asInt() - value.asInt());
-        } else {
-            result = Value(current.asFloat() - value.asFloat());
-        }
-    } else if (node->op == "*=") {
-        if (current.isInt() && value.isInt()) {
-            result = Value(current.asInt() * value.asInt());
-        } else {
-            result = Value(current.asFloat() * value.asFloat());
-        }
-    } else if (node->op == "/=") {
-        if (current.isInt() && value.isInt()) {
-            result = Value(current.asInt() / value.asInt());
-        } else {
-            result = Value(current.asFloat() / value.asFloat());
-        }
+    if (node->depth >= 0) {
+        currentEnv->slotAt(node->depth, node->slot) = result;
+    } else {
+        currentEnv->set(id->symbol, result);
     }
-    
-    currentEnv->set(id->name, result);
     lastValue = result;
 }
 
 void Interpreter::visit(UpdateExpression* node) {
-    auto* id = dynamic_cast<Identifier*>(node->operand.get());
-    if (!id) {
+    if (node->operand->kind != NodeKind::Identifier) {
         throw std::runtime_error("Update expression operand must be an identifier");
     }
+    auto* id = static_cast<Identifier*>(node->operand.get());
     
-    Value current = currentEnv->get(id->name);
-    Value result;
+    Value current = node->depth >= 0 ? currentEnv->slotAt(node->depth, node->slot)
+                                     : currentEnv->get(id->symbol);
+    Value result = updateOperation(current, node->increment);
     
-    if (node->op == "++") {
-        if (current.isInt()) {
-            result = Value(current.asInt() + 1);
-        } else {
-            result = Value(current.asFloat() + 1.0);
-        }
-    } else if (node->op == "--") {
-        if (current.isInt()) {
-            result = Value(current.asInt() - 1);
-        } else {
-            result = Value(current.asFloat() - 1.0);
-        }
+    if (node->depth >= 0) {
+        currentEnv->slotAt(node->depth, node->slot) = result;
+    } else {
+        currentEnv->set(id->symbol, result);
     }
     
-    currentEnv->set(id->name, result);
-    
     // For prefix, return new value; for postfix, return old value
     lastValue = node->prefix ? result : current;
 }
 
 void Interpreter::visit(InterpolatedString* node) {
-    std::string result;
+    // Short pieces are gathered in a buffer; long string values are joined
+    // as ropes so interpolating a growing string does not copy it
+    Value result{std::string()};
+    std::string buffer;
     
     for (auto& part : node->parts) {
-        if (part.isExpression) {
-            Value val = evaluate(part.expr.get());
-            result += val.toString();
-        } else {
-            result += part.text;
+        if (!part.isExpression) {
+            buffer += part.text;
+            continue;
+        }
+        Value val = evaluate(part.expr.get());
+        if (val.isString() && val.stringLength() >= Value::kRopeMinLength) {
+            result = Value::concat(Value::concat(result, Value(std::move(buffer))), val);
+            buffer.clear();
+        } else if (val.isString()) {
+            buffer.append(val.asStringView());
+        } else {
+            buffer += val.toString();
         }
     }
     
-    lastValue = Value(result);
+    lastValue = Value::concat(result, Value(std::move(buffer)));
 }
 
 // ========================================
@@ -2648,22 +3158,18 @@ void Interpreter::visit(InterpolatedString* node) {
 // ========================================
 
 void Interpreter::visit(MapLiteral* node) {
-    auto map = std::make_shared<Value::MapType>();
+    auto map = Value::make<Value::MapType>();
     
-    for (auto& entry : node->entries) {
-        // Evaluate key (should be a string or identifier)
-        Value keyVal = evaluate(entry.first.get());
-        std::string key;
+    for (size_t i = 0; i < node->entries.size(); ++i) {
+        auto& entry = node->entries[i];
         
-        if (keyVal.isString()) {
-            key = keyVal.asString();
-        } else {
-            // For identifiers used as keys, use their name
-            if (auto* ident = dynamic_cast<Identifier*>(entry.first.get())) {
-                key = ident->name;
-            } else {
-                key = keyVal.toString();
-            }
+        // Literal keys were interned by the parser; computed ones are not
+        Symbol key = node->keySymbols[i];
+        if (key.empty()) {
+            Value keyVal = evaluate(entry.first.get());
+            std::string text = keyVal.isString() ? keyVal.asString() : keyVal.toString();
+            (*map)[MapKey::of(text)] = evaluate(entry.second.get());
+            continue;
         }
         
         // Evaluate value
@@ -2675,367 +3181,645 @@ void Interpreter::visit(MapLiteral* node) {
     lastValue = Value(map);
 }
 
-void Interpreter::visit(MemberExpression* node) {
-    Value obj = evaluate(node->object.get());
+namespace {
 
-    if (obj.isMap()) {
-        auto map = obj.asMap();
-        auto it = map->find(node->member);
-        if (it != map->end()) {
-            lastValue = it->second;
-        } else {
-            throw std::runtime_error("Map does not have member: " + node->member);
+// Array methods
+Value arrayPush(const Value& self, std::vector<Value>& args) {
+    // arr.push(item) - add item to end, return new length
+    if (args.empty()) {
+        throw std::runtime_error("push() requires an argument");
+    }
+    auto arr = self.asArray();
+    arr->push_back(args[0]);
+    return Value(static_cast<int64_t>(arr->size()));
+}
+
+Value arrayPop(const Value& self, std::vector<Value>&) {
+    // arr.pop() - remove and return last item
+    auto arr = self.asArray();
+    if (arr->empty()) {
+        throw std::runtime_error("Cannot pop from empty array");
+    }
+    Value lastItem = arr->back();
+    arr->pop_back();
+    return lastItem;
+}
+
+Value arraySlice(const Value& self, std::vector<Value>& args) {
+    // arr.slice(start, end) - return new array slice
+    if (args.empty()) {
+        throw std::runtime_error("slice() requires at least start index");
+    }
+    auto arr = self.asArray();
+    size_t start = static_cast<size_t>(args[0].asInt());
+    size_t end = arr->size();
+    if (args.size() > 1) {
+        end = static_cast<size_t>(args[1].asInt());
+    }
+    if (start > arr->size()) {
+        start = arr->size();
+    }
+    if (end > arr->size()) {
+        end = arr->size();
+    }
+    auto newArr = Value::make<Value::ArrayType>();
+    for (size_t i = start; i < end; ++i) {
+        newArr->push_back((*arr)[i]);
+    }
+    return Value(newArr);
+}
+
+Value arrayShift(const Value& self, std::vector<Value>&) {
+    // arr.shift() - remove and return first item
+    auto arr = self.asArray();
+    if (arr->empty()) {
+        throw std::runtime_error("Cannot shift from empty array");
+    }
+    Value firstItem = arr->front();
+    arr->erase(arr->begin());
+    return firstItem;
+}
+
+Value arrayUnshift(const Value& self, std::vector<Value>& args) {
+    // arr.unshift(item) - add item to beginning, return new length
+    if (args.empty()) {
+        throw std::runtime_error("unshift() requires an argument");
+    }
+    auto arr = self.asArray();
+    arr->insert(arr->begin(), args[0]);
+    return Value(static_cast<int64_t>(arr->size()));
+}
+
+Value arrayInsert(const Value& self, std::vector<Value>& args) {
+    // arr.insert(index, item) - insert item at index
+    if (args.size() < 2) {
+        throw std::runtime_error("insert() requires index and item arguments");
+    }
+    auto arr = self.asArray();
+    size_t idx = static_cast<size_t>(args[0].asInt());
+    if (idx > arr->size()) {
+        idx = arr->size();
+    }
+    arr->insert(arr->begin() + idx, args[1]);
+    return Value(static_cast<int64_t>(arr->size()));
+}
+
+Value arrayRemove(const Value& self, std::vector<Value>& args) {
+    // arr.remove(index) - remove item at index, return removed item
+    if (args.empty()) {
+        throw std::runtime_error("remove() requires an index argument");
+    }
+    auto arr = self.asArray();
+    size_t idx = static_cast<size_t>(args[0].asInt());
+    if (idx >= arr->size()) {
+        throw std::runtime_error("Index out of bounds for remove()");
+    }
+    Value removed = (*arr)[idx];
+    arr->erase(arr->begin() + idx);
+    return removed;
+}
+
+Value arrayClear(const Value& self, std::vector<Value>&) {
+    // arr.clear() - remove all items
+    self.asArray()->clear();
+    return Value();
+}
+
+Value arrayContains(const Value& self, std::vector<Value>& args) {
+    // arr.contains(item) - check if item exists
+    if (args.empty()) {
+        throw std::runtime_error("contains() requires an argument");
+    }
+    std::string needle = args[0].toString();
+    for (const auto& item : *self.asArray()) {
+        if (item.toString() == needle) {
+            return Value(true);
         }
-    } else if (obj.isArray()) {
-        // Array built-in properties
-        if (node->member == "length") {
-            lastValue = Value(static_cast<int64_t>(obj.asArray()->size()));
-        } else {
-            throw std::runtime_error("Array does not have member: " + node->member);
+    }
+    return Value(false);
+}
+
+Value arrayIndexOf(const Value& self, std::vector<Value>& args) {
+    // arr.indexOf(item) - return index of item, or -1
+    if (args.empty()) {
+        throw std::runtime_error("indexOf() requires an argument");
+    }
+    auto arr = self.asArray();
+    std::string needle = args[0].toString();
+    for (size_t i = 0; i < arr->size(); ++i) {
+        if ((*arr)[i].toString() == needle) {
+            return Value(static_cast<int64_t>(i));
         }
-    } else if (obj.isString()) {
-        // String built-in properties
-        if (node->member == "length") {
-            lastValue = Value(static_cast<int64_t>(obj.asString().length()));
-        } else {
-            throw std::runtime_error("String does not have member: " + node->member);
+    }
+    return Value(static_cast<int64_t>(-1));
+}
+
+// String methods
+Value stringSplit(const Value& self, std::vector<Value>& args) {
+    // str.split(delimiter) - split string into array
+    std::string_view str = self.asStringView();
+    std::string delimiter = args.empty() ? " " : args[0].asString();
+    auto resultArr = Value::make<Value::ArrayType>();
+    if (delimiter.empty()) {
+        // Split into characters
+        for (char c : str) {
+            resultArr->push_back(Value(std::string(1, c)));
         }
     } else {
-        throw std::runtime_error("Cannot access member of non-object type");
+        // Long pieces are views into the original string
+        size_t pos = 0;
+        size_t delimLen = delimiter.length();
+        while (true) {
+            size_t found = str.find(delimiter, pos);
+            if (found == std::string_view::npos) {
+                resultArr->push_back(Value::substring(self, pos, str.length() - pos));
+                break;
+            }
+            resultArr->push_back(Value::substring(self, pos, found - pos));
+            pos = found + delimLen;
+        }
     }
+    return Value(resultArr);
 }
 
-void Interpreter::visit(MethodCallExpression* node) {
-    // Evaluate the object
-    Value obj = evaluate(node->object.get());
+Value stringContains(const Value& self, std::vector<Value>& args) {
+    // str.contains(substring) - check if substring exists
+    if (args.empty()) {
+        throw std::runtime_error("contains() requires an argument");
+    }
+    return Value(self.asStringView().find(args[0].asStringView()) != std::string_view::npos);
+}
 
-    // Evaluate arguments
-    std::vector<Value> args;
-    for (auto& arg : node->arguments) {
-        args.push_back(evaluate(arg.get()));
+Value stringIndexOf(const Value& self, std::vector<Value>& args) {
+    // str.indexOf(substring) - return index or -1
+    if (args.empty()) {
+        throw std::runtime_error("indexOf() requires an argument");
     }
+    size_t pos = self.asStringView().find(args[0].asStringView());
+    return Value(pos == std::string_view::npos ? -1 : static_cast<int64_t>(pos));
+}
 
-    // Handle array methods
-    if (obj.isArray()) {
-        auto arr = obj.asArray();
+Value stringStartsWith(const Value& self, std::vector<Value>& args) {
+    // str.startsWith(prefix)
+    if (args.empty()) {
+        throw std::runtime_error("startsWith() requires an argument");
+    }
+    std::string_view str = self.asStringView();
+    std::string_view prefix = args[0].asStringView();
+    return Value(str.substr(0, prefix.length()) == prefix);
+}
 
-        if (node->method == "push") {
-            // arr.push(item) - add item to end, return new length
-            if (args.empty()) {
-                throw std::runtime_error("push() requires an argument");
-            }
-            arr->push_back(args[0]);
-            lastValue = Value(static_cast<int64_t>(arr->size()));
-        } else if (node->method == "pop") {
-            // arr.pop() - remove and return last item
-            if (arr->empty()) {
-                throw std::runtime_error("Cannot pop from empty array");
-            }
-            Value lastItem = arr->back();
-            arr->pop_back();
-            lastValue = lastItem;
-        } else if (node->method == "slice") {
-            // arr.slice(start, end) - return new array slice
-            if (args.empty()) {
-                throw std::runtime_error("slice() requires at least start index");
-            }
-            size_t start = static_cast<size_t>(args[0].asInt());
-            size_t end = arr->size();
-            if (args.size() > 1) {
-                end = static_cast<size_t>(args[1].asInt());
-            }
-            if (start > arr->size()) {
-                start = arr->size();
-            }
-            if (end > arr->size()) {
-                end = arr->size();
-            }
-            auto newArr = std::make_shared<Value::ArrayType>();
-            for (size_t i = start; i < end; ++i) {
-                newArr->push_back((*arr)[i]);
-            }
-            lastValue = Value(newArr);
-        } else if (node->method == "shift") {
-            // arr.shift() - remove and return first item
-            if (arr->empty()) {
-                throw std::runtime_error("Cannot shift from empty array");
-            }
-            Value firstItem = arr->front();
-            arr->erase(arr->begin());
-            lastValue = firstItem;
-        } else if (node->method == "unshift") {
-            // arr.unshift(item) - add item to beginning, return new length
-            if (args.empty()) {
-                throw std::runtime_error("unshift() requires an argument");
-            }
-            arr->insert(arr->begin(), args[0]);
-            lastValue = Value(static_cast<int64_t>(arr->size()));
-        } else if (node->method == "insert") {
-            // arr.insert(index, item) - insert item at index
-            if (args.size() < 2) {
-                throw std::runtime_error("insert() requires index and item arguments");
-            }
-            size_t idx = static_cast<size_t>(args[0].asInt());
-            if (idx > arr->size()) {
-                idx = arr->size();
-            }
-            arr->insert(arr->begin() + idx, args[1]);
-            lastValue = Value(static_cast<int64_t>(arr->size()));
-        } else if (node->method == "remove") {
-            // arr.remove(index) - remove item at index, return removed item
-            if (args.empty()) {
-                throw std::runtime_error("remove() requires an index argument");
-            }
-            size_t idx = static_cast<size_t>(args[0].asInt());
-            if (idx >= arr->size()) {
-                throw std::runtime_error("Index out of bounds for remove()");
-            }
-            Value removed = (*arr)[idx];
-            arr->erase(arr->begin() + idx);
-            lastValue = removed;
-        } else if (node->method == "clear") {
-            // arr.clear() - remove all items
-            arr->clear();
-            lastValue = Value();
-        } else if (node->method == "contains") {
-            // arr.contains(item) - check if item exists
-            if (args.empty()) {
-                throw std::runtime_error("contains() requires an argument");
-            }
-            bool found = false;
-            for (const auto& item : *arr) {
-                if (item.toString() == args[0].toString()) {
-                    found = true;
-                    break;
-                }
-            }
-            lastValue = Value(found);
-        } else if (node->method == "indexOf") {
-            // arr.indexOf(item) - return index of item, or -1
-            if (args.empty()) {
-                throw std::runtime_error("indexOf() requires an argument");
-            }
-            int64_t index = -1;
-            for (size_t i = 0; i < arr->size(); ++i) {
-                if ((*arr)[i].toString() == args[0].toString()) {
-                    index = static_cast<int64_t>(i);
-                    break;
-                }
-            }
-            lastValue = Value(index);
-        } else {
-            throw std::runtime_error("Array does not have method: " + node->method);
+Value stringEndsWith(const Value& self, std::vector<Value>& args) {
+    // str.endsWith(suffix)
+    if (args.empty()) {
+        throw std::runtime_error("endsWith() requires an argument");
+    }
+    std::string_view str = self.asStringView();
+    std::string_view suffix = args[0].asStringView();
+    if (suffix.length() > str.length()) {
+        return Value(false);
+    }
+    return Value(str.substr(str.length() - suffix.length()) == suffix);
+}
+
+Value stringTrim(const Value& self, std::vector<Value>&) {
+    // str.trim() - remove leading/trailing whitespace
+    std::string_view str = self.asStringView();
+    size_t start = str.find_first_not_of(" \t\n\r");
+    if (start == std::string_view::npos) {
+        return Value("");
+    }
+    size_t end = str.find_last_not_of(" \t\n\r");
+    return Value::substring(self, start, end - start + 1);
+}
+
+Value stringToUpper(const Value& self, std::vector<Value>&) {
+    // str.toUpper() - convert to uppercase
+    std::string result = self.asString();
+    for (char& c : result) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return Value(std::move(result));
+}
+
+Value stringToLower(const Value& self, std::vector<Value>&) {
+    // str.toLower() - convert to lowercase
+    std::string result = self.asString();
+    for (char& c : result) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return Value(std::move(result));
+}
+
+Value stringReplace(const Value& self, std::vector<Value>& args) {
+    // str.replace(old, new) - replace all occurrences
+    if (args.size() < 2) {
+        throw std::runtime_error("replace() requires two arguments");
+    }
+    std::string result = self.asString();
+    const std::string& from = args[0].asString();
+    const std::string& to = args[1].asString();
+    if (!from.empty()) {
+        size_t pos = 0;
+        while ((pos = result.find(from, pos)) != std::string::npos) {
+            result.replace(pos, from.length(), to);
+            pos += to.length();
         }
-        return;
     }
+    return Value(std::move(result));
+}
 
-    // Handle string methods
-    if (obj.isString()) {
-        const std::string& str = obj.asString();
+Value stringSubstring(const Value& self, std::vector<Value>& args) {
+    // str.substring(start, end)
+    if (args.empty()) {
+        throw std::runtime_error("substring() requires at least start index");
+    }
+    size_t length = self.stringLength();
+    size_t start = static_cast<size_t>(args[0].asInt());
+    size_t end = length;
+    if (args.size() > 1) {
+        end = static_cast<size_t>(args[1].asInt());
+    }
+    if (start > length) start = length;
+    if (end > length) end = length;
+    return Value::substring(self, start, end - start);  // end < start wraps: the rest of the string
+}
 
-        if (node->method == "split") {
-            // str.split(delimiter) - split string into array
-            std::string delimiter = args.empty() ? " " : args[0].asString();
-            auto resultArr = std::make_shared<Value::ArrayType>();
-            if (delimiter.empty()) {
-                // Split into characters
-                for (char c : str) {
-                    resultArr->push_back(Value(std::string(1, c)));
-                }
-            } else {
-                size_t pos = 0;
-                size_t delimLen = delimiter.length();
-                while (true) {
-                    size_t found = str.find(delimiter, pos);
-                    if (found == std::string::npos) {
-                        resultArr->push_back(Value(str.substr(pos)));
-                        break;
-                    }
-                    resultArr->push_back(Value(str.substr(pos, found - pos)));
-                    pos = found + delimLen;
-                }
-            }
-            lastValue = Value(resultArr);
-        } else if (node->method == "contains") {
-            // str.contains(substring) - check if substring exists
-            if (args.empty()) {
-                throw std::runtime_error("contains() requires an argument");
-            }
-            lastValue = Value(str.find(args[0].asString()) != std::string::npos);
-        } else if (node->method == "indexOf") {
-            // str.indexOf(substring) - return index or -1
-            if (args.empty()) {
-                throw std::runtime_error("indexOf() requires an argument");
-            }
-            size_t pos = str.find(args[0].asString());
-            lastValue = Value(pos == std::string::npos ? -1 : static_cast<int64_t>(pos));
-        } else if (node->method == "startsWith") {
-            // str.startsWith(prefix)
-            if (args.empty()) {
-                throw std::runtime_error("startsWith() requires an argument");
-            }
-            lastValue = Value(str.rfind(args[0].asString(), 0) == 0);
-        } else if (node->method == "endsWith") {
-            // str.endsWith(suffix)
-            if (args.empty()) {
-                throw std::runtime_error("endsWith() requires an argument");
-            }
-            const std::string& suffix = args[0].asString();
-            if (suffix.length() > str.length()) {
-                lastValue = Value(false);
-            } else {
-                lastValue = Value(str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0);
-            }
-        } else if (node->method == "trim") {
-            // str.trim() - remove leading/trailing whitespace
-            size_t start = str.find_first_not_of(" \t\n\r");
-            if (start == std::string::npos) {
-                lastValue = Value("");
-            } else {
-                size_t end = str.find_last_not_of(" \t\n\r");
-                lastValue = Value(str.substr(start, end - start + 1));
-            }
-        } else if (node->method == "toUpper") {
-            // str.toUpper() - convert to uppercase
-            std::string result = str;
-            for (char& c : result) {
-                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
-            }
-            lastValue = Value(result);
-        } else if (node->method == "toLower") {
-            // str.toLower() - convert to lowercase
-            std::string result = str;
-            for (char& c : result) {
-                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-            }
-            lastValue = Value(result);
-        } else if (node->method == "replace") {
-            // str.replace(old, new) - replace all occurrences
-            if (args.size() < 2) {
-                throw std::runtime_error("replace() requires two arguments");
-            }
-            std::string result = str;
-            const std::string& from = args[0].asString();
-            const std::string& to = args[1].asString();
-            if (from.empty()) {
-                lastValue = Value(result);
-            } else {
-                size_t pos = 0;
-                while ((pos = result.find(from, pos)) != std::string::npos) {
-                    result.replace(pos, from.length(), to);
-                    pos += to.length();
-                }
-                lastValue = Value(result);
-            }
-        } else if (node->method == "substring") {
-            // str.substring(start, end)
-            if (args.empty()) {
-                throw std::runtime_error("substring() requires at least start index");
-            }
-            size_t start = static_cast<size_t>(args[0].asInt());
-            size_t end = str.length();
-            if (args.size() > 1) {
-                end = static_cast<size_t>(args[1].asInt());
+// Map/object methods
+Value mapKeys(const Value& self, std::vector<Value>&) {
+    // map.keys() - return array of keys
+    auto resultArr = Value::make<Value::ArrayType>();
+    for (const auto& entry : *self.asMap()) {
+        resultArr->push_back(Value(entry.first));
+    }
+    return Value(resultArr);
+}
+
+Value mapValues(const Value& self, std::vector<Value>&) {
+    // map.values() - return array of values
+    auto resultArr = Value::make<Value::ArrayType>();
+    for (const auto& entry : *self.asMap()) {
+        resultArr->push_back(entry.second);
+    }
+    return Value(resultArr);
+}
+
+Value mapContains(const Value& self, std::vector<Value>& args) {
+    // map.contains(key) - check if key exists
+    if (args.empty()) {
+        throw std::runtime_error("contains() requires an argument");
+    }
+    return Value(self.asMap()->count(MapKey::of(args[0].asString())) != 0);
+}
+
+Value mapRemove(const Value& self, std::vector<Value>& args) {
+    // map.remove(key) - remove key, return value
+    if (args.empty()) {
+        throw std::runtime_error("remove() requires an argument");
+    }
+    auto map = self.asMap();
+    auto it = map->find(MapKey::of(args[0].asString()));
+    if (it == map->end()) {
+        return Value();
+    }
+    Value removed = it->second;
+    map->erase(it);
+    return removed;
+}
+
+Value mapClear(const Value& self, std::vector<Value>&) {
+    // map.clear() - remove all entries
+    self.asMap()->clear();
+    return Value();
+}
+
+// Struct instances answer the same methods as maps
+Value structKeys(const Value& self, std::vector<Value>&) {
+    auto resultArr = Value::make<Value::ArrayType>();
+    const Shape* shape = self.asStruct().shape;
+    for (size_t i = 0; i < shape->size(); ++i) {
+        resultArr->push_back(Value(shape->fieldAt(i)));
+    }
+    return Value(resultArr);
+}
+
+Value structValues(const Value& self, std::vector<Value>&) {
+    return Value(Value::make<Value::ArrayType>(self.asStruct().slots));
+}
+
+Value structContains(const Value& self, std::vector<Value>& args) {
+    if (args.empty()) {
+        throw std::runtime_error("contains() requires an argument");
+    }
+    Symbol field;
+    return Value(Symbol::find(args[0].asString(), field) && self.asStruct().shape->slotOf(field) >= 0);
+}
+
+Value structRemove(const Value& self, std::vector<Value>& args) {
+    if (args.empty()) {
+        throw std::runtime_error("remove() requires an argument");
+    }
+    auto& instance = self.asStruct();
+    Symbol field;
+    int slot = Symbol::find(args[0].asString(), field) ? instance.shape->slotOf(field) : -1;
+    if (slot < 0) {
+        return Value();
+    }
+    Value removed = instance.slots[slot];
+    instance.remove(static_cast<size_t>(slot));
+    return removed;
+}
+
+Value structClear(const Value& self, std::vector<Value>&) {
+    self.asStruct().clear();
+    return Value();
+}
+
+const NativeMethod nativeMethods[] = {
+    {Value::Type::Array, sym::push, arrayPush},
+    {Value::Type::Array, sym::pop, arrayPop},
+    {Value::Type::Array, sym::slice, arraySlice},
+    {Value::Type::Array, sym::shift, arrayShift},
+    {Value::Type::Array, sym::unshift, arrayUnshift},
+    {Value::Type::Array, sym::insert, arrayInsert},
+    {Value::Type::Array, sym::remove, arrayRemove},
+    {Value::Type::Array, sym::clear, arrayClear},
+    {Value::Type::Array, sym::contains, arrayContains},
+    {Value::Type::Array, sym::indexOf, arrayIndexOf},
+    
+    {Value::Type::String, sym::split, stringSplit},
+    {Value::Type::String, sym::contains, stringContains},
+    {Value::Type::String, sym::indexOf, stringIndexOf},
+    {Value::Type::String, sym::startsWith, stringStartsWith},
+    {Value::Type::String, sym::endsWith, stringEndsWith},
+    {Value::Type::String, sym::trim, stringTrim},
+    {Value::Type::String, sym::toUpper, stringToUpper},
+    {Value::Type::String, sym::toLower, stringToLower},
+    {Value::Type::String, sym::replace, stringReplace},
+    {Value::Type::String, sym::substring, stringSubstring},
+    
+    {Value::Type::Map, sym::keys, mapKeys},
+    {Value::Type::Map, sym::values, mapValues},
+    {Value::Type::Map, sym::contains, mapContains},
+    {Value::Type::Map, sym::remove, mapRemove},
+    {Value::Type::Map, sym::clear, mapClear},
+    
+    {Value::Type::Struct, sym::keys, structKeys},
+    {Value::Type::Struct, sym::values, structValues},
+    {Value::Type::Struct, sym::contains, structContains},
+    {Value::Type::Struct, sym::remove, structRemove},
+    {Value::Type::Struct, sym::clear, structClear},
+};
+
+const NativeMethod* findNativeMethod(Value::Type receiver, Symbol name) {
+    for (const auto& method : nativeMethods) {
+        if (method.receiver == receiver && method.name == name) {
+            return &method;
+        }
+    }
+    return nullptr;
+}
+
+// Remember a resolution at a call site, or give up on caching it
+void addCacheEntry(InlineCache& cache, const InlineCache::Entry& entry) {
+    if (cache.size < InlineCache::kMaxEntries) {
+        cache.entries[cache.size++] = entry;
+    } else {
+        cache.megamorphic = true;
+    }
+}
+
+}  // namespace
+
+Value loadMember(const Value& obj, Symbol member, InlineCache& cache, InlineCacheStats& stats) {
+    auto receiver = static_cast<uint8_t>(obj.getType());
+
+    if (obj.isStruct()) {
+        // A field is at the same slot in every instance of a shape
+        const auto& instance = obj.asStruct();
+        for (uint8_t i = 0; i < cache.size; ++i) {
+            const auto& entry = cache.entries[i];
+            if (entry.shape == instance.shape) {
+                ++stats.memberHits;
+                return instance.slots[entry.position];
             }
-            if (start > str.length()) start = str.length();
-            if (end > str.length()) end = str.length();
-            lastValue = Value(str.substr(start, end - start));
-        } else {
-            throw std::runtime_error("String does not have method: " + node->method);
         }
-        return;
+        ++stats.memberMisses;
+        int slot = instance.shape->slotOf(member);
+        if (slot < 0) {
+            throw std::runtime_error("Map does not have member: " + member.str());
+        }
+        if (!cache.megamorphic) {
+            InlineCache::Entry entry;
+            entry.receiver = receiver;
+            entry.position = static_cast<uint32_t>(slot);
+            entry.shape = instance.shape;
+            addCacheEntry(cache, entry);
+        }
+        return instance.slots[slot];
     }
 
-    // Handle map/object methods
     if (obj.isMap()) {
         auto map = obj.asMap();
+        // Objects built by the same literal keep their keys at the same
+        // positions, so a cached position usually matches
+        for (uint8_t i = 0; i < cache.size; ++i) {
+            const auto& entry = cache.entries[i];
+            if (entry.receiver == receiver && map->hasKeyAt(entry.position, member)) {
+                ++stats.memberHits;
+                return map->valueAt(entry.position);
+            }
+        }
+        ++stats.memberMisses;
+        size_t pos = map->positionOf(member);
+        if (pos == map->size()) {
+            throw std::runtime_error("Map does not have member: " + member.str());
+        }
+        if (!cache.megamorphic) {
+            InlineCache::Entry entry;
+            entry.receiver = receiver;
+            entry.position = static_cast<uint32_t>(pos);
+            addCacheEntry(cache, entry);
+        }
+        return map->valueAt(pos);
+    }
 
-        if (node->method == "keys") {
-            // map.keys() - return array of keys
-            auto resultArr = std::make_shared<Value::ArrayType>();
-            for (const auto& [key, val] : *map) {
-                (void)val;  // Unused
-                resultArr->push_back(Value(key));
-            }
-            lastValue = Value(resultArr);
-        } else if (node->method == "values") {
-            // map.values() - return array of values
-            auto resultArr = std::make_shared<Value::ArrayType>();
-            for (const auto& [key, val] : *map) {
-                (void)key;  // Unused
-                resultArr->push_back(val);
-            }
-            lastValue = Value(resultArr);
-        } else if (node->method == "contains") {
-            // map.contains(key) - check if key exists
-            if (args.empty()) {
-                throw std::runtime_error("contains() requires an argument");
-            }
-            lastValue = Value(map->find(args[0].asString()) != map->end());
-        } else if (node->method == "remove") {
-            // map.remove(key) - remove key, return value
-            if (args.empty()) {
-                throw std::runtime_error("remove() requires an argument");
-            }
-            auto it = map->find(args[0].asString());
-            if (it != map->end()) {
-                Value removed = it->second;
-                map->erase(it);
-                lastValue = removed;
-            } else {
-                lastValue = Value();
-            }
-        } else if (node->method == "clear") {
-            // map.clear() - remove all entries
-            map->clear();
-            lastValue = Value();
-        } else {
-            throw std::runtime_error("Map does not have method: " + node->method);
+    // Arrays and strings only have `length`; an entry for their type means it was checked
+    for (uint8_t i = 0; i < cache.size; ++i) {
+        if (cache.entries[i].receiver == receiver) {
+            ++stats.memberHits;
+            return Value(static_cast<int64_t>(obj.isArray() ? obj.asArray()->size() : obj.asString().length()));
         }
-        return;
     }
+    ++stats.memberMisses;
 
-    throw std::runtime_error("Cannot call method on non-object type");
+    Value result;
+    if (obj.isArray()) {
+        // Array built-in properties
+        if (member != sym::length) {
+            throw std::runtime_error("Array does not have member: " + member.str());
+        }
+        result = Value(static_cast<int64_t>(obj.asArray()->size()));
+    } else if (obj.isString()) {
+        // String built-in properties
+        if (member != sym::length) {
+            throw std::runtime_error("String does not have member: " + member.str());
+        }
+        result = Value(static_cast<int64_t>(obj.asString().length()));
+    } else {
+        throw std::runtime_error("Cannot access member of non-object type");
+    }
+
+    if (!cache.megamorphic) {
+        InlineCache::Entry entry;
+        entry.receiver = receiver;
+        addCacheEntry(cache, entry);
+    }
+    return result;
+}
+
+Value invokeMethod(const Value& obj, Symbol name, std::vector<Value>& args,
+                   InlineCache& cache, InlineCacheStats& stats) {
+    auto receiver = static_cast<uint8_t>(obj.getType());
+    for (uint8_t i = 0; i < cache.size; ++i) {
+        if (cache.entries[i].receiver == receiver) {
+            ++stats.methodHits;
+            return cache.entries[i].method->invoke(obj, args);
+        }
+    }
+    ++stats.methodMisses;
+
+    const NativeMethod* method = findNativeMethod(obj.getType(), name);
+    if (!method) {
+        if (obj.isArray()) {
+            throw std::runtime_error("Array does not have method: " + name.str());
+        } else if (obj.isString()) {
+            throw std::runtime_error("String does not have method: " + name.str());
+        } else if (obj.isMap() || obj.isStruct()) {
+            throw std::runtime_error("Map does not have method: " + name.str());
+        }
+        throw std::runtime_error("Cannot call method on non-object type");
+    }
+
+    if (!cache.megamorphic) {
+        InlineCache::Entry entry;
+        entry.receiver = receiver;
+        entry.method = method;
+        addCacheEntry(cache, entry);
+    }
+    return method->invoke(obj, args);
+}
+
+void Interpreter::visit(MemberExpression* node) {
+    Value obj = evaluate(node->object.get());
+    lastValue = loadMember(obj, node->memberSymbol, node->cache, cacheStats);
+}
+
+void Interpreter::visit(MethodCallExpression* node) {
+    // Evaluate the object
+    Value obj = evaluate(node->object.get());
+
+    // Evaluate arguments
+    std::vector<Value> args;
+    args.reserve(node->arguments.size());
+    for (auto& arg : node->arguments) {
+        args.push_back(evaluate(arg.get()));
+    }
+
+    lastValue = invokeMethod(obj, node->methodSymbol, args, node->cache, cacheStats);
 }
 
 void Interpreter::visit(SelfExpression* node) {
     (void)node;  // Unused parameter
     // 'self' should be defined in the current environment when inside a method
-    if (currentEnv->exists("self")) {
-        lastValue = currentEnv->get("self");
+    if (currentEnv->exists(sym::self)) {
+        lastValue = currentEnv->get(sym::self);
     } else {
         throw std::runtime_error("'self' is not defined in current context");
     }
 }
 
-void Interpreter::visit(ImportStatement* node) {
-    std::string moduleName = node->moduleName;
-    std::string modulePath = node->modulePath;
-    
+std::string readModuleSource(const std::string& moduleName, const std::string& modulePath) {
     // Default path resolution for stdlib
-    if (modulePath.empty()) {
-        modulePath = "stdlib/" + moduleName + ".sf";
-    }
+    std::string path = modulePath.empty() ? "stdlib/" + moduleName + ".sf" : modulePath;
     
     // Read module file
-    std::ifstream file(modulePath);
+    std::ifstream file(path);
     if (!file.is_open()) {
         // Try without stdlib/ prefix if it was implicit
         file.open(moduleName + ".sf");
         if (!file.is_open()) {
-            throw std::runtime_error("Could not load module: " + moduleName + " (tried " + modulePath + ")");
+            throw std::runtime_error("Could not load module: " + moduleName + " (tried " + path + ")");
         }
     }
     
     std::stringstream buffer;
     buffer << file.rdbuf();
-    std::string source = buffer.str();
-    
-    // Parse the module
+    return buffer.str();
+}
+
+static ModuleTransform& moduleTransform() {
+    static ModuleTransform transform;
+    return transform;
+}
+
+void setModuleTransform(ModuleTransform transform) {
+    moduleTransform() = std::move(transform);
+}
+
+bool hasModuleTransform() {
+    return static_cast<bool>(moduleTransform());
+}
+
+std::vector<std::unique_ptr<Statement>> parseModule(const std::string& source, const std::string& moduleName,
+                                                    const std::string& modulePath) {
     Lexer lexer(source);
-    auto tokens = lexer.tokenize();
-    Parser parser(std::move(tokens));
+    Parser parser(lexer.tokenize());
     auto statements = parser.parse();
+    if (moduleTransform()) {
+        moduleTransform()(statements, moduleName, modulePath);
+    }
+    return statements;
+}
+
+static bool& moduleSpecialization() {
+    static bool enabled = true;
+    return enabled;
+}
+
+void setModuleSpecialization(bool enabled) {
+    moduleSpecialization() = enabled;
+}
+
+void resolveModule(const std::vector<std::unique_ptr<Statement>>& statements) {
+    Resolver resolver;
+    resolver.resolve(statements);
+    if (moduleSpecialization()) {
+        TypeSpecializer().specialize(statements);
+    }
+}
+
+Value exportModule(const Environment& moduleEnv) {
+    auto moduleMap = Value::make<Value::MapType>();
+    // For now, we export ALL variables from the module environment
+    // In a real system, we'd only export symbols marked with 'export'
+    // Bindings are hashed, so export them in name order to keep the module map deterministic
+    std::vector<Symbol> exported;
+    for (const auto& [name, value] : moduleEnv.getVariables()) {
+        exported.push_back(name);
+    }
+    std::sort(exported.begin(), exported.end(),
+              [](const Symbol& a, const Symbol& b) { return a.str() < b.str(); });
+    for (const auto& name : exported) {
+        (*moduleMap)[name] = *moduleEnv.find(name);
+    }
+    return Value(moduleMap);
+}
+
+void Interpreter::visit(ImportStatement* node) {
+    std::string source = readModuleSource(node->moduleName, node->modulePath);
+    auto statements = parseModule(source, node->moduleName, node->modulePath);
+    resolveModule(statements);
     
     // Execute module in its own environment
     auto moduleEnv = std::make_shared<Environment>(globalEnv);
@@ -3045,56 +3829,62 @@ void Interpreter::visit(ImportStatement* node) {
     try {
         for (const auto& stmt : statements) {
             stmt->accept(*this);
+            if (completion.isAbrupt()) {
+                break;  // A top-level return ends the module
+            }
         }
     } catch (...) {
         currentEnv = oldEnv;
         throw;
     }
     
+    completion = Completion();
     currentEnv = oldEnv;
     
-    // Export symbols to a map
-    auto moduleMap = std::make_shared<Value::MapType>();
-    // For now, we export ALL variables from the module environment
-    // In a real system, we'd only export symbols marked with 'export'
-    for (const auto& [name, value] : moduleEnv->getVariables()) {
-        (*moduleMap)[name] = value;
-    }
+    // Keep the module AST alive: its functions are registered by pointer
+    loadedModules.push_back(std::move(statements));
     
     // Define the module object in the current environment
-    std::string alias = node->alias.empty() ? moduleName : node->alias;
-    currentEnv->define(alias, Value(moduleMap));
+    Value moduleMap = exportModule(*moduleEnv);
+    std::string alias = node->alias.empty() ? node->moduleName : node->alias;
+    if (node->slot >= 0) {
+        currentEnv->defineSlot(node->slot, moduleMap);
+    } else {
+        currentEnv->define(Symbol(alias), moduleMap);
+    }
 }
 
 void Interpreter::visit(StructDeclaration* node) {
-    // Store struct definition in a special registry
-    // For now, we'll create a constructor function for the struct
-    
-    std::string structName = node->name;
-    std::vector<std::string> fieldNames;
-    
+    std::vector<Symbol> fieldNames;
     for (const auto& field : node->fields) {
-        fieldNames.push_back(field.name);
+        fieldNames.push_back(field.symbol);
+    }
+    defineStruct(node->name, fieldNames);
+}
+
+void Interpreter::defineStruct(const std::string& structName, const std::vector<Symbol>& fieldNames) {
+    // Instances get the fields given to the constructor, in declaration order,
+    // then a __type__ field naming the struct. The shapes for each argument
+    // count are found once, here, so constructing an instance does no lookups.
+    const Shape* shape = Shape::root(structName);
+    std::vector<const Shape*> shapes;
+    for (size_t count = 0;; ++count) {
+        shapes.push_back(shape->withField(sym::typeTag));
+        if (count == fieldNames.size()) break;
+        shape = shape->withField(fieldNames[count]);
     }
     
-    // Create a constructor function that creates map instances
-    auto constructor = std::make_shared<Value::FunctionType>(
-        [structName, fieldNames](std::vector<Value>& args, Interpreter& interp) -> Value {
-            (void)interp;  // Unused
-            auto instance = std::make_shared<Value::MapType>();
-            
-            // Set field values from arguments
-            for (size_t i = 0; i < fieldNames.size() && i < args.size(); ++i) {
-                (*instance)[fieldNames[i]] = args[i];
-            }
-            
-            // Add a __type__ field to identify the struct type
-            (*instance)["__type__"] = Value(structName);
-            
-            return Value(instance);
+    auto constructor = Value::make<Value::FunctionType>(
+        [shapes, typeName = Value(structName)](std::vector<Value>& args, Interpreter&) -> Value {
+            size_t count = std::min(args.size(), shapes.size() - 1);
+            std::vector<Value> slots;
+            slots.reserve(count + 1);
+            slots.insert(slots.end(), args.begin(), args.begin() + static_cast<std::ptrdiff_t>(count));
+            slots.push_back(typeName);
+            return Value(shapes[count], std::move(slots));
         }
     );
     
     // Define the constructor in global environment
-    globalEnv->define(structName, Value(constructor));
+    globalEnv->define(Symbol(structName), Value(constructor));
 }
@@ -0,0 +1,308 @@
+#include "../../include/resolver.h"
+
+// Scope management
+void Resolver::beginScope() {
+    auto scope = std::make_shared<Scope>();
+    scope->parent = current;
+    current = scope;
+}
+
+int Resolver::endScope() {
+    int size = current->size;
+    current = current->parent;
+    return size;
+}
+
+int Resolver::declare(const std::string& name) {
+    if (!current) {
+        return -1;  // Global scope: bound by name at runtime
+    }
+    // Redeclaring a name in the same scope reuses its slot, like Environment::define
+    auto it = current->slots.find(name);
+    if (it != current->slots.end()) {
+        return it->second;
+    }
+    int slot = current->size++;
+    current->slots[name] = slot;
+    return slot;
+}
+
+void Resolver::resolveName(const std::string& name, int& depth, int& slot) const {
+    int distance = 0;
+    for (Scope* scope = current.get(); scope; scope = scope->parent.get()) {
+        auto it = scope->slots.find(name);
+        if (it != scope->slots.end()) {
+            depth = distance;
+            slot = it->second;
+            return;
+        }
+        ++distance;
+    }
+    depth = -1;
+    slot = -1;
+}
+
+// A function declared here closes over every enclosing frame
+void Resolver::markCaptured() {
+    for (Scope* scope = current.get(); scope && !scope->captured; scope = scope->parent.get()) {
+        scope->captured = true;
+    }
+}
+
+void Resolver::resolveStatements(const std::vector<std::unique_ptr<Statement>>& statements) {
+    for (const auto& stmt : statements) {
+        stmt->accept(*this);
+    }
+}
+
+void Resolver::resolvePending() {
+    // Resolving a body may queue nested functions, so index rather than iterate
+    for (size_t i = 0; i < pending.size(); ++i) {
+        PendingFunction fn = pending[i];
+        current = std::make_shared<Scope>();
+        current->parent = fn.closure;
+
+        for (const auto& param : *fn.parameters) {
+            declare(param);
+        }
+        if (fn.blockBody) {
+            resolveStatements(fn.blockBody->statements);
+        } else if (fn.exprBody) {
+            fn.exprBody->accept(*this);
+        }
+
+        *fn.frameSize = current->size;
+        *fn.frameCaptured = current->captured;
+    }
+    pending.clear();
+    current = nullptr;
+}
+
+// A block needs its own frame only if it binds names directly
+bool Resolver::declaresLocals(const std::vector<std::unique_ptr<Statement>>& statements) {
+    for (const auto& stmt : statements) {
+        if (stmt->kind == NodeKind::VariableDeclaration || stmt->kind == NodeKind::ImportStatement) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Resolver::resolve(const std::vector<std::unique_ptr<Statement>>& statements) {
+    current = nullptr;
+    pending.clear();
+    resolveStatements(statements);
+    resolvePending();
+}
+
+// Expression visitors
+void Resolver::visit(IntegerLiteral*) {}
+void Resolver::visit(FloatLiteral*) {}
+void Resolver::visit(StringLiteral*) {}
+void Resolver::visit(BooleanLiteral*) {}
+void Resolver::visit(NullLiteral*) {}
+
+void Resolver::visit(Identifier* node) {
+    resolveName(node->name, node->depth, node->slot);
+}
+
+void Resolver::visit(BinaryExpression* node) {
+    node->left->accept(*this);
+    node->right->accept(*this);
+}
+
+void Resolver::visit(UnaryExpression* node) {
+    node->operand->accept(*this);
+}
+
+void Resolver::visit(AssignmentExpression* node) {
+    node->right->accept(*this);
+    node->left->accept(*this);
+    if (node->left->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->left.get());
+        node->depth = id->depth;
+        node->slot = id->slot;
+    }
+}
+
+void Resolver::visit(CallExpression* node) {
+    for (auto& arg : node->arguments) {
+        arg->accept(*this);
+    }
+}
+
+void Resolver::visit(ArrayLiteral* node) {
+    for (auto& elem : node->elements) {
+        elem->accept(*this);
+    }
+}
+
+void Resolver::visit(ArrayIndexExpression* node) {
+    node->array->accept(*this);
+    node->index->accept(*this);
+}
+
+void Resolver::visit(ArrayAssignmentExpression* node) {
+    node->array->accept(*this);
+    node->index->accept(*this);
+    node->value->accept(*this);
+}
+
+void Resolver::visit(LambdaExpression* node) {
+    markCaptured();
+    pending.push_back({&node->parameters, node->blockBody.get(), node->body.get(),
+                       &node->frameSize, &node->frameCaptured, current});
+}
+
+void Resolver::visit(MatchExpression* node) {
+    node->subject->accept(*this);
+    for (auto& matchCase : node->cases) {
+        if (matchCase.pattern) {
+            matchCase.pattern->accept(*this);
+        }
+        matchCase.result->accept(*this);
+    }
+}
+
+void Resolver::visit(CompoundAssignment* node) {
+    node->target->accept(*this);
+    node->value->accept(*this);
+    if (node->target->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->target.get());
+        node->depth = id->depth;
+        node->slot = id->slot;
+    }
+}
+
+void Resolver::visit(UpdateExpression* node) {
+    node->operand->accept(*this);
+    if (node->operand->kind == NodeKind::Identifier) {
+        auto* id = static_cast<Identifier*>(node->operand.get());
+        node->depth = id->depth;
+        node->slot = id->slot;
+    }
+}
+
+void Resolver::visit(InterpolatedString* node) {
+    for (auto& part : node->parts) {
+        if (part.isExpression) {
+            part.expr->accept(*this);
+        }
+    }
+}
+
+// SADK Expression visitors
+void Resolver::visit(MapLiteral* node) {
+    for (auto& entry : node->entries) {
+        entry.first->accept(*this);
+        entry.second->accept(*this);
+    }
+}
+
+void Resolver::visit(MemberExpression* node) {
+    node->object->accept(*this);
+}
+
+void Resolver::visit(MethodCallExpression* node) {
+    node->object->accept(*this);
+    for (auto& arg : node->arguments) {
+        arg->accept(*this);
+    }
+}
+
+void Resolver::visit(SelfExpression*) {}
+
+// Statement visitors
+void Resolver::visit(VariableDeclaration* node) {
+    // The initializer is evaluated before the name is bound
+    if (node->initializer) {
+        node->initializer->accept(*this);
+    }
+    node->slot = declare(node->name);
+}
+
+void Resolver::visit(ExpressionStatement* node) {
+    node->expression->accept(*this);
+}
+
+void Resolver::visit(BlockStatement* node) {
+    if (!declaresLocals(node->statements)) {
+        node->frameSize = 0;
+        resolveStatements(node->statements);
+        return;
+    }
+    beginScope();
+    resolveStatements(node->statements);
+    node->frameCaptured = current->captured;
+    node->frameSize = endScope();
+}
+
+void Resolver::visit(IfStatement* node) {
+    node->condition->accept(*this);
+    node->thenBranch->accept(*this);
+    if (node->elseBranch) {
+        node->elseBranch->accept(*this);
+    }
+}
+
+void Resolver::visit(WhileStatement* node) {
+    node->condition->accept(*this);
+    node->body->accept(*this);
+}
+
+void Resolver::visit(ForStatement* node) {
+    bool hasFrame = node->initializer && node->initializer->kind == NodeKind::VariableDeclaration;
+    if (hasFrame) {
+        beginScope();
+    }
+
+    if (node->initializer) node->initializer->accept(*this);
+    if (node->condition) node->condition->accept(*this);
+    if (node->increment) node->increment->accept(*this);
+    node->body->accept(*this);
+
+    node->frameCaptured = hasFrame && current->captured;
+    node->frameSize = hasFrame ? endScope() : 0;
+}
+
+void Resolver::visit(BreakStatement*) {}
+void Resolver::visit(ContinueStatement*) {}
+
+void Resolver::visit(FunctionDeclaration* node) {
+    markCaptured();
+    pending.push_back({&node->parameters, node->body.get(), nullptr,
+                       &node->frameSize, &node->frameCaptured, current});
+}
+
+void Resolver::visit(ReturnStatement* node) {
+    if (node->value) {
+        node->value->accept(*this);
+    }
+}
+
+void Resolver::visit(TryStatement* node) {
+    if (node->tryBlock) {
+        node->tryBlock->accept(*this);
+    }
+
+    // The catch clause binds the error variable in a one-slot frame
+    beginScope();
+    declare(node->errorVariable);
+    if (node->catchBlock) {
+        node->catchBlock->accept(*this);
+    }
+    endScope();
+}
+
+// SADK Statement visitors
+void Resolver::visit(ImportStatement* node) {
+    std::string alias = node->alias.empty() ? node->moduleName : node->alias;
+    node->slot = declare(alias);
+}
+
+void Resolver::visit(StructDeclaration* node) {
+    // Struct constructors are always global; methods resolve like functions
+    for (auto& method : node->methods) {
+        method->accept(*this);
+    }
+}
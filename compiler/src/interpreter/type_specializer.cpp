@@ -0,0 +1,462 @@
+#include "../../include/type_specializer.h"
+
+// Lattice: UNKNOWN (nothing assigned yet) below the concrete types, ANY above
+TypeKind TypeSpecializer::join(TypeKind a, TypeKind b) {
+    if (a == b || b == TypeKind::UNKNOWN) return a;
+    if (a == TypeKind::UNKNOWN) return b;
+    return TypeKind::ANY;
+}
+
+static bool isNumber(TypeKind type) {
+    return type == TypeKind::INT || type == TypeKind::FLOAT;
+}
+
+// Result types follow the runtime's operators (binaryOperation)
+TypeKind TypeSpecializer::binaryType(BinaryOp op, TypeKind left, TypeKind right) {
+    switch (op) {
+        case BinaryOp::Eq: case BinaryOp::Ne: case BinaryOp::Lt:
+        case BinaryOp::Gt: case BinaryOp::Le: case BinaryOp::Ge:
+        case BinaryOp::And: case BinaryOp::Or:
+            return TypeKind::BOOL;
+        case BinaryOp::Div:
+            return TypeKind::FLOAT;  // Division always produces a float
+        case BinaryOp::Mod:
+            return TypeKind::INT;
+        case BinaryOp::Add:
+            if (left == TypeKind::STRING || right == TypeKind::STRING) {
+                return TypeKind::STRING;
+            }
+            [[fallthrough]];
+        case BinaryOp::Sub:
+        case BinaryOp::Mul:
+            if (left == TypeKind::UNKNOWN || right == TypeKind::UNKNOWN) return TypeKind::UNKNOWN;
+            if (left == TypeKind::INT && right == TypeKind::INT) return TypeKind::INT;
+            if (isNumber(left) && isNumber(right)) return TypeKind::FLOAT;
+            return TypeKind::ANY;
+        case BinaryOp::Unknown:
+            break;
+    }
+    return TypeKind::ANY;
+}
+
+// Compound assignment keeps integer division (compoundOperation)
+TypeKind TypeSpecializer::compoundType(BinaryOp op, TypeKind current, TypeKind value) {
+    switch (op) {
+        case BinaryOp::Add:
+            if (current == TypeKind::STRING || value == TypeKind::STRING) {
+                return TypeKind::STRING;
+            }
+            [[fallthrough]];
+        case BinaryOp::Sub:
+        case BinaryOp::Mul:
+        case BinaryOp::Div:
+            if (current == TypeKind::UNKNOWN || value == TypeKind::UNKNOWN) return TypeKind::UNKNOWN;
+            if (current == TypeKind::INT && value == TypeKind::INT) return TypeKind::INT;
+            if (isNumber(current) && isNumber(value)) return TypeKind::FLOAT;
+            return TypeKind::ANY;
+        default:
+            return TypeKind::ANY;  // Yields null
+    }
+}
+
+// Only the types a value's tag can be checked against; nullable, struct and
+// map annotations say nothing a guard could use
+TypeKind TypeSpecializer::annotated(const std::string& annotation) {
+    if (annotation.empty()) {
+        return TypeKind::ANY;
+    }
+    switch (TypeKind kind = TypeInference::fromAnnotation(annotation)->kind) {
+        case TypeKind::INT:
+        case TypeKind::FLOAT:
+        case TypeKind::STRING:
+        case TypeKind::BOOL:
+        case TypeKind::ARRAY:
+            return kind;
+        default:
+            return TypeKind::ANY;
+    }
+}
+
+TypeKind TypeSpecializer::typeOf(Expression* expr) {
+    type = TypeKind::ANY;
+    expr->accept(*this);
+    return type;
+}
+
+// Frames mirror the Resolver's scopes, so (depth, slot) finds the same variable
+void TypeSpecializer::beginFrame() {
+    frames.push_back(nextFrame++);
+}
+
+void TypeSpecializer::endFrame() {
+    frames.pop_back();
+}
+
+uint64_t TypeSpecializer::variableKey(int depth, int slot) const {
+    uint32_t frame = frames[frames.size() - 1 - static_cast<size_t>(depth)];
+    return (static_cast<uint64_t>(frame) << 32) | static_cast<uint32_t>(slot);
+}
+
+TypeKind TypeSpecializer::variable(int depth, int slot) const {
+    if (depth < 0 || slot < 0 || static_cast<size_t>(depth) >= frames.size()) {
+        return TypeKind::ANY;  // A global, bound by name
+    }
+    auto it = variables.find(variableKey(depth, slot));
+    return it != variables.end() ? it->second : TypeKind::UNKNOWN;
+}
+
+void TypeSpecializer::assign(int depth, int slot, TypeKind value) {
+    if (depth < 0 || slot < 0 || static_cast<size_t>(depth) >= frames.size()) {
+        return;
+    }
+    TypeKind& current = variables.try_emplace(variableKey(depth, slot), TypeKind::UNKNOWN).first->second;
+    TypeKind joined = join(current, value);
+    if (joined != current) {
+        current = joined;
+        changed = true;
+    }
+}
+
+void TypeSpecializer::returns(Key fn, TypeKind value) {
+    if (!fn) {
+        return;
+    }
+    TypeKind& current = results.try_emplace(fn, TypeKind::UNKNOWN).first->second;
+    TypeKind joined = join(current, value);
+    if (joined != current) {
+        current = joined;
+        changed = true;
+    }
+}
+
+// The body shares the function frame, as in Resolver::resolvePending
+void TypeSpecializer::walkFunction(Key fn, const std::vector<std::string>& parameters,
+                                   const std::vector<std::string>* parameterTypes, TypeKind resultType,
+                                   BlockStatement* blockBody, Expression* exprBody) {
+    Key outer = function;
+    beginFrame();
+
+    // Parameters take the first slots in order; a repeated name reuses its slot
+    std::unordered_map<std::string, int> slots;
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        int slot = slots.try_emplace(parameters[i], static_cast<int>(slots.size())).first->second;
+        bool typed = parameterTypes && i < parameterTypes->size() && parameters[i].rfind("...", 0) != 0;
+        assign(0, slot, typed ? annotated((*parameterTypes)[i]) : TypeKind::ANY);
+    }
+
+    // An annotated result is taken as given; otherwise it joins the returns
+    if (resultType != TypeKind::ANY) {
+        results[fn] = resultType;
+        function = nullptr;
+    } else {
+        function = fn;
+    }
+    if (blockBody) {
+        walkStatements(blockBody->statements);
+        // Falling off the end returns null
+        const auto& body = blockBody->statements;
+        if (body.empty() || body.back()->kind != NodeKind::ReturnStatement) {
+            returns(function, TypeKind::ANY);
+        }
+    } else if (exprBody) {
+        returns(function, typeOf(exprBody));
+    }
+
+    endFrame();
+    function = outer;
+}
+
+void TypeSpecializer::walkStatements(const std::vector<std::unique_ptr<Statement>>& statements) {
+    for (const auto& stmt : statements) {
+        stmt->accept(*this);
+    }
+}
+
+size_t TypeSpecializer::specialize(const std::vector<std::unique_ptr<Statement>>& statements) {
+    // Calls are made by name: a top-level function is the callee only where
+    // nothing else at the top level binds its name
+    functions.clear();
+    for (const auto& stmt : statements) {
+        std::string name;
+        FunctionDeclaration* declaration = nullptr;
+        if (stmt->kind == NodeKind::FunctionDeclaration) {
+            declaration = static_cast<FunctionDeclaration*>(stmt.get());
+            name = declaration->name;
+        } else if (stmt->kind == NodeKind::VariableDeclaration) {
+            name = static_cast<VariableDeclaration*>(stmt.get())->name;
+        } else if (stmt->kind == NodeKind::StructDeclaration) {
+            name = static_cast<StructDeclaration*>(stmt.get())->name;
+        } else if (stmt->kind == NodeKind::ImportStatement) {
+            auto* import = static_cast<ImportStatement*>(stmt.get());
+            name = import->alias.empty() ? import->moduleName : import->alias;
+        } else {
+            continue;
+        }
+        auto inserted = functions.try_emplace(name, declaration);
+        if (!inserted.second) {
+            inserted.first->second = nullptr;
+        }
+    }
+
+    variables.clear();
+    results.clear();
+    for (int round = 0; round < kMaxRounds; ++round) {
+        changed = false;
+        frames.clear();
+        nextFrame = 0;
+        function = nullptr;
+        walkStatements(statements);
+        if (!changed) break;
+    }
+
+    marking = true;
+    marked = 0;
+    frames.clear();
+    nextFrame = 0;
+    function = nullptr;
+    walkStatements(statements);
+    marking = false;
+    return marked;
+}
+
+// Expression visitors
+void TypeSpecializer::visit(IntegerLiteral*) { type = TypeKind::INT; }
+void TypeSpecializer::visit(FloatLiteral*) { type = TypeKind::FLOAT; }
+void TypeSpecializer::visit(StringLiteral*) { type = TypeKind::STRING; }
+void TypeSpecializer::visit(BooleanLiteral*) { type = TypeKind::BOOL; }
+void TypeSpecializer::visit(NullLiteral*) { type = TypeKind::ANY; }
+
+void TypeSpecializer::visit(Identifier* node) {
+    type = variable(node->depth, node->slot);
+}
+
+void TypeSpecializer::visit(BinaryExpression* node) {
+    TypeKind left = typeOf(node->left.get());
+    TypeKind right = typeOf(node->right.get());
+
+    // Operand types the run has already seen are left alone
+    using OperandTypes = BinaryExpression::OperandTypes;
+    BinaryOp op = node->binaryOp;
+    if (marking && node->operandTypes == OperandTypes::Unknown) {
+        bool logical = op == BinaryOp::And || op == BinaryOp::Or || op == BinaryOp::Unknown;
+        if (left == TypeKind::INT && right == TypeKind::INT && !logical && op != BinaryOp::Div) {
+            node->operandTypes = OperandTypes::IntInt;
+            ++marked;
+        } else if (left == TypeKind::FLOAT && right == TypeKind::FLOAT && !logical && op != BinaryOp::Mod) {
+            node->operandTypes = OperandTypes::FloatFloat;
+            ++marked;
+        }
+    }
+    type = binaryType(op, left, right);
+}
+
+void TypeSpecializer::visit(UnaryExpression* node) {
+    TypeKind operand = typeOf(node->operand.get());
+    if (node->unaryOp == UnaryOp::Not) {
+        type = TypeKind::BOOL;
+    } else if (node->unaryOp == UnaryOp::Neg && (isNumber(operand) || operand == TypeKind::UNKNOWN)) {
+        type = operand;
+    } else {
+        type = TypeKind::ANY;
+    }
+}
+
+void TypeSpecializer::visit(AssignmentExpression* node) {
+    TypeKind value = typeOf(node->right.get());
+    assign(node->depth, node->slot, value);
+    type = value;
+}
+
+void TypeSpecializer::visit(CallExpression* node) {
+    for (auto& arg : node->arguments) {
+        typeOf(arg.get());
+    }
+
+    auto it = functions.find(node->callee);
+    if (it != functions.end()) {
+        auto result = it->second ? results.find(it->second) : results.end();
+        type = !it->second ? TypeKind::ANY : result != results.end() ? result->second : TypeKind::UNKNOWN;
+        return;
+    }
+    // A builtin, unless a module or an enclosing scope rebinds the name
+    // (then the guards catch it)
+    type = TypeKind::ANY;
+    auto builtin = inference.getGlobalEnv()->lookup(node->callee);
+    if (builtin && builtin->kind == TypeKind::FUNCTION && builtin->returnType) {
+        TypeKind result = builtin->returnType->kind;
+        if (result == TypeKind::INT || result == TypeKind::FLOAT || result == TypeKind::STRING) {
+            type = result;
+        }
+    }
+}
+
+void TypeSpecializer::visit(ArrayLiteral* node) {
+    for (auto& elem : node->elements) {
+        typeOf(elem.get());
+    }
+    type = TypeKind::ARRAY;
+}
+
+void TypeSpecializer::visit(ArrayIndexExpression* node) {
+    TypeKind array = typeOf(node->array.get());
+    TypeKind index = typeOf(node->index.get());
+    if (marking && !node->arrayIntIndex && array == TypeKind::ARRAY && index == TypeKind::INT) {
+        node->arrayIntIndex = true;
+        ++marked;
+    }
+    type = TypeKind::ANY;  // Element types are not tracked
+}
+
+void TypeSpecializer::visit(ArrayAssignmentExpression* node) {
+    typeOf(node->array.get());
+    typeOf(node->index.get());
+    type = typeOf(node->value.get());
+}
+
+void TypeSpecializer::visit(LambdaExpression* node) {
+    walkFunction(node, node->parameters, nullptr, TypeKind::ANY, node->blockBody.get(), node->body.get());
+    type = TypeKind::ANY;
+}
+
+void TypeSpecializer::visit(MatchExpression* node) {
+    typeOf(node->subject.get());
+    for (auto& matchCase : node->cases) {
+        if (matchCase.pattern) {
+            typeOf(matchCase.pattern.get());
+        }
+        typeOf(matchCase.result.get());
+    }
+    type = TypeKind::ANY;
+}
+
+void TypeSpecializer::visit(CompoundAssignment* node) {
+    TypeKind current = typeOf(node->target.get());
+    TypeKind value = compoundType(node->binaryOp, current, typeOf(node->value.get()));
+    assign(node->depth, node->slot, value);
+    type = value;
+}
+
+void TypeSpecializer::visit(UpdateExpression* node) {
+    TypeKind current = typeOf(node->operand.get());
+    TypeKind value = isNumber(current) || current == TypeKind::UNKNOWN ? current : TypeKind::ANY;
+    assign(node->depth, node->slot, value);
+    type = value;
+}
+
+void TypeSpecializer::visit(InterpolatedString* node) {
+    for (auto& part : node->parts) {
+        if (part.isExpression) {
+            typeOf(part.expr.get());
+        }
+    }
+    type = TypeKind::STRING;
+}
+
+// SADK Expression visitors
+void TypeSpecializer::visit(MapLiteral* node) {
+    for (auto& entry : node->entries) {
+        typeOf(entry.first.get());
+        typeOf(entry.second.get());
+    }
+    type = TypeKind::ANY;
+}
+
+void TypeSpecializer::visit(MemberExpression* node) {
+    typeOf(node->object.get());
+    type = TypeKind::ANY;
+}
+
+void TypeSpecializer::visit(MethodCallExpression* node) {
+    typeOf(node->object.get());
+    for (auto& arg : node->arguments) {
+        typeOf(arg.get());
+    }
+    type = TypeKind::ANY;
+}
+
+void TypeSpecializer::visit(SelfExpression*) { type = TypeKind::ANY; }
+
+// Statement visitors
+void TypeSpecializer::visit(VariableDeclaration* node) {
+    TypeKind value = node->initializer ? typeOf(node->initializer.get()) : TypeKind::ANY;
+    TypeKind declared = node->isNullable ? TypeKind::ANY : annotated(node->typeName);
+    assign(0, node->slot, declared != TypeKind::ANY ? declared : value);
+}
+
+void TypeSpecializer::visit(ExpressionStatement* node) {
+    typeOf(node->expression.get());
+}
+
+void TypeSpecializer::visit(BlockStatement* node) {
+    if (node->frameSize == 0) {
+        walkStatements(node->statements);
+        return;
+    }
+    beginFrame();
+    walkStatements(node->statements);
+    endFrame();
+}
+
+void TypeSpecializer::visit(IfStatement* node) {
+    typeOf(node->condition.get());
+    node->thenBranch->accept(*this);
+    if (node->elseBranch) {
+        node->elseBranch->accept(*this);
+    }
+}
+
+void TypeSpecializer::visit(WhileStatement* node) {
+    typeOf(node->condition.get());
+    node->body->accept(*this);
+}
+
+void TypeSpecializer::visit(ForStatement* node) {
+    bool hasFrame = node->frameSize > 0;
+    if (hasFrame) {
+        beginFrame();
+    }
+    if (node->initializer) node->initializer->accept(*this);
+    if (node->condition) typeOf(node->condition.get());
+    if (node->increment) typeOf(node->increment.get());
+    node->body->accept(*this);
+    if (hasFrame) {
+        endFrame();
+    }
+}
+
+void TypeSpecializer::visit(BreakStatement*) {}
+void TypeSpecializer::visit(ContinueStatement*) {}
+
+void TypeSpecializer::visit(FunctionDeclaration* node) {
+    walkFunction(node, node->parameters, &node->parameterTypes, annotated(node->returnType),
+                 node->body.get(), nullptr);
+}
+
+void TypeSpecializer::visit(ReturnStatement* node) {
+    returns(function, node->value ? typeOf(node->value.get()) : TypeKind::ANY);
+}
+
+void TypeSpecializer::visit(TryStatement* node) {
+    if (node->tryBlock) {
+        node->tryBlock->accept(*this);
+    }
+
+    // The catch clause binds the error variable in a one-slot frame
+    beginFrame();
+    assign(0, 0, TypeKind::ANY);
+    if (node->catchBlock) {
+        node->catchBlock->accept(*this);
+    }
+    endFrame();
+}
+
+// SADK Statement visitors
+void TypeSpecializer::visit(ImportStatement* node) {
+    assign(0, node->slot, TypeKind::ANY);
+}
+
+void TypeSpecializer::visit(StructDeclaration* node) {
+    for (auto& method : node->methods) {
+        method->accept(*this);
+    }
+}
@@ -2,8 +2,14 @@
 #include "../include/parser.h"
 #include "../include/ast.h"
 #include "../include/semantic_analyzer.h"
+#include "../include/optimizer.h"
 #include "../include/code_generator.h"
 #include "../include/interpreter.h"
+#include "../include/resolver.h"
+#include "../include/type_specializer.h"
+#include "../include/bytecode_compiler.h"
+#include "../include/vm.h"
+#include "../include/vm_profiler.h"
 #include "../include/js_transpiler.h"
 #include "../include/wasm_transpiler.h"
 #include "../include/modules.h"
@@ -11,6 +17,8 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <memory>
 #include <cstring>
 
 #define SYNTHFLOW_VERSION "0.0.27"
@@ -23,7 +31,19 @@ struct Config {
     bool verbose = false;
     bool quiet = false;
     int optimizeLevel = 0;
+    std::vector<std::string> passes;  // --passes: replaces the -O pipeline
+    bool printPasses = false;
     bool interactive = false;
+    bool icStats = false;
+    bool quickenStats = false;
+    bool noBytecodeCache = false;
+    bool noJit = false;
+    uint32_t jitThreshold = VM::kDefaultJitThreshold;
+    bool jitStats = false;
+    bool jitDifferential = false;
+    bool vmProfile = false;
+    std::string vmProfileJson;      // Where --vm-profile-json writes the profile
+    std::string engine = "interp";  // "interp" (tree-walker) or "vm" (bytecode)
 };
 
 static Config g_config;
@@ -74,8 +94,191 @@ std::string readFile(const std::string& path) {
 // Core Execution Functions
 // =============================================================================
 
+void printInlineCacheStats(const InlineCacheStats& stats) {
+    auto line = [](const char* label, uint64_t hits, uint64_t misses) {
+        uint64_t total = hits + misses;
+        double rate = total ? 100.0 * static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+        std::cerr << "  " << label << hits << " hits, " << misses << " misses ("
+                  << std::fixed << std::setprecision(1) << rate << "% hit rate)" << std::endl;
+    };
+    std::cerr << "Inline cache statistics:" << std::endl;
+    line("member access: ", stats.memberHits, stats.memberMisses);
+    line("method calls:  ", stats.methodHits, stats.methodMisses);
+}
+
+void printQuickeningStats(const QuickeningStats& stats) {
+    std::cerr << "Quickening statistics:" << std::endl;
+    std::cerr << "  quickened:   " << stats.quickened << " instructions" << std::endl;
+    std::cerr << "  deoptimized: " << stats.deoptimized << " instructions" << std::endl;
+}
+
+void printJitStats(const JitStats& stats) {
+    std::cerr << "JIT statistics:" << std::endl;
+    std::cerr << "  compiled:    " << stats.compiled << " functions" << std::endl;
+    std::cerr << "  entries:     " << stats.entries << std::endl;
+    std::cerr << "  guard exits: " << stats.guardExits << std::endl;
+    std::cerr << "  discarded:   " << stats.discarded << " functions" << std::endl;
+}
+
+void reportVMProfile(VMProfiler& profiler) {
+    profiler.finish();
+    if (g_config.vmProfile) {
+        profiler.printReport(std::cerr);
+    }
+    if (!g_config.vmProfileJson.empty()) {
+        std::ofstream file(g_config.vmProfileJson);
+        if (!file) {
+            logError("Cannot write VM profile to " + g_config.vmProfileJson);
+            return;
+        }
+        file << profiler.toJson();
+        logInfo("Wrote VM profile to " + g_config.vmProfileJson);
+    }
+}
+
+// Compiler tag of cached bytecode: the version and the options that change
+// the generated code
+std::string bytecodeCacheTag() {
+    std::string tag = std::string(SYNTHFLOW_VERSION) + " -O" + std::to_string(g_config.optimizeLevel);
+    if (!g_config.passes.empty()) {
+        tag += " --passes";
+        for (const std::string& pass : g_config.passes) {
+            tag += " " + pass;
+        }
+    }
+    return tag;
+}
+
+// Runs the AST passes -O, -OO or --passes ask for; the caller runs
+// specialize() once the program is resolved
+std::shared_ptr<Optimizer> optimizeProgram(std::vector<std::unique_ptr<Statement>>& statements) {
+    auto optimizer = std::make_shared<Optimizer>(g_config.passes.empty() ? Optimizer(g_config.optimizeLevel)
+                                                                          : Optimizer(g_config.passes));
+    setModuleSpecialization(optimizer->specializes());
+    if (!optimizer->rewrites()) {
+        return optimizer;
+    }
+    logDebug("Optimizing...");
+    optimizer->optimize(statements);
+    setModuleTransform([optimizer](std::vector<std::unique_ptr<Statement>>& module, const std::string& moduleName,
+                                   const std::string& modulePath) {
+        optimizer->optimizeModule(module, moduleName, modulePath);
+    });
+    return optimizer;
+}
+
+// Output and error of one run, for --jit-differential
+struct CapturedRun {
+    std::string output;
+    std::string error;
+};
+
+CapturedRun runCaptured(const BytecodeChunk& chunk, const BytecodeCache* cache, bool jit) {
+    CapturedRun result;
+    std::ostringstream output;
+    std::streambuf* console = std::cout.rdbuf(output.rdbuf());
+    try {
+        VM vm;
+        vm.setBytecodeCache(cache);
+        // Compile as early as possible, so native code runs as much of the program as it can
+        vm.setJit(jit, 1);
+        vm.run(chunk);
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    std::cout.rdbuf(console);
+    result.output = output.str();
+    return result;
+}
+
+// Run the program in the interpreter alone, then with the JIT, and compare
+// what the two runs print and raise
+int runJitDifferential(const BytecodeChunk& chunk, const BytecodeCache* cache) {
+    CapturedRun interpreted = runCaptured(chunk, cache, false);
+    CapturedRun compiled = runCaptured(chunk, cache, true);
+    std::cout << interpreted.output << std::flush;
+
+    if (interpreted.output == compiled.output && interpreted.error == compiled.error) {
+        if (!interpreted.error.empty()) {
+            logError(interpreted.error);
+        }
+        logSuccess("JIT differential: both runs match");
+        return interpreted.error.empty() ? 0 : 1;
+    }
+
+    std::istringstream expected(interpreted.output);
+    std::istringstream actual(compiled.output);
+    std::string expectedLine;
+    std::string actualLine;
+    size_t line = 1;
+    for (;; ++line) {
+        bool moreExpected = static_cast<bool>(std::getline(expected, expectedLine));
+        bool moreActual = static_cast<bool>(std::getline(actual, actualLine));
+        if (!moreExpected && !moreActual) {
+            break;
+        }
+        if (!moreExpected || !moreActual || expectedLine != actualLine) {
+            logError("JIT differential: output differs at line " + std::to_string(line));
+            std::cerr << "  interpreter: " << (moreExpected ? expectedLine : "<end of output>") << std::endl;
+            std::cerr << "  JIT:         " << (moreActual ? actualLine : "<end of output>") << std::endl;
+            return 1;
+        }
+    }
+    logError("JIT differential: errors differ");
+    std::cerr << "  interpreter: " << (interpreted.error.empty() ? "<none>" : interpreted.error) << std::endl;
+    std::cerr << "  JIT:         " << (compiled.error.empty() ? "<none>" : compiled.error) << std::endl;
+    return 1;
+}
+
+int runBytecode(BytecodeChunk chunk, const BytecodeCache* cache) {
+    if (g_config.jitDifferential) {
+        return runJitDifferential(chunk, cache);
+    }
+
+    logDebug("Starting VM...");
+    VM vm;
+    vm.setBytecodeCache(cache);
+    vm.setJit(!g_config.noJit, g_config.jitThreshold);
+    std::unique_ptr<VMProfiler> profiler;
+    if (g_config.vmProfile || !g_config.vmProfileJson.empty()) {
+        profiler = std::make_unique<VMProfiler>();
+        vm.setProfiler(profiler.get());
+    }
+    try {
+        vm.run(std::move(chunk));
+    } catch (...) {
+        // The profile of a program that failed shows where it got to
+        if (profiler) reportVMProfile(*profiler);
+        throw;
+    }
+    if (profiler) {
+        reportVMProfile(*profiler);
+    }
+    
+    if (g_config.icStats) {
+        printInlineCacheStats(vm.getInlineCacheStats());
+    }
+    if (g_config.quickenStats) {
+        printQuickeningStats(vm.getQuickeningStats());
+    }
+    if (g_config.jitStats) {
+        printJitStats(vm.getJitStats());
+    }
+    return 0;
+}
+
 int runProgram(const std::string& source) {
     try {
+        // A cached chunk for this source skips the whole front end
+        std::unique_ptr<BytecodeCache> cache;
+        if (g_config.engine == "vm" && !g_config.noBytecodeCache) {
+            cache = std::make_unique<BytecodeCache>(BytecodeCache::defaultDirectory(), bytecodeCacheTag());
+            if (auto chunk = cache->load(source)) {
+                logInfo("Loaded bytecode from " + cache->entryPath(source));
+                return runBytecode(std::move(*chunk), cache.get());
+            }
+        }
+        
         logDebug("Starting lexer...");
         Lexer lexer(source);
         auto tokens = lexer.tokenize();
@@ -96,10 +299,37 @@ int runProgram(const std::string& source) {
             logInfo("Skipping semantic analysis (optimization mode)");
         }
         
+        auto optimizer = optimizeProgram(statements);
+        // Not cached when it depends on the modules it imports
+        bool cacheable = !optimizer->dependsOnImports();
+        
+        logDebug("Resolving scopes...");
+        Resolver resolver;
+        resolver.resolve(statements);
+        optimizer->specialize(statements);
+        if (g_config.printPasses) {
+            optimizer->printReport(std::cerr);
+        }
+        
+        if (g_config.engine == "vm") {
+            logDebug("Compiling to bytecode...");
+            BytecodeCompiler compiler;
+            BytecodeChunk chunk = compiler.compile(statements);
+            logInfo("Compiled " + std::to_string(chunk.functions.size()) + " functions");
+            if (cache && cacheable) {
+                cache->store(source, chunk);
+            }
+            return runBytecode(std::move(chunk), cache.get());
+        }
+        
         logDebug("Starting interpreter...");
         Interpreter interpreter;
         interpreter.execute(statements);
         
+        if (g_config.icStats) {
+            printInlineCacheStats(interpreter.getInlineCacheStats());
+        }
+        
         return 0;
     } catch (const std::exception& e) {
         logError(e.what());
@@ -135,6 +365,11 @@ int compileProgram(const std::string& source) {
             std::cout << "\n=== Semantic Analysis Successful ===" << std::endl;
         }
         
+        auto optimizer = optimizeProgram(statements);
+        if (g_config.printPasses) {
+            optimizer->printReport(std::cerr);
+        }
+        
         CodeGenerator generator;
         std::string generatedCode = generator.generate(statements);
         
@@ -161,6 +396,11 @@ int transpileProgram(const std::string& source, const std::string& target, const
         SemanticAnalyzer analyzer;
         analyzer.analyze(statements);
         
+        auto optimizer = optimizeProgram(statements);
+        if (g_config.printPasses) {
+            optimizer->printReport(std::cerr);
+        }
+        
         JSTranspiler transpiler;
         std::string jsCode = transpiler.transpile(statements);
         
@@ -319,6 +559,10 @@ int startRepl() {
     std::cout << std::endl;
     
     Interpreter interpreter;  // Persistent interpreter for REPL session
+    Resolver resolver;
+    
+    // Every executed line stays alive: functions defined in it are referenced by pointer
+    std::vector<std::vector<std::unique_ptr<Statement>>> session;
     std::string line;
     std::string multiLine;
     bool inMultiLine = false;
@@ -396,7 +640,10 @@ int startRepl() {
                     auto tokens = lexer.tokenize();
                     Parser parser(std::move(tokens));
                     auto statements = parser.parse();
+                    resolver.resolve(statements);
+                    TypeSpecializer().specialize(statements);
                     interpreter.execute(statements);
+                    session.push_back(std::move(statements));
                     Value result = interpreter.getLastValue();
                     auto end = std::chrono::high_resolution_clock::now();
                     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -423,7 +670,10 @@ int startRepl() {
                     auto tokens = lexer.tokenize();
                     Parser parser(std::move(tokens));
                     auto statements = parser.parse();
+                    resolver.resolve(statements);
+                    TypeSpecializer().specialize(statements);
                     interpreter.execute(statements);
+                    session.push_back(std::move(statements));
                     logSuccess("Loaded " + filename);
                 } catch (const std::exception& e) {
                     logError(e.what());
@@ -460,8 +710,11 @@ int startRepl() {
             
             Parser parser(std::move(tokens));
             auto statements = parser.parse();
+            resolver.resolve(statements);
+            TypeSpecializer().specialize(statements);
             
             interpreter.execute(statements);
+            session.push_back(std::move(statements));
             
             // Print result if expression
             Value result = interpreter.getLastValue();
@@ -514,7 +767,21 @@ int main(int argc, char* argv[]) {
     app.add_flag("-v,--verbose", g_config.verbose, "Enable verbose output");
     app.add_flag("-q,--quiet", g_config.quiet, "Suppress non-essential output");
     app.add_flag("-O", g_config.optimizeLevel, "Optimization level (use -O for level 1, -OO for level 2)");
+    app.add_option("--passes", g_config.passes, "Comma-separated optimizer passes to run instead of the -O pipeline (fold, ctfe, dce, inline, cse, licm, specialize)")
+        ->delimiter(',');
+    app.add_flag("--print-passes", g_config.printPasses, "Print each optimizer pass's time and number of changes");
     app.add_flag("-i,--interactive", g_config.interactive, "Enter REPL after execution");
+    app.add_flag("--ic-stats", g_config.icStats, "Print inline cache hit/miss counts after running");
+    app.add_flag("--quicken-stats", g_config.quickenStats, "Print VM quickening counts after running (--engine=vm)");
+    app.add_flag("--no-bytecode-cache", g_config.noBytecodeCache, "Always compile from source instead of using cached bytecode (--engine=vm)");
+    app.add_flag("--no-jit", g_config.noJit, "Interpret all bytecode instead of compiling hot functions to machine code (--engine=vm)");
+    app.add_option("--jit-threshold", g_config.jitThreshold, "Calls plus loop iterations after which a function is compiled to machine code (--engine=vm)");
+    app.add_flag("--jit-stats", g_config.jitStats, "Print JIT compilation and exit counts after running (--engine=vm)");
+    app.add_flag("--jit-differential", g_config.jitDifferential, "Run the program with and without the JIT and compare the results (--engine=vm)");
+    app.add_flag("--vm-profile", g_config.vmProfile, "Print per-opcode counts and times, opcode pairs and hot loops after running (--engine=vm, turns the JIT off)");
+    app.add_option("--vm-profile-json", g_config.vmProfileJson, "Write the --vm-profile data to a JSON file (--engine=vm)");
+    app.add_option("--engine", g_config.engine, "Execution engine: interp (tree-walker) or vm (bytecode)")
+        ->check(CLI::IsMember({"interp", "vm"}));
     
     // Inline code execution
     std::string inlineCode;
@@ -530,6 +797,8 @@ int main(int argc, char* argv[]) {
     auto run_cmd = app.add_subcommand("run", "Execute a SynthFlow program");
     std::string run_file;
     run_cmd->add_option("file", run_file, "Source file to execute")->required();
+    run_cmd->add_option("--engine", g_config.engine, "Execution engine: interp (tree-walker) or vm (bytecode)")
+        ->check(CLI::IsMember({"interp", "vm"}));
     
     // ==========================================================================
     // Subcommand: compile
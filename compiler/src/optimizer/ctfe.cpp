@@ -0,0 +1,865 @@
+#include "../../include/optimizer.h"
+#include "../../include/interpreter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+
+using Statements = std::vector<std::unique_ptr<Statement>>;
+
+// Thrown when an evaluation cannot be finished at compile time; the code is
+// left for the run
+struct NotConstant {};
+
+bool isScalar(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::Null:
+        case Value::Type::Int:
+        case Value::Type::Float:
+        case Value::Type::Bool:
+        case Value::Type::String:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// An array or map of scalars
+bool isTable(const Value& value) {
+    if (value.isArray()) {
+        const auto& elements = *value.asArray();
+        return std::all_of(elements.begin(), elements.end(), isScalar);
+    }
+    if (value.isMap()) {
+        const auto& entries = *value.asMap();
+        return std::all_of(entries.begin(), entries.end(), [](const auto& entry) { return isScalar(entry.second); });
+    }
+    return false;
+}
+
+// Characters of a string, elements of an array or entries of a map
+size_t lengthOf(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::String: return value.stringLength();
+        case Value::Type::Array: return value.asArray()->size();
+        case Value::Type::Map: return value.asMap()->size();
+        default: return 0;
+    }
+}
+
+bool literalValue(const Expression* expr, Value& out) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral: out = Value(static_cast<const IntegerLiteral*>(expr)->value); return true;
+        case NodeKind::FloatLiteral: out = Value(static_cast<const FloatLiteral*>(expr)->value); return true;
+        case NodeKind::StringLiteral: out = Value(static_cast<const StringLiteral*>(expr)->value); return true;
+        case NodeKind::BooleanLiteral: out = Value(static_cast<const BooleanLiteral*>(expr)->value); return true;
+        case NodeKind::NullLiteral: out = Value(); return true;
+        default: return false;
+    }
+}
+
+// The literal that evaluates to `value`, with a new array or map for each one
+// in it, or nullptr if there is none: an array or map that appears twice
+// (one literal would make two), or more than `budget` elements in all
+std::unique_ptr<Expression> literalFor(const Value& value, std::unordered_set<const void*>& seen, size_t& budget) {
+    switch (value.getType()) {
+        case Value::Type::Int: return std::make_unique<IntegerLiteral>(value.asInt());
+        case Value::Type::Float:
+            if (!std::isfinite(value.asFloat())) return nullptr;
+            return std::make_unique<FloatLiteral>(value.asFloat());
+        case Value::Type::String: return std::make_unique<StringLiteral>(value.asString());
+        case Value::Type::Bool: return std::make_unique<BooleanLiteral>(value.asBool());
+        case Value::Type::Null: return std::make_unique<NullLiteral>();
+        case Value::Type::Array: {
+            auto elements = value.asArray();
+            if (!seen.insert(elements.get()).second || elements->size() > budget) return nullptr;
+            budget -= elements->size();
+            auto literal = std::make_unique<ArrayLiteral>();
+            for (const Value& element : *elements) {
+                literal->elements.push_back(literalFor(element, seen, budget));
+                if (!literal->elements.back()) return nullptr;
+            }
+            return literal;
+        }
+        case Value::Type::Map: {
+            auto entries = value.asMap();
+            if (!seen.insert(entries.get()).second || entries->size() > budget) return nullptr;
+            budget -= entries->size();
+            auto literal = std::make_unique<MapLiteral>();
+            for (const auto& entry : *entries) {
+                auto element = literalFor(entry.second, seen, budget);
+                if (!element) return nullptr;
+                literal->addEntry(std::make_unique<StringLiteral>(entry.first.str()), std::move(element));
+            }
+            return literal;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+// Whether int64 `a + b`, `a - b` and `a * b` would leave the int64 range,
+// checked against the limits so it builds with compilers that lack the
+// GCC overflow builtins
+bool addOverflows(int64_t a, int64_t b) {
+    constexpr int64_t max = std::numeric_limits<int64_t>::max();
+    constexpr int64_t min = std::numeric_limits<int64_t>::min();
+    return b > 0 ? a > max - b : a < min - b;
+}
+
+bool subOverflows(int64_t a, int64_t b) {
+    constexpr int64_t max = std::numeric_limits<int64_t>::max();
+    constexpr int64_t min = std::numeric_limits<int64_t>::min();
+    return b < 0 ? a > max + b : a < min + b;
+}
+
+bool mulOverflows(int64_t a, int64_t b) {
+    constexpr int64_t max = std::numeric_limits<int64_t>::max();
+    constexpr int64_t min = std::numeric_limits<int64_t>::min();
+    if (a == 0 || b == 0) return false;
+    if (a > 0) {
+        return b > 0 ? a > max / b : b < min / a;
+    }
+    return b > 0 ? a < min / b : a < max / b;
+}
+
+// Whether `a op b` on two ints would overflow (or trap, for `%` and `/`)
+bool intOverflows(BinaryOp op, int64_t a, int64_t b) {
+    switch (op) {
+        case BinaryOp::Add: return addOverflows(a, b);
+        case BinaryOp::Sub: return subOverflows(a, b);
+        case BinaryOp::Mul: return mulOverflows(a, b);
+        case BinaryOp::Div:
+        case BinaryOp::Mod: return b == 0 || (b == -1 && a == std::numeric_limits<int64_t>::min());
+        default: return false;
+    }
+}
+
+// Names used other than as the array of an element read, the object of a
+// field read or the argument of `len`: a table's value must have no other use,
+// so nothing can change it or tell it from a copy
+class TableUseScanner : public ASTRewriter {
+public:
+    TableUseScanner(std::unordered_set<std::string>& escaping, bool lenIsBuiltin)
+        : escaping(escaping), lenIsBuiltin(lenIsBuiltin) {}
+
+    void scan(Statements& statements) {
+        for (auto& stmt : statements) {
+            rewrite(stmt);
+        }
+    }
+
+    void visit(Identifier* node) override { escaping.insert(node->name); }
+
+    void visit(ArrayIndexExpression* node) override {
+        if (node->array->kind != NodeKind::Identifier) rewrite(node->array);
+        rewrite(node->index);
+    }
+
+    void visit(MemberExpression* node) override {
+        if (node->object->kind != NodeKind::Identifier) rewrite(node->object);
+    }
+
+    void visit(CallExpression* node) override {
+        if (lenIsBuiltin && node->callee == "len" && node->arguments.size() == 1 &&
+            node->arguments[0]->kind == NodeKind::Identifier) {
+            return;
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(AssignmentExpression* node) override {
+        assigns(node->left);
+        rewrite(node->right);
+    }
+
+    void visit(ArrayAssignmentExpression* node) override {
+        escapeRoot(node->array.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CompoundAssignment* node) override {
+        assigns(node->target);
+        rewrite(node->value);
+    }
+
+    void visit(UpdateExpression* node) override { assigns(node->operand); }
+
+private:
+    std::unordered_set<std::string>& escaping;
+    bool lenIsBuiltin;
+
+    // The name an element or field assignment changes the value of
+    void escapeRoot(const Expression* target) {
+        while (true) {
+            if (target->kind == NodeKind::ArrayIndexExpression) {
+                target = static_cast<const ArrayIndexExpression*>(target)->array.get();
+            } else if (target->kind == NodeKind::MemberExpression) {
+                target = static_cast<const MemberExpression*>(target)->object.get();
+            } else {
+                break;
+            }
+        }
+        if (target->kind == NodeKind::Identifier) {
+            escaping.insert(static_cast<const Identifier*>(target)->name);
+        }
+    }
+
+    void assigns(std::unique_ptr<Expression>& target) {
+        if (target->kind == NodeKind::Identifier) return;  // Assigned names are never constants
+        escapeRoot(target.get());
+        rewrite(target);
+    }
+};
+
+}  // namespace
+
+// =============================================================================
+// Program analysis
+// =============================================================================
+
+struct CompileTimeEvaluationPass::Analysis : ProgramUnits {
+    // A top-level constant and the statement that declares it
+    struct Constant {
+        Value value;
+        size_t index;
+        bool early;  // Declared before anything that could read it runs
+    };
+
+    // The variables of one call, innermost scope last. The site an evaluation
+    // starts from has none of its own: it reads the constants its position
+    // in the statements being rewritten knows.
+    struct Frame {
+        const ProgramUnit* unit;
+        bool site;
+        std::vector<std::unordered_map<std::string, Value>> scopes;
+    };
+
+    struct Evaluation {
+        size_t limit = 0;       // Statements of the unit before this one have run (a constant's initializer)
+        bool topLevel = false;  // The site is top-level code of the unit being rewritten
+        size_t fuel = 0;
+        size_t depth = 0;
+        enum class Flow { Normal, Return, Break, Continue } flow = Flow::Normal;
+        Value returned;
+    };
+    static constexpr size_t kAnySite = std::numeric_limits<size_t>::max();
+
+    Interpreter runtime;  // Its builtins
+    std::unordered_set<std::string> assigned;  // Anywhere
+    std::unordered_set<std::string> escaping;  // Used other than as a table
+    std::unordered_map<const ProgramUnit*, std::unordered_map<std::string, Constant>> constants;
+    std::unordered_map<const FunctionDeclaration*, size_t> functionIndex;
+    size_t fuel = 0;  // Steps left for this run
+
+    // The statements being rewritten
+    const Statements* top = nullptr;
+    const ProgramUnit* current = nullptr;
+    std::unordered_set<std::string> reached;  // Top-level constants declared so far
+    struct Local {
+        Value value;
+        int nesting;
+    };
+    std::unordered_map<std::string, Local> locals;  // `const`s of the enclosing blocks
+    int nesting = 0;                                 // Functions and lambdas entered
+    bool rewroteProgram = false;
+
+    void analyze(Statements& program);
+
+    const Constant* constantOf(const ProgramUnit* unit, const std::string& name) const;
+    const Value* siteValue(const std::string& name) const;
+    bool constantOperand(const Expression* expr) const;
+    bool constantOperands(const Expression* expr) const;
+    bool evaluateAt(const ProgramUnit* unit, size_t limit, const Expression* expr, Value& out);
+
+    void spend(Evaluation& e, size_t steps) const {
+        if (steps > e.fuel) throw NotConstant();
+        e.fuel -= steps;
+    }
+    const Value& made(const Value& value, Evaluation& e) const {
+        size_t length = lengthOf(value);
+        if (length > kMaxLength) throw NotConstant();
+        spend(e, length / 16);
+        return value;
+    }
+
+    const Value* lookup(const std::string& name, Frame& frame, const Evaluation& e) const;
+    Value* variable(const Expression* target, Frame& frame) const;
+    Value evaluate(const Expression* expr, Frame& frame, Evaluation& e);
+    Value call(const CallExpression* node, std::vector<Value>& args, const Frame& frame, Evaluation& e);
+    void execute(const Statement* stmt, Frame& frame, Evaluation& e);
+};
+
+void CompileTimeEvaluationPass::Analysis::analyze(Statements& program) {
+    assigned.clear();
+    escaping.clear();
+    constants.clear();
+    functionIndex.clear();
+    fuel = kRunFuel;
+    ProgramUnits::analyze(program);
+    if (!complete) return;
+
+    for (const auto& unit : units) {
+        assigned.insert(unit->assigned.begin(), unit->assigned.end());
+        for (const ProgramUnit::Function& function : unit->functions) {
+            if (!function.nested) functionIndex[function.decl] = function.index;
+        }
+    }
+    for (const auto& unit : units) {
+        TableUseScanner(escaping, !names.count("len")).scan(*unit->statements);
+    }
+
+    // Each constant's initializer runs where it is declared: it may only
+    // call functions and read constants its unit declared before it
+    for (const auto& unit : units) {
+        Statements& statements = *unit->statements;
+        for (size_t i = 0; i < statements.size(); ++i) {
+            if (statements[i]->kind != NodeKind::VariableDeclaration) continue;
+            auto* decl = static_cast<VariableDeclaration*>(statements[i].get());
+            if (!decl->isConst || !decl->initializer || unit->declared[decl->name] != 1 ||
+                assigned.count(decl->name)) {
+                continue;
+            }
+            Value value;
+            if (!evaluateAt(unit.get(), i, decl->initializer.get(), value)) continue;
+            // A module's tables can be reached (and changed) through the module's map
+            bool table = unit == units[0] && isTable(value) && !escaping.count(decl->name);
+            if (isScalar(value) || table) {
+                constants[unit.get()][decl->name] = {value, i, i <= unit->inertEnd};
+            }
+        }
+    }
+}
+
+const CompileTimeEvaluationPass::Analysis::Constant* CompileTimeEvaluationPass::Analysis::constantOf(
+    const ProgramUnit* unit, const std::string& name) const {
+    auto known = constants.find(unit);
+    if (known == constants.end()) return nullptr;
+    auto it = known->second.find(name);
+    return it != known->second.end() ? &it->second : nullptr;
+}
+
+// The value `name` has where the rewrite is: a `const` of an enclosing block,
+// or a top-level constant declared before this code runs
+const Value* CompileTimeEvaluationPass::Analysis::siteValue(const std::string& name) const {
+    auto local = locals.find(name);
+    if (local != locals.end()) {
+        // A function declared in the block may run before the `const` does
+        return local->second.nesting == nesting ? &local->second.value : nullptr;
+    }
+    const Constant* constant = constantOf(current, name);
+    if (!constant) return nullptr;
+    if (nesting == 0 ? reached.count(name) > 0 : constant->early) return &constant->value;
+    return nullptr;
+}
+
+// A literal, an array or map literal of those, or a table
+bool CompileTimeEvaluationPass::Analysis::constantOperand(const Expression* expr) const {
+    Value value;
+    if (literalValue(expr, value)) return true;
+    switch (expr->kind) {
+        case NodeKind::ArrayLiteral: {
+            const auto& elements = static_cast<const ArrayLiteral*>(expr)->elements;
+            return std::all_of(elements.begin(), elements.end(),
+                               [this](const auto& element) { return constantOperand(element.get()); });
+        }
+        case NodeKind::MapLiteral: {
+            const auto& entries = static_cast<const MapLiteral*>(expr)->entries;
+            return std::all_of(entries.begin(), entries.end(), [this](const auto& entry) {
+                return constantOperand(entry.first.get()) && constantOperand(entry.second.get());
+            });
+        }
+        case NodeKind::Identifier: {
+            const Value* known = siteValue(static_cast<const Identifier*>(expr)->name);
+            return known && !isScalar(*known);
+        }
+        default:
+            return false;
+    }
+}
+
+bool CompileTimeEvaluationPass::Analysis::constantOperands(const Expression* expr) const {
+    switch (expr->kind) {
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            return constantOperand(node->left.get()) && constantOperand(node->right.get());
+        }
+        case NodeKind::UnaryExpression:
+            return constantOperand(static_cast<const UnaryExpression*>(expr)->operand.get());
+        case NodeKind::CallExpression: {
+            const auto& args = static_cast<const CallExpression*>(expr)->arguments;
+            return std::all_of(args.begin(), args.end(), [this](const auto& arg) { return constantOperand(arg.get()); });
+        }
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<const ArrayIndexExpression*>(expr);
+            return constantOperand(node->array.get()) && constantOperand(node->index.get());
+        }
+        case NodeKind::MemberExpression:
+            return constantOperand(static_cast<const MemberExpression*>(expr)->object.get());
+        case NodeKind::InterpolatedString:
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (part.isExpression && !constantOperand(part.expr.get())) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Evaluate `expr` as the initializer of statement `limit` of `unit`, or (with
+// kAnySite) where the rewrite is; false if it cannot be done here
+bool CompileTimeEvaluationPass::Analysis::evaluateAt(const ProgramUnit* unit, size_t limit, const Expression* expr,
+                                                     Value& out) {
+    Evaluation e;
+    e.limit = limit;
+    e.topLevel = nesting == 0;
+    e.fuel = std::min(kFuel, fuel);
+    Frame frame{unit, limit == kAnySite, {}};
+    frame.scopes.emplace_back();
+    bool done = false;
+    try {
+        out = made(evaluate(expr, frame, e), e);
+        done = true;
+    } catch (const NotConstant&) {
+    } catch (const std::exception&) {
+        // Raised when the program runs instead
+    }
+    fuel -= std::min(kFuel, fuel) - e.fuel;
+    return done;
+}
+
+// =============================================================================
+// Evaluation
+// =============================================================================
+
+const Value* CompileTimeEvaluationPass::Analysis::lookup(const std::string& name, Frame& frame,
+                                                         const Evaluation& e) const {
+    for (auto scope = frame.scopes.rbegin(); scope != frame.scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return &it->second;
+    }
+    if (frame.site) return siteValue(name);
+    const Constant* constant = constantOf(frame.unit, name);
+    if (!constant) return nullptr;
+    if (e.limit != kAnySite) return constant->index < e.limit ? &constant->value : nullptr;
+    // A function may run before a late constant is declared, unless it is
+    // called from top-level code that comes after it
+    if (constant->early || (e.topLevel && frame.unit == current && reached.count(name))) {
+        return &constant->value;
+    }
+    return nullptr;
+}
+
+// The local variable an assignment changes
+Value* CompileTimeEvaluationPass::Analysis::variable(const Expression* target, Frame& frame) const {
+    if (target->kind != NodeKind::Identifier) throw NotConstant();
+    const std::string& name = static_cast<const Identifier*>(target)->name;
+    for (auto scope = frame.scopes.rbegin(); scope != frame.scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) return &it->second;
+    }
+    throw NotConstant();
+}
+
+Value CompileTimeEvaluationPass::Analysis::evaluate(const Expression* expr, Frame& frame, Evaluation& e) {
+    spend(e, 1);
+    Value value;
+    if (literalValue(expr, value)) return value;
+    switch (expr->kind) {
+        case NodeKind::Identifier: {
+            const Value* known = lookup(static_cast<const Identifier*>(expr)->name, frame, e);
+            if (!known) throw NotConstant();
+            return *known;
+        }
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            Value left = evaluate(node->left.get(), frame, e);
+            Value right = evaluate(node->right.get(), frame, e);
+            if (node->binaryOp == BinaryOp::Unknown) throw NotConstant();
+            if (left.isInt() && right.isInt() && node->binaryOp != BinaryOp::Div &&
+                intOverflows(node->binaryOp, left.asInt(), right.asInt())) {
+                throw NotConstant();
+            }
+            return made(binaryOperation(node->binaryOp, left, right), e);
+        }
+        case NodeKind::UnaryExpression: {
+            auto* node = static_cast<const UnaryExpression*>(expr);
+            Value operand = evaluate(node->operand.get(), frame, e);
+            if (node->unaryOp == UnaryOp::Unknown ||
+                (node->unaryOp == UnaryOp::Neg && operand.isInt() &&
+                 operand.asInt() == std::numeric_limits<int64_t>::min())) {
+                throw NotConstant();
+            }
+            return unaryOperation(node->unaryOp, operand);
+        }
+        case NodeKind::AssignmentExpression: {
+            auto* node = static_cast<const AssignmentExpression*>(expr);
+            value = evaluate(node->right.get(), frame, e);
+            return *variable(node->left.get(), frame) = value;
+        }
+        case NodeKind::CompoundAssignment: {
+            auto* node = static_cast<const CompoundAssignment*>(expr);
+            Value current = *variable(node->target.get(), frame);
+            value = evaluate(node->value.get(), frame, e);
+            if (current.isInt() && value.isInt() && intOverflows(node->binaryOp, current.asInt(), value.asInt())) {
+                throw NotConstant();
+            }
+            return *variable(node->target.get(), frame) = made(compoundOperation(node->binaryOp, current, value), e);
+        }
+        case NodeKind::UpdateExpression: {
+            auto* node = static_cast<const UpdateExpression*>(expr);
+            Value* target = variable(node->operand.get(), frame);
+            Value current = *target;
+            if (current.isInt() && intOverflows(BinaryOp::Add, current.asInt(), node->increment ? 1 : -1)) {
+                throw NotConstant();
+            }
+            *target = updateOperation(current, node->increment);
+            return node->prefix ? *target : current;
+        }
+        case NodeKind::CallExpression: {
+            auto* node = static_cast<const CallExpression*>(expr);
+            std::vector<Value> args;
+            args.reserve(node->arguments.size());
+            for (const auto& arg : node->arguments) {
+                args.push_back(evaluate(arg.get(), frame, e));
+            }
+            return call(node, args, frame, e);
+        }
+        case NodeKind::ArrayLiteral: {
+            auto elements = Value::make<Value::ArrayType>();
+            for (const auto& element : static_cast<const ArrayLiteral*>(expr)->elements) {
+                elements->push_back(evaluate(element.get(), frame, e));
+            }
+            return made(Value(elements), e);
+        }
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<const ArrayIndexExpression*>(expr);
+            Value array = evaluate(node->array.get(), frame, e);
+            Value index = evaluate(node->index.get(), frame, e);
+            if (!array.isArray() || !index.isInt() ||
+                static_cast<size_t>(index.asInt()) >= array.asArray()->size()) {
+                throw NotConstant();
+            }
+            return (*array.asArray())[static_cast<size_t>(index.asInt())];
+        }
+        case NodeKind::ArrayAssignmentExpression: {
+            auto* node = static_cast<const ArrayAssignmentExpression*>(expr);
+            Value array = evaluate(node->array.get(), frame, e);
+            Value index = evaluate(node->index.get(), frame, e);
+            value = evaluate(node->value.get(), frame, e);
+            if (!array.isArray() || !index.isInt() ||
+                static_cast<size_t>(index.asInt()) >= array.asArray()->size()) {
+                throw NotConstant();
+            }
+            return (*array.asArray())[static_cast<size_t>(index.asInt())] = value;
+        }
+        case NodeKind::InterpolatedString: {
+            std::string text;
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (!part.isExpression) {
+                    text += part.text;
+                    continue;
+                }
+                Value partValue = evaluate(part.expr.get(), frame, e);
+                text += partValue.isString() ? partValue.asString() : partValue.toString();
+                if (text.size() > kMaxLength) throw NotConstant();
+            }
+            return made(Value(std::move(text)), e);
+        }
+        case NodeKind::MapLiteral: {
+            auto* node = static_cast<const MapLiteral*>(expr);
+            auto entries = Value::make<Value::MapType>();
+            for (size_t i = 0; i < node->entries.size(); ++i) {
+                Symbol key = node->keySymbols[i];
+                if (key.empty()) {
+                    Value keyValue = evaluate(node->entries[i].first.get(), frame, e);
+                    key = keyValue.isString() ? Symbol(keyValue.asString()) : Symbol(keyValue.toString());
+                }
+                (*entries)[key] = evaluate(node->entries[i].second.get(), frame, e);
+            }
+            return made(Value(entries), e);
+        }
+        case NodeKind::MemberExpression: {
+            auto* node = static_cast<const MemberExpression*>(expr);
+            Value object = evaluate(node->object.get(), frame, e);
+            InlineCache cache;
+            InlineCacheStats stats;
+            return loadMember(object, node->memberSymbol, cache, stats);
+        }
+        case NodeKind::MatchExpression: {
+            auto* node = static_cast<const MatchExpression*>(expr);
+            Value subject = evaluate(node->subject.get(), frame, e);
+            for (const MatchCase& matchCase : node->cases) {
+                if (!matchCase.pattern || matchesPattern(subject, evaluate(matchCase.pattern.get(), frame, e))) {
+                    return evaluate(matchCase.result.get(), frame, e);
+                }
+            }
+            return Value();
+        }
+        default:
+            // Lambdas, methods and `self` need the program's own values
+            throw NotConstant();
+    }
+}
+
+Value CompileTimeEvaluationPass::Analysis::call(const CallExpression* node, std::vector<Value>& args,
+                                                const Frame& frame, Evaluation& e) {
+    auto candidate = candidates.find(node->callee);
+    if (candidate != candidates.end()) {
+        const ProgramUnit* unit = candidate->second.first;
+        const FunctionDeclaration* decl = candidate->second.second;
+        if (decl->parameters.size() != args.size() || e.depth == kMaxDepth) throw NotConstant();
+        // A constant's initializer may only call what its unit declared before it
+        if (e.limit != kAnySite && (unit != frame.unit || functionIndex.at(decl) >= e.limit)) throw NotConstant();
+
+        Frame callee{unit, false, {}};
+        callee.scopes.emplace_back();
+        for (size_t i = 0; i < args.size(); ++i) {
+            callee.scopes.back()[decl->parameters[i]] = std::move(args[i]);
+        }
+        ++e.depth;
+        for (const auto& stmt : decl->body->statements) {
+            execute(stmt.get(), callee, e);
+            if (e.flow != Evaluation::Flow::Normal) break;
+        }
+        --e.depth;
+        // Only a return carries a value; a stray break or continue stops at the call
+        Value result;
+        if (e.flow == Evaluation::Flow::Return) result = std::move(e.returned);
+        e.flow = Evaluation::Flow::Normal;
+        return result;
+    }
+
+    // Any other name the program declares may be bound to anything
+    if (names.count(node->callee)) throw NotConstant();
+    BuiltinEffect effect = builtinEffect(node->callee);
+    if (effect > BuiltinEffect::Mutates || node->callee == "__builtin_regex_test") throw NotConstant();
+    if (node->callee == "range" && !args.empty()) {
+        int64_t start = args.size() > 1 && args[0].isInt() ? args[0].asInt() : 0;
+        int64_t end = args[args.size() > 1 ? 1 : 0].isInt() ? args[args.size() > 1 ? 1 : 0].asInt() : 0;
+        if (end > start && static_cast<uint64_t>(end) - static_cast<uint64_t>(start) > kMaxLength) throw NotConstant();
+    }
+    if (node->callee == "abs" && !args.empty() && args[0].isInt() &&
+        args[0].asInt() == std::numeric_limits<int64_t>::min()) {
+        throw NotConstant();
+    }
+    Value result = made(runtime.callFunction(node->calleeSymbol, args), e);
+    if (effect == BuiltinEffect::Mutates && !args.empty()) made(args[0], e);
+    return result;
+}
+
+void CompileTimeEvaluationPass::Analysis::execute(const Statement* stmt, Frame& frame, Evaluation& e) {
+    using Flow = Evaluation::Flow;
+    spend(e, 1);
+    switch (stmt->kind) {
+        case NodeKind::VariableDeclaration: {
+            auto* node = static_cast<const VariableDeclaration*>(stmt);
+            Value value;
+            if (node->initializer) value = evaluate(node->initializer.get(), frame, e);
+            frame.scopes.back()[node->name] = std::move(value);
+            break;
+        }
+        case NodeKind::ExpressionStatement:
+            evaluate(static_cast<const ExpressionStatement*>(stmt)->expression.get(), frame, e);
+            break;
+        case NodeKind::BlockStatement:
+            frame.scopes.emplace_back();
+            for (const auto& inner : static_cast<const BlockStatement*>(stmt)->statements) {
+                execute(inner.get(), frame, e);
+                if (e.flow != Flow::Normal) break;
+            }
+            frame.scopes.pop_back();
+            break;
+        case NodeKind::IfStatement: {
+            auto* node = static_cast<const IfStatement*>(stmt);
+            if (evaluate(node->condition.get(), frame, e).isTruthy()) {
+                execute(node->thenBranch.get(), frame, e);
+            } else if (node->elseBranch) {
+                execute(node->elseBranch.get(), frame, e);
+            }
+            break;
+        }
+        case NodeKind::WhileStatement: {
+            auto* node = static_cast<const WhileStatement*>(stmt);
+            while (evaluate(node->condition.get(), frame, e).isTruthy()) {
+                execute(node->body.get(), frame, e);
+                if (e.flow == Flow::Break || e.flow == Flow::Continue) {
+                    bool stop = e.flow == Flow::Break;
+                    e.flow = Flow::Normal;
+                    if (stop) break;
+                } else if (e.flow == Flow::Return) {
+                    break;
+                }
+            }
+            break;
+        }
+        case NodeKind::ForStatement: {
+            auto* node = static_cast<const ForStatement*>(stmt);
+            frame.scopes.emplace_back();
+            if (node->initializer) execute(node->initializer.get(), frame, e);
+            while (!node->condition || evaluate(node->condition.get(), frame, e).isTruthy()) {
+                execute(node->body.get(), frame, e);
+                if (e.flow == Flow::Break) {
+                    e.flow = Flow::Normal;
+                    break;
+                }
+                if (e.flow == Flow::Return) break;
+                e.flow = Flow::Normal;  // Continue runs the increment
+                if (node->increment) evaluate(node->increment.get(), frame, e);
+            }
+            frame.scopes.pop_back();
+            break;
+        }
+        case NodeKind::BreakStatement:
+            e.flow = Flow::Break;
+            break;
+        case NodeKind::ContinueStatement:
+            e.flow = Flow::Continue;
+            break;
+        case NodeKind::ReturnStatement: {
+            auto* node = static_cast<const ReturnStatement*>(stmt);
+            e.returned = node->value ? evaluate(node->value.get(), frame, e) : Value();
+            e.flow = Flow::Return;
+            break;
+        }
+        default:
+            // Nested functions, structs, imports and try blocks
+            throw NotConstant();
+    }
+}
+
+// =============================================================================
+// Pass
+// =============================================================================
+
+CompileTimeEvaluationPass::CompileTimeEvaluationPass() : analysis(std::make_unique<Analysis>()) {}
+CompileTimeEvaluationPass::~CompileTimeEvaluationPass() = default;
+
+bool CompileTimeEvaluationPass::dependsOnImports() const {
+    return analysis->units.size() > 1 && analysis->rewroteProgram;
+}
+
+void CompileTimeEvaluationPass::begin(std::vector<std::unique_ptr<Statement>>& statements,
+                                      const std::string& moduleName, const std::string& modulePath) {
+    Analysis& a = *analysis;
+    a.top = &statements;
+    a.current = nullptr;
+    a.reached.clear();
+    a.locals.clear();
+    a.nesting = 0;
+    if (moduleName.empty()) {
+        a.rewroteProgram = false;
+        a.analyze(statements);
+        if (a.complete) a.current = a.units[0].get();
+    } else if (a.complete) {
+        // What the module's constants are was worked out with the program
+        a.fuel = kRunFuel;
+        a.current = a.findModule(moduleName, modulePath);
+    }
+}
+
+void CompileTimeEvaluationPass::fold(Expression* node, bool freshResult) {
+    Analysis& a = *analysis;
+    Value value;
+    if (!a.current || !a.constantOperands(node) || !a.evaluateAt(a.current, Analysis::kAnySite, node, value)) {
+        return;
+    }
+    // Arrays and maps a builtin or operator returns may be ones it was
+    // passed; only a function's are known to be new
+    if (!isScalar(value) && !freshResult) return;
+    std::unordered_set<const void*> seen;
+    size_t budget = kMaxLiteral;
+    if (auto literal = literalFor(value, seen, budget)) {
+        replace(std::move(literal));
+        if (a.current == a.units[0].get()) a.rewroteProgram = true;
+    }
+}
+
+void CompileTimeEvaluationPass::visit(Identifier* node) {
+    Analysis& a = *analysis;
+    if (!a.current) return;
+    const Value* value = a.siteValue(node->name);
+    if (!value || !isScalar(*value)) return;
+    std::unordered_set<const void*> seen;
+    size_t budget = 0;
+    if (auto literal = literalFor(*value, seen, budget)) {
+        replace(std::move(literal));
+        if (a.current == a.units[0].get()) a.rewroteProgram = true;
+    }
+}
+
+void CompileTimeEvaluationPass::visit(BinaryExpression* node) {
+    ASTRewriter::visit(node);
+    fold(node, false);
+}
+
+void CompileTimeEvaluationPass::visit(UnaryExpression* node) {
+    ASTRewriter::visit(node);
+    fold(node, false);
+}
+
+void CompileTimeEvaluationPass::visit(CallExpression* node) {
+    ASTRewriter::visit(node);
+    fold(node, analysis->candidates.count(node->callee) > 0);
+}
+
+void CompileTimeEvaluationPass::visit(ArrayIndexExpression* node) {
+    ASTRewriter::visit(node);
+    fold(node, false);
+}
+
+void CompileTimeEvaluationPass::visit(InterpolatedString* node) {
+    ASTRewriter::visit(node);
+    fold(node, false);
+}
+
+void CompileTimeEvaluationPass::visit(MemberExpression* node) {
+    ASTRewriter::visit(node);
+    fold(node, false);
+}
+
+void CompileTimeEvaluationPass::visit(LambdaExpression* node) {
+    ++analysis->nesting;
+    ASTRewriter::visit(node);
+    --analysis->nesting;
+}
+
+void CompileTimeEvaluationPass::visit(FunctionDeclaration* node) {
+    ++analysis->nesting;
+    ASTRewriter::visit(node);
+    --analysis->nesting;
+}
+
+void CompileTimeEvaluationPass::visitStatements(std::vector<std::unique_ptr<Statement>>& statements) {
+    Analysis& a = *analysis;
+    if (!a.current) {
+        ASTRewriter::visitStatements(statements);
+        return;
+    }
+    bool topLevel = &statements == a.top;
+    std::vector<std::string> declared;  // `const`s of this block
+    for (auto& stmt : statements) {
+        rewrite(stmt);
+        if (stmt->kind != NodeKind::VariableDeclaration) continue;
+        auto* decl = static_cast<VariableDeclaration*>(stmt.get());
+        if (!decl->isConst) continue;
+        if (topLevel) {
+            if (a.constantOf(a.current, decl->name)) a.reached.insert(decl->name);
+            continue;
+        }
+        // A `const` declared once is the only thing its name means in its unit
+        Value value;
+        auto count = a.current->declared.find(decl->name);
+        if (decl->initializer && literalValue(decl->initializer.get(), value) && count != a.current->declared.end() &&
+            count->second == 1 && !a.assigned.count(decl->name) && !a.locals.count(decl->name)) {
+            a.locals[decl->name] = {value, a.nesting};
+            declared.push_back(decl->name);
+        }
+    }
+    for (const std::string& name : declared) {
+        a.locals.erase(name);
+    }
+}
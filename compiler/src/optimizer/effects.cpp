@@ -0,0 +1,143 @@
+#include "../../include/optimizer.h"
+#include <unordered_map>
+
+namespace {
+
+// Every builtin the interpreter defines, by what a call to it can do
+const std::unordered_map<std::string, BuiltinEffect> kBuiltinEffects = {
+    // Values computed from the arguments alone
+    {"len", BuiltinEffect::None},
+    {"str", BuiltinEffect::None},
+    {"int", BuiltinEffect::None},
+    {"float", BuiltinEffect::None},
+    {"indexOf", BuiltinEffect::None},
+    {"contains", BuiltinEffect::None},
+    {"typeof", BuiltinEffect::None},
+    {"abs", BuiltinEffect::None},
+    {"sqrt", BuiltinEffect::None},
+    {"pow", BuiltinEffect::None},
+    {"sin", BuiltinEffect::None},
+    {"cos", BuiltinEffect::None},
+    {"exp", BuiltinEffect::None},
+    {"ln", BuiltinEffect::None},
+    {"floor", BuiltinEffect::None},
+    {"ceil", BuiltinEffect::None},
+    {"round", BuiltinEffect::None},
+    {"__builtin_substring", BuiltinEffect::None},
+    {"__builtin_base64url_encode", BuiltinEffect::None},
+    {"__builtin_base64url_decode", BuiltinEffect::None},
+    {"__builtin_regex_test", BuiltinEffect::None},
+    {"__builtin_join", BuiltinEffect::None},
+    {"__builtin_trim", BuiltinEffect::None},
+    {"__builtin_lowercase", BuiltinEffect::None},
+    {"__builtin_uppercase", BuiltinEffect::None},
+    {"__builtin_starts_with", BuiltinEffect::None},
+    {"__builtin_ends_with", BuiltinEffect::None},
+    {"__builtin_contains", BuiltinEffect::None},
+    {"__builtin_replace_all", BuiltinEffect::None},
+    {"__builtin_index_of", BuiltinEffect::None},
+    {"__builtin_json_stringify", BuiltinEffect::None},
+    {"__builtin_secure_compare", BuiltinEffect::None},
+
+    // Results built from the arguments: a new array or map on each call, but
+    // `text` returns its argument itself (as the body of a response)
+    {"slice", BuiltinEffect::Allocates},
+    {"range", BuiltinEffect::Allocates},
+    {"json", BuiltinEffect::Allocates},
+    {"html", BuiltinEffect::Allocates},
+    {"text", BuiltinEffect::Allocates},
+    {"__builtin_split", BuiltinEffect::Allocates},
+    {"__builtin_json_parse", BuiltinEffect::Allocates},
+    {"__builtin_keys", BuiltinEffect::Allocates},
+
+    // Change the array passed first
+    {"append", BuiltinEffect::Mutates},
+    {"push", BuiltinEffect::Mutates},
+    {"pop", BuiltinEffect::Mutates},
+    {"shift", BuiltinEffect::Mutates},
+    {"unshift", BuiltinEffect::Mutates},
+
+    // The world outside the program: I/O, time, the OS, native memory, devices
+    {"print", BuiltinEffect::External},
+    {"input", BuiltinEffect::External},
+    {"read_file", BuiltinEffect::External},
+    {"write_file", BuiltinEffect::External},
+    {"gemini_set_api_key", BuiltinEffect::External},
+    {"gemini_has_api_key", BuiltinEffect::External},
+    {"gemini_complete", BuiltinEffect::External},
+    {"gemini_chat", BuiltinEffect::External},
+    {"http_get", BuiltinEffect::External},
+    {"http_post", BuiltinEffect::External},
+    {"use", BuiltinEffect::External},
+    {"__builtin_exec", BuiltinEffect::External},
+    {"__builtin_shell", BuiltinEffect::External},
+    {"__builtin_env_get", BuiltinEffect::External},
+    {"__builtin_env_set", BuiltinEffect::External},
+    {"__builtin_getcwd", BuiltinEffect::External},
+    {"__builtin_chdir", BuiltinEffect::External},
+    {"__builtin_platform", BuiltinEffect::External},
+    {"__builtin_arch", BuiltinEffect::External},
+    {"__builtin_hostname", BuiltinEffect::External},
+    {"__builtin_username", BuiltinEffect::External},
+    {"__builtin_homedir", BuiltinEffect::External},
+    {"__builtin_tempdir", BuiltinEffect::External},
+    {"__builtin_path_exists", BuiltinEffect::External},
+    {"__builtin_is_file", BuiltinEffect::External},
+    {"__builtin_is_dir", BuiltinEffect::External},
+    {"__builtin_listdir", BuiltinEffect::External},
+    {"__builtin_mkdir", BuiltinEffect::External},
+    {"__builtin_remove", BuiltinEffect::External},
+    {"__builtin_rmdir", BuiltinEffect::External},
+    {"__builtin_rename", BuiltinEffect::External},
+    {"__builtin_getpid", BuiltinEffect::External},
+    {"__builtin_exit", BuiltinEffect::External},
+    {"__builtin_time", BuiltinEffect::External},
+    {"__builtin_time_ms", BuiltinEffect::External},
+    {"__builtin_sleep", BuiltinEffect::External},
+    {"__builtin_which", BuiltinEffect::External},
+    {"__builtin_tcp_connect", BuiltinEffect::External},
+    {"__builtin_tcp_send", BuiltinEffect::External},
+    {"__builtin_tcp_recv", BuiltinEffect::External},
+    {"__builtin_tcp_close", BuiltinEffect::External},
+    {"__builtin_tcp_listen", BuiltinEffect::External},
+    {"__builtin_tcp_accept", BuiltinEffect::External},
+    {"__builtin_dns_lookup", BuiltinEffect::External},
+    {"__builtin_port_check", BuiltinEffect::External},
+    {"__builtin_get_local_ip", BuiltinEffect::External},
+    {"__builtin_udp_create", BuiltinEffect::External},
+    {"__builtin_udp_sendto", BuiltinEffect::External},
+    {"__builtin_udp_close", BuiltinEffect::External},
+    {"__builtin_random_bytes", BuiltinEffect::External},
+    {"__builtin_uuid", BuiltinEffect::External},
+    {"__builtin_alloc_buffer", BuiltinEffect::External},
+    {"__builtin_free_buffer", BuiltinEffect::External},
+    {"__builtin_buffer_write", BuiltinEffect::External},
+    {"__builtin_buffer_read", BuiltinEffect::External},
+    {"__builtin_load_library", BuiltinEffect::External},
+    {"__builtin_unload_library", BuiltinEffect::External},
+    {"__builtin_get_proc_address", BuiltinEffect::External},
+    {"__builtin_mmap", BuiltinEffect::External},
+    {"__builtin_munmap", BuiltinEffect::External},
+    {"__builtin_gpio_mode", BuiltinEffect::External},
+    {"__builtin_gpio_write", BuiltinEffect::External},
+    {"__builtin_gpio_read", BuiltinEffect::External},
+    {"__builtin_i2c_open", BuiltinEffect::External},
+    {"__builtin_i2c_write", BuiltinEffect::External},
+    {"__builtin_i2c_read", BuiltinEffect::External},
+    {"__builtin_i2c_close", BuiltinEffect::External},
+    {"__builtin_spi_open", BuiltinEffect::External},
+    {"__builtin_spi_transfer", BuiltinEffect::External},
+    {"__builtin_spi_close", BuiltinEffect::External},
+
+    // `route` stores a handler (in a global it defines) for `serve` to call
+    {"route", BuiltinEffect::CallsBack},
+    {"serve", BuiltinEffect::CallsBack},
+    {"__builtin_ffi_call", BuiltinEffect::CallsBack},
+};
+
+}  // namespace
+
+BuiltinEffect builtinEffect(const std::string& name) {
+    auto it = kBuiltinEffects.find(name);
+    return it != kBuiltinEffects.end() ? it->second : BuiltinEffect::CallsBack;
+}
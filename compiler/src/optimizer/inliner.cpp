@@ -0,0 +1,764 @@
+#include "../../include/optimizer.h"
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+namespace {
+
+using Statements = std::vector<std::unique_ptr<Statement>>;
+using Unit = ProgramUnit;
+
+bool isLiteral(const Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+        case NodeKind::FloatLiteral:
+        case NodeKind::StringLiteral:
+        case NodeKind::BooleanLiteral:
+        case NodeKind::NullLiteral:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Calls `visit` on each subexpression of `expr` in evaluation order. Lambda
+// bodies are a scope of their own and are not visited.
+template <typename Visit>
+void forEachChild(const Expression* expr, Visit&& visit) {
+    switch (expr->kind) {
+        case NodeKind::BinaryExpression:
+            visit(static_cast<const BinaryExpression*>(expr)->left.get());
+            visit(static_cast<const BinaryExpression*>(expr)->right.get());
+            break;
+        case NodeKind::UnaryExpression:
+            visit(static_cast<const UnaryExpression*>(expr)->operand.get());
+            break;
+        case NodeKind::AssignmentExpression:
+            visit(static_cast<const AssignmentExpression*>(expr)->right.get());
+            break;
+        case NodeKind::CallExpression:
+            for (const auto& arg : static_cast<const CallExpression*>(expr)->arguments) visit(arg.get());
+            break;
+        case NodeKind::ArrayLiteral:
+            for (const auto& element : static_cast<const ArrayLiteral*>(expr)->elements) visit(element.get());
+            break;
+        case NodeKind::ArrayIndexExpression:
+            visit(static_cast<const ArrayIndexExpression*>(expr)->array.get());
+            visit(static_cast<const ArrayIndexExpression*>(expr)->index.get());
+            break;
+        case NodeKind::ArrayAssignmentExpression: {
+            auto* node = static_cast<const ArrayAssignmentExpression*>(expr);
+            visit(node->array.get());
+            visit(node->index.get());
+            visit(node->value.get());
+            break;
+        }
+        case NodeKind::MatchExpression:
+            visit(static_cast<const MatchExpression*>(expr)->subject.get());
+            for (const MatchCase& matchCase : static_cast<const MatchExpression*>(expr)->cases) {
+                if (matchCase.pattern) visit(matchCase.pattern.get());
+                visit(matchCase.result.get());
+            }
+            break;
+        case NodeKind::CompoundAssignment:
+            visit(static_cast<const CompoundAssignment*>(expr)->value.get());
+            break;
+        case NodeKind::InterpolatedString:
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (part.isExpression) visit(part.expr.get());
+            }
+            break;
+        case NodeKind::MapLiteral:
+            for (const auto& entry : static_cast<const MapLiteral*>(expr)->entries) {
+                visit(entry.first.get());
+                visit(entry.second.get());
+            }
+            break;
+        case NodeKind::MemberExpression:
+            visit(static_cast<const MemberExpression*>(expr)->object.get());
+            break;
+        case NodeKind::MethodCallExpression:
+            visit(static_cast<const MethodCallExpression*>(expr)->object.get());
+            for (const auto& arg : static_cast<const MethodCallExpression*>(expr)->arguments) visit(arg.get());
+            break;
+        default:
+            break;
+    }
+}
+
+size_t countNodes(const Expression* expr) {
+    size_t count = 1;
+    forEachChild(expr, [&](const Expression* child) { count += countNodes(child); });
+    return count;
+}
+
+// Every identifier `expr` reads
+void collectNames(const Expression* expr, std::vector<std::string>& names) {
+    if (expr->kind == NodeKind::Identifier) {
+        names.push_back(static_cast<const Identifier*>(expr)->name);
+    }
+    forEachChild(expr, [&](const Expression* child) { collectNames(child, names); });
+}
+
+// Whether evaluating `expr` can assign a variable: directly, through a lambda
+// it creates, or in a call `rebindingCall` accepts
+bool mayRebind(const Expression* expr, const std::function<bool(const std::string&)>& rebindingCall) {
+    switch (expr->kind) {
+        case NodeKind::AssignmentExpression:
+        case NodeKind::ArrayAssignmentExpression:
+        case NodeKind::CompoundAssignment:
+        case NodeKind::UpdateExpression:
+        case NodeKind::LambdaExpression:
+        case NodeKind::MethodCallExpression:
+            return true;
+        case NodeKind::CallExpression:
+            if (rebindingCall(static_cast<const CallExpression*>(expr)->callee)) return true;
+            break;
+        default:
+            break;
+    }
+    bool rebinds = false;
+    forEachChild(expr, [&](const Expression* child) { rebinds = rebinds || mayRebind(child, rebindingCall); });
+    return rebinds;
+}
+
+// Checks that the expressions bound to `names` can each be evaluated where its
+// name is used instead of before the body runs: every name is used exactly
+// once, not in a match case, in binding order, and nothing that can raise or
+// have an effect runs until the last of them has been used
+class DeferredBindings {
+public:
+    explicit DeferredBindings(std::vector<std::string> names) : names(std::move(names)) {}
+
+    void walk(const Expression* expr, bool conditional = false) {
+        switch (expr->kind) {
+            case NodeKind::IntegerLiteral:
+            case NodeKind::FloatLiteral:
+            case NodeKind::StringLiteral:
+            case NodeKind::BooleanLiteral:
+            case NodeKind::NullLiteral:
+                return;
+            case NodeKind::Identifier: {
+                auto it = std::find(names.begin(), names.end(), static_cast<const Identifier*>(expr)->name);
+                if (it == names.end()) return;
+                if (conditional || static_cast<size_t>(it - names.begin()) != next) {
+                    ok = false;
+                }
+                ++next;
+                return;
+            }
+            case NodeKind::BinaryExpression: {
+                auto* node = static_cast<const BinaryExpression*>(expr);
+                walk(node->left.get(), conditional);
+                walk(node->right.get(), conditional);
+                // Comparing for equality and `&&`/`||` take any operands
+                if (node->binaryOp != BinaryOp::Eq && node->binaryOp != BinaryOp::Ne &&
+                    node->binaryOp != BinaryOp::And && node->binaryOp != BinaryOp::Or) {
+                    event();
+                }
+                return;
+            }
+            case NodeKind::UnaryExpression: {
+                auto* node = static_cast<const UnaryExpression*>(expr);
+                walk(node->operand.get(), conditional);
+                if (node->unaryOp != UnaryOp::Not) event();
+                return;
+            }
+            case NodeKind::ArrayLiteral:
+            case NodeKind::MapLiteral:
+            case NodeKind::InterpolatedString:
+                forEachChild(expr, [&](const Expression* child) { walk(child, conditional); });
+                return;
+            case NodeKind::MatchExpression: {
+                auto* node = static_cast<const MatchExpression*>(expr);
+                walk(node->subject.get(), conditional);
+                event();
+                for (const MatchCase& matchCase : node->cases) {
+                    if (matchCase.pattern) walk(matchCase.pattern.get(), true);
+                    walk(matchCase.result.get(), true);
+                }
+                return;
+            }
+            case NodeKind::CallExpression:
+            case NodeKind::MethodCallExpression:
+            case NodeKind::MemberExpression:
+            case NodeKind::ArrayIndexExpression:
+                forEachChild(expr, [&](const Expression* child) { walk(child, conditional); });
+                event();
+                return;
+            default:
+                ok = false;
+                return;
+        }
+    }
+
+    bool valid() const { return ok && next == names.size(); }
+
+private:
+    std::vector<std::string> names;
+    size_t next = 0;  // Index of the next name to be used
+    bool ok = true;
+
+    void event() {
+        if (next < names.size()) ok = false;
+    }
+};
+
+// A function body ready to be inlined: its parameters are substituted and its
+// `let`s renamed at each call site
+struct Template {
+    const Unit* unit = nullptr;
+    std::vector<std::string> parameters;
+    std::vector<std::pair<std::string, std::unique_ptr<Expression>>> lets;
+    std::vector<std::pair<std::unique_ptr<Expression>, std::unique_ptr<Expression>>> branches;  // if (first) return second
+    std::unique_ptr<Expression> result;  // Returned if no branch is taken
+    bool portable = false;  // Reads no name declared anywhere in the program, so it can go in any unit
+    bool rebinds = false;   // May assign variables while it runs
+
+    bool isExpression() const { return lets.empty() && branches.empty(); }
+
+    template <typename Visit>
+    void forEachExpression(Visit&& visit) {
+        for (auto& let : lets) visit(let.second);
+        for (auto& branch : branches) {
+            visit(branch.first);
+            visit(branch.second);
+        }
+        visit(result);
+    }
+};
+
+// Reads the `return` statements that end a body (from statement `i` on): `if`
+// statements whose then branch only returns, ending in a return or an `else`
+bool readReturns(Statements& statements, size_t i, Template& out) {
+    if (i == statements.size()) {
+        out.result = std::make_unique<NullLiteral>();
+        return true;
+    }
+    Statement* stmt = statements[i].get();
+    if (stmt->kind == NodeKind::ReturnStatement) {
+        if (i + 1 != statements.size()) return false;
+        auto* ret = static_cast<ReturnStatement*>(stmt);
+        out.result = ret->value ? cloneExpression(ret->value.get()) : std::make_unique<NullLiteral>();
+        return out.result != nullptr;
+    }
+    if (stmt->kind != NodeKind::IfStatement) return false;
+    auto* ifStmt = static_cast<IfStatement*>(stmt);
+    const Statements& then = ifStmt->thenBranch->statements;
+    if (then.size() != 1 || then[0]->kind != NodeKind::ReturnStatement) return false;
+    auto* ret = static_cast<ReturnStatement*>(then[0].get());
+    auto condition = cloneExpression(ifStmt->condition.get());
+    auto value = ret->value ? cloneExpression(ret->value.get()) : std::make_unique<NullLiteral>();
+    if (!condition || !value) return false;
+    out.branches.emplace_back(std::move(condition), std::move(value));
+    if (!ifStmt->elseBranch) {
+        return readReturns(statements, i + 1, out);
+    }
+    return i + 1 == statements.size() && readReturns(ifStmt->elseBranch->statements, 0, out);
+}
+
+// Inlines calls inside a template, in expression form only
+class TemplateInliner : public ASTRewriter {
+public:
+    explicit TemplateInliner(std::function<std::unique_ptr<Expression>(CallExpression*)> inlineCall)
+        : inlineCall(std::move(inlineCall)) {}
+
+    void inlineInto(std::unique_ptr<Expression>& expr) { rewrite(expr); }
+
+    void visit(CallExpression* node) override {
+        ASTRewriter::visit(node);
+        if (auto inlined = inlineCall(node)) {
+            replace(std::move(inlined));
+        }
+    }
+
+private:
+    std::function<std::unique_ptr<Expression>(CallExpression*)> inlineCall;
+};
+
+// The first call in `expr`'s evaluation order that `wanted` accepts, outside
+// lambdas and match cases. `before` gets the expressions evaluated ahead of
+// it, in order, that are not part of it.
+std::unique_ptr<Expression>* findCall(std::unique_ptr<Expression>& expr,
+                                      std::vector<std::unique_ptr<Expression>*>& before,
+                                      const std::function<bool(CallExpression*)>& wanted) {
+    size_t entry = before.size();
+    std::unique_ptr<Expression>* found = nullptr;
+    auto search = [&](std::unique_ptr<Expression>& child) {
+        if (found) return;
+        size_t mark = before.size();
+        found = findCall(child, before, wanted);
+        if (!found) {
+            before.resize(mark);
+            before.push_back(&child);
+        }
+    };
+    switch (expr->kind) {
+        case NodeKind::BinaryExpression:
+            search(static_cast<BinaryExpression*>(expr.get())->left);
+            search(static_cast<BinaryExpression*>(expr.get())->right);
+            break;
+        case NodeKind::UnaryExpression:
+            search(static_cast<UnaryExpression*>(expr.get())->operand);
+            break;
+        case NodeKind::AssignmentExpression: {
+            auto* node = static_cast<AssignmentExpression*>(expr.get());
+            if (node->left->kind == NodeKind::Identifier) search(node->right);
+            break;
+        }
+        case NodeKind::CallExpression: {
+            auto* node = static_cast<CallExpression*>(expr.get());
+            for (auto& arg : node->arguments) search(arg);
+            if (!found && wanted(node)) {
+                // Its arguments are its own, not evaluated before it
+                before.resize(entry);
+                found = &expr;
+            }
+            break;
+        }
+        case NodeKind::ArrayLiteral:
+            for (auto& element : static_cast<ArrayLiteral*>(expr.get())->elements) search(element);
+            break;
+        case NodeKind::ArrayIndexExpression:
+            search(static_cast<ArrayIndexExpression*>(expr.get())->array);
+            search(static_cast<ArrayIndexExpression*>(expr.get())->index);
+            break;
+        case NodeKind::MatchExpression:
+            search(static_cast<MatchExpression*>(expr.get())->subject);
+            break;
+        case NodeKind::InterpolatedString:
+            for (auto& part : static_cast<InterpolatedString*>(expr.get())->parts) {
+                if (part.isExpression) search(part.expr);
+            }
+            break;
+        case NodeKind::MapLiteral:
+            for (auto& entry : static_cast<MapLiteral*>(expr.get())->entries) {
+                search(entry.first);
+                search(entry.second);
+            }
+            break;
+        case NodeKind::MemberExpression:
+            search(static_cast<MemberExpression*>(expr.get())->object);
+            break;
+        case NodeKind::MethodCallExpression: {
+            auto* node = static_cast<MethodCallExpression*>(expr.get());
+            search(node->object);
+            for (auto& arg : node->arguments) search(arg);
+            break;
+        }
+        default:
+            break;
+    }
+    if (!found) before.resize(entry);
+    return found;
+}
+
+// The expression a statement evaluates first, if a call in it can be inlined
+// ahead of the statement
+std::unique_ptr<Expression>* rootExpression(Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::ExpressionStatement:
+            return &static_cast<ExpressionStatement*>(stmt)->expression;
+        case NodeKind::VariableDeclaration: {
+            auto* decl = static_cast<VariableDeclaration*>(stmt);
+            return decl->initializer ? &decl->initializer : nullptr;
+        }
+        case NodeKind::ReturnStatement: {
+            auto* ret = static_cast<ReturnStatement*>(stmt);
+            return ret->value ? &ret->value : nullptr;
+        }
+        case NodeKind::IfStatement:
+            return &static_cast<IfStatement*>(stmt)->condition;
+        default:
+            return nullptr;
+    }
+}
+
+std::unique_ptr<Statement> declare(const std::string& name, std::unique_ptr<Expression> value, uint32_t line) {
+    auto decl = std::make_unique<VariableDeclaration>(name, std::move(value));
+    decl->line = line;
+    return decl;
+}
+
+std::unique_ptr<Statement> assign(const std::string& name, std::unique_ptr<Expression> value, uint32_t line) {
+    auto stmt = std::make_unique<ExpressionStatement>(
+        std::make_unique<AssignmentExpression>(std::make_unique<Identifier>(name), std::move(value)));
+    stmt->line = line;
+    return stmt;
+}
+
+}  // namespace
+
+// =============================================================================
+// Program analysis
+// =============================================================================
+
+struct FunctionInliningPass::Analysis : ProgramUnits {
+    // Templates of the candidates, once built
+    std::unordered_map<std::string, std::unique_ptr<Template>> templates;
+    std::vector<std::string> building;  // Templates being built, outermost first
+    std::unordered_set<std::string> recursive;
+
+    // The statements being rewritten
+    const Statements* top = nullptr;
+    const Unit* current = nullptr;
+    size_t nextName = 0;
+    bool inlinedIntoProgram = false;
+
+    void analyze(Statements& program);
+
+    const Template* templateFor(const std::string& name);
+    std::unique_ptr<Template> buildTemplate(const Unit& unit, FunctionDeclaration* decl);
+    const Template* usableTemplate(const CallExpression* call);
+
+    std::unique_ptr<Expression> inlineExpression(CallExpression* call, const Unit* site);
+    bool inlineStatement(std::unique_ptr<Statement>& stmt, Statements& generated);
+    void inlineStatements(Statements& statements);
+    std::string freshName() { return "__inline" + std::to_string(++nextName); }
+
+    // Whether calling `callee` can assign a variable: a builtin that calls
+    // back into the program, or a function that is not a template that can't
+    bool rebindingCall(const std::string& callee) {
+        if (!functions.count(callee)) return builtinEffect(callee) == BuiltinEffect::CallsBack;
+        const Template* t = templateFor(callee);
+        return !t || t->rebinds;
+    }
+    bool mayRebind(const Expression* expr) {
+        return ::mayRebind(expr, [this](const std::string& callee) { return rebindingCall(callee); });
+    }
+};
+
+void FunctionInliningPass::Analysis::analyze(Statements& program) {
+    templates.clear();
+    recursive.clear();
+    ProgramUnits::analyze(program);
+    for (const auto& candidate : candidates) {
+        templateFor(candidate.first);
+    }
+}
+
+// =============================================================================
+// Templates
+// =============================================================================
+
+const Template* FunctionInliningPass::Analysis::templateFor(const std::string& name) {
+    auto built = templates.find(name);
+    if (built != templates.end()) return built->second.get();
+    auto candidate = candidates.find(name);
+    if (candidate == candidates.end()) return nullptr;
+
+    auto inProgress = std::find(building.begin(), building.end(), name);
+    if (inProgress != building.end()) {
+        // Every function from here up the stack calls itself
+        recursive.insert(inProgress, building.end());
+        return nullptr;
+    }
+    building.push_back(name);
+    auto result = buildTemplate(*candidate->second.first, candidate->second.second);
+    building.pop_back();
+    if (recursive.count(name)) {
+        result.reset();
+    }
+    return (templates[name] = std::move(result)).get();
+}
+
+std::unique_ptr<Template> FunctionInliningPass::Analysis::buildTemplate(const Unit& unit,
+                                                                       FunctionDeclaration* decl) {
+    auto result = std::make_unique<Template>();
+    Template& t = *result;
+    t.unit = &unit;
+    t.parameters = decl->parameters;
+
+    // A few `let`s, then the returns
+    Statements& body = decl->body->statements;
+    size_t i = 0;
+    std::unordered_set<std::string> locals(t.parameters.begin(), t.parameters.end());
+    if (locals.size() != t.parameters.size()) return nullptr;
+    for (; i < body.size() && body[i]->kind == NodeKind::VariableDeclaration; ++i) {
+        auto* let = static_cast<VariableDeclaration*>(body[i].get());
+        auto value = let->initializer ? cloneExpression(let->initializer.get()) : std::make_unique<NullLiteral>();
+        if (!value || !locals.insert(let->name).second) return nullptr;
+        t.lets.emplace_back(let->name, std::move(value));
+    }
+    if (!readReturns(body, i, t)) return nullptr;
+
+    // A `let` may not be read before it is declared (that would mean another variable)
+    for (size_t let = 0; let < t.lets.size(); ++let) {
+        std::vector<std::string> read;
+        collectNames(t.lets[let].second.get(), read);
+        for (size_t later = let; later < t.lets.size(); ++later) {
+            if (std::find(read.begin(), read.end(), t.lets[later].first) != read.end()) return nullptr;
+        }
+    }
+
+    // Calls to other small functions are inlined first
+    TemplateInliner inliner([&](CallExpression* call) { return inlineExpression(call, &unit); });
+    t.forEachExpression([&](std::unique_ptr<Expression>& expr) { inliner.inlineInto(expr); });
+
+    // `let`s used once, in order, move into the result
+    if (!t.lets.empty() && t.branches.empty()) {
+        std::vector<std::string> letNames;
+        std::unordered_map<std::string, const Expression*> values;
+        bool independent = true;
+        for (const auto& let : t.lets) {
+            std::vector<std::string> read;
+            collectNames(let.second.get(), read);
+            for (const auto& other : t.lets) {
+                independent = independent && std::find(read.begin(), read.end(), other.first) == read.end();
+            }
+            letNames.push_back(let.first);
+            values[let.first] = let.second.get();
+        }
+        DeferredBindings order(letNames);
+        order.walk(t.result.get());
+        if (independent && order.valid()) {
+            t.result = cloneExpression(t.result.get(), values);
+            t.lets.clear();
+        }
+    }
+
+    size_t size = 0;
+    t.forEachExpression([&](std::unique_ptr<Expression>& expr) {
+        size += countNodes(expr.get());
+        t.rebinds = t.rebinds || mayRebind(expr.get());
+    });
+    if (size > kMaxSize) return nullptr;
+
+    // The names the body reads from outside must mean the same at the call
+    // site: declared at most once in the unit, and at its top level
+    t.portable = true;
+    bool stable = true;
+    t.forEachExpression([&](std::unique_ptr<Expression>& expr) {
+        std::vector<std::string> read;
+        collectNames(expr.get(), read);
+        for (const std::string& name : read) {
+            if (locals.count(name)) continue;
+            t.portable = t.portable && !names.count(name);
+            auto declared = unit.declared.find(name);
+            if (declared != unit.declared.end() &&
+                (declared->second > 1 || !unit.topLevel.count(name))) {
+                stable = false;
+            }
+        }
+    });
+    if (!stable) return nullptr;
+    return result;
+}
+
+const Template* FunctionInliningPass::Analysis::usableTemplate(const CallExpression* call) {
+    const Template* t = templateFor(call->callee);
+    if (!t || t->parameters.size() != call->arguments.size()) return nullptr;
+    if (!t->portable && t->unit != current) return nullptr;
+    return t;
+}
+
+// =============================================================================
+// Inlining
+// =============================================================================
+
+std::unique_ptr<Expression> FunctionInliningPass::Analysis::inlineExpression(CallExpression* call, const Unit* site) {
+    // Looked up even when it cannot be used here, so recursion is found
+    const Template* found = templateFor(call->callee);
+    if (!found) return nullptr;
+    const Template& t = *found;
+    if (!t.isExpression() || t.parameters.size() != call->arguments.size() || (!t.portable && t.unit != site)) {
+        return nullptr;
+    }
+
+    // Literals, and names nothing in the call can reassign, are read where
+    // they are used; anything else has to run there in the call's order
+    bool argsRebind = false;
+    for (const auto& arg : call->arguments) {
+        argsRebind = argsRebind || mayRebind(arg.get());
+    }
+    std::unordered_map<std::string, const Expression*> values;
+    std::vector<std::string> deferred;
+    for (size_t i = 0; i < t.parameters.size(); ++i) {
+        const Expression* arg = call->arguments[i].get();
+        values[t.parameters[i]] = arg;
+        if (!isLiteral(arg) && (arg->kind != NodeKind::Identifier || t.rebinds || argsRebind)) {
+            deferred.push_back(t.parameters[i]);
+        }
+    }
+    if (!deferred.empty()) {
+        DeferredBindings order(deferred);
+        order.walk(t.result.get());
+        if (!order.valid()) return nullptr;
+    }
+    auto inlined = cloneExpression(t.result.get(), values);
+    if (inlined && site == units[0].get()) inlinedIntoProgram = true;
+    return inlined;
+}
+
+bool FunctionInliningPass::Analysis::inlineStatement(std::unique_ptr<Statement>& stmt, Statements& generated) {
+    std::unique_ptr<Expression>* root = rootExpression(stmt.get());
+    if (!root) return false;
+    std::vector<std::unique_ptr<Expression>*> before;
+    std::unique_ptr<Expression>* slot =
+        findCall(*root, before, [&](CallExpression* call) { return usableTemplate(call) != nullptr; });
+    if (!slot) return false;
+
+    auto* call = static_cast<CallExpression*>(slot->get());
+    const Template& t = *usableTemplate(call);
+    uint32_t line = stmt->line;
+    std::string prefix = freshName();
+
+    // What the statement evaluates before the call, and the arguments, are
+    // stored first unless they are literals or names nothing can reassign
+    bool rebinds = t.rebinds;
+    for (const auto& arg : call->arguments) {
+        rebinds = rebinds || mayRebind(arg.get());
+    }
+    auto keep = [&](const Expression* expr) {
+        return isLiteral(expr) || (expr->kind == NodeKind::Identifier && !rebinds);
+    };
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (keep(before[i]->get())) continue;
+        std::string temp = prefix + "_" + std::to_string(i);
+        generated.push_back(declare(temp, std::move(*before[i]), line));
+        *before[i] = std::make_unique<Identifier>(temp);
+    }
+
+    // The other arguments can still go where they are used if that runs them
+    // in the same order as the call would
+    std::vector<std::string> deferred;
+    for (size_t i = 0; i < t.parameters.size(); ++i) {
+        if (!keep(call->arguments[i].get())) deferred.push_back(t.parameters[i]);
+    }
+    bool substitute = false;
+    if (!deferred.empty()) {
+        DeferredBindings order(deferred);
+        for (const auto& let : t.lets) order.walk(let.second.get());
+        for (size_t i = 0; i < t.branches.size(); ++i) {
+            order.walk(t.branches[i].first.get(), i > 0);
+            order.walk(t.branches[i].second.get(), true);
+        }
+        order.walk(t.result.get(), !t.branches.empty());
+        substitute = order.valid();
+    }
+
+    std::vector<std::unique_ptr<Expression>> renamed;
+    std::unordered_map<std::string, const Expression*> values;
+    for (size_t i = 0; i < t.parameters.size(); ++i) {
+        std::unique_ptr<Expression>& arg = call->arguments[i];
+        if (substitute || keep(arg.get())) {
+            values[t.parameters[i]] = arg.get();
+            continue;
+        }
+        std::string temp = prefix + "_" + t.parameters[i];
+        generated.push_back(declare(temp, std::move(arg), line));
+        renamed.push_back(std::make_unique<Identifier>(temp));
+        values[t.parameters[i]] = renamed.back().get();
+    }
+    for (const auto& let : t.lets) {
+        std::string temp = prefix + "_" + let.first;
+        generated.push_back(declare(temp, cloneExpression(let.second.get(), values), line));
+        renamed.push_back(std::make_unique<Identifier>(temp));
+        values[let.first] = renamed.back().get();
+    }
+
+    if (t.branches.empty()) {
+        *slot = cloneExpression(t.result.get(), values);
+        if (current == units[0].get()) inlinedIntoProgram = true;
+        return true;
+    }
+
+    // `let v = f(...)` assigns v in the branches itself, unless the
+    // arguments read another v
+    std::string result = prefix;
+    auto* decl = stmt->kind == NodeKind::VariableDeclaration ? static_cast<VariableDeclaration*>(stmt.get()) : nullptr;
+    if (decl && slot == &decl->initializer && !decl->isConst && decl->typeName.empty()) {
+        std::vector<std::string> read;
+        for (const auto& arg : call->arguments) {
+            if (arg) collectNames(arg.get(), read);
+        }
+        if (std::find(read.begin(), read.end(), decl->name) == read.end()) {
+            result = decl->name;
+        }
+    }
+
+    // if (c1) { r = v1 } else if (c2) { r = v2 } ... else { r = result }
+    generated.push_back(declare(result, std::make_unique<NullLiteral>(), line));
+    auto otherwise = std::make_unique<BlockStatement>();
+    otherwise->statements.push_back(assign(result, cloneExpression(t.result.get(), values), line));
+    for (size_t i = t.branches.size(); i-- > 0;) {
+        auto then = std::make_unique<BlockStatement>();
+        then->statements.push_back(assign(result, cloneExpression(t.branches[i].second.get(), values), line));
+        auto ifStmt = std::make_unique<IfStatement>(cloneExpression(t.branches[i].first.get(), values),
+                                                    std::move(then), std::move(otherwise));
+        ifStmt->line = line;
+        inlineStatements(ifStmt->thenBranch->statements);
+        inlineStatements(ifStmt->elseBranch->statements);
+        if (i == 0) {
+            generated.push_back(std::move(ifStmt));
+            break;
+        }
+        otherwise = std::make_unique<BlockStatement>();
+        otherwise->statements.push_back(std::move(ifStmt));
+    }
+    if (result == prefix) {
+        *slot = std::make_unique<Identifier>(prefix);
+    } else {
+        stmt.reset();
+    }
+    if (current == units[0].get()) inlinedIntoProgram = true;
+    return true;
+}
+
+void FunctionInliningPass::Analysis::inlineStatements(Statements& statements) {
+    size_t budget = kMaxPerBlock;
+    for (size_t i = 0; i < statements.size() && budget > 0;) {
+        Statements generated;
+        if (!inlineStatement(statements[i], generated)) {
+            ++i;
+            continue;
+        }
+        --budget;
+        // The new statements may call functions to inline too: look at them next
+        auto at = statements.begin() + static_cast<std::ptrdiff_t>(i);
+        if (!*at) at = statements.erase(at);  // Replaced by the generated statements
+        statements.insert(at, std::make_move_iterator(generated.begin()), std::make_move_iterator(generated.end()));
+    }
+}
+
+// =============================================================================
+// Pass
+// =============================================================================
+
+FunctionInliningPass::FunctionInliningPass() : analysis(std::make_unique<Analysis>()) {}
+FunctionInliningPass::~FunctionInliningPass() = default;
+
+bool FunctionInliningPass::dependsOnImports() const {
+    return analysis->units.size() > 1 && analysis->inlinedIntoProgram;
+}
+
+void FunctionInliningPass::begin(std::vector<std::unique_ptr<Statement>>& statements,
+                                 const std::string& moduleName, const std::string& modulePath) {
+    Analysis& a = *analysis;
+    a.top = &statements;
+    a.current = nullptr;
+    if (moduleName.empty()) {
+        a.analyze(statements);
+        if (a.complete) a.current = a.units[0].get();
+    } else if (a.complete) {
+        // What the module can inline was worked out with the program
+        a.current = a.findModule(moduleName, modulePath);
+    }
+}
+
+void FunctionInliningPass::visit(CallExpression* node) {
+    ASTRewriter::visit(node);
+    if (!analysis->current) return;
+    if (auto inlined = analysis->inlineExpression(node, analysis->current)) {
+        replace(std::move(inlined));
+    }
+}
+
+void FunctionInliningPass::visitStatements(std::vector<std::unique_ptr<Statement>>& statements) {
+    ASTRewriter::visitStatements(statements);
+    // New variables at the top level would be globals (and module exports)
+    if (!analysis->current || &statements == analysis->top) return;
+    size_t before = analysis->nextName;
+    analysis->inlineStatements(statements);
+    changes += analysis->nextName - before;
+}
@@ -1,231 +1,779 @@
 #include "../../include/optimizer.h"
-#include <iostream>
-#include <algorithm>
-
-// Constant Folding: Pre-compute constant expressions at compile time
-std::unique_ptr<Expression> Optimizer::foldBinaryExpression(BinaryExpression* node) {
-    // Check if both operands are literals
-    auto* leftInt = dynamic_cast<IntegerLiteral*>(node->left.get());
-    auto* rightInt = dynamic_cast<IntegerLiteral*>(node->right.get());
-    auto* leftFloat = dynamic_cast<FloatLiteral*>(node->left.get());
-    auto* rightFloat = dynamic_cast<FloatLiteral*>(node->right.get());
-    auto* leftBool = dynamic_cast<BooleanLiteral*>(node->left.get());
-    auto* rightBool = dynamic_cast<BooleanLiteral*>(node->right.get());
-    
-    // Integer + Integer folding
-    if (leftInt && rightInt) {
-        int64_t left = leftInt->value;
-        int64_t right = rightInt->value;
-        int64_t result = 0;
-        
-        if (node->op == "+") result = left + right;
-        else if (node->op == "-") result = left - right;
-        else if (node->op == "*") result = left * right;
-        else if (node->op == "/" && right != 0) result = left / right;
-        else if (node->op == "%") result = left % right;
-        else return nullptr;
-        
-        return std::make_unique<IntegerLiteral>(result);
-    }
-    
-    // Float folding
-    if ((leftFloat || leftInt) && (rightFloat || rightInt)) {
-        double left = leftFloat ? leftFloat->value : static_cast<double>(leftInt->value);
-        double right = rightFloat ? rightFloat->value : static_cast<double>(rightInt->value);
-        
-        if (node->op == "+") return std::make_unique<FloatLiteral>(left + right);
-        if (node->op == "-") return std::make_unique<FloatLiteral>(left - right);
-        if (node->op == "*") return std::make_unique<FloatLiteral>(left * right);
-        if (node->op == "/" && right != 0) return std::make_unique<FloatLiteral>(left / right);
-    }
-    
-    // Boolean folding
-    if (leftBool && rightBool) {
-        bool left = leftBool->value;
-        bool right = rightBool->value;
-        
-        if (node->op == "&&" || node->op == "and") 
-            return std::make_unique<BooleanLiteral>(left && right);
-        if (node->op == "||" || node->op == "or") 
-            return std::make_unique<BooleanLiteral>(left || right);
-    }
-    
-    // Comparison folding for integers
-    if (leftInt && rightInt) {
-        int64_t left = leftInt->value;
-        int64_t right = rightInt->value;
-        
-        if (node->op == "==") return std::make_unique<BooleanLiteral>(left == right);
-        if (node->op == "!=") return std::make_unique<BooleanLiteral>(left != right);
-        if (node->op == "<") return std::make_unique<BooleanLiteral>(left < right);
-        if (node->op == ">") return std::make_unique<BooleanLiteral>(left > right);
-        if (node->op == "<=") return std::make_unique<BooleanLiteral>(left <= right);
-        if (node->op == ">=") return std::make_unique<BooleanLiteral>(left >= right);
-    }
-    
-    return nullptr; // Cannot fold
-}
-
-std::unique_ptr<Expression> Optimizer::foldUnaryExpression(UnaryExpression* node) {
-    auto* intLit = dynamic_cast<IntegerLiteral*>(node->operand.get());
-    auto* floatLit = dynamic_cast<FloatLiteral*>(node->operand.get());
-    auto* boolLit = dynamic_cast<BooleanLiteral*>(node->operand.get());
-    
-    if (node->op == "-" && intLit) {
-        return std::make_unique<IntegerLiteral>(-intLit->value);
-    }
-    if (node->op == "-" && floatLit) {
-        return std::make_unique<FloatLiteral>(-floatLit->value);
-    }
-    if ((node->op == "!" || node->op == "not") && boolLit) {
-        return std::make_unique<BooleanLiteral>(!boolLit->value);
-    }
-    
-    return nullptr;
+#include "../../include/interpreter.h"
+#include "../../include/type_specializer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// The value of a literal expression; false for anything else
+bool literalValue(const Expression* expr, Value& out) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral: out = Value(static_cast<const IntegerLiteral*>(expr)->value); return true;
+        case NodeKind::FloatLiteral: out = Value(static_cast<const FloatLiteral*>(expr)->value); return true;
+        case NodeKind::StringLiteral: out = Value(static_cast<const StringLiteral*>(expr)->value); return true;
+        case NodeKind::BooleanLiteral: out = Value(static_cast<const BooleanLiteral*>(expr)->value); return true;
+        case NodeKind::NullLiteral: out = Value(); return true;
+        default: return false;
+    }
+}
+
+// The literal that evaluates to `value`, or nullptr if there is none
+std::unique_ptr<Expression> literalFor(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::Int: return std::make_unique<IntegerLiteral>(value.asInt());
+        case Value::Type::Float:
+            if (!std::isfinite(value.asFloat())) return nullptr;
+            return std::make_unique<FloatLiteral>(value.asFloat());
+        case Value::Type::String: return std::make_unique<StringLiteral>(value.asString());
+        case Value::Type::Bool: return std::make_unique<BooleanLiteral>(value.asBool());
+        case Value::Type::Null: return std::make_unique<NullLiteral>();
+        default: return nullptr;
+    }
 }
 
-void Optimizer::collectUsedVariables(Expression* expr) {
+// Whether a literal condition is true; false if `condition` is not a literal
+bool literalCondition(const Expression* condition, bool& truthy) {
+    Value value;
+    if (!literalValue(condition, value)) return false;
+    truthy = value.isTruthy();
+    return true;
+}
+
+// Statements that make the rest of their block unreachable
+bool endsBlock(const Statement* stmt) {
+    return stmt->kind == NodeKind::ReturnStatement || stmt->kind == NodeKind::BreakStatement ||
+           stmt->kind == NodeKind::ContinueStatement;
+}
+
+// Statements that bind a name in the enclosing scope
+bool isDeclaration(const Statement* stmt) {
+    return stmt->kind == NodeKind::FunctionDeclaration || stmt->kind == NodeKind::StructDeclaration ||
+           stmt->kind == NodeKind::VariableDeclaration || stmt->kind == NodeKind::ImportStatement;
+}
+
+// A block whose statements can run in the enclosing scope instead of its own
+bool isSpliceable(const Statement* stmt) {
+    if (stmt->kind != NodeKind::BlockStatement) return false;
+    for (const auto& inner : static_cast<const BlockStatement*>(stmt)->statements) {
+        if (isDeclaration(inner.get())) return false;
+    }
+    return true;
+}
+
+using PassFactory = std::unique_ptr<OptimizerPass> (*)();
+
+struct PassInfo {
+    const char* name;
+    PassFactory create;
+    int level;  // Lowest -O level that runs the pass
+};
+
+// Every known pass, in pipeline order
+const PassInfo kPasses[] = {
+    {"fold", [] { return std::unique_ptr<OptimizerPass>(new ConstantFoldingPass()); }, 1},
+    {"ctfe", [] { return std::unique_ptr<OptimizerPass>(new CompileTimeEvaluationPass()); }, 2},
+    {"dce", [] { return std::unique_ptr<OptimizerPass>(new DeadCodeEliminationPass()); }, 1},
+    {"inline", [] { return std::unique_ptr<OptimizerPass>(new FunctionInliningPass()); }, 2},
+    {"cse", [] { return std::unique_ptr<OptimizerPass>(new CommonSubexpressionEliminationPass()); }, 2},
+    {"licm", [] { return std::unique_ptr<OptimizerPass>(new LoopInvariantCodeMotionPass()); }, 2},
+    {Optimizer::kSpecializePass, nullptr, 0},  // After the resolver: Optimizer::specialize()
+};
+
+}  // namespace
+
+// =============================================================================
+// ASTRewriter
+// =============================================================================
+
+void ASTRewriter::rewrite(std::unique_ptr<Expression>& expr) {
     if (!expr) return;
-    
-    if (auto* id = dynamic_cast<Identifier*>(expr)) {
-        usedVariables.insert(id->name);
-    } else if (auto* binary = dynamic_cast<BinaryExpression*>(expr)) {
-        collectUsedVariables(binary->left.get());
-        collectUsedVariables(binary->right.get());
-    } else if (auto* unary = dynamic_cast<UnaryExpression*>(expr)) {
-        collectUsedVariables(unary->operand.get());
-    } else if (auto* call = dynamic_cast<CallExpression*>(expr)) {
-        usedVariables.insert(call->callee);
-        for (auto& arg : call->arguments) {
-            collectUsedVariables(arg.get());
-        }
-    } else if (auto* assign = dynamic_cast<AssignmentExpression*>(expr)) {
-        collectUsedVariables(assign->left.get());
-        collectUsedVariables(assign->right.get());
-    } else if (auto* arrIdx = dynamic_cast<ArrayIndexExpression*>(expr)) {
-        collectUsedVariables(arrIdx->array.get());
-        collectUsedVariables(arrIdx->index.get());
-    }
-}
-
-bool Optimizer::isVariableUsed(const std::string& name) const {
-    return usedVariables.find(name) != usedVariables.end();
-}
-
-std::unique_ptr<Expression> Optimizer::optimizeExpression(std::unique_ptr<Expression> expr) {
-    if (!expr) return expr;
-    
-    // Try constant folding on binary expressions
-    if (auto* binary = dynamic_cast<BinaryExpression*>(expr.get())) {
-        // First optimize children
-        binary->left = optimizeExpression(std::move(binary->left));
-        binary->right = optimizeExpression(std::move(binary->right));
-        
-        // Then try to fold
-        auto folded = foldBinaryExpression(binary);
-        if (folded) return folded;
-    }
-    
-    // Try constant folding on unary expressions
-    if (auto* unary = dynamic_cast<UnaryExpression*>(expr.get())) {
-        unary->operand = optimizeExpression(std::move(unary->operand));
-        
-        auto folded = foldUnaryExpression(unary);
-        if (folded) return folded;
-    }
-    
-    return expr;
-}
-
-std::unique_ptr<Statement> Optimizer::optimizeStatement(std::unique_ptr<Statement> stmt) {
-    if (!stmt) return stmt;
-    
-    // Optimize variable declaration initializer
-    if (auto* varDecl = dynamic_cast<VariableDeclaration*>(stmt.get())) {
-        if (varDecl->initializer) {
-            varDecl->initializer = optimizeExpression(std::move(varDecl->initializer));
-        }
-    }
-    
-    // Optimize expression statement
-    if (auto* exprStmt = dynamic_cast<ExpressionStatement*>(stmt.get())) {
-        exprStmt->expression = optimizeExpression(std::move(exprStmt->expression));
-    }
-    
-    // Optimize if statement condition and branches
-    if (auto* ifStmt = dynamic_cast<IfStatement*>(stmt.get())) {
-        ifStmt->condition = optimizeExpression(std::move(ifStmt->condition));
-        
-        // Constant condition elimination
-        if (auto* boolLit = dynamic_cast<BooleanLiteral*>(ifStmt->condition.get())) {
-            if (boolLit->value) {
-                // if (true) - keep only then branch
-                return std::move(ifStmt->thenBranch);
-            } else {
-                // if (false) - keep only else branch or nothing
-                if (ifStmt->elseBranch) {
-                    return std::move(ifStmt->elseBranch);
+    expr->accept(*this);
+    if (expressionReplacement) {
+        expr = std::move(expressionReplacement);
+    }
+}
+
+void ASTRewriter::rewrite(std::unique_ptr<Statement>& stmt) {
+    if (!stmt) return;
+    stmt->accept(*this);
+    if (statementRemoved) {
+        stmt.reset();
+        statementRemoved = false;
+    } else if (statementReplacement) {
+        // Keep the line for the VM's line table and error messages
+        if (statementReplacement->line == 0) {
+            statementReplacement->line = stmt->line;
+        }
+        stmt = std::move(statementReplacement);
+    }
+}
+
+void ASTRewriter::rewrite(std::unique_ptr<BlockStatement>& block) {
+    if (!block) return;
+    visit(block.get());
+    discardReplacement();
+}
+
+void ASTRewriter::visitStatements(std::vector<std::unique_ptr<Statement>>& statements) {
+    size_t kept = 0;
+    for (size_t i = 0; i < statements.size(); ++i) {
+        rewrite(statements[i]);
+        if (!statements[i]) continue;
+        if (kept != i) {
+            statements[kept] = std::move(statements[i]);
+        }
+        ++kept;
+    }
+    statements.resize(kept);
+}
+
+void ASTRewriter::replace(std::unique_ptr<Expression> expr) {
+    expressionReplacement = std::move(expr);
+    ++changes;
+}
+
+void ASTRewriter::replace(std::unique_ptr<Statement> stmt) {
+    statementReplacement = std::move(stmt);
+    ++changes;
+}
+
+void ASTRewriter::remove() {
+    statementRemoved = true;
+    ++changes;
+}
+
+void ASTRewriter::discardReplacement() {
+    if (statementReplacement || statementRemoved) {
+        throw std::logic_error("Optimizer pass replaced a block that belongs to another statement");
+    }
+}
+
+void ASTRewriter::visit(IntegerLiteral*) {}
+void ASTRewriter::visit(FloatLiteral*) {}
+void ASTRewriter::visit(StringLiteral*) {}
+void ASTRewriter::visit(BooleanLiteral*) {}
+void ASTRewriter::visit(NullLiteral*) {}
+void ASTRewriter::visit(Identifier*) {}
+void ASTRewriter::visit(SelfExpression*) {}
+
+void ASTRewriter::visit(BinaryExpression* node) {
+    rewrite(node->left);
+    rewrite(node->right);
+}
+
+void ASTRewriter::visit(UnaryExpression* node) {
+    rewrite(node->operand);
+}
+
+// Assignment targets are names, not values: only the assigned value is rewritten
+void ASTRewriter::visit(AssignmentExpression* node) {
+    rewrite(node->right);
+}
+
+void ASTRewriter::visit(CallExpression* node) {
+    for (auto& arg : node->arguments) {
+        rewrite(arg);
+    }
+}
+
+void ASTRewriter::visit(ArrayLiteral* node) {
+    for (auto& element : node->elements) {
+        rewrite(element);
+    }
+}
+
+void ASTRewriter::visit(ArrayIndexExpression* node) {
+    rewrite(node->array);
+    rewrite(node->index);
+}
+
+void ASTRewriter::visit(ArrayAssignmentExpression* node) {
+    rewrite(node->array);
+    rewrite(node->index);
+    rewrite(node->value);
+}
+
+void ASTRewriter::visit(LambdaExpression* node) {
+    rewrite(node->body);
+    rewrite(node->blockBody);
+}
+
+void ASTRewriter::visit(MatchExpression* node) {
+    rewrite(node->subject);
+    for (auto& matchCase : node->cases) {
+        rewrite(matchCase.pattern);
+        rewrite(matchCase.result);
+    }
+}
+
+void ASTRewriter::visit(CompoundAssignment* node) {
+    rewrite(node->value);
+}
+
+void ASTRewriter::visit(UpdateExpression*) {}
+
+void ASTRewriter::visit(InterpolatedString* node) {
+    for (auto& part : node->parts) {
+        if (part.isExpression) rewrite(part.expr);
+    }
+}
+
+void ASTRewriter::visit(MapLiteral* node) {
+    for (auto& entry : node->entries) {
+        rewrite(entry.first);
+        rewrite(entry.second);
+    }
+}
+
+void ASTRewriter::visit(MemberExpression* node) {
+    rewrite(node->object);
+}
+
+void ASTRewriter::visit(MethodCallExpression* node) {
+    rewrite(node->object);
+    for (auto& arg : node->arguments) {
+        rewrite(arg);
+    }
+}
+
+void ASTRewriter::visit(VariableDeclaration* node) {
+    rewrite(node->initializer);
+}
+
+void ASTRewriter::visit(ExpressionStatement* node) {
+    rewrite(node->expression);
+}
+
+void ASTRewriter::visit(BlockStatement* node) {
+    visitStatements(node->statements);
+}
+
+void ASTRewriter::visit(IfStatement* node) {
+    rewrite(node->condition);
+    rewrite(node->thenBranch);
+    rewrite(node->elseBranch);
+}
+
+void ASTRewriter::visit(WhileStatement* node) {
+    rewrite(node->condition);
+    rewrite(node->body);
+}
+
+void ASTRewriter::visit(ForStatement* node) {
+    rewrite(node->initializer);
+    rewrite(node->condition);
+    rewrite(node->increment);
+    rewrite(node->body);
+}
+
+void ASTRewriter::visit(BreakStatement*) {}
+void ASTRewriter::visit(ContinueStatement*) {}
+
+void ASTRewriter::visit(FunctionDeclaration* node) {
+    rewrite(node->body);
+}
+
+void ASTRewriter::visit(ReturnStatement* node) {
+    rewrite(node->value);
+}
+
+void ASTRewriter::visit(TryStatement* node) {
+    rewrite(node->tryBlock);
+    rewrite(node->catchBlock);
+}
+
+void ASTRewriter::visit(ImportStatement*) {}
+
+void ASTRewriter::visit(StructDeclaration* node) {
+    for (auto& field : node->fields) {
+        rewrite(field.defaultValue);
+    }
+    for (auto& method : node->methods) {
+        visit(method.get());
+        discardReplacement();
+    }
+}
+
+size_t OptimizerPass::run(std::vector<std::unique_ptr<Statement>>& program) {
+    changes = 0;
+    begin(program, "", "");
+    visitStatements(program);
+    return changes;
+}
+
+size_t OptimizerPass::runModule(std::vector<std::unique_ptr<Statement>>& module, const std::string& moduleName,
+                                const std::string& modulePath) {
+    changes = 0;
+    begin(module, moduleName, modulePath);
+    visitStatements(module);
+    return changes;
+}
+
+void OptimizerPass::begin(std::vector<std::unique_ptr<Statement>>&, const std::string&, const std::string&) {}
+
+// =============================================================================
+// Expression copies
+// =============================================================================
+
+namespace {
+
+using CloneNames = std::unordered_map<std::string, const Expression*>;
+
+bool cloneAll(const std::vector<std::unique_ptr<Expression>>& from, std::vector<std::unique_ptr<Expression>>& to,
+              const CloneNames& names) {
+    for (const auto& expr : from) {
+        to.push_back(cloneExpression(expr.get(), names));
+        if (!to.back()) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::unique_ptr<Expression> cloneExpression(const Expression* expr, const CloneNames& names) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+            return std::make_unique<IntegerLiteral>(static_cast<const IntegerLiteral*>(expr)->value);
+        case NodeKind::FloatLiteral:
+            return std::make_unique<FloatLiteral>(static_cast<const FloatLiteral*>(expr)->value);
+        case NodeKind::StringLiteral:
+            return std::make_unique<StringLiteral>(static_cast<const StringLiteral*>(expr)->value);
+        case NodeKind::BooleanLiteral:
+            return std::make_unique<BooleanLiteral>(static_cast<const BooleanLiteral*>(expr)->value);
+        case NodeKind::NullLiteral:
+            return std::make_unique<NullLiteral>();
+        case NodeKind::Identifier: {
+            const std::string& name = static_cast<const Identifier*>(expr)->name;
+            auto it = names.find(name);
+            if (it != names.end()) return cloneExpression(it->second);
+            return std::make_unique<Identifier>(name);
+        }
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            auto left = cloneExpression(node->left.get(), names);
+            auto right = cloneExpression(node->right.get(), names);
+            if (!left || !right) return nullptr;
+            return std::make_unique<BinaryExpression>(std::move(left), node->op, std::move(right));
+        }
+        case NodeKind::UnaryExpression: {
+            auto* node = static_cast<const UnaryExpression*>(expr);
+            auto operand = cloneExpression(node->operand.get(), names);
+            if (!operand) return nullptr;
+            return std::make_unique<UnaryExpression>(node->op, std::move(operand));
+        }
+        case NodeKind::CallExpression: {
+            // The callee is looked up by name when called, not in scope: it is never substituted
+            auto* node = static_cast<const CallExpression*>(expr);
+            std::vector<std::unique_ptr<Expression>> args;
+            if (!cloneAll(node->arguments, args, names)) return nullptr;
+            return std::make_unique<CallExpression>(node->callee, std::move(args));
+        }
+        case NodeKind::ArrayLiteral: {
+            auto copy = std::make_unique<ArrayLiteral>();
+            if (!cloneAll(static_cast<const ArrayLiteral*>(expr)->elements, copy->elements, names)) return nullptr;
+            return copy;
+        }
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<const ArrayIndexExpression*>(expr);
+            auto array = cloneExpression(node->array.get(), names);
+            auto index = cloneExpression(node->index.get(), names);
+            if (!array || !index) return nullptr;
+            return std::make_unique<ArrayIndexExpression>(std::move(array), std::move(index));
+        }
+        case NodeKind::MatchExpression: {
+            auto* node = static_cast<const MatchExpression*>(expr);
+            auto subject = cloneExpression(node->subject.get(), names);
+            if (!subject) return nullptr;
+            std::vector<MatchCase> cases;
+            for (const MatchCase& matchCase : node->cases) {
+                MatchCase copy;
+                if (matchCase.pattern) {
+                    copy.pattern = cloneExpression(matchCase.pattern.get(), names);
+                    if (!copy.pattern) return nullptr;
                 }
-                return nullptr; // Remove entire if statement
+                copy.result = cloneExpression(matchCase.result.get(), names);
+                if (!copy.result) return nullptr;
+                cases.push_back(std::move(copy));
+            }
+            return std::make_unique<MatchExpression>(std::move(subject), std::move(cases));
+        }
+        case NodeKind::InterpolatedString: {
+            std::vector<StringPart> parts;
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (!part.isExpression) {
+                    parts.emplace_back(part.text);
+                    continue;
+                }
+                auto copy = cloneExpression(part.expr.get(), names);
+                if (!copy) return nullptr;
+                parts.emplace_back(std::move(copy));
+            }
+            return std::make_unique<InterpolatedString>(std::move(parts));
+        }
+        case NodeKind::MapLiteral: {
+            auto copy = std::make_unique<MapLiteral>();
+            for (const auto& entry : static_cast<const MapLiteral*>(expr)->entries) {
+                auto key = cloneExpression(entry.first.get(), names);
+                auto value = cloneExpression(entry.second.get(), names);
+                if (!key || !value) return nullptr;
+                copy->addEntry(std::move(key), std::move(value));
             }
+            return copy;
         }
+        case NodeKind::MemberExpression: {
+            auto* node = static_cast<const MemberExpression*>(expr);
+            auto object = cloneExpression(node->object.get(), names);
+            if (!object) return nullptr;
+            return std::make_unique<MemberExpression>(std::move(object), node->member, node->isComputed);
+        }
+        case NodeKind::MethodCallExpression: {
+            auto* node = static_cast<const MethodCallExpression*>(expr);
+            auto object = cloneExpression(node->object.get(), names);
+            std::vector<std::unique_ptr<Expression>> args;
+            if (!object || !cloneAll(node->arguments, args, names)) return nullptr;
+            return std::make_unique<MethodCallExpression>(std::move(object), node->method, std::move(args));
+        }
+        default:
+            // Lambdas capture their scope, `self` means the enclosing method's
+            // receiver, and assignments write a name that belongs to their scope
+            return nullptr;
+    }
+}
+
+namespace {
+
+bool sameAll(const std::vector<std::unique_ptr<Expression>>& a, const std::vector<std::unique_ptr<Expression>>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!sameExpression(a[i].get(), b[i].get())) return false;
     }
-    
-    // Optimize while statement
-    if (auto* whileStmt = dynamic_cast<WhileStatement*>(stmt.get())) {
-        whileStmt->condition = optimizeExpression(std::move(whileStmt->condition));
-        
-        // while (false) can be eliminated
-        if (auto* boolLit = dynamic_cast<BooleanLiteral*>(whileStmt->condition.get())) {
-            if (!boolLit->value) {
-                return nullptr; // Remove unreachable loop
+    return true;
+}
+
+}  // namespace
+
+bool sameExpression(const Expression* a, const Expression* b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case NodeKind::IntegerLiteral:
+            return static_cast<const IntegerLiteral*>(a)->value == static_cast<const IntegerLiteral*>(b)->value;
+        case NodeKind::FloatLiteral: {
+            // 0.0 and -0.0 compare equal but divide differently
+            double x = static_cast<const FloatLiteral*>(a)->value;
+            double y = static_cast<const FloatLiteral*>(b)->value;
+            return x == y && std::signbit(x) == std::signbit(y);
+        }
+        case NodeKind::StringLiteral:
+            return static_cast<const StringLiteral*>(a)->value == static_cast<const StringLiteral*>(b)->value;
+        case NodeKind::BooleanLiteral:
+            return static_cast<const BooleanLiteral*>(a)->value == static_cast<const BooleanLiteral*>(b)->value;
+        case NodeKind::NullLiteral:
+            return true;
+        case NodeKind::Identifier:
+            return static_cast<const Identifier*>(a)->name == static_cast<const Identifier*>(b)->name;
+        case NodeKind::BinaryExpression: {
+            auto* x = static_cast<const BinaryExpression*>(a);
+            auto* y = static_cast<const BinaryExpression*>(b);
+            return x->op == y->op && sameExpression(x->left.get(), y->left.get()) &&
+                   sameExpression(x->right.get(), y->right.get());
+        }
+        case NodeKind::UnaryExpression: {
+            auto* x = static_cast<const UnaryExpression*>(a);
+            auto* y = static_cast<const UnaryExpression*>(b);
+            return x->op == y->op && sameExpression(x->operand.get(), y->operand.get());
+        }
+        case NodeKind::CallExpression: {
+            auto* x = static_cast<const CallExpression*>(a);
+            auto* y = static_cast<const CallExpression*>(b);
+            return x->callee == y->callee && sameAll(x->arguments, y->arguments);
+        }
+        case NodeKind::ArrayLiteral:
+            return sameAll(static_cast<const ArrayLiteral*>(a)->elements, static_cast<const ArrayLiteral*>(b)->elements);
+        case NodeKind::ArrayIndexExpression: {
+            auto* x = static_cast<const ArrayIndexExpression*>(a);
+            auto* y = static_cast<const ArrayIndexExpression*>(b);
+            return sameExpression(x->array.get(), y->array.get()) && sameExpression(x->index.get(), y->index.get());
+        }
+        case NodeKind::InterpolatedString: {
+            auto& x = static_cast<const InterpolatedString*>(a)->parts;
+            auto& y = static_cast<const InterpolatedString*>(b)->parts;
+            if (x.size() != y.size()) return false;
+            for (size_t i = 0; i < x.size(); ++i) {
+                if (x[i].isExpression != y[i].isExpression) return false;
+                if (x[i].isExpression ? !sameExpression(x[i].expr.get(), y[i].expr.get()) : x[i].text != y[i].text) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NodeKind::MapLiteral: {
+            auto& x = static_cast<const MapLiteral*>(a)->entries;
+            auto& y = static_cast<const MapLiteral*>(b)->entries;
+            if (x.size() != y.size()) return false;
+            for (size_t i = 0; i < x.size(); ++i) {
+                if (!sameExpression(x[i].first.get(), y[i].first.get()) ||
+                    !sameExpression(x[i].second.get(), y[i].second.get())) {
+                    return false;
+                }
             }
+            return true;
+        }
+        case NodeKind::MemberExpression: {
+            auto* x = static_cast<const MemberExpression*>(a);
+            auto* y = static_cast<const MemberExpression*>(b);
+            return x->member == y->member && x->isComputed == y->isComputed &&
+                   sameExpression(x->object.get(), y->object.get());
         }
+        case NodeKind::MethodCallExpression: {
+            auto* x = static_cast<const MethodCallExpression*>(a);
+            auto* y = static_cast<const MethodCallExpression*>(b);
+            return x->method == y->method && sameExpression(x->object.get(), y->object.get()) &&
+                   sameAll(x->arguments, y->arguments);
+        }
+        default:
+            return false;
     }
-    
-    return stmt;
 }
 
-void Optimizer::constantFoldingPass(std::vector<std::unique_ptr<Statement>>& statements) {
-    for (auto& stmt : statements) {
-        stmt = optimizeStatement(std::move(stmt));
+// =============================================================================
+// Constant folding
+// =============================================================================
+
+void ConstantFoldingPass::visit(BinaryExpression* node) {
+    ASTRewriter::visit(node);
+    Value left;
+    Value right;
+    if (node->binaryOp == BinaryOp::Unknown || !literalValue(node->left.get(), left) ||
+        !literalValue(node->right.get(), right)) {
+        return;
+    }
+    // Int `%` by 0 (or INT64_MIN by -1) traps rather than raising
+    if (node->binaryOp == BinaryOp::Mod && right.isInt() &&
+        (right.asInt() == 0 || (right.asInt() == -1 && left.isInt() &&
+                                left.asInt() == std::numeric_limits<int64_t>::min()))) {
+        return;
+    }
+    try {
+        if (auto folded = literalFor(binaryOperation(node->binaryOp, left, right))) {
+            replace(std::move(folded));
+        }
+    } catch (const std::exception&) {
+        // Raised when the program runs instead
     }
-    
-    // Remove null statements
-    statements.erase(
-        std::remove_if(statements.begin(), statements.end(),
-            [](const std::unique_ptr<Statement>& s) { return s == nullptr; }),
-        statements.end()
-    );
 }
 
-void Optimizer::deadCodeEliminationPass(std::vector<std::unique_ptr<Statement>>& statements) {
-    // First pass: collect all used variables
-    usedVariables.clear();
-    
-    for (auto& stmt : statements) {
-        if (auto* varDecl = dynamic_cast<VariableDeclaration*>(stmt.get())) {
-            if (varDecl->initializer) {
-                collectUsedVariables(varDecl->initializer.get());
+void ConstantFoldingPass::visit(UnaryExpression* node) {
+    ASTRewriter::visit(node);
+    Value operand;
+    if (node->unaryOp == UnaryOp::Unknown || !literalValue(node->operand.get(), operand)) {
+        return;
+    }
+    if (node->unaryOp == UnaryOp::Neg && operand.isInt() && operand.asInt() == std::numeric_limits<int64_t>::min()) {
+        return;
+    }
+    try {
+        if (auto folded = literalFor(unaryOperation(node->unaryOp, operand))) {
+            replace(std::move(folded));
+        }
+    } catch (const std::exception&) {
+    }
+}
+
+// =============================================================================
+// Dead code elimination
+// =============================================================================
+
+void DeadCodeEliminationPass::visit(IfStatement* node) {
+    ASTRewriter::visit(node);
+    bool truthy;
+    if (!literalCondition(node->condition.get(), truthy)) return;
+    if (truthy) {
+        replace(std::move(node->thenBranch));
+    } else if (node->elseBranch) {
+        replace(std::move(node->elseBranch));
+    } else {
+        remove();
+    }
+}
+
+void DeadCodeEliminationPass::visit(WhileStatement* node) {
+    ASTRewriter::visit(node);
+    bool truthy;
+    if (literalCondition(node->condition.get(), truthy) && !truthy) {
+        remove();
+    }
+}
+
+void DeadCodeEliminationPass::visit(ForStatement* node) {
+    ASTRewriter::visit(node);
+    bool truthy;
+    if (!node->condition || !literalCondition(node->condition.get(), truthy) || truthy) return;
+    // The initializer still runs once: only drop the loop if that does nothing
+    Value unused;
+    const Statement* init = node->initializer.get();
+    bool initializerIsInert =
+        !init || (init->kind == NodeKind::VariableDeclaration &&
+                  (!static_cast<const VariableDeclaration*>(init)->initializer ||
+                   literalValue(static_cast<const VariableDeclaration*>(init)->initializer.get(), unused)));
+    if (initializerIsInert) {
+        remove();
+    }
+}
+
+void DeadCodeEliminationPass::visitStatements(std::vector<std::unique_ptr<Statement>>& statements) {
+    ASTRewriter::visitStatements(statements);
+
+    // Blocks that declare nothing (such as the branch left of an if) need no scope of their own
+    bool spliceable = false;
+    for (const auto& stmt : statements) {
+        spliceable = spliceable || isSpliceable(stmt.get());
+    }
+    if (spliceable) {
+        std::vector<std::unique_ptr<Statement>> spliced;
+        for (auto& stmt : statements) {
+            if (!isSpliceable(stmt.get())) {
+                spliced.push_back(std::move(stmt));
+                continue;
+            }
+            for (auto& inner : static_cast<BlockStatement*>(stmt.get())->statements) {
+                spliced.push_back(std::move(inner));
+            }
+            ++changes;
+        }
+        statements = std::move(spliced);
+    }
+
+    size_t end = 0;
+    while (end < statements.size() && !endsBlock(statements[end].get())) {
+        ++end;
+    }
+    if (end == statements.size()) return;
+
+    size_t kept = end + 1;
+    for (size_t i = end + 1; i < statements.size(); ++i) {
+        if (isDeclaration(statements[i].get())) {
+            statements[kept++] = std::move(statements[i]);
+        } else {
+            ++changes;
+        }
+    }
+    statements.resize(kept);
+}
+
+// =============================================================================
+// Pass manager
+// =============================================================================
+
+Optimizer::Optimizer(int level) : maxRounds(level >= 2 ? kMaxRounds : 1) {
+    for (const std::string& name : pipeline(level)) {
+        if (name == kSpecializePass) {
+            specializeTypes = true;
+        } else {
+            passes.push_back(createPass(name));
+        }
+    }
+}
+
+Optimizer::Optimizer(const std::vector<std::string>& passNames) : maxRounds(1) {
+    for (const std::string& name : passNames) {
+        if (name == kSpecializePass) {
+            specializeTypes = true;
+            continue;
+        }
+        auto pass = createPass(name);
+        if (!pass) {
+            std::string known;
+            for (const std::string& available : availablePasses()) {
+                known += (known.empty() ? "" : ", ") + available;
             }
-        } else if (auto* exprStmt = dynamic_cast<ExpressionStatement*>(stmt.get())) {
-            collectUsedVariables(exprStmt->expression.get());
-        } else if (auto* ifStmt = dynamic_cast<IfStatement*>(stmt.get())) {
-            collectUsedVariables(ifStmt->condition.get());
-        } else if (auto* whileStmt = dynamic_cast<WhileStatement*>(stmt.get())) {
-            collectUsedVariables(whileStmt->condition.get());
+            throw std::runtime_error("Unknown optimizer pass: " + name + " (available: " + known + ")");
         }
+        passes.push_back(std::move(pass));
+    }
+}
+
+std::vector<std::string> Optimizer::pipeline(int level) {
+    std::vector<std::string> names;
+    for (const PassInfo& info : kPasses) {
+        if (level >= info.level) names.push_back(info.name);
+    }
+    return names;
+}
+
+std::vector<std::string> Optimizer::availablePasses() {
+    std::vector<std::string> names;
+    for (const PassInfo& info : kPasses) {
+        names.push_back(info.name);
     }
-    
-    // Second pass: remove unused variable declarations (keep side effects)
-    // For now, we only remove truly unused pure declarations
-    // This is conservative - we keep anything that might have side effects
+    return names;
+}
+
+std::unique_ptr<OptimizerPass> Optimizer::createPass(const std::string& name) {
+    for (const PassInfo& info : kPasses) {
+        if (name == info.name) return info.create ? info.create() : nullptr;
+    }
+    return nullptr;
 }
 
 void Optimizer::optimize(std::vector<std::unique_ptr<Statement>>& statements) {
-    // Run constant folding
-    constantFoldingPass(statements);
-    
-    // Run dead code elimination
-    deadCodeEliminationPass(statements);
+    for (size_t round = 1; round <= maxRounds; ++round) {
+        size_t roundChanges = 0;
+        for (auto& pass : passes) {
+            auto start = std::chrono::steady_clock::now();
+            size_t changed = pass->run(statements);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            history.push_back({pass->name(), round, ms, changed});
+            roundChanges += changed;
+        }
+        if (roundChanges == 0) break;
+    }
+}
+
+void Optimizer::optimizeModule(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+                               const std::string& modulePath) {
+    for (size_t round = 1; round <= maxRounds; ++round) {
+        size_t roundChanges = 0;
+        for (auto& pass : passes) {
+            roundChanges += pass->runModule(statements, moduleName, modulePath);
+        }
+        if (roundChanges == 0) break;
+    }
+}
+
+void Optimizer::specialize(const std::vector<std::unique_ptr<Statement>>& statements) {
+    if (!specializeTypes) return;
+    auto start = std::chrono::steady_clock::now();
+    size_t marked = TypeSpecializer().specialize(statements);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    history.push_back({kSpecializePass, 1, ms, marked});
+}
+
+bool Optimizer::dependsOnImports() const {
+    for (const auto& pass : passes) {
+        if (pass->dependsOnImports()) return true;
+    }
+    return false;
+}
+
+void Optimizer::printReport(std::ostream& out) const {
+    double totalMs = 0.0;
+    size_t totalChanges = 0;
+    for (const PassRun& run : history) {
+        totalMs += run.ms;
+        totalChanges += run.changes;
+    }
+    out << "Optimizer: " << history.size() << " pass runs, " << totalChanges << " changes, "
+        << std::fixed << std::setprecision(3) << totalMs << " ms" << std::endl;
+    out << "  pass          round   time ms   changes" << std::endl;
+    for (const PassRun& run : history) {
+        out << "  " << std::left << std::setw(12) << run.pass << std::right
+            << std::setw(7) << run.round
+            << std::setw(10) << std::setprecision(3) << run.ms
+            << std::setw(10) << run.changes << std::endl;
+    }
 }
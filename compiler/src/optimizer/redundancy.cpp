@@ -0,0 +1,875 @@
+#include "../../include/optimizer.h"
+#include "../../include/interpreter.h"
+#include "../../include/lexer.h"
+#include "../../include/parser.h"
+#include <functional>
+#include <map>
+#include <unordered_set>
+
+namespace {
+
+using Statements = std::vector<std::unique_ptr<Statement>>;
+using EffectOf = std::function<BuiltinEffect(const std::string&)>;
+
+bool isLeaf(const Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+        case NodeKind::FloatLiteral:
+        case NodeKind::StringLiteral:
+        case NodeKind::BooleanLiteral:
+        case NodeKind::NullLiteral:
+        case NodeKind::Identifier:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isIdentifier(const Expression* expr) {
+    return expr && expr->kind == NodeKind::Identifier;
+}
+
+const std::string& identifierName(const Expression* expr) {
+    return static_cast<const Identifier*>(expr)->name;
+}
+
+// Every name a program or module declares or assigns, in any scope, and the
+// modules it imports
+class NameScanner : public ASTRewriter {
+public:
+    NameScanner(std::unordered_set<std::string>& names, std::vector<std::pair<std::string, std::string>>& imports)
+        : names(names), imports(imports) {}
+
+    void scan(Statements& statements) { visitStatements(statements); }
+
+    void visit(VariableDeclaration* node) override {
+        names.insert(node->name);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(FunctionDeclaration* node) override {
+        names.insert(node->name);
+        names.insert(node->parameters.begin(), node->parameters.end());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(LambdaExpression* node) override {
+        names.insert(node->parameters.begin(), node->parameters.end());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(TryStatement* node) override {
+        if (!node->errorVariable.empty()) names.insert(node->errorVariable);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ImportStatement* node) override {
+        names.insert(node->alias.empty() ? node->moduleName : node->alias);
+        imports.emplace_back(node->moduleName, node->modulePath);
+    }
+
+    void visit(StructDeclaration* node) override {
+        names.insert(node->name);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(AssignmentExpression* node) override {
+        if (isIdentifier(node->left.get())) names.insert(identifierName(node->left.get()));
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CompoundAssignment* node) override {
+        if (isIdentifier(node->target.get())) names.insert(identifierName(node->target.get()));
+        ASTRewriter::visit(node);
+    }
+
+    void visit(UpdateExpression* node) override {
+        if (isIdentifier(node->operand.get())) names.insert(identifierName(node->operand.get()));
+    }
+
+private:
+    std::unordered_set<std::string>& names;
+    std::vector<std::pair<std::string, std::string>>& imports;
+};
+
+// Whether `expr` evaluates to an array or map nothing else holds
+bool isFreshValue(const Expression* expr, const EffectOf& effect) {
+    if (expr->kind == NodeKind::ArrayLiteral || expr->kind == NodeKind::MapLiteral) return true;
+    if (expr->kind != NodeKind::CallExpression) return false;
+    const std::string& callee = static_cast<const CallExpression*>(expr)->callee;
+    return callee != "text" && effect(callee) == BuiltinEffect::Allocates;
+}
+
+// The variables of a function that hold an array or map only they can reach:
+// declared once, by a `let` of a new array or map, only ever assigned new ones,
+// and only used where the value cannot be kept anywhere else (by operators,
+// fields, elements, conditions, `return`, and builtins that do not keep their
+// arguments). Uses in nested functions and lambdas count as kept.
+class FreshScanner : public ASTRewriter {
+public:
+    explicit FreshScanner(EffectOf effect) : effect(std::move(effect)) {}
+
+    std::unordered_set<std::string> scan(FunctionDeclaration* function) {
+        for (const std::string& parameter : function->parameters) {
+            variables[parameter].fresh = false;
+        }
+        rewrite(function->body);
+        std::unordered_set<std::string> fresh;
+        for (const auto& variable : variables) {
+            const Variable& info = variable.second;
+            if (info.declarations == 1 && info.fresh && info.uses == info.contained) {
+                fresh.insert(variable.first);
+            }
+        }
+        return fresh;
+    }
+
+    void visit(Identifier* node) override {
+        Variable& info = variables[node->name];
+        ++info.uses;
+        if (depth > 0) info.fresh = false;
+    }
+
+    void visit(VariableDeclaration* node) override {
+        Variable& info = variables[node->name];
+        ++info.declarations;
+        if (!node->initializer || !isFreshValue(node->initializer.get(), effect)) info.fresh = false;
+        ASTRewriter::visit(node);
+    }
+
+    void visit(AssignmentExpression* node) override {
+        if (isIdentifier(node->left.get()) && !isFreshValue(node->right.get(), effect)) {
+            variables[identifierName(node->left.get())].fresh = false;
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CompoundAssignment* node) override {
+        if (isIdentifier(node->target.get())) variables[identifierName(node->target.get())].fresh = false;
+        ASTRewriter::visit(node);
+    }
+
+    void visit(UpdateExpression* node) override {
+        if (isIdentifier(node->operand.get())) variables[identifierName(node->operand.get())].fresh = false;
+    }
+
+    void visit(BinaryExpression* node) override {
+        contain(node->left.get());
+        contain(node->right.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(UnaryExpression* node) override {
+        contain(node->operand.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CallExpression* node) override {
+        BuiltinEffect called = effect(node->callee);
+        for (size_t i = 0; i < node->arguments.size(); ++i) {
+            if (called == BuiltinEffect::None || called == BuiltinEffect::External ||
+                (called == BuiltinEffect::Mutates && i == 0)) {
+                contain(node->arguments[i].get());
+            }
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ArrayIndexExpression* node) override {
+        contain(node->array.get());
+        contain(node->index.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ArrayAssignmentExpression* node) override {
+        contain(node->array.get());
+        contain(node->index.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(MemberExpression* node) override {
+        contain(node->object.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(InterpolatedString* node) override {
+        for (const StringPart& part : node->parts) {
+            if (part.isExpression) contain(part.expr.get());
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ExpressionStatement* node) override {
+        contain(node->expression.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ReturnStatement* node) override {
+        contain(node->value.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(IfStatement* node) override {
+        contain(node->condition.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(WhileStatement* node) override {
+        contain(node->condition.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ForStatement* node) override {
+        contain(node->condition.get());
+        contain(node->increment.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(LambdaExpression* node) override {
+        for (const std::string& parameter : node->parameters) variables[parameter].fresh = false;
+        ++depth;
+        ASTRewriter::visit(node);
+        --depth;
+    }
+
+    void visit(FunctionDeclaration* node) override {
+        variables[node->name].fresh = false;
+        for (const std::string& parameter : node->parameters) variables[parameter].fresh = false;
+        ++depth;
+        ASTRewriter::visit(node);
+        --depth;
+    }
+
+    void visit(TryStatement* node) override {
+        if (!node->errorVariable.empty()) variables[node->errorVariable].fresh = false;
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ImportStatement* node) override {
+        variables[node->alias.empty() ? node->moduleName : node->alias].fresh = false;
+    }
+
+    void visit(StructDeclaration* node) override {
+        variables[node->name].fresh = false;
+        ++depth;
+        ASTRewriter::visit(node);
+        --depth;
+    }
+
+private:
+    struct Variable {
+        int declarations = 0;
+        bool fresh = true;
+        int uses = 0;
+        int contained = 0;  // Uses that cannot keep the value
+    };
+
+    EffectOf effect;
+    std::unordered_map<std::string, Variable> variables;
+    int depth = 0;  // Nested functions and lambdas entered
+
+    void contain(const Expression* expr) {
+        if (isIdentifier(expr)) ++variables[identifierName(expr)].contained;
+    }
+};
+
+// What running some code can change
+struct Effects {
+    std::unordered_set<std::string> touched;  // Names assigned or declared, and fresh arrays changed
+    bool heap = false;      // Arrays or maps other names may hold are changed
+    bool anything = false;  // Program code may run
+};
+
+class EffectScanner : public ASTRewriter {
+public:
+    EffectScanner(const EffectOf& effect, const std::unordered_set<std::string>& fresh, Effects& out)
+        : effect(effect), fresh(fresh), out(out) {}
+
+    void scan(Statement* stmt) { stmt->accept(*this); }
+
+    void visit(VariableDeclaration* node) override {
+        out.touched.insert(node->name);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(AssignmentExpression* node) override {
+        if (isIdentifier(node->left.get())) {
+            out.touched.insert(identifierName(node->left.get()));
+        } else {
+            out.heap = true;
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ArrayAssignmentExpression* node) override {
+        change(node->array.get());
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CompoundAssignment* node) override {
+        if (isIdentifier(node->target.get())) {
+            out.touched.insert(identifierName(node->target.get()));
+        } else {
+            out.heap = true;
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(UpdateExpression* node) override {
+        if (isIdentifier(node->operand.get())) {
+            out.touched.insert(identifierName(node->operand.get()));
+        } else {
+            out.heap = true;
+        }
+    }
+
+    void visit(CallExpression* node) override {
+        switch (effect(node->callee)) {
+            case BuiltinEffect::Mutates:
+                if (node->arguments.empty()) break;
+                change(node->arguments[0].get());
+                break;
+            case BuiltinEffect::CallsBack:
+                out.anything = true;
+                break;
+            default:
+                break;
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(MethodCallExpression* node) override {
+        out.anything = true;
+        ASTRewriter::visit(node);
+    }
+
+    // Creating a function runs none of its code
+    void visit(LambdaExpression*) override {}
+    void visit(FunctionDeclaration* node) override { out.touched.insert(node->name); }
+    void visit(StructDeclaration* node) override { out.touched.insert(node->name); }
+
+    void visit(TryStatement* node) override {
+        if (!node->errorVariable.empty()) out.touched.insert(node->errorVariable);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ImportStatement*) override { out.anything = true; }
+
+private:
+    const EffectOf& effect;
+    const std::unordered_set<std::string>& fresh;
+    Effects& out;
+
+    // An array or map is changed through `target`
+    void change(const Expression* target) {
+        if (isIdentifier(target) && fresh.count(identifierName(target))) {
+            out.touched.insert(identifierName(target));
+        } else {
+            out.heap = true;
+        }
+    }
+};
+
+// Whether `expr` reads the contents of an array or map: `+` turns one into a
+// string, and builtins, fields and elements read them
+bool readsHeap(const Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::CallExpression:
+        case NodeKind::MemberExpression:
+        case NodeKind::ArrayIndexExpression:
+        case NodeKind::InterpolatedString:
+            return true;
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            return node->binaryOp == BinaryOp::Add || readsHeap(node->left.get()) || readsHeap(node->right.get());
+        }
+        case NodeKind::UnaryExpression:
+            return readsHeap(static_cast<const UnaryExpression*>(expr)->operand.get());
+        default:
+            return false;
+    }
+}
+
+bool readsName(const Expression* expr, const std::unordered_set<std::string>& names) {
+    switch (expr->kind) {
+        case NodeKind::Identifier:
+            return names.count(identifierName(expr)) > 0;
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            return readsName(node->left.get(), names) || readsName(node->right.get(), names);
+        }
+        case NodeKind::UnaryExpression:
+            return readsName(static_cast<const UnaryExpression*>(expr)->operand.get(), names);
+        case NodeKind::CallExpression:
+            for (const auto& arg : static_cast<const CallExpression*>(expr)->arguments) {
+                if (readsName(arg.get(), names)) return true;
+            }
+            return false;
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<const ArrayIndexExpression*>(expr);
+            return readsName(node->array.get(), names) || readsName(node->index.get(), names);
+        }
+        case NodeKind::MemberExpression:
+            return readsName(static_cast<const MemberExpression*>(expr)->object.get(), names);
+        case NodeKind::InterpolatedString:
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (part.isExpression && readsName(part.expr.get(), names)) return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Whether a pure expression may evaluate differently after code with `effects`
+bool changedBy(const Expression* expr, const Effects& effects) {
+    return effects.anything || (effects.heap && readsHeap(expr)) || readsName(expr, effects.touched);
+}
+
+// Whether keeping the value of `expr` saves more than the variable costs
+bool worthStoring(const Expression* expr) {
+    switch (expr->kind) {
+        case NodeKind::CallExpression:
+        case NodeKind::MemberExpression:
+        case NodeKind::ArrayIndexExpression:
+        case NodeKind::InterpolatedString:
+            return true;
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            return worthStoring(node->left.get()) || worthStoring(node->right.get());
+        }
+        case NodeKind::UnaryExpression:
+            return worthStoring(static_cast<const UnaryExpression*>(expr)->operand.get());
+        default:
+            return false;
+    }
+}
+
+// Finds the first subexpression of `expr`, in evaluation order, that `wanted`
+// accepts and that is evaluated whenever `expr` is, with nothing before it
+// that can raise or have an effect. Returns false once no later
+// subexpression can qualify.
+bool findFirst(std::unique_ptr<Expression>& expr, const std::function<bool(const Expression*)>& wanted,
+               std::unique_ptr<Expression>*& found) {
+    if (wanted(expr.get())) {
+        found = &expr;
+        return false;
+    }
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+        case NodeKind::FloatLiteral:
+        case NodeKind::StringLiteral:
+        case NodeKind::BooleanLiteral:
+        case NodeKind::NullLiteral:
+        case NodeKind::Identifier:
+            return true;
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<BinaryExpression*>(expr.get());
+            if (!findFirst(node->left, wanted, found)) return false;
+            // The right operand of `&&` and `||` may not run
+            if (node->binaryOp == BinaryOp::And || node->binaryOp == BinaryOp::Or) return false;
+            if (!findFirst(node->right, wanted, found)) return false;
+            return node->binaryOp == BinaryOp::Eq || node->binaryOp == BinaryOp::Ne;
+        }
+        case NodeKind::UnaryExpression: {
+            auto* node = static_cast<UnaryExpression*>(expr.get());
+            return findFirst(node->operand, wanted, found) && node->unaryOp == UnaryOp::Not;
+        }
+        case NodeKind::AssignmentExpression: {
+            auto* node = static_cast<AssignmentExpression*>(expr.get());
+            if (isIdentifier(node->left.get())) findFirst(node->right, wanted, found);
+            return false;
+        }
+        case NodeKind::CallExpression:
+            for (auto& arg : static_cast<CallExpression*>(expr.get())->arguments) {
+                if (!findFirst(arg, wanted, found)) return false;
+            }
+            return false;
+        case NodeKind::ArrayLiteral:
+            for (auto& element : static_cast<ArrayLiteral*>(expr.get())->elements) {
+                if (!findFirst(element, wanted, found)) return false;
+            }
+            return true;
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<ArrayIndexExpression*>(expr.get());
+            if (findFirst(node->array, wanted, found)) findFirst(node->index, wanted, found);
+            return false;
+        }
+        case NodeKind::MemberExpression:
+            findFirst(static_cast<MemberExpression*>(expr.get())->object, wanted, found);
+            return false;
+        case NodeKind::MethodCallExpression: {
+            auto* node = static_cast<MethodCallExpression*>(expr.get());
+            if (!findFirst(node->object, wanted, found)) return false;
+            for (auto& arg : node->arguments) {
+                if (!findFirst(arg, wanted, found)) return false;
+            }
+            return false;
+        }
+        case NodeKind::InterpolatedString:
+            for (auto& part : static_cast<InterpolatedString*>(expr.get())->parts) {
+                if (part.isExpression && !findFirst(part.expr, wanted, found)) return false;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// The expression a statement evaluates first
+std::unique_ptr<Expression>* rootExpression(Statement* stmt) {
+    switch (stmt->kind) {
+        case NodeKind::ExpressionStatement:
+            return &static_cast<ExpressionStatement*>(stmt)->expression;
+        case NodeKind::VariableDeclaration: {
+            auto* decl = static_cast<VariableDeclaration*>(stmt);
+            return decl->initializer ? &decl->initializer : nullptr;
+        }
+        case NodeKind::ReturnStatement: {
+            auto* ret = static_cast<ReturnStatement*>(stmt);
+            return ret->value ? &ret->value : nullptr;
+        }
+        case NodeKind::IfStatement:
+            return &static_cast<IfStatement*>(stmt)->condition;
+        default:
+            return nullptr;
+    }
+}
+
+// Counts the expressions that are the same as `pattern`, outside nested
+// functions and lambdas, and replaces them with `name` if it is not empty
+class Occurrences : public ASTRewriter {
+public:
+    Occurrences(const Expression* pattern, std::string name) : pattern(pattern), name(std::move(name)) {}
+
+    size_t in(std::unique_ptr<Statement>& stmt) { return walk([&] { rewrite(stmt); }); }
+    size_t in(std::unique_ptr<Expression>& expr) { return walk([&] { rewrite(expr); }); }
+    size_t in(std::unique_ptr<BlockStatement>& block) { return walk([&] { rewrite(block); }); }
+
+    void visit(BinaryExpression* node) override { ASTRewriter::visit(node); match(node); }
+    void visit(UnaryExpression* node) override { ASTRewriter::visit(node); match(node); }
+    void visit(CallExpression* node) override { ASTRewriter::visit(node); match(node); }
+    void visit(ArrayIndexExpression* node) override { ASTRewriter::visit(node); match(node); }
+    void visit(MemberExpression* node) override { ASTRewriter::visit(node); match(node); }
+    void visit(InterpolatedString* node) override { ASTRewriter::visit(node); match(node); }
+
+    void visit(LambdaExpression*) override {}
+    void visit(FunctionDeclaration*) override {}
+    void visit(StructDeclaration*) override {}
+
+private:
+    const Expression* pattern;
+    std::string name;
+    size_t found = 0;
+
+    size_t walk(const std::function<void()>& run) {
+        found = 0;
+        run();
+        return found;
+    }
+
+    void match(Expression* node) {
+        if (!sameExpression(node, pattern)) return;
+        ++found;
+        if (!name.empty()) replace(std::make_unique<Identifier>(name));
+    }
+};
+
+// A for loop initializer that can run after code moved ahead of the loop
+bool isInertInitializer(const Statement* init) {
+    if (!init) return true;
+    const Expression* value = nullptr;
+    if (init->kind == NodeKind::VariableDeclaration) {
+        value = static_cast<const VariableDeclaration*>(init)->initializer.get();
+        if (!value) return true;
+    } else if (init->kind == NodeKind::ExpressionStatement) {
+        auto* expr = static_cast<const ExpressionStatement*>(init)->expression.get();
+        if (expr->kind != NodeKind::AssignmentExpression) return false;
+        auto* assignment = static_cast<const AssignmentExpression*>(expr);
+        if (!isIdentifier(assignment->left.get())) return false;
+        value = assignment->right.get();
+    } else {
+        return false;
+    }
+    return isLeaf(value) && value->kind != NodeKind::Identifier;
+}
+
+std::unique_ptr<Statement> declare(const std::string& name, std::unique_ptr<Expression> value, uint32_t line) {
+    auto decl = std::make_unique<VariableDeclaration>(name, std::move(value));
+    decl->line = line;
+    return decl;
+}
+
+}  // namespace
+
+// =============================================================================
+// Shared analysis
+// =============================================================================
+
+struct RedundancyPass::Analysis {
+    std::map<std::string, Statements> modules;  // Parsed module sources, by name and path
+    std::unordered_set<std::string> names;      // Declared or assigned anywhere in the program or its modules
+    bool complete = false;  // Every imported module could be read and parsed
+    bool imports = false;   // The program imports modules
+    bool rewroteProgram = false;
+
+    const Statements* top = nullptr;  // The statements being rewritten
+    bool inProgram = false;
+    std::vector<std::unordered_set<std::string>> fresh;  // Of each function being rewritten, innermost last
+    size_t nextName = 0;
+
+    void analyze(Statements& program);
+
+    BuiltinEffect effect(const std::string& callee) const {
+        return names.count(callee) ? BuiltinEffect::CallsBack : builtinEffect(callee);
+    }
+    EffectOf effectOf() const {
+        return [this](const std::string& callee) { return effect(callee); };
+    }
+
+    bool isPure(const Expression* expr) const;
+    Effects effectsOf(Statement* stmt) const;
+    std::string freshName(const char* prefix) { return prefix + std::to_string(++nextName); }
+
+    size_t hoistInvariants(Statement* loop, std::unique_ptr<Expression>& condition,
+                           std::unique_ptr<Expression>* increment, std::unique_ptr<BlockStatement>& body,
+                           Statements& hoisted);
+    size_t eliminateCommon(Statements& statements);
+};
+
+void RedundancyPass::Analysis::analyze(Statements& program) {
+    names.clear();
+    complete = true;
+    std::vector<std::pair<std::string, std::string>> pending;
+    NameScanner(names, pending).scan(program);
+    imports = !pending.empty();
+    std::unordered_set<std::string> seen;
+    while (!pending.empty()) {
+        auto import = pending.back();
+        pending.pop_back();
+        std::string key = import.first + "\n" + import.second;
+        if (!seen.insert(key).second) continue;
+        auto it = modules.find(key);
+        if (it == modules.end()) {
+            try {
+                Lexer lexer(readModuleSource(import.first, import.second));
+                Parser parser(lexer.tokenize());
+                it = modules.emplace(key, parser.parse()).first;
+            } catch (const std::exception&) {
+                // The import fails when the program runs; until then any name may be anything
+                complete = false;
+                return;
+            }
+        }
+        NameScanner(names, pending).scan(it->second);
+    }
+}
+
+bool RedundancyPass::Analysis::isPure(const Expression* expr) const {
+    switch (expr->kind) {
+        case NodeKind::IntegerLiteral:
+        case NodeKind::FloatLiteral:
+        case NodeKind::StringLiteral:
+        case NodeKind::BooleanLiteral:
+        case NodeKind::NullLiteral:
+        case NodeKind::Identifier:
+            return true;
+        case NodeKind::BinaryExpression: {
+            auto* node = static_cast<const BinaryExpression*>(expr);
+            return isPure(node->left.get()) && isPure(node->right.get());
+        }
+        case NodeKind::UnaryExpression:
+            return isPure(static_cast<const UnaryExpression*>(expr)->operand.get());
+        case NodeKind::CallExpression: {
+            auto* node = static_cast<const CallExpression*>(expr);
+            if (effect(node->callee) != BuiltinEffect::None) return false;
+            for (const auto& arg : node->arguments) {
+                if (!isPure(arg.get())) return false;
+            }
+            return true;
+        }
+        case NodeKind::ArrayIndexExpression: {
+            auto* node = static_cast<const ArrayIndexExpression*>(expr);
+            return isPure(node->array.get()) && isPure(node->index.get());
+        }
+        case NodeKind::MemberExpression:
+            return isPure(static_cast<const MemberExpression*>(expr)->object.get());
+        case NodeKind::InterpolatedString:
+            for (const StringPart& part : static_cast<const InterpolatedString*>(expr)->parts) {
+                if (part.isExpression && !isPure(part.expr.get())) return false;
+            }
+            return true;
+        default:
+            // Array and map literals are new each time they are evaluated
+            return false;
+    }
+}
+
+Effects RedundancyPass::Analysis::effectsOf(Statement* stmt) const {
+    static const std::unordered_set<std::string> none;
+    Effects effects;
+    EffectOf effect = effectOf();
+    EffectScanner(effect, fresh.empty() ? none : fresh.back(), effects).scan(stmt);
+    return effects;
+}
+
+// =============================================================================
+// Loop-invariant code motion
+// =============================================================================
+
+size_t RedundancyPass::Analysis::hoistInvariants(Statement* loop, std::unique_ptr<Expression>& condition,
+                                                 std::unique_ptr<Expression>* increment,
+                                                 std::unique_ptr<BlockStatement>& body, Statements& hoisted) {
+    if (!condition) return 0;
+    Effects effects = effectsOf(loop);
+    auto invariant = [&](const Expression* expr) {
+        return !isLeaf(expr) && isPure(expr) && !changedBy(expr, effects);
+    };
+    size_t replaced = 0;
+    for (;;) {
+        std::unique_ptr<Expression>* found = nullptr;
+        findFirst(condition, invariant, found);
+        if (!found) break;
+        std::string name = freshName("__licm");
+        auto value = cloneExpression(found->get());
+        Occurrences uses(value.get(), name);
+        replaced += uses.in(condition);
+        if (increment) replaced += uses.in(*increment);
+        replaced += uses.in(body);
+        hoisted.push_back(declare(name, std::move(value), loop->line));
+    }
+    return replaced;
+}
+
+// =============================================================================
+// Common subexpression elimination
+// =============================================================================
+
+size_t RedundancyPass::Analysis::eliminateCommon(Statements& statements) {
+    std::vector<Effects> effects;
+    for (auto& stmt : statements) {
+        effects.push_back(effectsOf(stmt.get()));
+    }
+    size_t replaced = 0;
+    for (size_t i = 0; i < statements.size(); ++i) {
+        std::unique_ptr<Expression>* root = rootExpression(statements[i].get());
+        if (!root) continue;
+
+        // Statements from i up to `end` repeat the expression found
+        size_t end = i;
+        auto repeated = [&](const Expression* expr) {
+            if (isLeaf(expr) || !worthStoring(expr) || !isPure(expr) || changedBy(expr, effects[i])) return false;
+            Occurrences occurrences(expr, "");
+            size_t count = occurrences.in(statements[i]);
+            size_t last = i;
+            for (size_t j = i + 1; j < statements.size() && !changedBy(expr, effects[j]); ++j) {
+                if (size_t more = occurrences.in(statements[j])) {
+                    count += more;
+                    last = j;
+                }
+            }
+            end = last;
+            return count > 1;
+        };
+        std::unique_ptr<Expression>* found = nullptr;
+        findFirst(*root, repeated, found);
+        if (!found) continue;
+
+        std::string name = freshName("__cse");
+        auto value = cloneExpression(found->get());
+        Occurrences uses(value.get(), name);
+        for (size_t j = i; j <= end; ++j) {
+            replaced += uses.in(statements[j]);
+        }
+        // The statement is looked at again next, for what comes after the value
+        uint32_t line = statements[i]->line;
+        statements.insert(statements.begin() + static_cast<std::ptrdiff_t>(i), declare(name, std::move(value), line));
+        Effects declared;
+        declared.touched.insert(name);
+        effects.insert(effects.begin() + static_cast<std::ptrdiff_t>(i), std::move(declared));
+    }
+    return replaced;
+}
+
+// =============================================================================
+// Passes
+// =============================================================================
+
+RedundancyPass::RedundancyPass() : analysis(std::make_unique<Analysis>()) {}
+RedundancyPass::~RedundancyPass() = default;
+
+bool RedundancyPass::dependsOnImports() const {
+    // Whether a builtin is reached depends on the names the modules declare
+    return analysis->imports && analysis->rewroteProgram;
+}
+
+void RedundancyPass::begin(std::vector<std::unique_ptr<Statement>>& statements, const std::string& moduleName,
+                           const std::string&) {
+    Analysis& a = *analysis;
+    a.top = &statements;
+    a.inProgram = moduleName.empty();
+    a.fresh.clear();
+    if (a.inProgram) {
+        a.rewroteProgram = false;
+        a.analyze(statements);
+    }
+}
+
+void RedundancyPass::visit(FunctionDeclaration* node) {
+    Analysis& a = *analysis;
+    if (!a.complete) return;
+    a.fresh.push_back(FreshScanner(a.effectOf()).scan(node));
+    ASTRewriter::visit(node);
+    a.fresh.pop_back();
+}
+
+void LoopInvariantCodeMotionPass::visit(WhileStatement* node) {
+    ASTRewriter::visit(node);
+    Analysis& a = *analysis;
+    if (!a.complete) return;
+    Statements hoisted;
+    size_t replaced = a.hoistInvariants(node, node->condition, nullptr, node->body, hoisted);
+    if (hoisted.empty()) return;
+    a.rewroteProgram = a.rewroteProgram || a.inProgram;
+
+    // The loop runs in a new block that declares the hoisted values
+    auto loop = std::make_unique<WhileStatement>(std::move(node->condition), std::move(node->body));
+    loop->line = node->line;
+    auto block = std::make_unique<BlockStatement>();
+    block->statements = std::move(hoisted);
+    block->statements.push_back(std::move(loop));
+    changes += replaced - 1;
+    replace(std::move(block));
+}
+
+void LoopInvariantCodeMotionPass::visit(ForStatement* node) {
+    ASTRewriter::visit(node);
+    Analysis& a = *analysis;
+    if (!a.complete || !isInertInitializer(node->initializer.get())) return;
+    Statements hoisted;
+    size_t replaced = a.hoistInvariants(node, node->condition, &node->increment, node->body, hoisted);
+    if (hoisted.empty()) return;
+    a.rewroteProgram = a.rewroteProgram || a.inProgram;
+
+    auto loop = std::make_unique<ForStatement>(std::move(node->initializer), std::move(node->condition),
+                                               std::move(node->increment), std::move(node->body));
+    loop->line = node->line;
+    auto block = std::make_unique<BlockStatement>();
+    block->statements = std::move(hoisted);
+    block->statements.push_back(std::move(loop));
+    changes += replaced - 1;
+    replace(std::move(block));
+}
+
+void CommonSubexpressionEliminationPass::visitStatements(std::vector<std::unique_ptr<Statement>>& statements) {
+    // A block before the blocks in it, so that one variable serves the
+    // repeats in all of them
+    Analysis& a = *analysis;
+    // New variables at the top level would be globals (and module exports)
+    if (a.complete && &statements != a.top) {
+        size_t replaced = a.eliminateCommon(statements);
+        changes += replaced;
+        if (replaced > 0) a.rewroteProgram = a.rewroteProgram || a.inProgram;
+    }
+    ASTRewriter::visitStatements(statements);
+}
@@ -0,0 +1,297 @@
+#include "../../include/optimizer.h"
+#include "../../include/interpreter.h"
+#include "../../include/lexer.h"
+#include "../../include/parser.h"
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+using Statements = std::vector<std::unique_ptr<Statement>>;
+
+std::string moduleKey(const std::string& moduleName, const std::string& modulePath) {
+    return moduleName + "\n" + modulePath;
+}
+
+// Records the declarations of a unit
+class UnitScanner : public ASTRewriter {
+public:
+    explicit UnitScanner(ProgramUnit& unit) : unit(unit) {}
+
+    void scan() {
+        Statements& statements = *unit.statements;
+        for (size_t i = 0; i < statements.size(); ++i) {
+            top = statements[i].get();
+            index = i;
+            rewrite(statements[i]);
+        }
+    }
+
+    void visit(VariableDeclaration* node) override {
+        declare(node->name, node);
+        ASTRewriter::visit(node);
+    }
+
+    void visit(FunctionDeclaration* node) override {
+        declare(node->name, node);
+        if (!inStruct) {
+            unit.functions.push_back({node, index, node != top});
+        }
+        for (const std::string& parameter : node->parameters) {
+            declare(parameter, nullptr);
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(LambdaExpression* node) override {
+        for (const std::string& parameter : node->parameters) {
+            declare(parameter, nullptr);
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(TryStatement* node) override {
+        if (!node->errorVariable.empty()) {
+            declare(node->errorVariable, nullptr);
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(ImportStatement* node) override {
+        declare(node->alias.empty() ? node->moduleName : node->alias, node);
+        unit.imports.push_back({node->moduleName, node->modulePath, index, node != top});
+    }
+
+    void visit(StructDeclaration* node) override {
+        // Methods are called through an instance, never by name
+        declare(node->name, node);
+        inStruct = true;
+        ASTRewriter::visit(node);
+        inStruct = false;
+    }
+
+    void visit(AssignmentExpression* node) override {
+        if (node->left->kind == NodeKind::Identifier) {
+            unit.assigned.insert(static_cast<Identifier*>(node->left.get())->name);
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(CompoundAssignment* node) override {
+        if (node->target->kind == NodeKind::Identifier) {
+            unit.assigned.insert(static_cast<Identifier*>(node->target.get())->name);
+        }
+        ASTRewriter::visit(node);
+    }
+
+    void visit(UpdateExpression* node) override {
+        if (node->operand->kind == NodeKind::Identifier) {
+            unit.assigned.insert(static_cast<Identifier*>(node->operand.get())->name);
+        }
+    }
+
+private:
+    ProgramUnit& unit;
+    const Statement* top = nullptr;
+    size_t index = 0;
+    bool inStruct = false;
+
+    void declare(const std::string& name, const Statement* stmt) {
+        ++unit.declared[name];
+        if (stmt && stmt == top) {
+            unit.topLevel.insert(name);
+        }
+    }
+};
+
+// Whether a statement runs no user code: it calls no declared function,
+// creates no lambda, calls no methods, and imports only modules that run no
+// user code either
+class InertScanner : public ASTRewriter {
+public:
+    InertScanner(const std::unordered_map<std::string, int>& functions,
+                 std::function<bool(const ImportStatement*)> inertImport)
+        : functions(functions), inertImport(std::move(inertImport)) {}
+
+    bool isInert(std::unique_ptr<Statement>& stmt) {
+        inert = true;
+        rewrite(stmt);
+        return inert;
+    }
+
+    void visit(Identifier* node) override {
+        if (functions.count(node->name)) inert = false;
+    }
+
+    void visit(CallExpression* node) override {
+        if (functions.count(node->callee)) inert = false;
+        ASTRewriter::visit(node);
+    }
+
+    void visit(MethodCallExpression*) override { inert = false; }
+    void visit(LambdaExpression*) override { inert = false; }
+    void visit(FunctionDeclaration*) override {}
+
+    void visit(ImportStatement* node) override {
+        if (!inertImport(node)) inert = false;
+    }
+
+private:
+    const std::unordered_map<std::string, int>& functions;
+    std::function<bool(const ImportStatement*)> inertImport;
+    bool inert = true;
+};
+
+}  // namespace
+
+ProgramUnit* ProgramUnits::loadModule(const std::string& moduleName, const std::string& modulePath) {
+    std::string key = moduleKey(moduleName, modulePath);
+    for (auto& unit : units) {
+        if (unit->key == key) return unit.get();
+    }
+    auto it = modules.find(key);
+    if (it == modules.end()) {
+        try {
+            Lexer lexer(readModuleSource(moduleName, modulePath));
+            Parser parser(lexer.tokenize());
+            it = modules.emplace(key, parser.parse()).first;
+        } catch (const std::exception&) {
+            // The import fails when the program runs; until then nothing is known
+            return nullptr;
+        }
+    }
+    units.push_back(std::make_unique<ProgramUnit>());
+    units.back()->key = key;
+    units.back()->statements = &it->second;
+    return units.back().get();
+}
+
+ProgramUnit* ProgramUnits::findModule(const std::string& moduleName, const std::string& modulePath) const {
+    std::string key = moduleKey(moduleName, modulePath);
+    for (const auto& unit : units) {
+        if (unit->key == key) return unit.get();
+    }
+    return nullptr;
+}
+
+void ProgramUnits::analyze(std::vector<std::unique_ptr<Statement>>& program) {
+    units.clear();
+    functions.clear();
+    names.clear();
+    candidates.clear();
+    complete = true;
+
+    // The program and every module it imports, directly or not
+    units.push_back(std::make_unique<ProgramUnit>());
+    units[0]->statements = &program;
+    for (size_t i = 0; i < units.size(); ++i) {
+        ProgramUnit& unit = *units[i];
+        UnitScanner(unit).scan();
+        for (ProgramUnit::Import& import : unit.imports) {
+            ProgramUnit* module = loadModule(import.moduleName, import.modulePath);
+            if (!module) {
+                complete = false;
+                return;
+            }
+            import.target = static_cast<size_t>(std::find_if(units.begin(), units.end(), [&](const auto& u) {
+                                                     return u.get() == module;
+                                                 }) - units.begin());
+        }
+    }
+
+    // A module runs once per import that runs; imports inside other
+    // statements, or in units that run more than once, may run many times
+    units[0]->multiplicity = 1;
+    for (bool changed = true; changed;) {
+        changed = false;
+        std::vector<int> runs(units.size(), 0);
+        runs[0] = 1;
+        for (const auto& unit : units) {
+            for (const ProgramUnit::Import& import : unit->imports) {
+                int times = (import.nested || unit->multiplicity > 1) ? 2 : unit->multiplicity;
+                runs[import.target] = std::min(2, runs[import.target] + times);
+            }
+        }
+        for (size_t i = 0; i < units.size(); ++i) {
+            if (runs[i] != units[i]->multiplicity) {
+                units[i]->multiplicity = runs[i];
+                changed = true;
+            }
+        }
+    }
+
+    for (const auto& unit : units) {
+        for (const ProgramUnit::Function& function : unit->functions) {
+            int& count = functions[function.decl->name];
+            count = std::min(2, count + (function.nested ? 2 : unit->multiplicity));
+        }
+        for (const auto& declared : unit->declared) names.insert(declared.first);
+        names.insert(unit->assigned.begin(), unit->assigned.end());
+    }
+
+    std::unordered_map<const ProgramUnit*, int> inertMemo;
+    InertScanner inert(functions, [&](const ImportStatement* import) {
+        ProgramUnit* module = loadModule(import->moduleName, import->modulePath);
+        return module && inertModule(*module, inertMemo);
+    });
+    for (const auto& unit : units) {
+        Statements& statements = *unit->statements;
+        unit->inertEnd = 0;
+        while (unit->inertEnd < statements.size() && inert.isInert(statements[unit->inertEnd])) {
+            ++unit->inertEnd;
+        }
+    }
+
+    // A call made before the function is declared would fail (or reach a
+    // builtin): only functions declared before anything that could call them
+    // runs are candidates
+    std::unordered_map<const ProgramUnit*, bool> earlyMemo;
+    for (const auto& unit : units) {
+        if (!reachedEarly(*unit, earlyMemo)) continue;
+        for (const ProgramUnit::Function& function : unit->functions) {
+            const std::string& name = function.decl->name;
+            if (!function.nested && functions[name] == 1 && unit->declared[name] == 1 &&
+                function.index <= unit->inertEnd) {
+                candidates[name] = {unit.get(), function.decl};
+            }
+        }
+    }
+}
+
+bool ProgramUnits::inertModule(const ProgramUnit& unit, std::unordered_map<const ProgramUnit*, int>& memo) {
+    auto it = memo.find(&unit);
+    if (it != memo.end()) return it->second == 1;  // An import cycle (still 0) is not inert
+    memo[&unit] = 0;
+    InertScanner scanner(functions, [&](const ImportStatement* import) {
+        ProgramUnit* module = loadModule(import->moduleName, import->modulePath);
+        return module && inertModule(*module, memo);
+    });
+    bool inert = true;
+    for (auto& stmt : *unit.statements) {
+        if (!scanner.isInert(stmt)) {
+            inert = false;
+            break;
+        }
+    }
+    memo[&unit] = inert ? 1 : 2;
+    return inert;
+}
+
+bool ProgramUnits::reachedEarly(const ProgramUnit& unit, std::unordered_map<const ProgramUnit*, bool>& memo) {
+    if (&unit == units[0].get()) return true;
+    if (unit.multiplicity != 1) return false;
+    auto it = memo.find(&unit);
+    if (it != memo.end()) return it->second;
+    memo[&unit] = false;
+    // Imported once, by a top-level import that only inert statements precede
+    bool early = false;
+    for (const auto& importer : units) {
+        for (const ProgramUnit::Import& import : importer->imports) {
+            if (units[import.target].get() == &unit) {
+                early = import.index <= importer->inertEnd && reachedEarly(*importer, memo);
+            }
+        }
+    }
+    memo[&unit] = early;
+    return early;
+}
\ No newline at end of file
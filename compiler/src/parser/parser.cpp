@@ -516,6 +516,13 @@ std::unique_ptr<Expression> Parser::parsePrimary() {
 }
 
 std::unique_ptr<Statement> Parser::parseStatement() {
+    size_t line = peek().line;
+    auto statement = parseStatementKind();
+    statement->line = static_cast<uint32_t>(line);
+    return statement;
+}
+
+std::unique_ptr<Statement> Parser::parseStatementKind() {
     // SADK: import statement
     if (peek().type == TokenType::KW_IMPORT) {
         return parseImportStatement();
@@ -633,6 +640,7 @@ std::unique_ptr<Statement> Parser::parseFunctionDeclaration() {
     }
     
     std::vector<std::string> parameters;
+    std::vector<std::string> parameterTypes;
     if (!match(TokenType::RPAREN)) {
         do {
             // Check for variadic: ...args
@@ -640,6 +648,7 @@ std::unique_ptr<Statement> Parser::parseFunctionDeclaration() {
                 advance(); advance(); advance(); // consume ...
                 if (match(TokenType::IDENTIFIER)) {
                     parameters.push_back("..." + tokens[current - 1].lexeme);
+                    parameterTypes.push_back("");
                 }
                 break; // Variadic must be last
             }
@@ -649,20 +658,12 @@ std::unique_ptr<Statement> Parser::parseFunctionDeclaration() {
             }
             parameters.push_back(tokens[current - 1].lexeme);
             
-            // Skip optional type annotation: param: type
+            // Optional type annotation: param: type (a hint for type specialization)
+            std::string typeName = "";
             if (match(TokenType::COLON)) {
-                // Accept any type keyword or identifier as type annotation
-                if (match(TokenType::KW_INT) || match(TokenType::KW_FLOAT) ||
-                    match(TokenType::KW_STRING) || match(TokenType::KW_BOOL) ||
-                    match(TokenType::KW_ARRAY) || match(TokenType::KW_MAP) ||
-                    match(TokenType::IDENTIFIER)) {
-                    // Type annotation consumed, continue
-                    // Also check for nullable type (?)
-                    match(TokenType::QUESTION);
-                } else {
-                    throw std::runtime_error("Expected type after ':'");
-                }
+                typeName = parseTypeName("Expected type after ':'");
             }
+            parameterTypes.push_back(typeName);
         } while (match(TokenType::COMMA));
         
         if (!match(TokenType::RPAREN)) {
@@ -670,23 +671,36 @@ std::unique_ptr<Statement> Parser::parseFunctionDeclaration() {
         }
     }
     
-    // Skip optional return type annotation: -> type
+    // Optional return type annotation: -> type
+    std::string returnType = "";
     if (match(TokenType::ARROW)) {
-        // Accept any type keyword or identifier as return type
-        if (match(TokenType::KW_INT) || match(TokenType::KW_FLOAT) ||
-            match(TokenType::KW_STRING) || match(TokenType::KW_BOOL) ||
-            match(TokenType::KW_ARRAY) || match(TokenType::KW_MAP) ||
-            match(TokenType::IDENTIFIER)) {
-            // Return type annotation consumed
-            match(TokenType::QUESTION); // Optional nullable
-        } else {
-            throw std::runtime_error("Expected return type after '->'");
-        }
+        returnType = parseTypeName("Expected return type after '->'");
     }
     
     auto block = parseBlockStatement();
     BlockStatement* rawBlock = static_cast<BlockStatement*>(block.release());
-    return std::make_unique<FunctionDeclaration>(name, parameters, std::unique_ptr<BlockStatement>(rawBlock));
+    auto function = std::make_unique<FunctionDeclaration>(name, parameters, std::unique_ptr<BlockStatement>(rawBlock));
+    function->parameterTypes = std::move(parameterTypes);
+    function->returnType = std::move(returnType);
+    return function;
+}
+
+std::string Parser::parseTypeName(const char* error) {
+    std::string typeName;
+    if (match(TokenType::KW_INT)) typeName = "int";
+    else if (match(TokenType::KW_FLOAT)) typeName = "float";
+    else if (match(TokenType::KW_STRING)) typeName = "string";
+    else if (match(TokenType::KW_BOOL)) typeName = "bool";
+    else if (match(TokenType::KW_ARRAY)) typeName = "array";
+    else if (match(TokenType::KW_MAP)) typeName = "map";
+    else if (match(TokenType::IDENTIFIER)) typeName = tokens[current - 1].lexeme;
+    else throw std::runtime_error(error);
+    
+    // Nullable type (?)
+    if (match(TokenType::QUESTION)) {
+        typeName += "?";
+    }
+    return typeName;
 }
 
 std::unique_ptr<Statement> Parser::parseBlockStatement() {
@@ -7,13 +7,24 @@ echo.
 REM Compile all tests
 echo Compiling tests...
 g++ -std=c++17 -Icompiler/include tests/test_lexer.cpp compiler/src/lexer/lexer.cpp -o test_lexer.exe
-g++ -std=c++17 -Icompiler/include tests/test_parser.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/codegen/code_generator.cpp -o test_parser.exe
-g++ -std=c++17 -Icompiler/include tests/test_semantic.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/semantic/semantic_analyzer.cpp -o test_semantic.exe
-g++ -std=c++17 -Icompiler/include tests/test_codegen.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/codegen/code_generator.cpp -o test_codegen.exe
-g++ -std=c++17 -Icompiler/include tests/test_while_loop.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/codegen/code_generator.cpp -o test_while_loop.exe
-g++ -std=c++17 -Icompiler/include tests/test_break_continue.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/semantic/semantic_analyzer.cpp compiler/src/codegen/code_generator.cpp -o test_break_continue.exe
-g++ -std=c++17 -Icompiler/include tests/test_for_loop.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/codegen/code_generator.cpp -o test_for_loop.exe
-g++ -std=c++17 -Icompiler/include tests/test_arrays.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/semantic/semantic_analyzer.cpp compiler/src/codegen/code_generator.cpp -o test_arrays.exe
+g++ -std=c++17 -Icompiler/include tests/test_parser.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/codegen/code_generator.cpp -o test_parser.exe
+g++ -std=c++17 -Icompiler/include tests/test_semantic.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/semantic/semantic_analyzer.cpp -o test_semantic.exe
+g++ -std=c++17 -Icompiler/include tests/test_codegen.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/codegen/code_generator.cpp -o test_codegen.exe
+g++ -std=c++17 -Icompiler/include tests/test_while_loop.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/codegen/code_generator.cpp -o test_while_loop.exe
+g++ -std=c++17 -Icompiler/include tests/test_break_continue.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/semantic/semantic_analyzer.cpp compiler/src/codegen/code_generator.cpp -o test_break_continue.exe
+g++ -std=c++17 -Icompiler/include tests/test_for_loop.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/codegen/code_generator.cpp -o test_for_loop.exe
+g++ -std=c++17 -Icompiler/include tests/test_arrays.cpp compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/semantic/semantic_analyzer.cpp compiler/src/codegen/code_generator.cpp -o test_arrays.exe
+g++ -std=c++17 -Icompiler/include tests/test_symbols.cpp compiler/src/ast/symbol.cpp -o test_symbols.exe
+
+REM The runtime tests link the interpreter, optimizer and bytecode VM
+set RUNTIME_SRC=compiler/src/lexer/lexer.cpp compiler/src/parser/parser.cpp compiler/src/ast/ast_visitor.cpp compiler/src/ast/symbol.cpp compiler/src/interpreter/interpreter.cpp compiler/src/interpreter/resolver.cpp compiler/src/interpreter/type_specializer.cpp compiler/src/optimizer/optimizer.cpp compiler/src/optimizer/inliner.cpp compiler/src/optimizer/units.cpp compiler/src/optimizer/ctfe.cpp compiler/src/optimizer/effects.cpp compiler/src/optimizer/redundancy.cpp compiler/src/bytecode/bytecode_compiler.cpp compiler/src/bytecode/bytecode_peephole.cpp compiler/src/bytecode/bytecode_cache.cpp compiler/src/bytecode/vm.cpp compiler/src/bytecode/jit.cpp compiler/src/bytecode/vm_profiler.cpp compiler/src/http/http_client.cpp compiler/src/http/http_server.cpp
+g++ -std=c++17 -Icompiler/include tests/test_optimizer.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_optimizer.exe
+g++ -std=c++17 -Icompiler/include tests/test_bytecode_cache.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_bytecode_cache.exe
+g++ -std=c++17 -Icompiler/include tests/test_peephole.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_peephole.exe
+g++ -std=c++17 -Icompiler/include tests/test_vm_profiler.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_vm_profiler.exe
+g++ -std=c++17 -Icompiler/include tests/test_vm_dispatch.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_vm_dispatch.exe
+g++ -std=c++17 -Icompiler/include tests/test_shapes.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_shapes.exe
+g++ -std=c++17 -Icompiler/include tests/test_type_specializer.cpp %RUNTIME_SRC% -lwinhttp -lws2_32 -o test_type_specializer.exe
 
 echo.
 echo Running tests...
@@ -146,6 +157,134 @@ if exist test_arrays.exe (
     echo [WARN] Arrays test executable not found!
 )
 
+echo.
+
+REM Run symbols test
+if exist test_symbols.exe (
+    echo Testing symbols...
+    .\test_symbols.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Symbols test passed!
+    ) else (
+        echo [FAIL] Symbols test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Symbols test executable not found!
+)
+
+echo.
+
+REM Run optimizer test
+if exist test_optimizer.exe (
+    echo Testing optimizer...
+    .\test_optimizer.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Optimizer test passed!
+    ) else (
+        echo [FAIL] Optimizer test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Optimizer test executable not found!
+)
+
+echo.
+
+REM Run bytecode cache test
+if exist test_bytecode_cache.exe (
+    echo Testing bytecode cache...
+    .\test_bytecode_cache.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Bytecode cache test passed!
+    ) else (
+        echo [FAIL] Bytecode cache test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Bytecode cache test executable not found!
+)
+
+echo.
+
+REM Run peephole pass test
+if exist test_peephole.exe (
+    echo Testing peephole pass...
+    .\test_peephole.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Peephole pass test passed!
+    ) else (
+        echo [FAIL] Peephole pass test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Peephole pass test executable not found!
+)
+
+echo.
+
+REM Run VM profiler test
+if exist test_vm_profiler.exe (
+    echo Testing VM profiler...
+    .\test_vm_profiler.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] VM profiler test passed!
+    ) else (
+        echo [FAIL] VM profiler test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] VM profiler test executable not found!
+)
+
+echo.
+
+REM Run VM dispatch test
+if exist test_vm_dispatch.exe (
+    echo Testing VM dispatch...
+    .\test_vm_dispatch.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] VM dispatch test passed!
+    ) else (
+        echo [FAIL] VM dispatch test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] VM dispatch test executable not found!
+)
+
+echo.
+
+REM Run struct shapes test
+if exist test_shapes.exe (
+    echo Testing struct shapes...
+    .\test_shapes.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Struct shapes test passed!
+    ) else (
+        echo [FAIL] Struct shapes test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Struct shapes test executable not found!
+)
+
+echo.
+
+REM Run type specializer test
+if exist test_type_specializer.exe (
+    echo Testing type specializer...
+    .\test_type_specializer.exe
+    if %ERRORLEVEL% EQU 0 (
+        echo [PASS] Type specializer test passed!
+    ) else (
+        echo [FAIL] Type specializer test failed!
+        exit /b %ERRORLEVEL%
+    )
+) else (
+    echo [WARN] Type specializer test executable not found!
+)
+
 echo.
 echo ========================================
 echo   All tests completed!
@@ -0,0 +1,156 @@
+#include "test_helpers.h"
+#include "../include/bytecode_cache.h"
+#include <iostream>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+static bool rejects(const std::string& data, uint64_t hash, const std::string& tag) {
+    try {
+        deserializeChunk(data.data(), data.size(), hash, tag);
+        return false;
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+}
+
+static const std::string kSource =
+    "struct Point { x: int, y: int }\n"
+    "fn scale(p, k) { return Point(p.x * k, p.y * k) }\n"
+    "let m = {\"a\": 1.5, \"b\": [1, 2, true]}\n"
+    "try { print(scale(Point(1, 2), 3).y) } catch (e) { print(e) }\n";
+
+void testRoundTrip() {
+    BytecodeChunk chunk = compileSource(kSource);
+    uint64_t hash = hashBytes(kSource.data(), kSource.size());
+
+    std::string data = serializeChunk(chunk, hash, "test");
+    BytecodeChunk loaded = deserializeChunk(data.data(), data.size(), hash, "test");
+    assert(loaded.constants == chunk.constants);
+    assert(loaded.names == chunk.names);
+    assert(loaded.memberSites == chunk.memberSites);
+    assert(loaded.functions.size() == chunk.functions.size());
+    for (size_t i = 0; i < chunk.functions.size(); ++i) {
+        const auto& a = chunk.functions[i];
+        const auto& b = loaded.functions[i];
+        assert(a.name == b.name && a.parameters == b.parameters);
+        assert(a.registerCount == b.registerCount);
+        assert(a.frameCaptured == b.frameCaptured && a.usesUpvalues == b.usesUpvalues);
+        assert(a.code.size() == b.code.size());
+        for (size_t j = 0; j < a.code.size(); ++j) {
+            assert(a.code[j].opcode == b.code[j].opcode);
+            assert(a.code[j].a == b.code[j].a && a.code[j].b == b.code[j].b && a.code[j].c == b.code[j].c);
+        }
+        assert(a.lines.size() == b.lines.size());
+        for (size_t j = 0; j < a.lines.size(); ++j) {
+            assert(a.lines[j].pc == b.lines[j].pc && a.lines[j].line == b.lines[j].line);
+        }
+        assert(a.handlers.size() == b.handlers.size());
+        for (size_t j = 0; j < a.handlers.size(); ++j) {
+            assert(a.handlers[j].start == b.handlers[j].start && a.handlers[j].end == b.handlers[j].end);
+            assert(a.handlers[j].target == b.handlers[j].target);
+            assert(a.handlers[j].messageRegister == b.handlers[j].messageRegister);
+        }
+    }
+    assert(loaded.functions[0].handlers.size() == 1);
+    assert(loaded.structs.size() == 1 && loaded.structs[0].fields.size() == 2);
+    assert(loaded.mapLayouts.size() == chunk.mapLayouts.size());
+    assert(serializeChunk(loaded, hash, "test") == data);
+
+    std::cout << "Round trip test passed!" << std::endl;
+}
+
+void testRejectsStaleEntries() {
+    uint64_t hash = hashBytes(kSource.data(), kSource.size());
+    std::string data = serializeChunk(compileSource(kSource), hash, "test");
+
+    // Another source, another compiler, a truncated or damaged file
+    assert(rejects(data, hash + 1, "test"));
+    assert(rejects(data, hash, "other"));
+    assert(rejects(data.substr(0, data.size() - 1), hash, "test"));
+    std::string flipped = data;
+    flipped[flipped.size() - 3] ^= 0x40;
+    assert(rejects(flipped, hash, "test"));
+    assert(rejects("", hash, "test"));
+
+    std::cout << "Stale entry test passed!" << std::endl;
+}
+
+// The first instruction of the chunk's functions with opcode `op`
+static Instruction& find(BytecodeChunk& chunk, OpCode op) {
+    for (auto& fn : chunk.functions) {
+        for (auto& instr : fn.code) {
+            if (instr.opcode == op) return instr;
+        }
+    }
+    assert(false && "opcode not found");
+    return chunk.functions[0].code[0];
+}
+
+void testRejectsBadOperands() {
+    uint64_t hash = hashBytes(kSource.data(), kSource.size());
+    // Well-formed files with a valid checksum whose code indexes out of bounds
+    auto rejectsCorrupted = [&](const std::function<void(BytecodeChunk&)>& corrupt) {
+        BytecodeChunk chunk = compileSource(kSource);
+        corrupt(chunk);
+        return rejects(serializeChunk(chunk, hash, "test"), hash, "test");
+    };
+
+    assert(!rejectsCorrupted([](BytecodeChunk&) {}));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::LOAD_CONST).a = static_cast<uint16_t>(chunk.functions[0].registerCount);
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::LOAD_CONST).setBx(static_cast<uint32_t>(chunk.constants.size()));
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::JUMP).setBx(static_cast<uint32_t>(chunk.functions[0].code.size()));
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::CALL).b = static_cast<uint16_t>(chunk.names.size());
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::GET_MEMBER).c = static_cast<uint16_t>(chunk.memberSites.size());
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::MAKE_MAP).c = static_cast<uint16_t>(chunk.mapLayouts.size());
+    }));
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) {
+        find(chunk, OpCode::DEFINE_STRUCT).setBx(static_cast<uint32_t>(chunk.structs.size()));
+    }));
+    // Running off the end of a function
+    assert(rejectsCorrupted([](BytecodeChunk& chunk) { chunk.functions[0].code.pop_back(); }));
+
+    // A damaged entry on disk is a miss: the program is compiled again
+    std::string dir = (std::filesystem::temp_directory_path() / "synthflow_cache_test").string();
+    std::filesystem::remove_all(dir);
+    BytecodeCache cache(dir, "test");
+    cache.store(kSource, compileSource(kSource));
+    assert(cache.load(kSource).has_value());
+    BytecodeChunk damaged = compileSource(kSource);
+    find(damaged, OpCode::MOVE).b = static_cast<uint16_t>(kMaxOperand);
+    {
+        std::ofstream file(cache.entryPath(kSource), std::ios::binary | std::ios::trunc);
+        file << serializeChunk(damaged, hash, "test");
+    }
+    assert(!cache.load(kSource).has_value());
+    std::filesystem::remove_all(dir);
+
+    std::cout << "Bad operand test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testRoundTrip();
+        testRejectsStaleEntries();
+        testRejectsBadOperands();
+        std::cout << "All bytecode cache tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/resolver.h"
+#include "../include/type_specializer.h"
+#include "../include/bytecode_compiler.h"
+#include <cassert>
+#include <string>
+
+// Shared by the bytecode and VM tests
+
+// Compile `source` the way the VM engine does without -O: type specialized
+// after the resolver, but without the AST passes
+inline BytecodeChunk compileSource(const std::string& source) {
+    Lexer lexer(source);
+    Parser parser(lexer.tokenize());
+    auto statements = parser.parse();
+    Resolver resolver;
+    resolver.resolve(statements);
+    TypeSpecializer().specialize(statements);
+    BytecodeCompiler compiler;
+    return compiler.compile(statements);
+}
+
+// The compiled function named `name`
+inline const CompiledFunction& function(const BytecodeChunk& chunk, const std::string& name) {
+    for (const auto& fn : chunk.functions) {
+        if (fn.name == name) return fn;
+    }
+    assert(false && "function not found");
+    return chunk.functions[0];
+}
+
+// How many of `fn`'s instructions are `op`
+inline size_t count(const CompiledFunction& fn, OpCode op) {
+    size_t n = 0;
+    for (const auto& instr : fn.code) {
+        if (instr.opcode == op) ++n;
+    }
+    return n;
+}
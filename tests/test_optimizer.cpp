@@ -0,0 +1,283 @@
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/resolver.h"
+#include "../include/optimizer.h"
+#include <iostream>
+#include <cassert>
+#include <sstream>
+
+static std::vector<std::unique_ptr<Statement>> parseSource(const std::string& source) {
+    Lexer lexer(source);
+    Parser parser(lexer.tokenize());
+    return parser.parse();
+}
+
+template <typename T>
+static T* initializerOf(const std::unique_ptr<Statement>& stmt) {
+    assert(stmt->kind == NodeKind::VariableDeclaration);
+    auto* decl = static_cast<VariableDeclaration*>(stmt.get());
+    return static_cast<T*>(decl->initializer.get());
+}
+
+void testConstantFolding() {
+    // Folding uses the runtime's operators: `/` always yields a float, `+`
+    // with a string concatenates, and anything that would raise is kept
+    auto program = parseSource(
+        "let a = 1 + 2 * 3\n"
+        "let b = 7 / 2\n"
+        "let c = \"n=\" + 4\n"
+        "let d = 1 / 0\n"
+        "let e = 5 % 0\n"
+        "let f = !(2 > 3) && 1 == 1.0\n"
+        "let g = \"s\" * 2\n"
+        "let h = -(-5)\n");
+    ConstantFoldingPass fold;
+    assert(fold.run(program) == 10);
+    assert(program[0]->kind == NodeKind::VariableDeclaration);
+    assert(initializerOf<IntegerLiteral>(program[0])->kind == NodeKind::IntegerLiteral);
+    assert(initializerOf<IntegerLiteral>(program[0])->value == 7);
+    assert(initializerOf<FloatLiteral>(program[1])->kind == NodeKind::FloatLiteral);
+    assert(initializerOf<FloatLiteral>(program[1])->value == 3.5);
+    assert(initializerOf<StringLiteral>(program[2])->value == "n=4");
+    assert(initializerOf<Expression>(program[3])->kind == NodeKind::BinaryExpression);
+    assert(initializerOf<Expression>(program[4])->kind == NodeKind::BinaryExpression);
+    assert(initializerOf<BooleanLiteral>(program[5])->value == true);
+    assert(initializerOf<Expression>(program[6])->kind == NodeKind::BinaryExpression);
+    assert(initializerOf<IntegerLiteral>(program[7])->value == 5);
+    assert(fold.run(program) == 0);
+
+    std::cout << "Constant folding test passed!" << std::endl;
+}
+
+void testDeadCodeElimination() {
+    // Dead code: literal conditions and statements after a return, in
+    // nested functions too; declarations after the return stay. A kept branch
+    // is merged into the enclosing block unless it declares something.
+    auto program = parseSource(
+        "fn f(x) {\n"
+        "    if (true) { x = x + 1 } else { x = 0 }\n"
+        "    while (false) { x = x - 1 }\n"
+        "    if (false) { x = 0 } else { let y = x x = y }\n"
+        "    return x\n"
+        "    print(x)\n"
+        "    fn later() { return 1 }\n"
+        "}\n"
+        "if (0) { print(1) }\n"
+        "print(f(1))\n");
+    DeadCodeEliminationPass dce;
+    assert(dce.run(program) == 6);
+    assert(program.size() == 2);
+    auto* f = static_cast<FunctionDeclaration*>(program[0].get());
+    assert(f->body->statements.size() == 4);
+    assert(f->body->statements[0]->kind == NodeKind::ExpressionStatement);
+    assert(f->body->statements[0]->line == 2);
+    assert(f->body->statements[1]->kind == NodeKind::BlockStatement);
+    assert(f->body->statements[1]->line == 4);
+    assert(f->body->statements[2]->kind == NodeKind::ReturnStatement);
+    assert(f->body->statements[3]->kind == NodeKind::FunctionDeclaration);
+
+    std::cout << "Dead code elimination test passed!" << std::endl;
+}
+
+void testPipelineRepeats() {
+    // -O2 repeats the pipeline until nothing changes; each run is recorded
+    auto program = parseSource("if (1 + 1 == 2) { print(\"yes\") } else { print(\"no\") }\n");
+    Optimizer level2(2);
+    level2.optimize(program);
+    assert(program.size() == 1 && program[0]->kind == NodeKind::ExpressionStatement);
+    assert(level2.runs().size() == 12);
+    assert(level2.runs()[0].pass == "fold" && level2.runs()[0].changes == 2);
+    assert(level2.runs()[1].pass == "ctfe" && level2.runs()[1].changes == 0);
+    assert(level2.runs()[2].pass == "dce" && level2.runs()[2].changes == 2);
+    assert(level2.runs()[3].pass == "inline" && level2.runs()[3].changes == 0);
+    assert(level2.runs()[5].pass == "licm" && level2.runs()[5].changes == 0);
+    assert(level2.runs()[6].round == 2 && level2.runs()[6].changes == 0);
+    std::ostringstream report;
+    level2.printReport(report);
+    assert(report.str().find("fold") != std::string::npos);
+
+    std::cout << "Pipeline test passed!" << std::endl;
+}
+
+void testPassSelection() {
+    // -O1 runs each pass once; --passes picks passes by name
+    assert(Optimizer(1).runs().empty());
+    assert(Optimizer::pipeline(1) == std::vector<std::string>({"fold", "dce", "specialize"}));
+    auto program = parseSource("let x = 2 * 3\n");
+    Optimizer only(std::vector<std::string>{"dce"});
+    only.optimize(program);
+    assert(initializerOf<Expression>(program[0])->kind == NodeKind::BinaryExpression);
+    bool threw = false;
+    try {
+        Optimizer unknown(std::vector<std::string>{"nope"});
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // `specialize` runs after the resolver, at every level, and only when
+    // --passes names it
+    assert(Optimizer::pipeline(0) == std::vector<std::string>({"specialize"}));
+    assert(Optimizer(0).specializes() && !Optimizer(0).rewrites());
+    assert(!only.specializes());
+    auto typed = parseSource("fn twice(n: int) { return n * 2 }\n");
+    Resolver().resolve(typed);
+    only.specialize(typed);
+    assert(only.runs().size() == 1);
+    Optimizer specializer(std::vector<std::string>{"specialize"});
+    specializer.specialize(typed);
+    assert(specializer.runs().size() == 1 && specializer.runs()[0].pass == "specialize");
+    assert(specializer.runs()[0].changes == 1);
+
+    std::cout << "Pass selection test passed!" << std::endl;
+}
+
+void testInlining() {
+    // Inlining (-OO): a one-expression body replaces the call, with the
+    // arguments substituted; an `if` chain becomes statements ahead of the
+    // call's statement that assign the declared variable; recursive
+    // functions keep their calls
+    assert(Optimizer::pipeline(2) == std::vector<std::string>({"fold", "ctfe", "dce", "inline", "cse", "licm", "specialize"}));
+    auto program = parseSource(
+        "fn sq(x) { return x * x }\n"
+        "fn sign(x) {\n"
+        "    if (x < 0) { return -1 }\n"
+        "    return 1\n"
+        "}\n"
+        "fn fact(n) {\n"
+        "    if (n < 2) { return 1 }\n"
+        "    return n * fact(n - 1)\n"
+        "}\n"
+        "fn use(a) {\n"
+        "    let s = sq(a)\n"
+        "    let t = sign(a - 1)\n"
+        "    return fact(s + t)\n"
+        "}\n");
+    FunctionInliningPass inliner;
+    assert(inliner.run(program) == 2);
+    auto* use = static_cast<FunctionDeclaration*>(program[3].get());
+    auto& body = use->body->statements;
+    assert(body.size() == 4);
+    auto* square = initializerOf<BinaryExpression>(body[0]);
+    assert(square->kind == NodeKind::BinaryExpression && square->op == "*");
+    assert(static_cast<Identifier*>(square->left.get())->name == "a");
+    assert(initializerOf<Expression>(body[1])->kind == NodeKind::NullLiteral);
+    assert(body[2]->kind == NodeKind::IfStatement && body[2]->line == 12);
+    auto* negative = static_cast<BinaryExpression*>(static_cast<IfStatement*>(body[2].get())->condition.get());
+    assert(negative->left->kind == NodeKind::BinaryExpression);
+    auto* ret = static_cast<ReturnStatement*>(body[3].get());
+    assert(static_cast<CallExpression*>(ret->value.get())->callee == "fact");
+    auto* fact = static_cast<FunctionDeclaration*>(program[2].get());
+    assert(fact->body->statements.size() == 2);
+    assert(!inliner.dependsOnImports());
+
+    std::cout << "Inlining test passed!" << std::endl;
+}
+
+void testBuiltinEffects() {
+    // Builtins by effect; a name that is not a builtin may run anything
+    assert(builtinEffect("len") == BuiltinEffect::None);
+    assert(builtinEffect("range") == BuiltinEffect::Allocates);
+    assert(builtinEffect("push") == BuiltinEffect::Mutates);
+    assert(builtinEffect("print") == BuiltinEffect::External);
+    assert(builtinEffect("serve") == BuiltinEffect::CallsBack);
+    assert(builtinEffect("fact") == BuiltinEffect::CallsBack);
+
+    std::cout << "Builtin effect test passed!" << std::endl;
+}
+
+void testLoopInvariantsAndCse() {
+    // Loop-invariant code motion and common subexpressions (-OO): `len(xs)`
+    // moves ahead of the first loop, as only the function's own `out` changes;
+    // `len(ys)` stays, as the loop changes `ys`; `xs[i]` is read once
+    auto program = parseSource(
+        "fn squares(xs, ys) {\n"
+        "    let out = []\n"
+        "    for (let i = 0; i < len(xs); i = i + 1) {\n"
+        "        push(out, xs[i] * xs[i])\n"
+        "    }\n"
+        "    let j = 0\n"
+        "    while (j < len(ys)) {\n"
+        "        push(ys, j)\n"
+        "        j = j + 1\n"
+        "    }\n"
+        "    return out\n"
+        "}\n");
+    LoopInvariantCodeMotionPass licm;
+    assert(licm.run(program) == 1);
+    auto& squares = static_cast<FunctionDeclaration*>(program[0].get())->body->statements;
+    assert(squares.size() == 5);
+    assert(squares[1]->kind == NodeKind::BlockStatement && squares[1]->line == 3);
+    auto& hoisted = static_cast<BlockStatement*>(squares[1].get())->statements;
+    assert(hoisted.size() == 2 && hoisted[1]->kind == NodeKind::ForStatement);
+    assert(static_cast<VariableDeclaration*>(hoisted[0].get())->name == "__licm1");
+    assert(initializerOf<CallExpression>(hoisted[0])->callee == "len");
+    assert(squares[3]->kind == NodeKind::WhileStatement);
+    CommonSubexpressionEliminationPass cse;
+    assert(cse.run(program) == 2);
+    auto& loopBody = static_cast<ForStatement*>(hoisted[1].get())->body->statements;
+    assert(loopBody.size() == 2);
+    assert(initializerOf<ArrayIndexExpression>(loopBody[0])->kind == NodeKind::ArrayIndexExpression);
+    assert(cse.run(program) == 0 && licm.run(program) == 0);
+
+    std::cout << "Loop-invariant code motion test passed!" << std::endl;
+}
+
+void testCompileTimeEvaluation() {
+    // Compile-time evaluation (-OO): constants, a lookup table read by index
+    // and `len`, and calls to a function with a loop become literals; a call
+    // that runs out of fuel, one that reads a variable and the table itself stay
+    auto program = parseSource(
+        "const N = 10\n"
+        "const PRIMES = [2, 3, 5, 7]\n"
+        "fn fib(n) {\n"
+        "    let a = 0\n"
+        "    let b = 1\n"
+        "    for (let i = 0; i < n; i = i + 1) {\n"
+        "        let t = a + b\n"
+        "        a = b\n"
+        "        b = t\n"
+        "    }\n"
+        "    return a\n"
+        "}\n"
+        "fn spin() {\n"
+        "    while (true) {}\n"
+        "}\n"
+        "let k = 3\n"
+        "let a = fib(N) + PRIMES[2]\n"
+        "let b = \"${len(PRIMES)} primes\"\n"
+        "let c = spin()\n"
+        "let d = fib(k)\n"
+        "let e = PRIMES[k]\n");
+    CompileTimeEvaluationPass ctfe;
+    assert(ctfe.run(program) == 6);
+    assert(initializerOf<IntegerLiteral>(program[5])->kind == NodeKind::IntegerLiteral);
+    assert(initializerOf<IntegerLiteral>(program[5])->value == 60);
+    assert(initializerOf<StringLiteral>(program[6])->value == "4 primes");
+    assert(initializerOf<Expression>(program[7])->kind == NodeKind::CallExpression);
+    assert(initializerOf<Expression>(program[8])->kind == NodeKind::CallExpression);
+    assert(initializerOf<Expression>(program[9])->kind == NodeKind::ArrayIndexExpression);
+    assert(initializerOf<Expression>(program[1])->kind == NodeKind::ArrayLiteral);
+    assert(!ctfe.dependsOnImports());
+
+    std::cout << "Compile-time evaluation test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testConstantFolding();
+        testDeadCodeElimination();
+        testPipelineRepeats();
+        testPassSelection();
+        testInlining();
+        testBuiltinEffects();
+        testLoopInvariantsAndCse();
+        testCompileTimeEvaluation();
+        std::cout << "All optimizer tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -58,6 +58,28 @@ void testFunctionDeclaration() {
     std::cout << "Function declaration test passed!" << std::endl;
 }
 
+void testFunctionAnnotations() {
+    std::string source = "fn dot(a: array, b: array, n: int?, rest) -> float { return 0.0; }";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+
+    Parser parser(std::move(tokens));
+    auto statements = parser.parse();
+
+    auto funcDecl = dynamic_cast<FunctionDeclaration*>(statements[0].get());
+    assert(funcDecl != nullptr);
+
+    // Annotations are kept per parameter, "" where there is none
+    assert(funcDecl->parameterTypes.size() == 4);
+    assert(funcDecl->parameterTypes[0] == "array");
+    assert(funcDecl->parameterTypes[1] == "array");
+    assert(funcDecl->parameterTypes[2] == "int?");
+    assert(funcDecl->parameterTypes[3] == "");
+    assert(funcDecl->returnType == "float");
+
+    std::cout << "Function annotations test passed!" << std::endl;
+}
+
 void testExpressionParsing() {
     std::string source = "let result = 10 + 20 * 3;";
     Lexer lexer(source);
@@ -86,6 +108,7 @@ int main() {
     try {
         testVariableDeclaration();
         testFunctionDeclaration();
+        testFunctionAnnotations();
         testExpressionParsing();
         std::cout << "All parser tests passed!" << std::endl;
     } catch (const std::exception& e) {
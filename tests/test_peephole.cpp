@@ -0,0 +1,113 @@
+#include "test_helpers.h"
+#include "../include/bytecode_peephole.h"
+#include <iostream>
+#include <cassert>
+
+void testConstantPool() {
+    // Equal constants share a pool entry; 0.0 and -0.0 do not
+    BytecodeChunk pool;
+    assert(pool.addConstant(int64_t(1)) == 0);
+    assert(pool.addConstant(std::string("a")) == 1);
+    assert(pool.addConstant(int64_t(1)) == 0);
+    assert(pool.addConstant(1.0) == 2);
+    assert(pool.addConstant(0.0) == 3);
+    assert(pool.addConstant(-0.0) == 4);
+    assert(pool.addConstant(std::string("a")) == 1);
+    assert(pool.constants.size() == 5);
+
+    std::cout << "Constant pool test passed!" << std::endl;
+}
+
+void testBranchesAndJumps() {
+    BytecodeChunk chunk = compileSource(
+        "fn count(n) {\n"
+        "    let total = 0\n"
+        "    for (let i = 0; i < n; i++) { total = total + i }\n"
+        "    let k = n\n"
+        "    while (k > 0) { k = k - 1 }\n"
+        "    return total + k\n"
+        "}\n"
+        "fn pick(a, b) {\n"
+        "    let label = \"none\"\n"
+        "    if (a > 0) {\n"
+        "        if (b > 0) { label = \"both\" } else { label = \"a\" }\n"
+        "    } else {\n"
+        "        label = \"b\"\n"
+        "    }\n"
+        "    return label\n"
+        "}\n");
+
+    // Loop back edges are compare-and-branch instructions
+    const CompiledFunction& loops = function(chunk, "count");
+    assert(count(loops, OpCode::INC_BRANCH_LT) == 1);
+    assert(count(loops, OpCode::BRANCH_GT) == 1);
+    assert(count(loops, OpCode::INC) == 0);
+
+    // No jump lands on another jump, and the dead "none" store is gone
+    const CompiledFunction& branches = function(chunk, "pick");
+    for (const auto& instr : branches.code) {
+        if (instr.opcode == OpCode::JUMP) {
+            assert(branches.code[instr.bx()].opcode != OpCode::JUMP);
+            assert(branches.code[instr.bx()].opcode != OpCode::RETURN);
+        }
+    }
+    assert(count(branches, OpCode::LOAD_CONST) == 3);
+
+    // Nothing follows the last RETURN
+    for (const auto& fn : chunk.functions) {
+        assert(fn.code.back().opcode == OpCode::RETURN);
+    }
+
+    std::cout << "Branch and jump test passed!" << std::endl;
+}
+
+void testHandlersKept() {
+    // A catch clause is only reached through the handler table, but is kept
+    BytecodeChunk chunk = compileSource(
+        "fn safe(xs, n) {\n"
+        "    let total = 0\n"
+        "    for (let i = 0; i < n; i++) {\n"
+        "        try { total = total + xs[i] } catch (e) { total = total - 1 }\n"
+        "    }\n"
+        "    return total\n"
+        "}\n");
+    const CompiledFunction& safe = function(chunk, "safe");
+    assert(safe.handlers.size() == 1);
+    const ExceptionHandler& handler = safe.handlers[0];
+    assert(handler.start < handler.end && handler.end <= handler.target);
+    assert(handler.target < safe.code.size() && safe.code[handler.target].opcode == OpCode::SUB);
+    assert(safe.code[handler.start].opcode == OpCode::INDEX);
+
+    std::cout << "Handler test passed!" << std::endl;
+}
+
+void testSkippedJumpKept() {
+    // The jump a test skips stays one instruction, even when it goes to the next one
+    BytecodeChunk chunk;
+    CompiledFunction guarded;
+    guarded.registerCount = 1;
+    guarded.code = {
+        Instruction(OpCode::TEST_LT, 0, 0, kConstantOperand),
+        Instruction(OpCode::JUMP, 0, 2),
+        Instruction(OpCode::RETURN, 0),
+    };
+    optimizePeephole(guarded, chunk);
+    assert(guarded.code.size() == 3 && guarded.code[1].opcode == OpCode::RETURN);
+
+    std::cout << "Skipped jump test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testConstantPool();
+        testBranchesAndJumps();
+        testHandlersKept();
+        testSkippedJumpKept();
+        std::cout << "All peephole tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "test_helpers.h"
+#include "../include/vm.h"
+#include "../include/vm_profiler.h"
+#include <iostream>
+#include <cassert>
+#include <sstream>
+
+void testShapeTransitions() {
+    // Adding the same fields in the same order always reaches the same shape
+    Symbol x("x"), y("y");
+    const Shape* root = Shape::root("Pair");
+    assert(Shape::root("Pair") == root && Shape::root("Other") != root);
+    const Shape* xy = root->withField(x)->withField(y);
+    assert(xy == root->withField(x)->withField(y));
+    assert(xy != root->withField(y)->withField(x));
+    assert(xy->size() == 2 && xy->typeName() == "Pair");
+    assert(xy->slotOf(x) == 0 && xy->slotOf(y) == 1 && xy->slotOf(Symbol("z")) == -1);
+    assert(xy->withoutField(x) == root->withField(y));
+    assert(xy->withoutField(y) == root->withField(x));
+
+    std::cout << "Shape transition test passed!" << std::endl;
+}
+
+void testSharedShapes() {
+    // Instances share their shape; removing a field moves one to another
+    Symbol x("x"), y("y");
+    const Shape* root = Shape::root("Pair");
+    const Shape* xy = root->withField(x)->withField(y);
+    Value first(xy, {Value(1), Value(2)});
+    Value second(xy, {Value(3), Value(4)});
+    assert(first.isStruct() && first.asStruct().shape == second.asStruct().shape);
+    first.asStruct().remove(0);
+    assert(first.asStruct().shape == root->withField(y) && first.asStruct().slots[0].asInt() == 2);
+    assert(first.toString() == "{\"y\": 2}");
+
+    std::cout << "Shared shape test passed!" << std::endl;
+}
+
+void testFieldLoads() {
+    // Member sites that only see one shape become slot loads
+    std::string source =
+        "struct Point { x: int, y: int }\n"
+        "fn total(n) {\n"
+        "    let sum = 0\n"
+        "    for (let i = 0; i < n; i++) {\n"
+        "        let p = Point(i, 1)\n"
+        "        sum = sum + p.x + p.y\n"
+        "    }\n"
+        "    return sum\n"
+        "}\n"
+        "let result = total(100)\n";
+    VMProfiler profiler;
+    {
+        VM vm;
+        vm.setProfiler(&profiler);
+        vm.run(compileSource(source));
+        profiler.finish();
+        assert(vm.getInlineCacheStats().memberMisses == 2);
+        assert(vm.getQuickeningStats().deoptimized == 0);
+    }
+    std::ostringstream report;
+    profiler.printReport(report);
+    assert(report.str().find("GET_FIELD") != std::string::npos);
+
+    std::cout << "Field load test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testShapeTransitions();
+        testSharedShapes();
+        testFieldLoads();
+        std::cout << "All shape tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "../include/symbol.h"
+#include "../include/object_map.h"
+#include <iostream>
+#include <cassert>
+
+void testFindDoesNotIntern() {
+    size_t before = SymbolTable::instance().size();
+    Symbol found;
+    assert(!Symbol::find("never-interned-name", found));
+    assert(SymbolTable::instance().size() == before);
+
+    Symbol name("interned-name");
+    assert(Symbol::find("interned-name", found));
+    assert(found == name);
+
+    std::cout << "Symbol find test passed!" << std::endl;
+}
+
+void testStringKeys() {
+    // Keys that arrive at run time are stored as strings, not interned
+    ObjectMap<int> map;
+    map["a"] = 1;
+    size_t before = SymbolTable::instance().size();
+    for (int i = 0; i < 20; ++i) {
+        map[MapKey::of("request-key-" + std::to_string(i))] = i;
+    }
+    assert(SymbolTable::instance().size() == before);
+    assert(map.size() == 21);
+    assert(map.count(MapKey::of("request-key-7")) == 1);
+    assert(map.find(MapKey::of("request-key-7"))->second == 7);
+    assert(map.count(MapKey::of("request-key-99")) == 0);
+    assert(map.find(Symbol("a"))->second == 1);
+
+    // A name interned after its string key was stored still finds the entry
+    assert(map.count(Symbol("request-key-12")) == 1);
+    map[Symbol("request-key-12")] = 120;
+    assert(map.size() == 21);
+    assert(map.find(MapKey::of("request-key-12"))->second == 120);
+
+    // Iteration keeps insertion order and spells string keys
+    auto it = map.begin();
+    assert(it->first.str() == "a");
+    ++it;
+    assert(it->first.str() == "request-key-0");
+
+    map.erase(map.find(MapKey::of("request-key-0")));
+    assert(map.count(MapKey::of("request-key-0")) == 0);
+    assert(map.find(MapKey::of("request-key-19"))->second == 19);
+
+    std::cout << "String keys test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testFindDoesNotIntern();
+        testStringKeys();
+        std::cout << "All symbol tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "test_helpers.h"
+#include <iostream>
+#include <cassert>
+
+void testAnnotatedParameters() {
+    // Annotated parameters and the locals computed from them get the typed
+    // forms, and so does an int array indexed by an int loop counter
+    auto chunk = compileSource(
+        "fn dot(a: array, b: array, n: int) -> float {\n"
+        "    let sum = 0.0\n"
+        "    for (let i = 0; i < n; i = i + 1) {\n"
+        "        sum = sum + a[i] * 1.0\n"
+        "    }\n"
+        "    return sum\n"
+        "}\n"
+        "fn scale(x: float, k: float) { return x * k - 1.0 }\n");
+    const auto& dot = function(chunk, "dot");
+    assert(count(dot, OpCode::INDEX_ARRAY_INT) == 1);
+    assert(count(dot, OpCode::ADD_INT) == 1);
+    assert(count(dot, OpCode::INDEX) == 0);
+    const auto& scale = function(chunk, "scale");
+    assert(count(scale, OpCode::MUL_FLOAT) == 1);
+    assert(count(scale, OpCode::SUB_FLOAT) == 1);
+
+    std::cout << "Annotated parameter test passed!" << std::endl;
+}
+
+void testInferredLocals() {
+    // Literals and builtin results type a local without annotations; `/`
+    // stays generic for ints, since it yields a float
+    auto chunk = compileSource(
+        "fn f(xs) {\n"
+        "    let n = len(xs)\n"
+        "    let half = n / 2\n"
+        "    return n * 3 + n % 2\n"
+        "}\n");
+    const auto& f = function(chunk, "f");
+    assert(count(f, OpCode::MUL_INT) == 1);
+    assert(count(f, OpCode::ADD_INT) == 1);
+    assert(count(f, OpCode::MOD_INT) == 1);
+    assert(count(f, OpCode::DIV) == 1);
+
+    std::cout << "Inferred local test passed!" << std::endl;
+}
+
+void testUntypedVariables() {
+    // A variable assigned two types, or by a nested function, is not typed;
+    // unannotated parameters and globals never are
+    auto chunk = compileSource(
+        "let g = 1\n"
+        "fn h(p) {\n"
+        "    let v = 1\n"
+        "    fn bump() { v = v + 0.5 }\n"
+        "    bump()\n"
+        "    return v + 1 + p + g\n"
+        "}\n");
+    const auto& h = function(chunk, "h");
+    assert(count(h, OpCode::ADD_INT) == 0);
+    assert(count(h, OpCode::ADD_FLOAT) == 0);
+
+    std::cout << "Untyped variable test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testAnnotatedParameters();
+        testInferredLocals();
+        testUntypedVariables();
+        std::cout << "All type specializer tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "test_helpers.h"
+#include "../include/vm.h"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Allocations not yet freed, counted through the global operator new
+static size_t liveAllocations = 0;
+
+void* operator new(size_t size) {
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) throw std::bad_alloc();
+    ++liveAllocations;
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory) {
+        --liveAllocations;
+        std::free(memory);
+    }
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+// Allocations a run of `source` leaves behind once its VM is gone
+static size_t leftBehind(const std::string& source) {
+    BytecodeChunk chunk = compileSource(source);
+    size_t before = liveAllocations;
+    {
+        VM vm;
+        vm.setJit(false);
+        vm.run(std::move(chunk));
+    }
+    return liveAllocations - before;
+}
+
+static std::string loop(int iterations) {
+    return "fn work(n) {\n"
+           "    let total = 0\n"
+           "    for (let i = 0; i < n; i++) {\n"
+           "        let a = [i, i + 1, \"item\"]\n"
+           "        let m = {id: i, name: \"row\", items: a}\n"
+           "        total = total + len(a) + len(str(m.id))\n"
+           "    }\n"
+           "    return total\n"
+           "}\n"
+           "let result = work(" + std::to_string(iterations) + ")\n";
+}
+
+void testHandlersReleaseObjects() {
+    // Arrays, maps and the argument vectors of native calls built in a loop
+    // are freed with the iteration, not kept alive by the dispatch loop
+    leftBehind(loop(1));
+    size_t few = leftBehind(loop(10));
+    size_t many = leftBehind(loop(1000));
+    assert(many == few);
+
+    std::cout << "Handler release test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testHandlersReleaseObjects();
+        std::cout << "All VM dispatch tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
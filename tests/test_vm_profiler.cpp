@@ -0,0 +1,75 @@
+#include "test_helpers.h"
+#include "../include/vm.h"
+#include "../include/vm_profiler.h"
+#include <iostream>
+#include <cassert>
+#include <sstream>
+
+static bool contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+}
+
+static const std::string kSource =
+    "fn sum(n) {\n"
+    "    let total = 0\n"
+    "    for (let i = 0; i < n; i++) {\n"
+    "        total = total + i\n"
+    "    }\n"
+    "    return total\n"
+    "}\n"
+    "let result = sum(1000)\n";
+
+void testLineTables() {
+    BytecodeChunk chunk = compileSource(kSource);
+
+    // Every instruction of sum() maps to a line of its body
+    const CompiledFunction& sum = function(chunk, "sum");
+    assert(!sum.lines.empty() && sum.lines[0].pc == 0);
+    for (size_t pc = 0; pc < sum.code.size(); ++pc) {
+        uint32_t line = sum.lineAt(pc);
+        assert(line >= 1 && line <= 7);
+    }
+    const CompiledFunction& main = chunk.functions[0];
+    for (size_t pc = 0; pc < main.code.size(); ++pc) {
+        if (main.code[pc].opcode == OpCode::CALL) assert(main.lineAt(pc) == 8);
+    }
+
+    std::cout << "Line table test passed!" << std::endl;
+}
+
+void testReport() {
+    VMProfiler profiler;
+    {
+        VM vm;
+        vm.setProfiler(&profiler);
+        vm.run(compileSource(kSource));
+        profiler.finish();
+    }
+
+    // The report names the loop and its lines after the VM and its code are gone
+    std::ostringstream report;
+    profiler.printReport(report);
+    std::string text = report.str();
+    assert(contains(text, "INC_BRANCH_LT"));
+    assert(contains(text, "ADD_INT -> INC_BRANCH_LT"));
+    assert(contains(text, "hot loop"));
+
+    std::string json = profiler.toJson();
+    assert(contains(json, "{\"function\": \"sum\", \"lines\": \"3-4\""));
+    assert(contains(json, "{\"opcode\": \"INC_BRANCH_LT\", \"count\": 1000,"));
+
+    std::cout << "Profile report test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        testLineTables();
+        testReport();
+        std::cout << "All VM profiler tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}